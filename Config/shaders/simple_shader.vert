@@ -5,13 +5,25 @@ layout (location = 0) in vec3 position;
 layout (location = 0) out vec3 fragColor;
 layout (location = 1) out vec2 uv;
 
-layout (push_constant) uniform Push {
+struct ObjectData {
     mat4 transform;
-    vec3 color;
+    vec4 color;
+};
+
+// per object data for the frame, written by the material each frame
+layout (std430, set = 0, binding = 0) readonly buffer ObjectBuffer {
+    ObjectData objects[];
+} objectBuffer;
+
+// index of the materials first object, the draws first instance selects
+// the object within the material
+layout (push_constant) uniform Push {
+    uint objectBase;
 } push;
 
 void main () {
-    gl_Position = vec4(push.transform * vec4(position, 1.0));
-    fragColor = push.color;
+    ObjectData object = objectBuffer.objects[push.objectBase + gl_InstanceIndex];
+    gl_Position = vec4(object.transform * vec4(position, 1.0));
+    fragColor = object.color.rgb;
     uv = vec2(0.0, 0.0);
 }
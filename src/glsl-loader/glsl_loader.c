@@ -2,10 +2,163 @@
 
 #include "render/spirit_device.h"
 #include <shaderc/shaderc.h>
+#include <stdatomic.h>
 #include <utils/spirit_file.h>
+#include <utils/platform.h>
+#include <utils/spirit_jobs.h>
 
 const char GLSL_LOADER_CACHE_FOLDER[] = "glsl-loader-cache/";
 
+// cached shaders start with a ShaderCacheHeader, followed by the code
+#define GLSL_LOADER_CACHE_MAGIC 0x43535053 // "SPSC"
+#define GLSL_LOADER_CACHE_VERSION 1
+
+// includes nested deeper than this are not hashed, to stop include cycles
+#define GLSL_LOADER_MAX_INCLUDE_DEPTH 16
+
+// everything set on the compile options that changes the compiled code,
+// except the optimization level. It is part of the cache key, so changing a
+// setting invalidates the cache. Debug info is only kept in debug builds.
+// spirit_header.h always defines DEBUG, so release builds are told apart by
+// NDEBUG, which CMake sets for them.
+#ifdef NDEBUG
+static const char COMPILE_OPTIONS[] = "target=vulkan1.0;entry=main";
+#else
+static const char COMPILE_OPTIONS[] = "target=vulkan1.0;entry=main;debug";
+#endif
+
+// optimize for performance only in release, it makes shaders hard to debug
+#ifdef NDEBUG
+#define GLSL_LOADER_DEFAULT_OPTIMIZATION SPIRIT_SHADER_OPTIMIZATION_PERFORMANCE
+#else
+#define GLSL_LOADER_DEFAULT_OPTIMIZATION SPIRIT_SHADER_OPTIMIZATION_NONE
+#endif
+
+static _Atomic SpiritShaderOptimization g_optimization =
+    GLSL_LOADER_DEFAULT_OPTIMIZATION;
+
+// the compiler and its options, made on first use and kept until
+// spReleaseShaderCompiler. Compiling only reads them, so any number of
+// threads can compile at once.
+typedef struct t_ShaderCompiler
+{
+    shaderc_compiler_t compiler;
+    shaderc_compile_options_t options;
+} ShaderCompiler;
+
+static _Atomic(ShaderCompiler *) g_shaderCompiler = NULL;
+
+typedef struct t_ShaderCacheHeader
+{
+    u32 magic;
+    u32 version;
+    u64 key; // the file is named after it
+    u32 type; // SpiritShaderType
+    u32 codeSize; // bytes of SPIR-V after the header
+} ShaderCacheHeader;
+
+// shader packs start with a ShaderPackHeader, then the ShaderPackEntry of each
+// shader sorted by key, then the code of each shader
+#define GLSL_LOADER_PACK_MAGIC 0x4b505053 // "SPPK"
+#define GLSL_LOADER_PACK_VERSION 1
+
+typedef struct t_ShaderPackHeader
+{
+    u32 magic;
+    u32 version;
+    u32 entryCount;
+    u32 reserved;
+} ShaderPackHeader;
+
+typedef struct t_ShaderPackEntry
+{
+    u64 key;      // hash of the path the shader was packed with
+    u32 offset;   // of the code from the start of the pack
+    u32 codeSize; // bytes
+} ShaderPackEntry;
+
+// the open shader pack, mapped for as long as it is open
+typedef struct t_ShaderPack
+{
+    const u8 *data;
+    size_t size;
+    const ShaderPackEntry *entries;
+    u32 entryCount;
+} ShaderPack;
+
+static ShaderPack g_shaderPack = {};
+
+//
+// Helpers
+//
+
+// get the shared compiler, creating it if this is the first compile. NULL on
+// failure.
+static ShaderCompiler *getCompiler(void);
+
+// job loading one entry of spLoadSourceShaders
+static void loadShaderJob(void *arg, u32 start, u32 end);
+
+// continue a 64 bit FNV-1a hash over some bytes
+static u64 hashBytes(u64 hash, const void *data, const size_t size);
+
+// read a whole text file, NULL if it does not exist. Free the result.
+static char *readSource(const char *path, size_t *length);
+
+// the path of an include, relative to the file including it. Free the result.
+static char *resolveInclude(const char *requested, const char *requesting);
+
+// hash the source, the shader type, the compile options and every file it
+// includes, so any change to the compiled code changes the key
+static u64 shaderCacheKey(
+    const char *path,
+    const char *src,
+    const size_t srcLength,
+    const SpiritShaderType type);
+
+// add the files included by a source to a hash, recursively
+static u64 hashIncludes(
+    u64 hash,
+    const char *path,
+    const char *src,
+    const size_t srcLength,
+    const u32 depth);
+
+// the cache file of a key, dest must hold GLSL_LOADER_CACHE_PATH_LENGTH
+static void formatCachePath(char *dest, const u64 key);
+
+#define GLSL_LOADER_CACHE_PATH_LENGTH                                          \
+    (sizeof(GLSL_LOADER_CACHE_FOLDER) + 16 + sizeof(".spv") - 1)
+
+// the key of a path in a shader pack
+static u64 shaderPackKey(const char *path);
+
+// find a shader in the open pack. The code points into the pack.
+static bool findPackedShader(
+    const char *path, const SpiritShaderType type, SpiritShader *output);
+
+// qsort comparison of ShaderPackEntry keys
+static int compareShaderPackEntries(const void *a, const void *b);
+
+// load a cached shader, if the file exists and its header matches. Otherwise
+// the shader size is 0.
+static SpiritShader loadCachedShader(
+    const char *cachePath, const u64 key, const SpiritShaderType type);
+
+// write a compiled shader to the cache, with its header
+static void writeCachedShader(
+    const char *cachePath, const u64 key, const SpiritShader *shader);
+
+// shaderc include callbacks, reading includes relative to the including file
+static shaderc_include_result *includeResolve(
+    void *userData,
+    const char *requested,
+    int type,
+    const char *requesting,
+    size_t depth);
+
+static void includeRelease(void *userData, shaderc_include_result *result);
+
 // return SPIRIT_SHADER_TYPE_MAX on failure
 static SpiritShaderType autoDetectShaderType(const char *path)
 {
@@ -14,15 +167,15 @@ static SpiritShaderType autoDetectShaderType(const char *path)
     char fileExtension[extensionLen];
     spStringStrip(fileExtension, &extensionLen, path, '.');
 
-    if (strncmp("vert", fileExtension, 4))
+    if (strncmp("vert", fileExtension, 4) == 0)
     {
         return SPIRIT_SHADER_TYPE_VERTEX;
     }
-    else if (strncmp("frag", fileExtension, 4))
+    else if (strncmp("frag", fileExtension, 4) == 0)
     {
         return SPIRIT_SHADER_TYPE_FRAGMENT;
     }
-    else if (strncmp("comp", fileExtension, 4))
+    else if (strncmp("comp", fileExtension, 4) == 0)
     {
         return SPIRIT_SHADER_TYPE_COMPUTE;
     }
@@ -59,6 +212,9 @@ shaderc_shader_kind convertShaderType(SpiritShaderType type)
 extern SpiritShader
 spLoadCompiledShader(const char *path, SpiritShaderType type)
 {
+    SpiritShader out;
+    if (findPackedShader(path, type, &out))
+        return out;
 
     u64 shaderCodeSize = spReadFileSize(path);
     // get file size
@@ -78,10 +234,11 @@ spLoadCompiledShader(const char *path, SpiritShaderType type)
     void *shaderCodeBinary = malloc(shaderCodeSize);
     spReadFileBinary(shaderCodeBinary, path, shaderCodeSize);
 
-    SpiritShader out;
     out.type       = type;
+    out.path       = NULL;
     out.shader     = shaderCodeBinary;
     out.shaderSize = shaderCodeSize;
+    out.packed     = false;
 
     return out;
 }
@@ -89,89 +246,69 @@ spLoadCompiledShader(const char *path, SpiritShaderType type)
 // load a shader from glsl source code
 extern SpiritShader spLoadSourceShader(const char *path, SpiritShaderType type)
 {
-    // shader filename, without path
-    u32 strippedShaderNameLength = 0;
-    spStringStrip(
-        NULL, &strippedShaderNameLength, path, SPIRIT_PLATFORM_FOLDER_BREAK);
-    char strippedShaderName[strippedShaderNameLength];
-    spStringStrip(
-        strippedShaderName,
-        &strippedShaderNameLength,
-        path,
-        SPIRIT_PLATFORM_FOLDER_BREAK);
-    strippedShaderNameLength--; // remove space for terminator
-
-    // check if shader has been precompiled
-    u32 shaderCodePathLength = strlen(GLSL_LOADER_CACHE_FOLDER) +
-                               strippedShaderNameLength +
-                               5; /* sizeof(".spv\0")*/
-
-    char shaderCodePath[shaderCodePathLength];
-    snprintf(
-        shaderCodePath,
-        shaderCodePathLength,
-        "%s%s%s",
-        GLSL_LOADER_CACHE_FOLDER,
-        strippedShaderName,
-        ".spv");
-    log_debug("Shader name: %s", shaderCodePath);
+    if (type == SPIRIT_SHADER_TYPE_AUTO_DETECT)
+        type = autoDetectShaderType(path);
 
-    if (spReadFileModifiedTime(shaderCodePath) > spReadFileModifiedTime(path))
+    // a packed shader needs no source, or cache lookup
+    SpiritShader packed;
+    if (findPackedShader(path, type, &packed))
+        return packed;
+
+    // load source code
+    size_t shaderSrcLength = 0;
+    char *shaderSrc        = readSource(path, &shaderSrcLength);
+    if (shaderSrc == NULL)
     {
-        log_verbose("Loading compiled shader '%s'", shaderCodePath);
-        return spLoadCompiledShader(shaderCodePath, type);
+        log_error("Shader '%s' does not exist", path);
+        return (SpiritShader){0, 0, 0, 0};
     }
-    else
-    {
-
-        if (SPIRIT_SHADER_TYPE_AUTO_DETECT) // do no matter what
-        {
-            type = autoDetectShaderType(path);
-        }
-
-        // load source code
-        size_t shaderSrcLength = spReadFileSize(path);
-
-        if (shaderSrcLength == 0)
-        {
-            log_error("Shader '%s' does not exist", path);
-            return (SpiritShader){0, 0, 0, 0};
-        }
 
-        char shaderSrc[shaderSrcLength + 1];
+    // the cache is keyed by content, so a checkout that touches the file
+    // without changing it still hits, and an edit can never hit
+    const u64 key = shaderCacheKey(path, shaderSrc, shaderSrcLength, type);
+    char shaderCodePath[GLSL_LOADER_CACHE_PATH_LENGTH];
+    formatCachePath(shaderCodePath, key);
+    log_debug("Shader name: %s", shaderCodePath);
 
-        spReadFileText(shaderSrc, path, shaderSrcLength + 1);
+    SpiritShader out = loadCachedShader(shaderCodePath, key, type);
+    if (out.shaderSize)
+    {
+        log_verbose("Loaded cached shader '%s'", shaderCodePath);
+        free(shaderSrc);
+        return out;
+    }
 
-        SpiritShader out = spCompileShader(
-            shaderSrc, shaderSrcLength, strippedShaderName, type);
+    out = spCompileShader(shaderSrc, shaderSrcLength, path, type);
+    free(shaderSrc);
 
-        if (out.shaderSize == 0)
-        {
-            return out;
-        }
-
-        log_verbose("Compiled shader '%s'", shaderCodePath);
+    if (out.shaderSize == 0)
+    {
+        return out;
+    }
 
-        // create folder
-        SpiritResult catchBuffer = spWriteFileFolder(GLSL_LOADER_CACHE_FOLDER);
-        if (catchBuffer)
-            log_error("Failed to create folder '%s'", GLSL_LOADER_CACHE_FOLDER);
+    log_verbose("Compiled shader '%s'", path);
+    writeCachedShader(shaderCodePath, key, &out);
 
-        db_assert_msg(catchBuffer == SPIRIT_SUCCESS, "Failed to write folder");
+    return out;
+}
 
-        // write file
-        catchBuffer =
-            spWriteFileBinary(shaderCodePath, out.shader, out.shaderSize);
-        if (catchBuffer)
-            log_error("Failed to file '%s'", shaderCodePath);
+SpiritResult spShaderCachePath(
+    char *dest, const u32 destLength, const char *path, SpiritShaderType type)
+{
+    if (type == SPIRIT_SHADER_TYPE_AUTO_DETECT)
+        type = autoDetectShaderType(path);
 
-        db_assert_msg(catchBuffer == SPIRIT_SUCCESS, "Failed to write file");
+    size_t srcLength = 0;
+    char *src        = readSource(path, &srcLength);
+    if (src == NULL)
+        return SPIRIT_FAILURE;
 
-        log_verbose(
-            "Cached shader '%s' with size %lu", shaderCodePath, out.shaderSize);
+    char cachePath[GLSL_LOADER_CACHE_PATH_LENGTH];
+    formatCachePath(cachePath, shaderCacheKey(path, src, srcLength, type));
+    free(src);
 
-        return out;
-    }
+    snprintf(dest, destLength, "%s", cachePath);
+    return destLength >= sizeof(cachePath) ? SPIRIT_SUCCESS : SPIRIT_FAILURE;
 }
 
 extern SpiritShader spCompileShader(
@@ -182,30 +319,19 @@ extern SpiritShader spCompileShader(
 {
     shaderc_shader_kind shadercType = convertShaderType(type);
 
-    // initialize a shaderc compiler
-    shaderc_compilation_result_t result = NULL;
-    shaderc_compiler_t compiler         = NULL;
-    shaderc_compile_options_t settings  = NULL;
-
-    compiler = shaderc_compiler_initialize();
-    db_assert_msg(compiler, "Failure to create compiler");
-
-    settings = shaderc_compile_options_initialize();
-    db_assert_msg(settings, "Failed to create shader settings");
-
-    // set shader type
-    shaderc_compile_options_set_target_env(
-        settings, shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_0);
+    const ShaderCompiler *compiler = getCompiler();
+    if (compiler == NULL)
+        return (SpiritShader){0, 0, 0, 0};
 
     // compile the shader
-    result = shaderc_compile_into_spv(
-        compiler,
+    shaderc_compilation_result_t result = shaderc_compile_into_spv(
+        compiler->compiler,
         src,
         srcLength,
         shadercType,
         outputShaderName,
         "main",
-        NULL /*settings*/);
+        compiler->options);
 
     shaderc_compilation_status output;
     output = shaderc_result_get_compilation_status(result);
@@ -219,8 +345,6 @@ extern SpiritShader spCompileShader(
             shaderc_result_get_error_message(result),
             src);
         shaderc_result_release(result);
-        shaderc_compile_options_release(settings);
-        shaderc_compiler_release(compiler);
 
         return (SpiritShader){0, 0, 0, 0};
     }
@@ -249,12 +373,252 @@ extern SpiritShader spCompileShader(
 
     // release resources
     shaderc_result_release(result);
-    shaderc_compile_options_release(settings);
-    shaderc_compiler_release(compiler);
 
     return out;
 } // compileShader
 
+SpiritResult spLoadSourceShaders(
+    SpiritJobSystem jobs, SpiritShaderLoadInfo *shaders, const u32 shaderCount)
+{
+    if (shaderCount == 0)
+        return SPIRIT_SUCCESS;
+
+    // without a job system, run the batch on a temporary one sized to it
+    SpiritJobSystem batchJobs = jobs;
+    const u32 workerCount =
+        min_value(shaderCount, spPlatformGetCoreCount()) - 1;
+    if (batchJobs == NULL && workerCount > 0)
+    {
+        SpiritJobSystemCreateInfo jobsInfo = {};
+        jobsInfo.workerCount               = workerCount;
+        batchJobs = spCreateJobSystem(&jobsInfo);
+    }
+
+    // one shader per job, they take far longer than scheduling them
+    if (batchJobs)
+    {
+        SpiritJobCounter counter = {};
+        spJobSystemParallelFor(
+            batchJobs, shaderCount, 1, loadShaderJob, shaders, &counter);
+        spJobSystemWait(batchJobs, &counter);
+    }
+    else
+    {
+        loadShaderJob(shaders, 0, shaderCount);
+    }
+
+    if (batchJobs && batchJobs != jobs)
+        spDestroyJobSystem(batchJobs);
+
+    SpiritResult result = SPIRIT_SUCCESS;
+    for (u32 i = 0; i < shaderCount; i++)
+    {
+        if (shaders[i].shader.shaderSize == 0)
+            result = SPIRIT_FAILURE;
+    }
+
+    return result;
+}
+
+void spSetShaderOptimization(const SpiritShaderOptimization optimization)
+{
+    if (atomic_exchange(&g_optimization, optimization) != optimization)
+    {
+        // the next compile makes a compiler with the new level
+        spReleaseShaderCompiler();
+    }
+}
+
+void spReleaseShaderCompiler(void)
+{
+    ShaderCompiler *compiler = atomic_exchange(&g_shaderCompiler, NULL);
+    if (compiler == NULL)
+        return;
+
+    shaderc_compile_options_release(compiler->options);
+    shaderc_compiler_release(compiler->compiler);
+    free(compiler);
+}
+
+SpiritResult spWriteShaderPack(
+    const char *packPath,
+    const char *const *shaderPaths,
+    const u32 shaderCount)
+{
+    // compile the sources as a batch, then read the compiled shaders after
+    SpiritShaderLoadInfo *shaders =
+        new_array(SpiritShaderLoadInfo, shaderCount);
+    u32 sourceCount = 0;
+    for (u32 i = 0; i < shaderCount; i++)
+    {
+        const char *extension = strrchr(shaderPaths[i], '.');
+        if (extension && strcmp(extension, ".spv") == 0)
+            continue;
+
+        shaders[sourceCount++] = (SpiritShaderLoadInfo){
+            .path = shaderPaths[i], .type = SPIRIT_SHADER_TYPE_AUTO_DETECT};
+    }
+
+    SpiritResult result = spLoadSourceShaders(NULL, shaders, sourceCount);
+
+    u32 loadedCount = sourceCount;
+    for (u32 i = 0; i < shaderCount; i++)
+    {
+        const char *extension = strrchr(shaderPaths[i], '.');
+        if (!extension || strcmp(extension, ".spv") != 0)
+            continue;
+
+        shaders[loadedCount] = (SpiritShaderLoadInfo){
+            .path   = shaderPaths[i],
+            .type   = SPIRIT_SHADER_TYPE_AUTO_DETECT,
+            .shader = spLoadCompiledShader(
+                shaderPaths[i], SPIRIT_SHADER_TYPE_AUTO_DETECT)};
+        if (shaders[loadedCount++].shader.shaderSize == 0)
+            result = SPIRIT_FAILURE;
+    }
+
+    // the entries are sorted so the pack can be binary searched
+    const size_t headerSize =
+        sizeof(ShaderPackHeader) + sizeof(ShaderPackEntry) * shaderCount;
+    size_t packSize          = headerSize;
+    ShaderPackEntry *entries = new_array(ShaderPackEntry, shaderCount);
+    for (u32 i = 0; i < shaderCount; i++)
+    {
+        entries[i].key      = shaderPackKey(shaders[i].path);
+        entries[i].offset   = i; // the shader, until the offsets are known
+        entries[i].codeSize = shaders[i].shader.shaderSize;
+        packSize += shaders[i].shader.shaderSize;
+
+        if (shaders[i].shader.shaderSize % sizeof(u32))
+        {
+            log_error("Shader '%s' is not valid SPIR-V", shaders[i].path);
+            result = SPIRIT_FAILURE;
+        }
+    }
+    qsort(entries, shaderCount, sizeof(*entries), compareShaderPackEntries);
+
+    for (u32 i = 1; i < shaderCount; i++)
+    {
+        if (entries[i].key == entries[i - 1].key)
+        {
+            log_error(
+                "Shaders '%s' and '%s' have the same key in the pack",
+                shaders[entries[i - 1].offset].path,
+                shaders[entries[i].offset].path);
+            result = SPIRIT_FAILURE;
+        }
+    }
+
+    if (packSize > UINT32_MAX)
+    {
+        log_error("Shader pack '%s' is too large", packPath);
+        result = SPIRIT_FAILURE;
+    }
+
+    if (result == SPIRIT_SUCCESS)
+    {
+        const ShaderPackHeader header = {
+            .magic      = GLSL_LOADER_PACK_MAGIC,
+            .version    = GLSL_LOADER_PACK_VERSION,
+            .entryCount = shaderCount,
+            .reserved   = 0};
+
+        // code is a whole number of words, so every shader stays aligned
+        u8 *pack      = malloc(packSize);
+        size_t offset = headerSize;
+        for (u32 i = 0; i < shaderCount; i++)
+        {
+            const SpiritShader *shader = &shaders[entries[i].offset].shader;
+            memcpy(pack + offset, shader->shader, shader->shaderSize);
+            entries[i].offset = offset;
+            offset += shader->shaderSize;
+        }
+        memcpy(pack, &header, sizeof(header));
+        memcpy(
+            pack + sizeof(header),
+            entries,
+            sizeof(ShaderPackEntry) * shaderCount);
+
+        result = spWriteFileBinary(packPath, pack, packSize);
+        if (result)
+            log_error("Failed to write shader pack '%s'", packPath);
+        else
+            log_verbose(
+                "Packed %u shaders into '%s' with size %zu",
+                shaderCount,
+                packPath,
+                packSize);
+        free(pack);
+    }
+
+    for (u32 i = 0; i < loadedCount; i++)
+    {
+        if (shaders[i].shader.shaderSize)
+            spDestroyShader(shaders[i].shader);
+    }
+    free(entries);
+    free(shaders);
+
+    return result;
+}
+
+SpiritResult spOpenShaderPack(const char *packPath)
+{
+    if (g_shaderPack.data)
+        spCloseShaderPack();
+
+    size_t size    = 0;
+    const u8 *data = spPlatformMapFile(packPath, &size);
+    if (data == NULL)
+    {
+        log_error("Failed to open shader pack '%s'", packPath);
+        return SPIRIT_FAILURE;
+    }
+
+    ShaderPackHeader header = {};
+    if (size >= sizeof(header))
+        memcpy(&header, data, sizeof(header));
+
+    const ShaderPackEntry *entries =
+        (const ShaderPackEntry *)(data + sizeof(header));
+    bool valid = header.magic == GLSL_LOADER_PACK_MAGIC &&
+                 header.version == GLSL_LOADER_PACK_VERSION &&
+                 (size - sizeof(header)) / sizeof(ShaderPackEntry) >=
+                     header.entryCount;
+
+    // every shader must be aligned, inside the pack, and in key order
+    for (u32 i = 0; valid && i < header.entryCount; i++)
+    {
+        valid = entries[i].offset % sizeof(u32) == 0 &&
+                (size_t)entries[i].offset + entries[i].codeSize <= size &&
+                (i == 0 || entries[i].key > entries[i - 1].key);
+    }
+
+    if (!valid)
+    {
+        log_error("Shader pack '%s' is invalid", packPath);
+        spPlatformUnmapFile(data, size);
+        return SPIRIT_FAILURE;
+    }
+
+    g_shaderPack = (ShaderPack){
+        .data       = data,
+        .size       = size,
+        .entries    = entries,
+        .entryCount = header.entryCount};
+
+    log_verbose(
+        "Opened shader pack '%s' with %u shaders", packPath, header.entryCount);
+    return SPIRIT_SUCCESS;
+}
+
+void spCloseShaderPack(void)
+{
+    if (g_shaderPack.data)
+        spPlatformUnmapFile(g_shaderPack.data, g_shaderPack.size);
+    g_shaderPack = (ShaderPack){};
+}
+
 // convert loaded shader to a VkShaderModule
 // Try not to do this often, it is not a fast process
 // Remember to destroy the shader module when you are done with them
@@ -278,6 +642,383 @@ spConvertShaderToModule(SpiritDevice device, SpiritShader *shader)
 
 SpiritResult spDestroyShader(SpiritShader shader)
 {
-    free(shader.shader);
+    // packed code belongs to the pack
+    if (!shader.packed)
+        free(shader.shader);
     return SPIRIT_SUCCESS;
 }
+
+//
+// Helpers
+//
+
+ShaderCompiler *getCompiler(void)
+{
+    ShaderCompiler *out = atomic_load(&g_shaderCompiler);
+    if (out)
+        return out;
+
+    out           = new_var(ShaderCompiler);
+    out->compiler = shaderc_compiler_initialize();
+    out->options  = shaderc_compile_options_initialize();
+    if (out->compiler == NULL || out->options == NULL)
+    {
+        log_error("Failed to create shader compiler");
+        if (out->options)
+            shaderc_compile_options_release(out->options);
+        if (out->compiler)
+            shaderc_compiler_release(out->compiler);
+        free(out);
+        return NULL;
+    }
+
+    // set shader type, see COMPILE_OPTIONS
+    shaderc_compile_options_set_target_env(
+        out->options,
+        shaderc_target_env_vulkan,
+        shaderc_env_version_vulkan_1_0);
+    shaderc_compile_options_set_include_callbacks(
+        out->options, includeResolve, includeRelease, NULL);
+#ifndef NDEBUG
+    shaderc_compile_options_set_generate_debug_info(out->options);
+#endif
+
+    // shaderc runs the spirv-tools optimizer after compiling
+    switch (atomic_load(&g_optimization))
+    {
+    case SPIRIT_SHADER_OPTIMIZATION_NONE:
+        shaderc_compile_options_set_optimization_level(
+            out->options, shaderc_optimization_level_zero);
+        break;
+    case SPIRIT_SHADER_OPTIMIZATION_SIZE:
+        shaderc_compile_options_set_optimization_level(
+            out->options, shaderc_optimization_level_size);
+        break;
+    case SPIRIT_SHADER_OPTIMIZATION_PERFORMANCE:
+        shaderc_compile_options_set_optimization_level(
+            out->options, shaderc_optimization_level_performance);
+        break;
+    }
+
+    // threads compiling their first shader at once race to publish theirs,
+    // and the losers use the winner's
+    ShaderCompiler *expected = NULL;
+    if (!atomic_compare_exchange_strong(&g_shaderCompiler, &expected, out))
+    {
+        shaderc_compile_options_release(out->options);
+        shaderc_compiler_release(out->compiler);
+        free(out);
+        return expected;
+    }
+
+    return out;
+}
+
+void loadShaderJob(void *arg, u32 start, u32 end)
+{
+    SpiritShaderLoadInfo *shaders = arg;
+    for (u32 i = start; i < end; i++)
+    {
+        shaders[i].shader =
+            spLoadSourceShader(shaders[i].path, shaders[i].type);
+    }
+}
+
+u64 hashBytes(u64 hash, const void *data, const size_t size)
+{
+    const u8 *bytes = data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+char *readSource(const char *path, size_t *length)
+{
+    if (!spReadFileExists(path))
+        return NULL;
+    *length = spReadFileSize(path);
+
+    char *out = malloc(*length + 1);
+    out[0]    = '\0';
+    if (*length && spReadFileText(out, path, *length + 1))
+    {
+        free(out);
+        return NULL;
+    }
+
+    return out;
+}
+
+char *resolveInclude(const char *requested, const char *requesting)
+{
+    // the folder of the including file, with its trailing separator
+    const char *folderEnd = strrchr(requesting, SPIRIT_PLATFORM_FOLDER_BREAK);
+    const size_t folderLength =
+        folderEnd && requested[0] != SPIRIT_PLATFORM_FOLDER_BREAK
+            ? (size_t)(folderEnd - requesting) + 1
+            : 0;
+
+    const size_t length = folderLength + strlen(requested) + 1;
+    char *out           = malloc(length);
+    snprintf(out, length, "%.*s%s", (int)folderLength, requesting, requested);
+    return out;
+}
+
+u64 shaderCacheKey(
+    const char *path,
+    const char *src,
+    const size_t srcLength,
+    const SpiritShaderType type)
+{
+    const u32 version                         = GLSL_LOADER_CACHE_VERSION;
+    const SpiritShaderOptimization optimization = atomic_load(&g_optimization);
+
+    u64 hash = 0xcbf29ce484222325ull;
+    hash     = hashBytes(hash, &version, sizeof(version));
+    hash     = hashBytes(hash, COMPILE_OPTIONS, sizeof(COMPILE_OPTIONS));
+    hash     = hashBytes(hash, &optimization, sizeof(optimization));
+    hash     = hashBytes(hash, &type, sizeof(type));
+    hash     = hashBytes(hash, src, srcLength);
+    return hashIncludes(hash, path, src, srcLength, 0);
+}
+
+u64 hashIncludes(
+    u64 hash,
+    const char *path,
+    const char *src,
+    const size_t srcLength,
+    const u32 depth)
+{
+    if (depth >= GLSL_LOADER_MAX_INCLUDE_DEPTH)
+        return hash;
+
+    // look for lines like '#include "file"', the same way the preprocessor
+    // does, but without evaluating conditions. An include that is never
+    // compiled only costs an extra hash.
+    const char *line = src;
+    const char *end  = src + srcLength;
+    while (line < end)
+    {
+        const char *next = memchr(line, '\n', end - line);
+        next             = next ? next + 1 : end;
+
+        const char *c = line;
+        while (c < next && (*c == ' ' || *c == '\t'))
+            c++;
+        if (c < next && *c == '#')
+        {
+            c++;
+            while (c < next && (*c == ' ' || *c == '\t'))
+                c++;
+
+            const size_t directiveLength = sizeof("include") - 1;
+            if ((size_t)(next - c) > directiveLength &&
+                strncmp(c, "include", directiveLength) == 0)
+            {
+                c += directiveLength;
+                while (c < next && (*c == ' ' || *c == '\t'))
+                    c++;
+
+                const char close = *c == '<' ? '>' : '"';
+                const char *nameEnd =
+                    c < next ? memchr(c + 1, close, next - c - 1) : NULL;
+                if ((*c == '"' || *c == '<') && nameEnd)
+                {
+                    char requested[nameEnd - c];
+                    memcpy(requested, c + 1, nameEnd - c - 1);
+                    requested[nameEnd - c - 1] = '\0';
+
+                    // a missing include is hashed by name, compilation will
+                    // report it
+                    char *includePath = resolveInclude(requested, path);
+                    hash              = hashBytes(
+                        hash, includePath, strlen(includePath) + 1);
+
+                    size_t includeLength = 0;
+                    char *include = readSource(includePath, &includeLength);
+                    if (include)
+                    {
+                        hash = hashBytes(hash, include, includeLength);
+                        hash = hashIncludes(
+                            hash,
+                            includePath,
+                            include,
+                            includeLength,
+                            depth + 1);
+                        free(include);
+                    }
+                    free(includePath);
+                }
+            }
+        }
+
+        line = next;
+    }
+
+    return hash;
+}
+
+void formatCachePath(char *dest, const u64 key)
+{
+    snprintf(
+        dest,
+        GLSL_LOADER_CACHE_PATH_LENGTH,
+        "%s%016lx.spv",
+        GLSL_LOADER_CACHE_FOLDER,
+        key);
+}
+
+u64 shaderPackKey(const char *path)
+{
+    return hashBytes(0xcbf29ce484222325ull, path, strlen(path));
+}
+
+bool findPackedShader(
+    const char *path, const SpiritShaderType type, SpiritShader *output)
+{
+    if (g_shaderPack.data == NULL)
+        return false;
+
+    const u64 key = shaderPackKey(path);
+    u32 low       = 0;
+    u32 high      = g_shaderPack.entryCount;
+    while (low < high)
+    {
+        const u32 middle = low + (high - low) / 2;
+        if (g_shaderPack.entries[middle].key < key)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    if (low == g_shaderPack.entryCount ||
+        g_shaderPack.entries[low].key != key)
+        return false;
+
+    const ShaderPackEntry *entry = &g_shaderPack.entries[low];
+
+    *output            = (SpiritShader){};
+    output->type       = type;
+    output->shader     = (SpiritShaderCode)(g_shaderPack.data + entry->offset);
+    output->shaderSize = entry->codeSize;
+    output->packed     = true;
+    return true;
+}
+
+int compareShaderPackEntries(const void *a, const void *b)
+{
+    const u64 keyA = ((const ShaderPackEntry *)a)->key;
+    const u64 keyB = ((const ShaderPackEntry *)b)->key;
+    return (keyA > keyB) - (keyA < keyB);
+}
+
+SpiritShader loadCachedShader(
+    const char *cachePath, const u64 key, const SpiritShaderType type)
+{
+    const u64 fileSize = spReadFileSize(cachePath);
+    if (fileSize <= sizeof(ShaderCacheHeader))
+        return (SpiritShader){0, 0, 0, 0};
+
+    u8 *file = malloc(fileSize);
+    if (spReadFileBinary(file, cachePath, fileSize))
+    {
+        free(file);
+        return (SpiritShader){0, 0, 0, 0};
+    }
+
+    // a file cut short or written by another version is recompiled
+    ShaderCacheHeader header;
+    memcpy(&header, file, sizeof(header));
+    if (header.magic != GLSL_LOADER_CACHE_MAGIC ||
+        header.version != GLSL_LOADER_CACHE_VERSION || header.key != key ||
+        header.type != (u32)type ||
+        header.codeSize != fileSize - sizeof(header))
+    {
+        log_warning("Ignoring invalid cached shader '%s'", cachePath);
+        free(file);
+        return (SpiritShader){0, 0, 0, 0};
+    }
+
+    memmove(file, file + sizeof(header), header.codeSize);
+
+    SpiritShader out = {};
+    out.type         = type;
+    out.shader       = (SpiritShaderCode)file;
+    out.shaderSize   = header.codeSize;
+    return out;
+}
+
+void writeCachedShader(
+    const char *cachePath, const u64 key, const SpiritShader *shader)
+{
+    const ShaderCacheHeader header = {
+        .magic    = GLSL_LOADER_CACHE_MAGIC,
+        .version  = GLSL_LOADER_CACHE_VERSION,
+        .key      = key,
+        .type     = shader->type,
+        .codeSize = shader->shaderSize};
+
+    const size_t fileSize = sizeof(header) + shader->shaderSize;
+    u8 *file              = malloc(fileSize);
+    memcpy(file, &header, sizeof(header));
+    memcpy(file + sizeof(header), shader->shader, shader->shaderSize);
+
+    // create folder
+    SpiritResult catchBuffer = spWriteFileFolder(GLSL_LOADER_CACHE_FOLDER);
+    if (catchBuffer)
+        log_error("Failed to create folder '%s'", GLSL_LOADER_CACHE_FOLDER);
+
+    // write file
+    if (catchBuffer == SPIRIT_SUCCESS)
+        catchBuffer = spWriteFileBinary(cachePath, file, fileSize);
+    if (catchBuffer)
+        log_error("Failed to file '%s'", cachePath);
+    else
+        log_verbose(
+            "Cached shader '%s' with size %lu", cachePath, shader->shaderSize);
+
+    free(file);
+}
+
+shaderc_include_result *includeResolve(
+    __attribute__((unused)) void *userData,
+    const char *requested,
+    __attribute__((unused)) int type,
+    const char *requesting,
+    __attribute__((unused)) size_t depth)
+{
+    // there are no include folders, so <file> is found the same as "file"
+    shaderc_include_result *out = new_var(shaderc_include_result);
+    char *includePath           = resolveInclude(requested, requesting);
+
+    size_t length = 0;
+    char *content = readSource(includePath, &length);
+    if (content == NULL)
+    {
+        // an empty name reports the content as the error
+        const char message[] = "Included file does not exist";
+        free(includePath);
+        includePath = calloc(1, 1);
+        content     = malloc(sizeof(message));
+        memcpy(content, message, sizeof(message));
+        length = sizeof(message) - 1;
+    }
+
+    out->source_name        = includePath;
+    out->source_name_length = strlen(includePath);
+    out->content            = content;
+    out->content_length     = length;
+    out->user_data          = NULL;
+    return out;
+}
+
+void includeRelease(
+    __attribute__((unused)) void *userData, shaderc_include_result *result)
+{
+    free((void *)result->source_name);
+    free((void *)result->content);
+    free(result);
+}
@@ -1,6 +1,7 @@
 #pragma once
 #include <spirit_header.h>
 #include <render/spirit_device.h>
+#include <utils/spirit_jobs.h>
 
 /**
  * Functions to load and compile glsl vertex and fragment shader
@@ -11,6 +12,10 @@
  * executable file, not the CWD. This is to make finding program files
  * more intuitive.
  *
+ * Shaders can also be packed offline into a single file with
+ * spWriteShaderPack. While a pack is open, shaders in it are loaded straight
+ * from its mapping, without touching the sources or the cache.
+ *
  * @author Kael Johnston
  * @date Jul 24 2022
  */
@@ -18,9 +23,26 @@
 // file to store cached shaders, relative to the executable
 extern const char GLSL_LOADER_CACHE_FOLDER[];
 
+// how the spirv-tools optimizer is run on compiled shaders
+typedef enum e_SpiritShaderOptimization
+{
+    SPIRIT_SHADER_OPTIMIZATION_NONE,
+    SPIRIT_SHADER_OPTIMIZATION_SIZE,        // smallest modules
+    SPIRIT_SHADER_OPTIMIZATION_PERFORMANCE, // fastest shaders
+} SpiritShaderOptimization;
+
+// one shader of a batch given to spLoadSourceShaders
+typedef struct t_SpiritShaderLoadInfo
+{
+    const char *path;
+    SpiritShaderType type;
+    SpiritShader shader; // output, shaderSize is 0 if it failed
+} SpiritShaderLoadInfo;
+
 /**
  * Load a compiled SPIR-V shader. You can compile a GLSL shader to SPIR-V using
- * the glslc compiler.
+ * the glslc compiler. If the open shader pack has the path, the code points
+ * into the pack.
  *
  * @param path the path to the SPIR-V (.spv) binary
  * @param type the type of shader, vertex, fragment, etc.
@@ -35,9 +57,12 @@ SpiritShader spLoadCompiledShader(const char *path, SpiritShaderType type);
 /**
  * Loads a GLSL shader from source code. It will automatically store the
  * compiled shader in the GLSL_LOADER_CACHE_FOLDER so that it will not
- * need to be compiled again in the future. It will automatically recompile
- * and recache the shader if the source file was modified after the binary
- * was compiled.
+ * need to be compiled again in the future. Cached shaders are named by a hash
+ * of the source, the shader type, the compile options and every included
+ * file, so any change to those compiles the shader again, and file times are
+ * never compared.
+ *
+ * Includes are found relative to the file including them.
  *
  * @param filepath the shader source file
  * @param type the type of shader, vertex, fragment or compute
@@ -49,6 +74,39 @@ SpiritShader spLoadCompiledShader(const char *path, SpiritShaderType type);
  */
 SpiritShader spLoadSourceShader(const char *filepath, SpiritShaderType type);
 
+/**
+ * Load several GLSL shaders at once, compiling those that are not cached on
+ * the workers of a job system. Each shader is loaded as spLoadSourceShader
+ * would, so the cache is shared with it.
+ *
+ * @param jobs the job system to compile on. If NULL, one is made for the
+ * batch and destroyed after.
+ * @param shaders the shaders to load, each gets its output set
+ * @param shaderCount
+ *
+ * @return SPIRIT_FAILURE if any shader failed, the others are still loaded
+ * and must be destroyed
+ */
+SpiritResult spLoadSourceShaders(
+    SpiritJobSystem jobs, SpiritShaderLoadInfo *shaders, const u32 shaderCount);
+
+/**
+ * Find the file a source shader is cached in, whether or not it has been
+ * compiled yet.
+ *
+ * @param dest the path is written here
+ * @param destLength the size of dest, including the terminator
+ * @param filepath the shader source file
+ * @param type the type of shader, vertex, fragment or compute
+ *
+ * @return SPIRIT_FAILURE if the source can not be read, or dest is too short
+ */
+SpiritResult spShaderCachePath(
+    char *dest,
+    const u32 destLength,
+    const char *filepath,
+    SpiritShaderType type);
+
 /**
  * Compile a shader from a string of source. It will return a
  * SpiritShader object storing the code.
@@ -57,7 +115,8 @@ SpiritShader spLoadSourceShader(const char *filepath, SpiritShaderType type);
  *
  * @param src the shader source code
  * @param srcLength the number of characters the source code is long
- * @param outputShaderName the name of the shader, for the shader module
+ * @param outputShaderName the name of the shader, for the shader module. It
+ * is the path includes are relative to.
  * @param type the type of shader, vertex, fragment, etc.
  *
  * @return a SpiritShader object containing the shader. If the shadersize is 0,
@@ -71,6 +130,66 @@ SpiritShader spCompileShader(
     const char *outputShaderName,
     SpiritShaderType type);
 
+/**
+ * Set how compiled shaders are optimized. Release builds, with NDEBUG
+ * defined, default to SPIRIT_SHADER_OPTIMIZATION_PERFORMANCE, and others to
+ * SPIRIT_SHADER_OPTIMIZATION_NONE. The level is part of the cache key, so
+ * shaders cached at another level are compiled again. Debug info is only
+ * kept without NDEBUG.
+ *
+ * Must not be called while shaders are compiling.
+ *
+ * @param optimization
+ */
+void spSetShaderOptimization(const SpiritShaderOptimization optimization);
+
+/**
+ * Pack shaders into one file, to be opened with spOpenShaderPack. Source
+ * shaders are compiled, or taken from the cache, and their type is found from
+ * their extension. Files ending in .spv are packed as they are.
+ *
+ * Shaders are found in the pack by the path they were packed with, so it must
+ * be spelled the same when they are loaded.
+ *
+ * @param packPath the file to write
+ * @param shaderPaths the shaders to pack
+ * @param shaderCount
+ *
+ * @return SPIRIT_FAILURE if any shader failed to load, nothing is written
+ */
+SpiritResult spWriteShaderPack(
+    const char *packPath,
+    const char *const *shaderPaths,
+    const u32 shaderCount);
+
+/**
+ * Open a shader pack. It is mapped into memory and read in at once, and
+ * spLoadCompiledShader and spLoadSourceShader return shaders in it without
+ * reading any other files. A pack that is already open is closed.
+ *
+ * Must not be called while shaders are loading.
+ *
+ * @param packPath the pack written by spWriteShaderPack
+ *
+ * @return SPIRIT_FAILURE if the pack can not be read or is not valid
+ */
+SpiritResult spOpenShaderPack(const char *packPath);
+
+/**
+ * Close the shader pack. Shaders loaded from it must be destroyed first, but
+ * shader modules made from them can be kept.
+ */
+void spCloseShaderPack(void);
+
+/**
+ * Release the shader compiler. It is made the first time a shader is
+ * compiled and kept for the rest, so call this once no more shaders will be
+ * compiled. Compiling again afterwards makes a new one.
+ *
+ * Must not be called while shaders are compiling.
+ */
+void spReleaseShaderCompiler(void);
+
 /**
  * Used to convert a SpiritShader to a vulkan VkShaderModule.
  *
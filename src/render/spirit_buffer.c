@@ -0,0 +1,200 @@
+#include "spirit_buffer.h"
+
+//
+// Helpers
+//
+
+// flush or invalidate a range of a mapped buffer, if it is not coherent
+static SpiritResult syncMappedRange(
+    const SpiritDevice device,
+    const SpiritBuffer *buffer,
+    const VkDeviceSize offset,
+    const VkDeviceSize size,
+    const bool flush);
+
+//
+// Public functions
+//
+
+SpiritResult spCreateBuffer(
+    const SpiritDevice device,
+    const SpiritBufferCreateInfo *createInfo,
+    SpiritBuffer *output)
+{
+    *output             = (SpiritBuffer){};
+    output->size        = createInfo->size;
+    output->usage       = createInfo->usage;
+    output->memoryFlags = createInfo->memoryFlags;
+
+    if (!device->bufferDeviceAddress &&
+        createInfo->usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT)
+    {
+        log_warning("Device does not support buffer device addresses");
+        output->usage &= ~VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+    }
+
+    VkBufferCreateInfo bufferInfo = {};
+    bufferInfo.sType              = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size               = output->size;
+    bufferInfo.usage              = output->usage;
+    bufferInfo.sharingMode        = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateBuffer(
+            device->device, &bufferInfo, ALLOCATION_CALLBACK, &output->buffer))
+    {
+        log_error("Failed to create buffer");
+        return SPIRIT_FAILURE;
+    }
+
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(
+        device->device, output->buffer, &requirements);
+
+    const u32 memoryType = spDeviceChooseMemoryType(
+        device,
+        requirements.memoryTypeBits,
+        createInfo->memoryFlags,
+        requirements.size);
+    output->memoryFlags =
+        device->memoryProperties.memoryTypes[memoryType].propertyFlags;
+
+    if (spDeviceAllocateMemory(
+            device, requirements.size, memoryType, &output->memory))
+    {
+        spDestroyBuffer(device, output);
+        return SPIRIT_FAILURE;
+    }
+
+    // every buffer has its own allocation for now, so it starts at 0
+    output->offset = 0;
+    if (vkBindBufferMemory(
+            device->device, output->buffer, output->memory, output->offset))
+    {
+        log_error("Failed to bind buffer memory");
+        spDestroyBuffer(device, output);
+        return SPIRIT_FAILURE;
+    }
+
+    // the type may be host visible even if only device local was asked for
+    if (output->memoryFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT &&
+        vkMapMemory(
+            device->device,
+            output->memory,
+            output->offset,
+            output->size,
+            0,
+            &output->mapped))
+    {
+        log_error("Failed to map buffer");
+        spDestroyBuffer(device, output);
+        return SPIRIT_FAILURE;
+    }
+
+    return SPIRIT_SUCCESS;
+}
+
+SpiritResult spBufferWrite(
+    const SpiritDevice device,
+    const SpiritBuffer *buffer,
+    const VkDeviceSize offset,
+    const void *data,
+    const VkDeviceSize size)
+{
+    db_assert_msg(buffer->mapped, "Buffer is not host visible");
+    db_assert_msg(offset + size <= buffer->size, "Write is out of bounds");
+
+    memcpy((u8 *)buffer->mapped + offset, data, size);
+    return spBufferFlush(device, buffer, offset, size);
+}
+
+SpiritResult spBufferFlush(
+    const SpiritDevice device,
+    const SpiritBuffer *buffer,
+    const VkDeviceSize offset,
+    const VkDeviceSize size)
+{
+    return syncMappedRange(device, buffer, offset, size, true);
+}
+
+SpiritResult spBufferInvalidate(
+    const SpiritDevice device,
+    const SpiritBuffer *buffer,
+    const VkDeviceSize offset,
+    const VkDeviceSize size)
+{
+    return syncMappedRange(device, buffer, offset, size, false);
+}
+
+VkDeviceAddress
+spBufferGetAddress(const SpiritDevice device, const SpiritBuffer *buffer)
+{
+    if (!(buffer->usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT))
+        return 0;
+
+    VkBufferDeviceAddressInfo addressInfo = {
+        .sType  = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+        .buffer = buffer->buffer};
+
+    return vkGetBufferDeviceAddress(device->device, &addressInfo);
+}
+
+void spDestroyBuffer(const SpiritDevice device, SpiritBuffer *buffer)
+{
+    if (buffer->mapped)
+        vkUnmapMemory(device->device, buffer->memory);
+    buffer->mapped = NULL;
+    if (buffer->buffer)
+        vkDestroyBuffer(device->device, buffer->buffer, ALLOCATION_CALLBACK);
+    buffer->buffer = NULL;
+    if (buffer->memory)
+        spDeviceFreeMemory(device, buffer->memory);
+    buffer->memory = NULL;
+}
+
+//
+// Helpers
+//
+
+static SpiritResult syncMappedRange(
+    const SpiritDevice device,
+    const SpiritBuffer *buffer,
+    const VkDeviceSize offset,
+    const VkDeviceSize size,
+    const bool flush)
+{
+    if (buffer->memoryFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
+        return SPIRIT_SUCCESS;
+    db_assert_msg(buffer->mapped, "Buffer is not host visible");
+
+    // the range has to cover whole atoms, the memory is allocated in them
+    const VkDeviceSize atom  = device->nonCoherentAtomSize;
+    const VkDeviceSize start = (buffer->offset + offset) / atom * atom;
+    VkDeviceSize rangeSize   = VK_WHOLE_SIZE;
+    if (size != VK_WHOLE_SIZE)
+    {
+        const VkDeviceSize end = buffer->offset + offset + size;
+        rangeSize              = (end - start + atom - 1) / atom * atom;
+
+        // rounding up may pass the end of the memory, which is only allowed
+        // as the whole size
+        if (start + rangeSize > buffer->offset + buffer->size)
+            rangeSize = VK_WHOLE_SIZE;
+    }
+
+    VkMappedMemoryRange range = {
+        .sType  = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+        .memory = buffer->memory,
+        .offset = start,
+        .size   = rangeSize};
+
+    const VkResult result =
+        flush ? vkFlushMappedMemoryRanges(device->device, 1, &range)
+              : vkInvalidateMappedMemoryRanges(device->device, 1, &range);
+    if (result)
+    {
+        log_error("Failed to %s buffer", flush ? "flush" : "invalidate");
+        return SPIRIT_FAILURE;
+    }
+
+    return SPIRIT_SUCCESS;
+}
@@ -0,0 +1,135 @@
+#pragma once
+#include <spirit_header.h>
+#include "spirit_device.h"
+
+// Buffers that remember how they were made. A buffer in host visible memory
+// is mapped when it is created and stays mapped until it is destroyed, so
+// writing to it is a memcpy, plus a flush if the memory is not coherent.
+
+//
+// Types
+//
+
+struct t_SpiritBuffer
+{
+    VkBuffer buffer;
+    VkDeviceMemory memory;
+    VkDeviceSize offset; // of the buffer in memory
+    VkDeviceSize size;   // requested, the memory may be larger
+    VkBufferUsageFlags usage;
+    VkMemoryPropertyFlags memoryFlags; // of the memory type used
+    void *mapped; // persistently mapped, NULL if not host visible
+};
+
+typedef struct t_SpiritBufferCreateInfo
+{
+    VkDeviceSize size;
+    VkBufferUsageFlags usage;
+    VkMemoryPropertyFlags memoryFlags; // required, more may be set
+} SpiritBufferCreateInfo;
+
+// a pointer to the element at an index of a mapped buffer of a type
+#define SPIRIT_BUFFER_AT(buffer, type, index)                                  \
+    (((type *)(buffer)->mapped) + (index))
+
+//
+// Functions
+//
+
+/**
+ * @brief Create a buffer and its memory, and map it if it is host visible.
+ * Device local memory may fall back to host memory when its heap is over
+ * budget, see spDeviceChooseMemoryType.
+ *
+ * @param device
+ * @param createInfo
+ * @param output
+ * @return SpiritResult
+ */
+SpiritResult spCreateBuffer(
+    const SpiritDevice device,
+    const SpiritBufferCreateInfo *createInfo,
+    SpiritBuffer *output) SPIRIT_NONULL(1, 2, 3);
+
+/**
+ * @brief Copy data into a mapped buffer, and flush it if needed
+ *
+ * @param device
+ * @param buffer
+ * @param offset bytes from the start of the buffer
+ * @param data
+ * @param size bytes to copy
+ * @return SpiritResult
+ */
+SpiritResult spBufferWrite(
+    const SpiritDevice device,
+    const SpiritBuffer *buffer,
+    const VkDeviceSize offset,
+    const void *data,
+    const VkDeviceSize size) SPIRIT_NONULL(1, 2, 4);
+
+/**
+ * @brief Make host writes to a range of a mapped buffer visible to the
+ * device. Does nothing for host coherent memory.
+ *
+ * @param device
+ * @param buffer
+ * @param offset
+ * @param size may be VK_WHOLE_SIZE
+ * @return SpiritResult
+ */
+SpiritResult spBufferFlush(
+    const SpiritDevice device,
+    const SpiritBuffer *buffer,
+    const VkDeviceSize offset,
+    const VkDeviceSize size) SPIRIT_NONULL(1, 2);
+
+/**
+ * @brief Make device writes to a range of a mapped buffer visible to the
+ * host, once the gpu has finished writing. Does nothing for host coherent
+ * memory.
+ *
+ * @param device
+ * @param buffer
+ * @param offset
+ * @param size may be VK_WHOLE_SIZE
+ * @return SpiritResult
+ */
+SpiritResult spBufferInvalidate(
+    const SpiritDevice device,
+    const SpiritBuffer *buffer,
+    const VkDeviceSize offset,
+    const VkDeviceSize size) SPIRIT_NONULL(1, 2);
+
+/**
+ * @brief Get the address of a buffer for use in shaders. The buffer needs
+ * VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, and the device the feature.
+ *
+ * @param device
+ * @param buffer
+ * @return VkDeviceAddress 0 if the buffer has no address
+ */
+VkDeviceAddress
+spBufferGetAddress(const SpiritDevice device, const SpiritBuffer *buffer)
+    SPIRIT_NONULL(1, 2);
+
+/**
+ * @brief Check if the buffer is mapped, and can be written from the host
+ *
+ * @param buffer
+ * @return bool
+ */
+SPIRIT_INLINE bool spBufferIsMapped(const SpiritBuffer *buffer)
+{
+    return buffer->mapped != NULL;
+}
+
+/**
+ * @brief Destroy a buffer and free its memory. The gpu must have finished
+ * with it.
+ *
+ * @param device
+ * @param buffer
+ */
+void spDestroyBuffer(const SpiritDevice device, SpiritBuffer *buffer)
+    SPIRIT_NONULL(1, 2);
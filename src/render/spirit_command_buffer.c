@@ -1,16 +1,49 @@
 #include "spirit_command_buffer.h"
 
 #include "spirit_device.h"
-#include "spirit_fence.h"
 
 SpiritResult beginCommandBuffer(
     SpiritCommandBuffer buffer,
     bool singleUse,
     bool simultanious,
-    bool renderpassContinue);
+    bool renderpassContinue,
+    const VkCommandBufferInheritanceInfo *inheritance);
+
+// submit to the queue of the buffer, and record its timeline value
+static SpiritResult submitCommandBuffer(
+    const SpiritDevice device,
+    SpiritCommandBuffer buffer,
+    const SpiritSubmitInfo *submitInfo);
+
+// end or wait for a buffer, so it can be freed or begun again
+static void finishCommandBuffer(
+    const SpiritDevice device, SpiritCommandBuffer buffer);
+
+// take a recycled buffer for a queue, NULL if there are none
+static SpiritCommandBuffer
+takeRecycled(const SpiritDevice device, const SpiritQueueType queue);
+
+// find or create the pool of the calling thread for a queue
+static struct t_SpiritThreadQueuePool *
+getThreadPool(const SpiritDevice device, const SpiritQueueType queue);
+
+// its address is different on every thread, so it names the calling thread
+static _Thread_local char threadKey;
 
 SpiritCommandBuffer spCreateCommandBuffer(SpiritDevice device, bool primary)
 {
+    return spCreateQueueCommandBuffer(device, SPIRIT_QUEUE_GRAPHICS, primary);
+}
+
+SpiritCommandBuffer spCreateQueueCommandBuffer(
+    const SpiritDevice device, const SpiritQueueType queue, bool primary)
+{
+    if (primary)
+    {
+        SpiritCommandBuffer recycled = takeRecycled(device, queue);
+        if (recycled)
+            return recycled;
+    }
 
     SpiritCommandBuffer buffer = new_var(struct t_SpiritCommandBuffer);
 
@@ -18,20 +51,71 @@ SpiritCommandBuffer spCreateCommandBuffer(SpiritDevice device, bool primary)
         .sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
         .level              = primary ? VK_COMMAND_BUFFER_LEVEL_PRIMARY
                                       : VK_COMMAND_BUFFER_LEVEL_SECONDARY,
-        .commandPool        = device->commandPool,
+        .commandPool        = spDeviceGetCommandPool(device, queue),
         .commandBufferCount = 1,
     };
 
-    if (vkAllocateCommandBuffers(device->device, &allocInfo, &buffer->handle))
+    spPlatformLockMutex(device->commandLock);
+    VkResult result =
+        vkAllocateCommandBuffers(device->device, &allocInfo, &buffer->handle);
+    spPlatformUnlockMutex(device->commandLock);
+    if (result)
     {
         log_error("Failed to allocate command buffers");
         free(buffer);
         return NULL;
     }
 
-    buffer->fence = spCreateFence(device, true);
+    buffer->state       = SPIRIT_COMMAND_BUFFER_STATE_READY;
+    buffer->queue       = queue;
+    buffer->primary     = primary;
+    buffer->submitValue = 0;
 
-    buffer->state = SPIRIT_COMMAND_BUFFER_STATE_READY;
+    return buffer;
+}
+
+SpiritCommandBuffer spCreateThreadCommandBuffer(
+    const SpiritDevice device, const SpiritQueueType queue)
+{
+    struct t_SpiritThreadQueuePool *pool = getThreadPool(device, queue);
+    if (!pool)
+        return NULL;
+
+    // only this thread uses the pool, so nothing here is locked
+    for (size_t i = 0; i < VECTOR_SIZE(&pool->buffers); i++)
+    {
+        SpiritCommandBuffer buffer = VECTOR_AT(&pool->buffers, i);
+        if (buffer->state == SPIRIT_COMMAND_BUFFER_STATE_BUSY &&
+            spTimelineReached(device, spCommandBufferGetSyncPoint(buffer)))
+        {
+            // reset when it is begun again
+            buffer->state = SPIRIT_COMMAND_BUFFER_STATE_READY;
+            return buffer;
+        }
+    }
+
+    VkCommandBufferAllocateInfo allocInfo = {
+        .sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandPool        = pool->handle,
+        .commandBufferCount = 1,
+    };
+
+    VkCommandBuffer handle;
+    if (vkAllocateCommandBuffers(device->device, &allocInfo, &handle))
+    {
+        log_error("Failed to allocate command buffers");
+        return NULL;
+    }
+
+    SpiritCommandBuffer buffer = new_var(struct t_SpiritCommandBuffer);
+    buffer->handle             = handle;
+    buffer->state              = SPIRIT_COMMAND_BUFFER_STATE_READY;
+    buffer->queue              = queue;
+    buffer->primary            = true;
+    buffer->submitValue        = 0;
+
+    VECTOR_PUSH_BACK(&pool->buffers, buffer);
 
     return buffer;
 }
@@ -51,16 +135,22 @@ SpiritResult spCreateCommandBuffers(
     };
 
     VkCommandBuffer buffer[count];
-    if (vkAllocateCommandBuffers(device->device, &allocInfo, buffer))
+    spPlatformLockMutex(device->commandLock);
+    VkResult result =
+        vkAllocateCommandBuffers(device->device, &allocInfo, buffer);
+    spPlatformUnlockMutex(device->commandLock);
+    if (result)
     {
         return SPIRIT_FAILURE;
     }
 
     for (u32 i = 0; i < count; ++i)
     {
-        buf[i]->handle = buffer[i];
-        buf[i]->fence  = spCreateFence(device, true);
-        buf[i]->state  = SPIRIT_COMMAND_BUFFER_STATE_READY;
+        buf[i]->handle      = buffer[i];
+        buf[i]->state       = SPIRIT_COMMAND_BUFFER_STATE_READY;
+        buf[i]->queue       = SPIRIT_QUEUE_GRAPHICS;
+        buf[i]->primary     = primary;
+        buf[i]->submitValue = 0;
     }
 
     return SPIRIT_SUCCESS;
@@ -69,29 +159,48 @@ SpiritResult spCreateCommandBuffers(
 void spDestroyCommandBuffer(
     const SpiritDevice device, SpiritCommandBuffer buffer)
 {
-
     // handle cases when the command buffer cannot be destroyed
-    switch (buffer->state)
-    {
-    case SPIRIT_COMMAND_BUFFER_STATE_RECORDING:
+    if (buffer->state == SPIRIT_COMMAND_BUFFER_STATE_RECORDING)
         log_warning("Attempting to destroy a command buffer that is recording");
-        spCommandBufferEnd(buffer);
-        break;
-    case SPIRIT_COMMAND_BUFFER_STATE_BUSY:
+    else if (buffer->state == SPIRIT_COMMAND_BUFFER_STATE_BUSY)
         log_warning("Attempting to destroy a command buffer that is busy");
-        spCommandBufferWait(device, buffer, UINT64_MAX);
-        break;
-    default: break;
-    }
-
-    spDestroyFence(device, buffer->fence);
+    finishCommandBuffer(device, buffer);
 
+    spPlatformLockMutex(device->commandLock);
     vkFreeCommandBuffers(
-        device->device, device->commandPool, 1, &buffer->handle);
+        device->device,
+        spDeviceGetCommandPool(device, buffer->queue),
+        1,
+        &buffer->handle);
+    spPlatformUnlockMutex(device->commandLock);
 
     free(buffer);
 }
 
+void spRecycleCommandBuffer(
+    const SpiritDevice device, SpiritCommandBuffer buffer)
+{
+    finishCommandBuffer(device, buffer);
+
+    // the pools reset buffers when they are begun again
+    buffer->state = SPIRIT_COMMAND_BUFFER_STATE_READY;
+
+    spPlatformLockMutex(device->commandLock);
+    bool kept = false;
+    if (buffer->primary &&
+        VECTOR_SIZE(&device->recycledCommandBuffers[buffer->queue]) <
+            SPIRIT_MAX_RECYCLED_COMMAND_BUFFERS)
+    {
+        VECTOR_PUSH_BACK(
+            &device->recycledCommandBuffers[buffer->queue], buffer);
+        kept = true;
+    }
+    spPlatformUnlockMutex(device->commandLock);
+
+    if (!kept)
+        spDestroyCommandBuffer(device, buffer);
+}
+
 SpiritCommandBuffer
 spCreateCommandBufferAndBeginSingleUse(const SpiritDevice device)
 {
@@ -104,7 +213,7 @@ SpiritResult spCommandBufferBeginSingleUse(SpiritCommandBuffer buf)
 {
     if (buf->state != SPIRIT_COMMAND_BUFFER_STATE_READY)
         return SPIRIT_FAILURE;
-    if (beginCommandBuffer(buf, true, false, false))
+    if (beginCommandBuffer(buf, true, false, false, NULL))
         return SPIRIT_FAILURE;
 
     buf->state = SPIRIT_COMMAND_BUFFER_STATE_RECORDING;
@@ -112,6 +221,29 @@ SpiritResult spCommandBufferBeginSingleUse(SpiritCommandBuffer buf)
     return SPIRIT_SUCCESS;
 }
 
+SpiritResult spCommandBufferBeginSecondary(
+    SpiritCommandBuffer buffer,
+    const VkCommandBufferInheritanceInfo *inheritance)
+{
+    if (buffer->primary || buffer->state != SPIRIT_COMMAND_BUFFER_STATE_READY)
+    {
+        log_warning("Can only begin secondary command buffers that are ready");
+        return SPIRIT_FAILURE;
+    }
+
+    if (beginCommandBuffer(
+            buffer,
+            true,
+            false,
+            inheritance->renderPass != VK_NULL_HANDLE,
+            inheritance))
+        return SPIRIT_FAILURE;
+
+    buffer->state = SPIRIT_COMMAND_BUFFER_STATE_RECORDING;
+
+    return SPIRIT_SUCCESS;
+}
+
 // command buffer creation and destruction
 SpiritResult spCommandBufferBegin(SpiritCommandBuffer buffer)
 {
@@ -125,7 +257,7 @@ SpiritResult spCommandBufferBegin(SpiritCommandBuffer buffer)
         return SPIRIT_FAILURE;
     }
 
-    if (beginCommandBuffer(buffer, false, false, false))
+    if (beginCommandBuffer(buffer, false, false, false, NULL))
         return SPIRIT_FAILURE;
 
     buffer->state = SPIRIT_COMMAND_BUFFER_STATE_RECORDING;
@@ -141,38 +273,37 @@ SpiritResult spCommandBufferSubmit(
     VkPipelineStageFlags *waitStages)
 {
 
-    if (buffer->state != SPIRIT_COMMAND_BUFFER_STATE_RECORDED)
-    {
-        log_warning("Must record and end buffer before submitting");
-        return SPIRIT_FAILURE;
-    }
-
-    VkSubmitInfo submitInfo = {};
-    submitInfo.sType        = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-
-    submitInfo.waitSemaphoreCount = waitSemaphore ? 1 : 0;
-    submitInfo.pWaitSemaphores    = &waitSemaphore;
-    submitInfo.pWaitDstStageMask  = waitStages;
-
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers    = &buffer->handle;
-
-    submitInfo.signalSemaphoreCount = signalSemaphore ? 1 : 0;
-    submitInfo.pSignalSemaphores    = &signalSemaphore;
+    SpiritSubmitInfo submitInfo = {
+        .waitSemaphore   = waitSemaphore,
+        .waitStage       = waitStages ? *waitStages : 0,
+        .signalSemaphore = signalSemaphore,
+    };
 
-    spFenceReset(device, buffer->fence);
+    return submitCommandBuffer(device, buffer, &submitInfo);
+}
 
-    if (vkQueueSubmit(
-            device->graphicsQueue, 1, &submitInfo, buffer->fence->handle) !=
-        VK_SUCCESS)
-    {
-        log_error("Failed to submit command buffer");
-        return SPIRIT_FAILURE;
-    }
+SpiritResult spCommandBufferSubmitAfter(
+    const SpiritDevice device,
+    const SpiritCommandBuffer buffer,
+    const SpiritSyncPoint *waits,
+    const u32 waitCount,
+    VkPipelineStageFlags waitStage)
+{
+    SpiritSubmitInfo submitInfo = {
+        .waits          = waits,
+        .waitCount      = waitCount,
+        .waitPointStage = waitStage,
+    };
 
-    buffer->state = SPIRIT_COMMAND_BUFFER_STATE_BUSY;
+    return submitCommandBuffer(device, buffer, &submitInfo);
+}
 
-    return SPIRIT_SUCCESS;
+SpiritResult spCommandBufferSubmitWithInfo(
+    const SpiritDevice device,
+    const SpiritCommandBuffer buffer,
+    const SpiritSubmitInfo *submitInfo)
+{
+    return submitCommandBuffer(device, buffer, submitInfo);
 }
 
 SpiritResult spCommandBufferSubmitSingleUse(
@@ -204,7 +335,8 @@ SpiritResult spCommandBufferWait(
         return SPIRIT_UNDEFINED;
     }
 
-    if (spFenceWait(device, buffer->fence, timeout_ns))
+    if (spTimelineWait(
+            device, spCommandBufferGetSyncPoint(buffer), timeout_ns))
     {
         return SPIRIT_FAILURE;
     }
@@ -230,11 +362,13 @@ SpiritResult beginCommandBuffer(
     SpiritCommandBuffer buffer,
     bool singleUse,
     bool simultanious,
-    bool renderpassContinue)
+    bool renderpassContinue,
+    const VkCommandBufferInheritanceInfo *inheritance)
 {
 
     VkCommandBufferBeginInfo bufferBeginInfo = {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .sType            = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .pInheritanceInfo = inheritance,
     };
 
     if (singleUse)
@@ -253,3 +387,110 @@ SpiritResult beginCommandBuffer(
 
     return SPIRIT_SUCCESS;
 }
+
+static SpiritResult submitCommandBuffer(
+    const SpiritDevice device,
+    SpiritCommandBuffer buffer,
+    const SpiritSubmitInfo *submitInfo)
+{
+    if (buffer->state != SPIRIT_COMMAND_BUFFER_STATE_RECORDED)
+    {
+        log_warning("Must record and end buffer before submitting");
+        return SPIRIT_FAILURE;
+    }
+
+    SpiritSubmitInfo info   = *submitInfo;
+    info.commandBuffers     = &buffer->handle;
+    info.commandBufferCount = 1;
+
+    SpiritSyncPoint point = spTimelineSubmit(device, buffer->queue, &info);
+    if (point.value == 0)
+    {
+        log_error("Failed to submit command buffer");
+        return SPIRIT_FAILURE;
+    }
+
+    buffer->submitValue = point.value;
+    buffer->state       = SPIRIT_COMMAND_BUFFER_STATE_BUSY;
+
+    return SPIRIT_SUCCESS;
+}
+
+static void finishCommandBuffer(
+    const SpiritDevice device, SpiritCommandBuffer buffer)
+{
+    switch (buffer->state)
+    {
+    case SPIRIT_COMMAND_BUFFER_STATE_RECORDING:
+        spCommandBufferEnd(buffer);
+        break;
+    case SPIRIT_COMMAND_BUFFER_STATE_BUSY:
+        spCommandBufferWait(device, buffer, UINT64_MAX);
+        break;
+    default: break;
+    }
+}
+
+static SpiritCommandBuffer
+takeRecycled(const SpiritDevice device, const SpiritQueueType queue)
+{
+    SpiritCommandBuffer out = NULL;
+
+    spPlatformLockMutex(device->commandLock);
+    if (VECTOR_SIZE(&device->recycledCommandBuffers[queue]))
+    {
+        out = VECTOR_AT(
+            &device->recycledCommandBuffers[queue],
+            --device->recycledCommandBuffers[queue].size);
+    }
+    spPlatformUnlockMutex(device->commandLock);
+
+    return out;
+}
+
+static struct t_SpiritThreadQueuePool *
+getThreadPool(const SpiritDevice device, const SpiritQueueType queue)
+{
+    struct t_SpiritThreadQueuePool *out = NULL;
+
+    spPlatformLockMutex(device->commandLock);
+    for (size_t i = 0; i < VECTOR_SIZE(&device->threadPools); i++)
+    {
+        struct t_SpiritThreadQueuePool *pool =
+            VECTOR_AT(&device->threadPools, i);
+        if (pool->thread == &threadKey && pool->queue == queue)
+        {
+            out = pool;
+            break;
+        }
+    }
+
+    if (!out)
+    {
+        // buffers are reset one at a time, as their submissions finish
+        VkCommandPoolCreateInfo poolInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+            .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT |
+                     VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+            .queueFamilyIndex = spDeviceGetQueueFamily(device, queue)};
+
+        VkCommandPool handle;
+        if (vkCreateCommandPool(
+                device->device, &poolInfo, ALLOCATION_CALLBACK, &handle))
+        {
+            log_error("Failed to create command pool");
+        }
+        else
+        {
+            out         = new_var(struct t_SpiritThreadQueuePool);
+            out->thread = &threadKey;
+            out->queue  = queue;
+            out->handle = handle;
+            VECTOR_INIT(&out->buffers, 0);
+            VECTOR_PUSH_BACK(&device->threadPools, out);
+        }
+    }
+    spPlatformUnlockMutex(device->commandLock);
+
+    return out;
+}
@@ -13,6 +13,9 @@
 
 #include <spirit_header.h>
 
+#include "spirit_device.h"
+#include "spirit_timeline.h"
+
 typedef enum e_SpiritCommandBufferState
 {
     SPIRIT_COMMAND_BUFFER_STATE_READY = 0,
@@ -24,10 +27,16 @@ typedef enum e_SpiritCommandBufferState
 struct t_SpiritCommandBuffer
 {
     VkCommandBuffer handle;
-    SpiritFence fence;
     SpiritCommandBufferState state;
+    SpiritQueueType queue; // submitted to, and allocated from its pool
+    bool primary;
+    u64 submitValue; // on the timeline of its queue, 0 until submitted
 };
 
+// finished single use buffers kept by the device for each queue, the rest are
+// destroyed
+#define SPIRIT_MAX_RECYCLED_COMMAND_BUFFERS 16
+
 /**
  * @brief can be used to keep track of whether or not a command buffer is single
  * use.
@@ -46,6 +55,33 @@ typedef SpiritCommandBuffer SpiritCommandBufferSingleUse;
 SpiritCommandBuffer
 spCreateCommandBuffer(const SpiritDevice device, bool primary);
 
+/**
+ * @brief Create a command buffer for the transfer or compute queue. It can
+ * only record commands the queue supports, and resources it uses may need
+ * their ownership transferred, see spDeviceAcquireBuffer.
+ *
+ * @param device the device
+ * @param queue the queue the command buffer is submitted to
+ * @param primary whether or not the command buffer
+ * should be a primary command buffer
+ * @return SpiritCommandBuffer
+ */
+SpiritCommandBuffer spCreateQueueCommandBuffer(
+    const SpiritDevice device, const SpiritQueueType queue, bool primary);
+
+/**
+ * @brief Get a single use primary command buffer from a pool owned by the
+ * calling thread, so threads can record uploads at the same time without
+ * sharing a pool. The buffer is handed out again once its submission is
+ * finished, so it must be submitted, and never destroyed or recycled.
+ *
+ * @param device
+ * @param queue the queue the command buffer is submitted to
+ * @return SpiritCommandBuffer NULL on failure
+ */
+SpiritCommandBuffer spCreateThreadCommandBuffer(
+    const SpiritDevice device, const SpiritQueueType queue) SPIRIT_NONULL(1);
+
 /**
  * @brief create a command buffer that can only be used once
  *
@@ -86,6 +122,18 @@ spCreateCommandBufferAndBeginSingleUse(const SpiritDevice device);
 void spDestroyCommandBuffer(
     const SpiritDevice device, SpiritCommandBuffer buffer);
 
+/**
+ * @brief Give a command buffer back to the device once it is no longer
+ * needed, instead of destroying it. The buffer is handed out again by the
+ * next spCreateCommandBuffer for the same queue, so single use buffers do not
+ * allocate on every submit. Waits if the buffer is busy.
+ *
+ * @param device
+ * @param buffer must not be used after
+ */
+void spRecycleCommandBuffer(
+    const SpiritDevice device, SpiritCommandBuffer buffer) SPIRIT_NONULL(1, 2);
+
 /**
  * @brief begin a command buffer. allow it to recieve commands.
  *
@@ -102,6 +150,17 @@ SpiritResult spCommandBufferBegin(SpiritCommandBuffer buffer);
  */
 SpiritResult spCommandBufferBeginSingleUse(SpiritCommandBuffer buf);
 
+/**
+ * @brief Begin a secondary command buffer, to be executed by a primary one
+ *
+ * @param buffer
+ * @param inheritance the render pass and framebuffer it continues, if any
+ * @return SpiritResult
+ */
+SpiritResult spCommandBufferBeginSecondary(
+    SpiritCommandBuffer buffer,
+    const VkCommandBufferInheritanceInfo *inheritance) SPIRIT_NONULL(1, 2);
+
 /**
  * @brief Submit a command buffer to the gpu
  *
@@ -110,7 +169,6 @@ SpiritResult spCommandBufferBeginSingleUse(SpiritCommandBuffer buf);
  * @param waitSemaphore the wait semaphore, if any
  * @param signalSemaphore the signal semaphore, if any
  * @param waitStages the pipeline stages to wait for, if any
- * @param fence the fence to use to wait
  * @return SpiritResult
  */
 SpiritResult spCommandBufferSubmit(
@@ -120,6 +178,38 @@ SpiritResult spCommandBufferSubmit(
     VkSemaphore signalSemaphore,
     VkPipelineStageFlags *waitStages) SPIRIT_NONULL(1, 2);
 
+/**
+ * @brief Submit a command buffer once other submissions finish, which may be
+ * on other queues. The wait happens on the gpu.
+ *
+ * @param device
+ * @param buffer the command buffer
+ * @param waits the submissions to wait for, see spCommandBufferGetSyncPoint
+ * @param waitCount
+ * @param waitStage the pipeline stages that wait
+ * @return SpiritResult
+ */
+SpiritResult spCommandBufferSubmitAfter(
+    const SpiritDevice device,
+    const SpiritCommandBuffer buffer,
+    const SpiritSyncPoint *waits,
+    const u32 waitCount,
+    VkPipelineStageFlags waitStage) SPIRIT_NONULL(1, 2);
+
+/**
+ * @brief Submit a command buffer waiting for both binary semaphores and
+ * other submissions, like a frame waiting for its image and for uploads.
+ *
+ * @param device
+ * @param buffer the command buffer
+ * @param submitInfo its command buffers are ignored
+ * @return SpiritResult
+ */
+SpiritResult spCommandBufferSubmitWithInfo(
+    const SpiritDevice device,
+    const SpiritCommandBuffer buffer,
+    const SpiritSubmitInfo *submitInfo) SPIRIT_NONULL(1, 2, 3);
+
 /**
  * @brief Wait for a command buffer to finish executiona
  *
@@ -154,4 +244,17 @@ SPIRIT_INLINE SpiritCommandBufferState
 spCommandBufferGetState(const SpiritCommandBuffer buf)
 {
     return buf->state;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Get the last submission of a command buffer, to wait for it on
+ * another queue or check if resources it used are free
+ *
+ * @param buf
+ * @return SpiritSyncPoint
+ */
+SPIRIT_INLINE SpiritSyncPoint
+spCommandBufferGetSyncPoint(const SpiritCommandBuffer buf)
+{
+    return (SpiritSyncPoint){.queue = buf->queue, .value = buf->submitValue};
+}
@@ -0,0 +1,198 @@
+#include "spirit_command_pool.h"
+
+#include "spirit_command_buffer.h"
+
+//
+// Helpers
+//
+
+// allocate another buffer for a thread pool that has handed out all of its own
+static SpiritCommandBuffer allocateBuffer(
+    const SpiritDevice device,
+    const SpiritCommandPool pool,
+    struct t_SpiritThreadCommandPool *threadPool,
+    const bool primary);
+
+// free the buffers and the pool of one thread
+static void destroyThreadPool(
+    const SpiritDevice device, struct t_SpiritThreadCommandPool *threadPool);
+
+//
+// Public functions
+//
+
+SpiritCommandPool spCreateCommandPool(
+    const SpiritDevice device, const SpiritCommandPoolCreateInfo *createInfo)
+{
+    db_assert(createInfo->frameCount > 0);
+
+    SpiritCommandPool out = new_var(struct t_SpiritCommandPool);
+    out->queue            = createInfo->queue;
+    out->frameCount       = createInfo->frameCount;
+    out->threadCount =
+        createInfo->threadCount ? createInfo->threadCount : 1;
+    out->frame = 0;
+
+    const u32 poolCount = out->frameCount * out->threadCount;
+    out->pools = new_array(struct t_SpiritThreadCommandPool, poolCount);
+    memset(out->pools, 0, sizeof(*out->pools) * poolCount);
+
+    // buffers are only reset with their whole pool
+    VkCommandPoolCreateInfo poolInfo = {};
+    poolInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = spDeviceGetQueueFamily(device, out->queue);
+    poolInfo.flags            = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+    for (u32 i = 0; i < poolCount; i++)
+    {
+        struct t_SpiritThreadCommandPool *threadPool = &out->pools[i];
+        VECTOR_INIT(&threadPool->primary, 0);
+        VECTOR_INIT(&threadPool->secondary, 0);
+
+        if (vkCreateCommandPool(
+                device->device,
+                &poolInfo,
+                ALLOCATION_CALLBACK,
+                &threadPool->handle))
+        {
+            log_error("Failed to create command pool");
+            spDestroyCommandPool(device, out);
+            return NULL;
+        }
+    }
+
+    return out;
+}
+
+SpiritResult spCommandPoolBeginFrame(
+    const SpiritDevice device, SpiritCommandPool pool, const u32 frame)
+{
+    db_assert(frame < pool->frameCount);
+    pool->frame = frame;
+
+    struct t_SpiritThreadCommandPool *pools =
+        &pool->pools[frame * pool->threadCount];
+
+    SpiritResult result = SPIRIT_SUCCESS;
+    for (u32 i = 0; i < pool->threadCount; i++)
+    {
+        struct t_SpiritThreadCommandPool *threadPool = &pools[i];
+        if (threadPool->primaryUsed == 0 && threadPool->secondaryUsed == 0)
+            continue;
+
+        // keep the memory, the frame will likely record as much again
+        if (vkResetCommandPool(device->device, threadPool->handle, 0))
+        {
+            log_error("Failed to reset command pool");
+            result = SPIRIT_FAILURE;
+        }
+
+        for (u32 j = 0; j < threadPool->primaryUsed; j++)
+            VECTOR_AT(&threadPool->primary, j)->state =
+                SPIRIT_COMMAND_BUFFER_STATE_READY;
+        for (u32 j = 0; j < threadPool->secondaryUsed; j++)
+            VECTOR_AT(&threadPool->secondary, j)->state =
+                SPIRIT_COMMAND_BUFFER_STATE_READY;
+
+        threadPool->primaryUsed   = 0;
+        threadPool->secondaryUsed = 0;
+    }
+
+    return result;
+}
+
+SpiritCommandBuffer spCommandPoolGetBuffer(
+    const SpiritDevice device,
+    SpiritCommandPool pool,
+    const u32 thread,
+    const bool primary)
+{
+    db_assert(thread < pool->threadCount);
+
+    struct t_SpiritThreadCommandPool *threadPool =
+        &pool->pools[pool->frame * pool->threadCount + thread];
+
+    if (primary)
+    {
+        if (threadPool->primaryUsed < VECTOR_SIZE(&threadPool->primary))
+            return VECTOR_AT(&threadPool->primary, threadPool->primaryUsed++);
+    }
+    else if (threadPool->secondaryUsed < VECTOR_SIZE(&threadPool->secondary))
+    {
+        return VECTOR_AT(&threadPool->secondary, threadPool->secondaryUsed++);
+    }
+
+    return allocateBuffer(device, pool, threadPool, primary);
+}
+
+void spDestroyCommandPool(const SpiritDevice device, SpiritCommandPool pool)
+{
+    for (u32 i = 0; i < pool->frameCount * pool->threadCount; i++)
+        destroyThreadPool(device, &pool->pools[i]);
+
+    free(pool->pools);
+    free(pool);
+}
+
+//
+// Helpers
+//
+
+static SpiritCommandBuffer allocateBuffer(
+    const SpiritDevice device,
+    const SpiritCommandPool pool,
+    struct t_SpiritThreadCommandPool *threadPool,
+    const bool primary)
+{
+    VkCommandBufferAllocateInfo allocInfo = {
+        .sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .level              = primary ? VK_COMMAND_BUFFER_LEVEL_PRIMARY
+                                      : VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+        .commandPool        = threadPool->handle,
+        .commandBufferCount = 1,
+    };
+
+    VkCommandBuffer handle;
+    if (vkAllocateCommandBuffers(device->device, &allocInfo, &handle))
+    {
+        log_error("Failed to allocate command buffers");
+        return NULL;
+    }
+
+    SpiritCommandBuffer out = new_var(struct t_SpiritCommandBuffer);
+    out->handle             = handle;
+    out->state              = SPIRIT_COMMAND_BUFFER_STATE_READY;
+    out->queue              = pool->queue;
+    out->primary            = primary;
+    out->submitValue        = 0;
+
+    if (primary)
+    {
+        VECTOR_PUSH_BACK(&threadPool->primary, out);
+        threadPool->primaryUsed++;
+    }
+    else
+    {
+        VECTOR_PUSH_BACK(&threadPool->secondary, out);
+        threadPool->secondaryUsed++;
+    }
+
+    return out;
+}
+
+static void destroyThreadPool(
+    const SpiritDevice device, struct t_SpiritThreadCommandPool *threadPool)
+{
+    // the buffers are freed with the pool
+    for (size_t i = 0; i < VECTOR_SIZE(&threadPool->primary); i++)
+        free(VECTOR_AT(&threadPool->primary, i));
+    for (size_t i = 0; i < VECTOR_SIZE(&threadPool->secondary); i++)
+        free(VECTOR_AT(&threadPool->secondary, i));
+
+    VECTOR_DELETE(&threadPool->primary);
+    VECTOR_DELETE(&threadPool->secondary);
+
+    if (threadPool->handle)
+        vkDestroyCommandPool(
+            device->device, threadPool->handle, ALLOCATION_CALLBACK);
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <spirit_header.h>
+#include "spirit_device.h"
+#include "utils/spirit_vector.h"
+
+// Command pools for recording on several threads. Every thread gets its own
+// VkCommandPool for each frame in flight, so threads never share a pool while
+// recording. When a frame comes around again its pools are reset as a whole,
+// and the command buffers they handed out are reused without being freed or
+// allocated again.
+//
+// Buffers from a pool belong to it, and must not be destroyed or recycled.
+
+//
+// Types
+//
+
+typedef struct t_SpiritCommandPoolCreateInfo
+{
+    SpiritQueueType queue; // the buffers are submitted to
+    u32 frameCount;        // frames in flight
+    u32 threadCount;       // threads recording, 0 for one
+} SpiritCommandPoolCreateInfo;
+
+// the command buffers one thread records for one frame
+struct t_SpiritThreadCommandPool
+{
+    VkCommandPool handle;
+    VECTOR(SpiritCommandBuffer) primary; // allocated so far
+    VECTOR(SpiritCommandBuffer) secondary;
+    u32 primaryUsed; // handed out this frame
+    u32 secondaryUsed;
+};
+
+struct t_SpiritCommandPool
+{
+    SpiritQueueType queue;
+    u32 frameCount;
+    u32 threadCount;
+    u32 frame; // being recorded
+
+    // frameCount * threadCount, the threads of each frame next to each other
+    struct t_SpiritThreadCommandPool *pools;
+};
+
+//
+// Functions
+//
+
+/**
+ * @brief Create the command pools for every thread and frame in flight
+ *
+ * @param device
+ * @param createInfo
+ * @return SpiritCommandPool NULL on failure
+ */
+SpiritCommandPool spCreateCommandPool(
+    const SpiritDevice device, const SpiritCommandPoolCreateInfo *createInfo)
+    SPIRIT_NONULL(1, 2);
+
+/**
+ * @brief Start recording a frame. Resets the pools of every thread for the
+ * frame, so the gpu must have finished the last time the frame was submitted.
+ *
+ * @param device
+ * @param pool
+ * @param frame the index of the frame in flight
+ * @return SpiritResult
+ */
+SpiritResult spCommandPoolBeginFrame(
+    const SpiritDevice device, SpiritCommandPool pool, const u32 frame)
+    SPIRIT_NONULL(1, 2);
+
+/**
+ * @brief Get a command buffer for this frame, ready to be begun. Only the
+ * thread the index belongs to may call this between frames.
+ *
+ * @param device
+ * @param pool
+ * @param thread the index of the recording thread, like its job worker index
+ * @param primary whether or not the command buffer
+ * should be a primary command buffer
+ * @return SpiritCommandBuffer NULL on failure
+ */
+SpiritCommandBuffer spCommandPoolGetBuffer(
+    const SpiritDevice device,
+    SpiritCommandPool pool,
+    const u32 thread,
+    const bool primary) SPIRIT_NONULL(1, 2);
+
+/**
+ * @brief Destroy the pools and every command buffer they handed out. The gpu
+ * must have finished with them.
+ *
+ * @param device
+ * @param pool
+ */
+void spDestroyCommandPool(const SpiritDevice device, SpiritCommandPool pool)
+    SPIRIT_NONULL(1, 2);
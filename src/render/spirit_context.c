@@ -1,18 +1,70 @@
 #include "spirit_context.h"
 
 #include "spirit_command_buffer.h"
+#include "spirit_command_pool.h"
+#include "spirit_deletion_queue.h"
 #include "spirit_device.h"
 #include "spirit_fence.h"
+#include "spirit_image.h"
 #include "spirit_material.h"
+#include "spirit_readback.h"
 #include "spirit_swapchain.h"
 
+// the end of the frame interval the frame limiter spins through, in
+// nanoseconds. Sleeping until the deadline can overshoot by the timer slack.
+#define FRAME_LIMIT_SPIN_TIME 1000000ull
+
 //
 // Private functions
 //
 
-SpiritResult createSyncObjects(SpiritContext context);
+// create the per frame resources, semaphores and object buffers. The command
+// buffers come from the context command pool.
+SpiritResult createFrames(SpiritContext context);
+
+void destroyFrames(SpiritContext context);
+
+// create the semaphores signaled when rendering to each swapchain image is
+// done. Called again when the swapchain is recreated.
+SpiritResult createRenderFinishedSemaphores(SpiritContext context);
+
+// hand the semaphores to the deletion queue
+void destroyRenderFinishedSemaphores(SpiritContext context);
+
+// create the descriptor set layout and pool used by the object buffers
+SpiritResult createObjectDescriptors(SpiritContext context);
+
+// create the object storage buffer for a frame
+SpiritResult createObjectBuffer(
+    SpiritContext context, struct t_SpiritObjectBuffer *objectBuffer);
+
+void destroyObjectBuffer(
+    SpiritContext context, struct t_SpiritObjectBuffer *objectBuffer);
+
+// fill the swapchain create info from the context settings, so recreation
+// keeps the chosen present mode
+void fillSwapchainCreateInfo(
+    const SpiritContext context, SpiritSwapchainCreateInfo *swapInfo);
+
+// create a device for the context, and take its window surface
+void createDevice(
+    SpiritContext context, const SpiritContextCreateInfo *createInfo);
+
+// share the device of another context, and make a surface for the window
+SpiritResult createDeviceSurface(SpiritContext context, SpiritDevice device);
+
+// wait for the gpu to finish the last submitted frame
+void waitForPreviousFrame(SpiritContext context);
+
+// wait until the next frame is due
+void limitFrameRate(SpiritContext context);
 
-void destroySyncObjects(SpiritContext context);
+// check if anything changed since the last frame, in render on demand mode
+bool takeChanges(SpiritContext context);
+
+// pass readback copies from frames the gpu has finished to the readback ring,
+// without waiting
+void pollReadback(SpiritContext context);
 
 SpiritResult beginFrame(SpiritContext context, u32 *imageIndex);
 
@@ -27,48 +79,84 @@ SpiritContext spCreateContext(SpiritContextCreateInfo *createInfo)
 
     SpiritContext context = new_var(struct t_SpiritContext);
 
+    context->objectSetLayout = VK_NULL_HANDLE;
+    context->descriptorPool  = VK_NULL_HANDLE;
+    context->maxObjectCount  = createInfo->maxObjectCount
+                                   ? createInfo->maxObjectCount
+                                   : SPIRIT_CONTEXT_DEFAULT_MAX_OBJECTS;
+    context->frames          = NULL;
+    context->frameCount      = createInfo->framesInFlight
+                                   ? createInfo->framesInFlight
+                                   : SPIRIT_CONTEXT_DEFAULT_FRAMES_IN_FLIGHT;
+    context->renderFinishedSemaphores     = NULL;
+    context->renderFinishedSemaphoreCount = 0;
+    context->presentMode                  = createInfo->presentMode;
+    context->powerSaving                  = createInfo->powerSaving;
+    context->limitFrameLatency            = createInfo->limitFrameLatency;
+    context->frameInterval                = 0;
+    context->nextFrameTime                = 0;
+    context->renderOnDemand               = createInfo->renderOnDemand;
+    context->redraw                       = true;
+    context->damageCount                  = 0;
+    context->headless                     = createInfo->headless;
+    context->window                       = NULL;
+    context->surface                      = VK_NULL_HANDLE;
+    context->windowState                  = SPIRIT_WINDOW_NORMAL;
+    context->readback                     = NULL;
+    context->commandPool                  = NULL;
+    context->frameArena                   = NULL;
+    context->deletionQueue                = NULL;
+    context->dynamicResolution            = NULL;
+    context->renderGraph                  = NULL;
+    context->renderGraphBackbuffer        = SPIRIT_RENDER_GRAPH_NONE;
+
+    if (createInfo->maxFrameRate > 0.0f)
+        spContextSetMaxFrameRate(context, createInfo->maxFrameRate);
+    else if (createInfo->powerSaving)
+        spContextSetMaxFrameRate(
+            context, SPIRIT_CONTEXT_POWER_SAVE_FRAME_RATE);
+
     // initialize basic components
     // create window
-    SpiritWindowCreateInfo windowCreateInfo = {};
-    windowCreateInfo.windowSize             = createInfo->windowSize;
-    windowCreateInfo.title                  = createInfo->windowName;
-    windowCreateInfo.fullscreen             = createInfo->windowFullscreen;
-
-    context->window = spCreateWindow(&windowCreateInfo);
-    if (!context->window)
+    if (context->headless)
     {
-        log_fatal("Must have window to create context");
-        spDestroyContext(context);
-        return NULL;
+        context->screenResolution = createInfo->windowSize;
+        context->windowSize       = createInfo->windowSize;
     }
-    context->screenResolution = spWindowGetPixelSize(context->window);
-    context->windowSize       = createInfo->windowSize;
-    db_assert(context->window);
-
-    // create device
-    SpiritDeviceCreateInfo deviceCreateInfo = {};
-    deviceCreateInfo.enableValidation       = createInfo->enableValidation;
-    deviceCreateInfo.powerSaveMode          = createInfo->powerSaving;
-
-    deviceCreateInfo.appName       = "";
-    deviceCreateInfo.appVersion    = VK_MAKE_VERSION(0, 0, 0);
-    deviceCreateInfo.engineName    = "Spirit Render";
-    deviceCreateInfo.engineVersion = VK_MAKE_VERSION(0, 0, 0);
-
-    deviceCreateInfo.windowExtensions = spWindowGetExtensions(context->window);
-    deviceCreateInfo.window           = context->window;
+    else
+    {
+        SpiritWindowCreateInfo windowCreateInfo = {};
+        windowCreateInfo.windowSize             = createInfo->windowSize;
+        windowCreateInfo.title                  = createInfo->windowName;
+        windowCreateInfo.fullscreen = createInfo->windowFullscreen;
 
-    const char *deviceExtensions[] = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+        context->window = spCreateWindow(&windowCreateInfo);
+        if (!context->window)
+        {
+            log_fatal("Must have window to create context");
+            spDestroyContext(context);
+            return NULL;
+        }
+        context->screenResolution = spWindowGetPixelSize(context->window);
+        context->windowSize       = createInfo->windowSize;
+        db_assert(context->window);
+    }
 
-    deviceCreateInfo.requiredDeviceExtensions = deviceExtensions;
-    deviceCreateInfo.requiredDeviceExtensionCount =
-        array_length(deviceExtensions);
+    // share the device of another context, or create one
+    if (createInfo->sharedDevice)
+    {
+        if (createDeviceSurface(context, createInfo->sharedDevice))
+        {
+            log_fatal("Can not share device with context");
+            spDestroyContext(context);
+            return NULL;
+        }
+    }
+    else
+    {
+        createDevice(context, createInfo);
+    }
 
-    const char *deviceLayers[] = {/* "VK_LAYER_LUNARG_assistant_layer", */
-                                  "VK_LAYER_KHRONOS_validation"};
-    deviceCreateInfo.requiredValidationLayers     = deviceLayers;
-    deviceCreateInfo.requiredValidationLayerCount = array_length(deviceLayers);
-    context->device = spCreateDevice(&deviceCreateInfo);
     if (!context->device)
     {
         log_fatal("Must have device to create context");
@@ -76,13 +164,13 @@ SpiritContext spCreateContext(SpiritContextCreateInfo *createInfo)
         return NULL;
     }
 
+    context->deletionQueue = spCreateDeletionQueue();
+
     // create swapchain
     SpiritSwapchainCreateInfo swapCreateInfo = {};
-    context->windowSize      = spWindowGetPixelSize(context->window);
-    swapCreateInfo.windowRes = context->screenResolution;
-
-    swapCreateInfo.selectedPresentMode  = true;
-    swapCreateInfo.preferredPresentMode = VK_PRESENT_MODE_FIFO_KHR;
+    if (!context->headless)
+        context->windowSize = spWindowGetPixelSize(context->window);
+    fillSwapchainCreateInfo(context, &swapCreateInfo);
 
     context->swapchain =
         spCreateSwapchain(&swapCreateInfo, context->device, NULL);
@@ -93,30 +181,69 @@ SpiritContext spCreateContext(SpiritContextCreateInfo *createInfo)
         return NULL;
     }
 
-    // sync objects
-    context->maxImagesInFlight = context->swapchain->imageCount - 1;
-    if (createSyncObjects(context))
+    // before any material, so render passes are made for the targets
+    if (createInfo->dynamicResolution)
     {
-        log_fatal("Failed to create sync objects");
+        SpiritDynamicResolutionCreateInfo dynamicInfo = {
+            .targetFrameTime = createInfo->targetFrameTime,
+            .minScale        = createInfo->minRenderScale};
+
+        if (!(context->swapchain->imageUsage &
+              VK_IMAGE_USAGE_TRANSFER_DST_BIT))
+            log_warning("Swapchain images can not be scaled into, "
+                        "dynamic resolution is disabled");
+        else
+            context->dynamicResolution = spCreateDynamicResolution(
+                context->device,
+                context->swapchain,
+                &dynamicInfo,
+                context->frameCount);
+    }
+
+    // per frame resources
+    if (createObjectDescriptors(context) || createFrames(context))
+    {
+        log_fatal("Failed to create frame resources");
         spDestroyContext(context);
         return NULL;
     }
 
-    // create command buffers
-    context->commandBufferCount = context->swapchain->imageCount;
-    context->commandBuffers =
-        new_array(SpiritCommandBuffer, context->commandBufferCount);
+    SpiritCommandPoolCreateInfo commandPoolInfo = {
+        .queue       = SPIRIT_QUEUE_GRAPHICS,
+        .frameCount  = context->frameCount,
+        .threadCount = createInfo->recordThreadCount,
+    };
+    context->commandPool =
+        spCreateCommandPool(context->device, &commandPoolInfo);
+    if (!context->commandPool)
+    {
+        log_fatal("Failed to create command pools");
+        spDestroyContext(context);
+        return NULL;
+    }
 
-    for (u32 i = 0; i < context->commandBufferCount; ++i)
+    SpiritFrameArenaCreateInfo arenaInfo = {
+        .frameCount = context->frameCount,
+        .cpuSize    = createInfo->frameArenaSize
+                          ? createInfo->frameArenaSize
+                          : SPIRIT_CONTEXT_DEFAULT_FRAME_ARENA_SIZE,
+        .uploadSize = createInfo->uploadArenaSize
+                          ? createInfo->uploadArenaSize
+                          : SPIRIT_CONTEXT_DEFAULT_UPLOAD_ARENA_SIZE,
+    };
+    context->frameArena = spCreateFrameArena(context->device, &arenaInfo);
+    if (!context->frameArena)
     {
-        context->commandBuffers[i] =
-            spCreateCommandBuffer(context->device, true);
-        if (context->commandBuffers[i] == NULL)
-        {
-            log_fatal("Failed to create command buffer");
-            spDestroyContext(context);
-            return NULL;
-        }
+        log_fatal("Failed to create frame arena");
+        spDestroyContext(context);
+        return NULL;
+    }
+
+    if (!context->headless && createRenderFinishedSemaphores(context))
+    {
+        log_fatal("Failed to create sync objects");
+        spDestroyContext(context);
+        return NULL;
     }
 
     LIST_INIT(&context->materials);
@@ -133,25 +260,72 @@ SpiritResult spContextHandleWindowResized(SpiritContext context)
     if (!context && context->window)
         return SPIRIT_FAILURE;
 
-    // recreate swapchain
-    spDeviceWaitIdle(context->device);
+    context->redraw = true;
 
-    // update stored sizes
-    context->screenResolution = spWindowGetPixelSize(context->window);
-    context->windowSize       = spWindowGetSize(context->window);
+    // update stored sizes, a headless context keeps its resolution
+    if (!context->headless)
+    {
+        context->screenResolution = spWindowGetPixelSize(context->window);
+        context->windowSize       = spWindowGetSize(context->window);
+    }
 
     // check swapchain exists, in case creation failed last frame
     SpiritSwapchainCreateInfo swapInfo = {};
-    swapInfo.windowRes                 = context->screenResolution;
+    fillSwapchainCreateInfo(context, &swapInfo);
 
+    // frames in flight keep rendering to the old swapchain, it is retired
+    // rather than destroyed, even if the new one could not be created
+    SpiritSwapchain oldSwapchain = context->swapchain;
     context->swapchain =
-        spCreateSwapchain(&swapInfo, context->device, context->swapchain);
+        spCreateSwapchain(&swapInfo, context->device, oldSwapchain);
+    if (oldSwapchain)
+        spRetireSwapchain(
+            context->device, oldSwapchain, context->deletionQueue);
 
     if (!context->swapchain)
     {
         return SPIRIT_FAILURE;
     }
 
+    // without render targets frames must render to the swapchain directly,
+    // so dynamic resolution is turned off rather than left half made. The
+    // materials are updated below, which remakes their render passes to leave
+    // the swapchain images ready to present.
+    if (context->dynamicResolution &&
+        spDynamicResolutionResize(
+            context->device,
+            context->dynamicResolution,
+            context->swapchain,
+            context->deletionQueue))
+    {
+        log_warning(
+            "Failed to resize render targets, dynamic resolution has been "
+            "disabled");
+        spDeviceWaitIdle(context->device);
+        spDestroyDynamicResolution(
+            context->device, context->dynamicResolution);
+        context->dynamicResolution = NULL;
+    }
+
+    // presents to the old swapchain may still wait on the semaphores, so new
+    // ones are made even if the image count is the same
+    if (!context->headless)
+    {
+        destroyRenderFinishedSemaphores(context);
+        if (createRenderFinishedSemaphores(context))
+            return SPIRIT_FAILURE;
+    }
+
+    // the readback buffers are sized for the old images. This is the only part
+    // of a resize that waits for the device.
+    if (context->readback)
+    {
+        SpiritReadbackCreateInfo readbackInfo = context->readback->createInfo;
+        spContextDisableReadback(context);
+        if (spContextEnableReadback(context, &readbackInfo))
+            log_warning("Failed to recreate readback, it has been disabled");
+    }
+
     // iterate through materials
     struct t_ContextMaterialListNode *np;
     LIST_FOREACH(np, &context->materials, data)
@@ -164,6 +338,10 @@ SpiritResult spContextHandleWindowResized(SpiritContext context)
 
 SpiritResult spContextSubmitFrame(SpiritContext context)
 {
+    // nothing can be presented, see spContextPollEvents
+    if (context->windowState == SPIRIT_WINDOW_MINIMIZED)
+        return SPIRIT_SUCCESS;
+
     // if failed to create swapchain last frame, try again now
     if (!context->swapchain)
     {
@@ -174,6 +352,17 @@ SpiritResult spContextSubmitFrame(SpiritContext context)
         }
     }
 
+    // nothing changed, keep the image on screen
+    if (context->renderOnDemand && !takeChanges(context))
+    {
+        struct t_ContextMaterialListNode *np;
+        LIST_FOREACH(np, &context->materials, data)
+        {
+            spMaterialDiscardMeshes(np->material);
+        }
+        return SPIRIT_SUCCESS;
+    }
+
     u32 imageIndex;
     SpiritResult result;
     time_function_with_return(beginFrame(context, &imageIndex), result);
@@ -202,6 +391,39 @@ SpiritResult spContextSubmitFrame(SpiritContext context)
         }
     }
 
+    if (context->renderGraph)
+    {
+        struct t_SpiritFrame *frame = spContextGetCurrentFrame(context);
+        const bool usesBackbuffer =
+            context->renderGraphBackbuffer != SPIRIT_RENDER_GRAPH_NONE;
+        SpiritImage *backbuffer =
+            context->swapchain->renderTargets
+                ? &context->swapchain->renderTargets[imageIndex]
+                : &context->swapchain->images[imageIndex];
+        if (usesBackbuffer)
+        {
+            spRenderGraphSetImage(
+                context->renderGraph,
+                context->renderGraphBackbuffer,
+                backbuffer);
+
+            // no material drew to the image, so it is not in the layout the
+            // graph expects and holds nothing worth keeping
+            spRenderGraphDiscardImage(
+                context->renderGraph,
+                context->renderGraphBackbuffer,
+                !frame->imageWritten);
+        }
+
+        time_function_with_return(
+            spRenderGraphExecute(context->renderGraph, frame->commandBuffer),
+            result);
+        if (result)
+            log_error("Render graph failed to record commands");
+        else if (usesBackbuffer)
+            frame->imageWritten = true;
+    }
+
     time_function_with_return(endFrame(context, imageIndex), result);
     if (result)
     {
@@ -209,12 +431,153 @@ SpiritResult spContextSubmitFrame(SpiritContext context)
         return SPIRIT_FAILURE;
     }
 
+    context->redraw      = false;
+    context->damageCount = 0;
+
     return SPIRIT_SUCCESS;
 }
 
+void spContextRequestRedraw(SpiritContext context)
+{
+    context->redraw = true;
+}
+
+void spContextAddDamage(SpiritContext context, const VkRect2D *rect)
+{
+    // too many to describe, so present all of it
+    if (context->damageCount == SPIRIT_CONTEXT_MAX_DAMAGE_RECTS)
+    {
+        context->redraw = true;
+        return;
+    }
+
+    context->damage[context->damageCount++] = (VkRectLayerKHR){
+        .offset = rect->offset, .extent = rect->extent, .layer = 0};
+}
+
+SpiritResult
+spContextSetPresentMode(SpiritContext context, SpiritPresentMode presentMode)
+{
+    context->presentMode = presentMode;
+    return spContextHandleWindowResized(context);
+}
+
+SpiritPresentMode spContextGetPresentMode(const SpiritContext context)
+{
+    if (!context->swapchain)
+        return context->presentMode;
+
+    switch (context->swapchain->presentMode)
+    {
+    case VK_PRESENT_MODE_MAILBOX_KHR: return SPIRIT_PRESENT_MODE_MAILBOX;
+    case VK_PRESENT_MODE_IMMEDIATE_KHR: return SPIRIT_PRESENT_MODE_IMMEDIATE;
+    default: return SPIRIT_PRESENT_MODE_VSYNC;
+    }
+}
+
+void spContextSetFrameLatencyLimit(SpiritContext context, bool enable)
+{
+    context->limitFrameLatency = enable;
+}
+
+void spContextSetMaxFrameRate(SpiritContext context, f32 frameRate)
+{
+    context->frameInterval =
+        frameRate > 0.0f ? (u64)(1000000000.0 / frameRate) : 0;
+    context->nextFrameTime = 0;
+}
+
+f32 spContextGetRenderScale(const SpiritContext context)
+{
+    if (!context->dynamicResolution)
+        return 1.0f;
+    return spDynamicResolutionGetScale(context->dynamicResolution);
+}
+
+void spContextSetRenderGraph(
+    SpiritContext context,
+    SpiritRenderGraph graph,
+    const SpiritRenderGraphResource backbuffer)
+{
+    context->renderGraph           = graph;
+    context->renderGraphBackbuffer = graph ? backbuffer
+                                           : SPIRIT_RENDER_GRAPH_NONE;
+    context->redraw                = true;
+}
+
+SpiritResult spContextEnableReadback(
+    SpiritContext context, const SpiritReadbackCreateInfo *createInfo)
+{
+    if (!context->swapchain ||
+        !(context->swapchain->imageUsage & VK_IMAGE_USAGE_TRANSFER_SRC_BIT))
+    {
+        log_error("Swapchain images do not support readback");
+        return SPIRIT_FAILURE;
+    }
+
+    if (context->readback)
+        spContextDisableReadback(context);
+
+    context->readback = spCreateReadback(
+        context->device, context->swapchain, createInfo, context->frameCount);
+
+    return context->readback ? SPIRIT_SUCCESS : SPIRIT_FAILURE;
+}
+
+void spContextDisableReadback(SpiritContext context)
+{
+    if (!context->readback)
+        return;
+
+    // pending copies may still be writing the buffers
+    spDeviceWaitIdle(context->device);
+
+    spDestroyReadback(context->device, context->readback);
+    context->readback = NULL;
+}
+
+SpiritResult
+spContextAcquireReadback(SpiritContext context, SpiritReadbackFrame *frame)
+{
+    if (!context->readback)
+        return SPIRIT_FAILURE;
+
+    pollReadback(context);
+
+    return spReadbackAcquire(context->readback, frame);
+}
+
+void spContextReleaseReadback(
+    SpiritContext context, const SpiritReadbackFrame *frame)
+{
+    if (context->readback)
+        spReadbackRelease(context->readback, frame);
+}
+
 SpiritWindowState spContextPollEvents(SpiritContext context)
 {
+    limitFrameRate(context);
+
+    // sample input as late as possible, once the last frame is done
+    if (context->limitFrameLatency)
+        waitForPreviousFrame(context);
+
+    // there are no events without a window
+    if (context->headless)
+        return SPIRIT_WINDOW_NORMAL;
+
     context->windowState = spWindowGetState(context->window);
+
+    // nothing is rendered while minimized, so sleep until something happens
+    // to the window instead of spinning. Other windows keep running.
+    while (context->windowState == SPIRIT_WINDOW_MINIMIZED &&
+           spWindowGetOpenCount() == 1)
+    {
+        context->windowState   = spWindowWaitState(context->window);
+        context->nextFrameTime = 0;
+        context->redraw        = true;
+    }
+
     switch (context->windowState)
     {
     case SPIRIT_WINDOW_NORMAL:
@@ -229,6 +592,33 @@ SpiritWindowState spContextPollEvents(SpiritContext context)
     }
 }
 
+struct t_SpiritFrame *spContextGetCurrentFrame(const SpiritContext context)
+{
+    return &context->frames[context->currentFrame];
+}
+
+SpiritObjectData *spContextReserveObjects(
+    SpiritContext context, const u32 count, u32 *objectBase)
+{
+    struct t_SpiritObjectBuffer *objectBuffer =
+        &spContextGetCurrentFrame(context)->objectBuffer;
+
+    if (count > context->maxObjectCount - objectBuffer->objectCount)
+    {
+        log_warning(
+            "Object buffer full, increase SpiritContextCreateInfo."
+            "maxObjectCount (%u)",
+            context->maxObjectCount);
+        return NULL;
+    }
+
+    *objectBase = objectBuffer->objectCount;
+    objectBuffer->objectCount += count;
+
+    return SPIRIT_BUFFER_AT(
+        &objectBuffer->buffer, SpiritObjectData, *objectBase);
+}
+
 inline SpiritWindowState spContextGetWindowState(const SpiritContext context)
 {
     return context->windowState;
@@ -269,6 +659,7 @@ spContextAddMaterial(SpiritContext context, const SpiritMaterial material)
     LIST_INSERT_HEAD(&context->materials, node, data);
 
     ++context->materialCount;
+    context->redraw = true;
 
     return SPIRIT_SUCCESS;
 }
@@ -285,6 +676,7 @@ spContextRemoveMaterial(SpiritContext context, const SpiritMaterial material)
             LIST_REMOVE(np, data);
             free(np);
             --context->materialCount;
+            context->redraw = true;
             return SPIRIT_SUCCESS;
         }
     }
@@ -305,31 +697,33 @@ SpiritResult spDestroyContext(SpiritContext context)
         free(op);
     }
 
-    destroySyncObjects(context);
+    spContextDisableReadback(context);
+    destroyFrames(context);
+    destroyRenderFinishedSemaphores(context);
 
-    for (u32 i = 0; context->commandBuffers && i < context->commandBufferCount;
-         ++i)
+    if (context->dynamicResolution)
     {
-        SpiritCommandBuffer buf = context->commandBuffers[i];
-        if (buf)
-        {
-            if (buf->state == SPIRIT_COMMAND_BUFFER_STATE_BUSY)
-                spCommandBufferWait(context->device, buf, UINT32_MAX);
-            else if (buf->state == SPIRIT_COMMAND_BUFFER_STATE_RECORDING)
-                spCommandBufferEnd(buf);
-
-            spDestroyCommandBuffer(context->device, buf);
-        }
+        spDeviceWaitIdle(context->device);
+        spDestroyDynamicResolution(
+            context->device, context->dynamicResolution);
     }
 
     context->swapchain &&spDestroySwapchain(
         context->swapchain, context->device);
     log_debug("Destroyed swapchain");
+
+    if (context->deletionQueue)
+    {
+        spDeviceWaitIdle(context->device);
+        spDestroyDeletionQueue(context->device, context->deletionQueue);
+    }
+    // before the device, it may destroy the instance
+    if (context->surface && context->device)
+        vkDestroySurfaceKHR(
+            context->device->instance, context->surface, ALLOCATION_CALLBACK);
     context->device &&spDestroyDevice(context->device);
     context->window &&spDestroyWindow(context->window);
 
-    free(context->commandBuffers);
-
     free(context);
 
     return SPIRIT_SUCCESS;
@@ -341,37 +735,94 @@ SpiritResult spDestroyContext(SpiritContext context)
 
 SpiritResult beginFrame(SpiritContext context, u32 *imageIndex)
 {
+    struct t_SpiritFrame *frame = spContextGetCurrentFrame(context);
+
+    // wait for the gpu to finish the last frame that used these resources. A
+    // frame that was never recorded has no command buffer yet.
+    if (frame->commandBuffer &&
+        spCommandBufferWait(context->device, frame->commandBuffer, UINT64_MAX))
+        return SPIRIT_FAILURE;
+
+    // the buffers recorded for it can be reused. The rendering thread is
+    // thread 0 of the pool, and its first primary buffer is the frame's, so
+    // it is the same buffer every time the frame comes around.
+    spCommandPoolBeginFrame(
+        context->device, context->commandPool, context->currentFrame);
+    frame->commandBuffer = spCommandPoolGetBuffer(
+        context->device, context->commandPool, 0, true);
+    if (!frame->commandBuffer)
+        return SPIRIT_FAILURE;
+    SpiritCommandBuffer buf = frame->commandBuffer;
+    spFrameArenaBeginFrame(context->frameArena, context->currentFrame);
+
+    // so any copies it made are finished
+    if (context->readback)
+        spReadbackRetireFrame(context->readback, context->currentFrame);
+
+    // frames complete in submission order, so everything up to this one is
+    // done with the resources that were replaced before it
+    spDeletionQueueFlush(context->device, context->deletionQueue);
+
+    // memory freed above counts against the heaps now, so allocations this
+    // frame see how much is really left
+    spDeviceUpdateMemoryBudget(context->device);
+
+    // pick the render resolution from how long this frame took. The old
+    // framebuffers are safe to replace, frames using them hold them in the
+    // deletion queue.
+    if (context->dynamicResolution &&
+        spDynamicResolutionUpdate(
+            context->device,
+            context->dynamicResolution,
+            context->swapchain,
+            context->currentFrame))
+    {
+        struct t_ContextMaterialListNode *np;
+        LIST_FOREACH(np, &context->materials, data)
+        {
+            spMaterialUpdate(context, np->material);
+        }
+    }
 
     // aquire image
     if (spSwapchainAquireNextImage(
             context->device,
             context->swapchain,
-            context->imageAvailableSemaphores[context->currentFrame],
+            frame->imageAvailable,
             imageIndex))
         return SPIRIT_FAILURE;
 
-    // if the imageInFlight fence is not null, wait for it to complete
-    if (spCommandBufferWait(
-            context->device, context->commandBuffers[*imageIndex], UINT64_MAX))
-        return SPIRIT_FAILURE;
-
-    SpiritCommandBuffer buf = context->commandBuffers[*imageIndex];
+    // the gpu is done with this frames object buffer
+    frame->objectBuffer.objectCount = 0;
+    frame->imageWritten             = false;
 
     spCommandBufferBegin(buf);
 
+    // take ownership of buffers uploaded on the transfer queue
+    frame->transferWait = spDeviceRecordAcquires(context->device, buf->handle);
+
+    SpiritResolution resolution = context->screenResolution;
+    if (context->dynamicResolution)
+    {
+        spDynamicResolutionBeginFrame(
+            context->dynamicResolution, buf, context->currentFrame);
+        resolution =
+            spDynamicResolutionGetResolution(context->dynamicResolution);
+    }
+
     // Dynamic state
     VkViewport viewport = {
         .x        = 0.0f,
-        .y        = (f32)context->screenResolution.h,
-        .width    = (f32)context->screenResolution.w,
-        .height   = -(f32)context->screenResolution.h,
+        .y        = (f32)resolution.h,
+        .width    = (f32)resolution.w,
+        .height   = -(f32)resolution.h,
         .minDepth = 0.0f,
         .maxDepth = 1.0f};
 
     VkRect2D scissor = {
         .offset.x = scissor.offset.y = 0,
-        .extent.width                = context->screenResolution.w,
-        .extent.height               = context->screenResolution.h};
+        .extent.width                = resolution.w,
+        .extent.height               = resolution.h};
 
     vkCmdSetViewport(buf->handle, 0, 1, &viewport);
     vkCmdSetScissor(buf->handle, 0, 1, &scissor);
@@ -382,83 +833,345 @@ SpiritResult beginFrame(SpiritContext context, u32 *imageIndex)
 SpiritResult endFrame(SpiritContext context, const u32 imageIndex)
 {
 
-    SpiritCommandBuffer buf = context->commandBuffers[imageIndex];
-    const u32 currentFrame  = context->currentFrame;
+    struct t_SpiritFrame *frame = spContextGetCurrentFrame(context);
+    SpiritCommandBuffer buf     = frame->commandBuffer;
+
+    // headless frames are not acquired or presented, so only the fence is
+    // needed
+    VkSemaphore imageAvailable = VK_NULL_HANDLE;
+    VkSemaphore renderFinished = VK_NULL_HANDLE;
+    if (!context->headless)
+    {
+        imageAvailable = frame->imageAvailable;
+        renderFinished = context->renderFinishedSemaphores[imageIndex];
+    }
+
+    // scale the render target up to the swapchain image
+    if (context->dynamicResolution)
+    {
+        spDynamicResolutionEndFrame(
+            context->dynamicResolution,
+            buf,
+            context->swapchain,
+            imageIndex,
+            context->currentFrame,
+            frame->imageWritten);
+    }
+
+    // copy the image out, unless nothing rendered to it this frame and its
+    // contents are undefined
+    if (context->readback && frame->imageWritten)
+    {
+        spReadbackRecordCopy(
+            context->readback,
+            buf,
+            &context->swapchain->images[imageIndex],
+            context->headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+                              : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+            context->currentFrame);
+    }
 
     spCommandBufferEnd(buf);
 
-    VkPipelineStageFlags waitStages =
-        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    // meshes are drawn once their uploads finish, without the cpu waiting
+    const SpiritSyncPoint transferWait = {
+        .queue = SPIRIT_QUEUE_TRANSFER, .value = frame->transferWait};
+    const SpiritSubmitInfo submitInfo = {
+        .waitSemaphore   = imageAvailable,
+        .waitStage       = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        .signalSemaphore = renderFinished,
+        .waits           = &transferWait,
+        .waitCount       = frame->transferWait ? 1 : 0,
+        .waitPointStage  = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT};
 
     // submit command buffer
-    if (spCommandBufferSubmit(
-            context->device,
-            buf,
-            context->imageAvailableSemaphores[currentFrame],
-            context->queueCompleteSemaphores[currentFrame],
-            &waitStages))
+    if (spCommandBufferSubmitWithInfo(context->device, buf, &submitInfo))
     {
         log_fatal("Failed to submit command buffer");
         return SPIRIT_FAILURE;
     }
+    spDeletionQueueSubmit(context->deletionQueue, buf->submitValue);
 
-    // present image
+    // present image, or only the damaged parts if that is all that changed
+    const bool partial =
+        context->renderOnDemand && !context->redraw && context->damageCount;
     if (spSwapchainPresent(
             context->device,
             context->swapchain,
-            context->queueCompleteSemaphores[currentFrame],
-            imageIndex))
+            renderFinished,
+            imageIndex,
+            partial ? context->damage : NULL,
+            partial ? context->damageCount : 0))
     {
         log_error("Failed to present image");
         return SPIRIT_FAILURE;
     };
 
-    // increment current image
-    context->currentFrame = (currentFrame + 1) % context->maxImagesInFlight;
+    // move to the next frame
+    context->currentFrame = (context->currentFrame + 1) % context->frameCount;
+
+    return SPIRIT_SUCCESS;
+}
+
+void createDevice(
+    SpiritContext context, const SpiritContextCreateInfo *createInfo)
+{
+    SpiritDeviceCreateInfo deviceCreateInfo = {};
+    deviceCreateInfo.enableValidation       = createInfo->enableValidation;
+    deviceCreateInfo.powerSaveMode          = createInfo->powerSaving;
+
+    deviceCreateInfo.appName       = "";
+    deviceCreateInfo.appVersion    = VK_MAKE_VERSION(0, 0, 0);
+    deviceCreateInfo.engineName    = "Spirit Render";
+    deviceCreateInfo.engineVersion = VK_MAKE_VERSION(0, 0, 0);
+
+    deviceCreateInfo.headless = context->headless;
+    deviceCreateInfo.window   = context->window;
+    if (!context->headless)
+        deviceCreateInfo.windowExtensions =
+            spWindowGetExtensions(context->window);
+
+    const char *deviceExtensions[] = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+
+    // nothing is presented without a window
+    deviceCreateInfo.requiredDeviceExtensions = deviceExtensions;
+    deviceCreateInfo.requiredDeviceExtensionCount =
+        context->headless ? 0 : array_length(deviceExtensions);
+
+    const char *deviceLayers[] = {/* "VK_LAYER_LUNARG_assistant_layer", */
+                                  "VK_LAYER_KHRONOS_validation"};
+    deviceCreateInfo.requiredValidationLayers     = deviceLayers;
+    deviceCreateInfo.requiredValidationLayerCount = array_length(deviceLayers);
+    context->device  = spCreateDevice(&deviceCreateInfo);
+    context->surface = deviceCreateInfo.windowSurface;
+}
+
+SpiritResult createDeviceSurface(SpiritContext context, SpiritDevice device)
+{
+    // the device was made without VK_KHR_swapchain
+    if (!context->headless && device->headless)
+    {
+        log_error("A window context can not share a headless device");
+        return SPIRIT_FAILURE;
+    }
+
+    context->device = spDeviceRetain(device);
+    if (context->headless)
+        return SPIRIT_SUCCESS;
+
+    context->surface =
+        spWindowGetSurface(context->window, context->device->instance);
+    if (!spDeviceSupportsSurface(context->device, context->surface))
+    {
+        log_error("The shared device can not present to the window");
+        return SPIRIT_FAILURE;
+    }
+
+    return SPIRIT_SUCCESS;
+}
+
+void fillSwapchainCreateInfo(
+    const SpiritContext context, SpiritSwapchainCreateInfo *swapInfo)
+{
+    swapInfo->windowRes           = context->screenResolution;
+    swapInfo->surface             = context->surface;
+    swapInfo->frameCount          = context->frameCount;
+    swapInfo->selectedPresentMode = true;
+
+    // the context decides rather than the device, which may be shared with a
+    // context that does not save power
+    if (context->powerSaving)
+    {
+        swapInfo->preferredPresentMode = VK_PRESENT_MODE_FIFO_KHR;
+        return;
+    }
+
+    switch (context->presentMode)
+    {
+    case SPIRIT_PRESENT_MODE_MAILBOX:
+        swapInfo->preferredPresentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+        break;
+    case SPIRIT_PRESENT_MODE_IMMEDIATE:
+        swapInfo->preferredPresentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+        break;
+    default: swapInfo->preferredPresentMode = VK_PRESENT_MODE_FIFO_KHR; break;
+    }
+}
+
+void waitForPreviousFrame(SpiritContext context)
+{
+    const u32 previousFrame =
+        (context->currentFrame + context->frameCount - 1) %
+        context->frameCount;
+
+    SpiritCommandBuffer buf = context->frames[previousFrame].commandBuffer;
+    if (buf)
+        spCommandBufferWait(context->device, buf, UINT64_MAX);
+}
+
+void limitFrameRate(SpiritContext context)
+{
+    if (!context->frameInterval)
+        return;
+
+    u64 now = spPlatformGetNanoseconds();
+
+    // more than a frame behind, or the first frame. Start the cadence again
+    // rather than running frames back to back to catch up.
+    if (now >= context->nextFrameTime + context->frameInterval)
+    {
+        context->nextFrameTime = now + context->frameInterval;
+        return;
+    }
+
+    // the scheduler wakes threads late, so sleep through most of the
+    // interval and spin through the rest
+    const u64 deadline = context->nextFrameTime;
+    if (now + FRAME_LIMIT_SPIN_TIME < deadline)
+        spPlatformSleepUntil(deadline - FRAME_LIMIT_SPIN_TIME);
+
+    while (now < deadline)
+    {
+        spPlatformYieldThread();
+        now = spPlatformGetNanoseconds();
+    }
+
+    // from the deadline, so frames do not drift by the time spent waking up
+    context->nextFrameTime = deadline + context->frameInterval;
+}
+
+bool takeChanges(SpiritContext context)
+{
+    if (context->window && spWindowTakeRefresh(context->window))
+        context->redraw = true;
+
+    // every material is checked, so each one remembers this frame
+    struct t_ContextMaterialListNode *np;
+    LIST_FOREACH(np, &context->materials, data)
+    {
+        if (spMaterialTakeChanges(np->material))
+            context->redraw = true;
+    }
+
+    return context->redraw || context->damageCount;
+}
+
+void pollReadback(SpiritContext context)
+{
+    for (u32 i = 0; i < context->frameCount; i++)
+    {
+        SpiritCommandBuffer buf = context->frames[i].commandBuffer;
+        if (buf && buf->state == SPIRIT_COMMAND_BUFFER_STATE_BUSY &&
+            spTimelineReached(
+                context->device, spCommandBufferGetSyncPoint(buf)))
+        {
+            spReadbackRetireFrame(context->readback, i);
+        }
+    }
+}
+
+SpiritResult createFrames(SpiritContext context)
+{
+    const u32 frameCount = context->frameCount;
+    db_assert_msg(frameCount > 0, "Must have at least one frame in flight");
+
+    context->frames = new_array(struct t_SpiritFrame, frameCount);
+    memset(context->frames, 0, sizeof(struct t_SpiritFrame) * frameCount);
+
+    for (u32 i = 0; i < frameCount; i++)
+    {
+        struct t_SpiritFrame *frame = &context->frames[i];
+
+        // taken from the context command pool when the frame begins
+        frame->imageWritten  = false;
+        frame->transferWait  = 0;
+        frame->commandBuffer = NULL;
+
+        frame->imageAvailable = spSyncPoolGetSemaphore(context->device);
+        if (!frame->imageAvailable)
+        {
+            log_error("Failed to create syncronization objects");
+            return SPIRIT_FAILURE;
+        }
+
+        if (createObjectBuffer(context, &frame->objectBuffer))
+            return SPIRIT_FAILURE;
+    }
 
     return SPIRIT_SUCCESS;
 }
 
-SpiritResult createSyncObjects(SpiritContext context)
+void destroyFrames(SpiritContext context)
+{
+    if (context->frames)
+    {
+        for (u32 i = 0; i < context->frameCount; i++)
+        {
+            struct t_SpiritFrame *frame = &context->frames[i];
+
+            // the buffer belongs to the command pool, destroyed below
+            SpiritCommandBuffer buf = frame->commandBuffer;
+            if (buf && buf->state == SPIRIT_COMMAND_BUFFER_STATE_BUSY)
+                spCommandBufferWait(context->device, buf, UINT64_MAX);
+
+            if (frame->imageAvailable)
+                spSyncPoolReleaseSemaphore(
+                    context->device, frame->imageAvailable);
+
+            destroyObjectBuffer(context, &frame->objectBuffer);
+        }
+
+        free(context->frames);
+        context->frames = NULL;
+    }
+
+    // after waiting for every frame, so none of its buffers are in use
+    if (context->commandPool)
+    {
+        spDestroyCommandPool(context->device, context->commandPool);
+        context->commandPool = NULL;
+    }
+
+    // and none of them reads the upload ring
+    if (context->frameArena)
+    {
+        spDestroyFrameArena(context->device, context->frameArena);
+        context->frameArena = NULL;
+    }
+
+    // destroying the pool frees the sets
+    if (context->descriptorPool)
+        vkDestroyDescriptorPool(
+            context->device->device,
+            context->descriptorPool,
+            ALLOCATION_CALLBACK);
+    if (context->objectSetLayout)
+        vkDestroyDescriptorSetLayout(
+            context->device->device,
+            context->objectSetLayout,
+            ALLOCATION_CALLBACK);
+}
+
+SpiritResult createRenderFinishedSemaphores(SpiritContext context)
 {
 
     db_assert_msg(context->swapchain, "Context must have swapchain");
 
-    const u32 imagesInFlight = context->maxImagesInFlight;
-    db_assert_msg(
-        imagesInFlight < 10, "Images in flight should not be more then 10")
-        const u32 imageCount = context->swapchain->imageCount;
+    const u32 imageCount = context->swapchain->imageCount;
     db_assert_msg(imageCount < 11, "Image count should not be more then 10");
-    db_assert_msg(
-        imagesInFlight == imageCount - 1,
-        "Images in flight should be imageCount - 1");
-
-    context->imageAvailableSemaphores = new_array(VkSemaphore, imagesInFlight);
-    context->queueCompleteSemaphores  = new_array(VkSemaphore, imagesInFlight);
-
-    VkSemaphoreCreateInfo semaphoreInfo = {
-        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
-        .flags = 0,
-        .pNext = 0};
-
-    for (size_t i = 0; i < imagesInFlight; i++)
-    {
-
-        bool failure = false;
-        if (vkCreateSemaphore(
-                context->device->device,
-                &semaphoreInfo,
-                NULL,
-                &context->imageAvailableSemaphores[i]))
-            failure = true;
-        if (vkCreateSemaphore(
-                context->device->device,
-                &semaphoreInfo,
-                NULL,
-                &context->queueCompleteSemaphores[i]))
-            failure = true;
-
-        if (failure)
+
+    context->renderFinishedSemaphores = new_array(VkSemaphore, imageCount);
+    memset(
+        context->renderFinishedSemaphores,
+        0,
+        sizeof(VkSemaphore) * imageCount);
+    context->renderFinishedSemaphoreCount = imageCount;
+
+    for (u32 i = 0; i < imageCount; i++)
+    {
+        context->renderFinishedSemaphores[i] =
+            spSyncPoolGetSemaphore(context->device);
+        if (!context->renderFinishedSemaphores[i])
         {
             log_error("Failed to create syncronization objects");
             return SPIRIT_FAILURE;
@@ -468,26 +1181,127 @@ SpiritResult createSyncObjects(SpiritContext context)
     return SPIRIT_SUCCESS;
 }
 
-void destroySyncObjects(SpiritContext context)
+void destroyRenderFinishedSemaphores(SpiritContext context)
+{
+    if (!context->renderFinishedSemaphores)
+        return;
+
+    // a present may still be waiting on them
+    for (u32 i = 0; i < context->renderFinishedSemaphoreCount; i++)
+    {
+        spDeletionQueuePushSemaphore(
+            context->deletionQueue, context->renderFinishedSemaphores[i]);
+    }
+
+    free(context->renderFinishedSemaphores);
+    context->renderFinishedSemaphores     = NULL;
+    context->renderFinishedSemaphoreCount = 0;
+}
+
+SpiritResult createObjectDescriptors(SpiritContext context)
+{
+    const u32 setCount = context->frameCount;
+
+    // layout, a single storage buffer read by the vertex shader
+    VkDescriptorSetLayoutBinding binding = {
+        .binding            = 0,
+        .descriptorType     = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .descriptorCount    = 1,
+        .stageFlags         = VK_SHADER_STAGE_VERTEX_BIT,
+        .pImmutableSamplers = NULL};
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {
+        .sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = 1,
+        .pBindings    = &binding};
+
+    if (vkCreateDescriptorSetLayout(
+            context->device->device,
+            &layoutInfo,
+            ALLOCATION_CALLBACK,
+            &context->objectSetLayout))
+    {
+        log_error("Failed to create object descriptor set layout");
+        return SPIRIT_FAILURE;
+    }
+
+    VkDescriptorPoolSize poolSize = {
+        .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = setCount};
+
+    VkDescriptorPoolCreateInfo poolInfo = {
+        .sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .maxSets       = setCount,
+        .poolSizeCount = 1,
+        .pPoolSizes    = &poolSize};
+
+    if (vkCreateDescriptorPool(
+            context->device->device,
+            &poolInfo,
+            ALLOCATION_CALLBACK,
+            &context->descriptorPool))
+    {
+        log_error("Failed to create descriptor pool");
+        return SPIRIT_FAILURE;
+    }
+
+    return SPIRIT_SUCCESS;
+}
+
+SpiritResult createObjectBuffer(
+    SpiritContext context, struct t_SpiritObjectBuffer *objectBuffer)
 {
-    for (u32 i = 0; i < context->maxImagesInFlight; i++)
+    const VkDeviceSize bufferSize =
+        sizeof(SpiritObjectData) * context->maxObjectCount;
+
+    const SpiritBufferCreateInfo createInfo = {
+        .size  = bufferSize,
+        .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        .memoryFlags =
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT};
+
+    if (spCreateBuffer(context->device, &createInfo, &objectBuffer->buffer))
     {
-        if (context->queueCompleteSemaphores &&
-            context->queueCompleteSemaphores[i])
-            vkDestroySemaphore(
-                context->device->device,
-                context->queueCompleteSemaphores[i],
-                ALLOCATION_CALLBACK);
-        if (context->imageAvailableSemaphores &&
-            context->imageAvailableSemaphores[i])
-            vkDestroySemaphore(
-                context->device->device,
-                context->imageAvailableSemaphores[i],
-                NULL);
+        log_error("Failed to create object buffer");
+        return SPIRIT_FAILURE;
     }
 
-    if (context->imageAvailableSemaphores)
-        free(context->imageAvailableSemaphores);
-    if (context->queueCompleteSemaphores)
-        free(context->queueCompleteSemaphores);
+    VkDescriptorSetAllocateInfo allocInfo = {
+        .sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool     = context->descriptorPool,
+        .descriptorSetCount = 1,
+        .pSetLayouts        = &context->objectSetLayout};
+
+    if (vkAllocateDescriptorSets(
+            context->device->device, &allocInfo, &objectBuffer->descriptorSet))
+    {
+        log_error("Failed to allocate object descriptor set");
+        return SPIRIT_FAILURE;
+    }
+
+    VkDescriptorBufferInfo bufferInfo = {
+        .buffer = objectBuffer->buffer.buffer,
+        .offset = 0,
+        .range  = bufferSize};
+
+    VkWriteDescriptorSet write = {
+        .sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet          = objectBuffer->descriptorSet,
+        .dstBinding      = 0,
+        .dstArrayElement = 0,
+        .descriptorCount = 1,
+        .descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pBufferInfo     = &bufferInfo};
+
+    vkUpdateDescriptorSets(context->device->device, 1, &write, 0, NULL);
+
+    objectBuffer->objectCount = 0;
+
+    return SPIRIT_SUCCESS;
+}
+
+void destroyObjectBuffer(
+    SpiritContext context, struct t_SpiritObjectBuffer *objectBuffer)
+{
+    spDestroyBuffer(context->device, &objectBuffer->buffer);
 }
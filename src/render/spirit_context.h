@@ -1,4 +1,8 @@
 #pragma once
+#include "spirit_dynamic_resolution.h"
+#include "spirit_frame_arena.h"
+#include "spirit_readback.h"
+#include "spirit_render_graph.h"
 #include "spirit_window.h"
 #include <spirit_header.h>
 
@@ -8,17 +12,63 @@
 
 // include components
 
+// the number of objects that can be drawn each frame when
+// SpiritContextCreateInfo.maxObjectCount is 0
+#define SPIRIT_CONTEXT_DEFAULT_MAX_OBJECTS 4096
+
+// the number of frames the cpu can record ahead of the gpu when
+// SpiritContextCreateInfo.framesInFlight is 0
+#define SPIRIT_CONTEXT_DEFAULT_FRAMES_IN_FLIGHT 2
+
+// the frame rate limit when SpiritContextCreateInfo.powerSaving is set and
+// maxFrameRate is 0
+#define SPIRIT_CONTEXT_POWER_SAVE_FRAME_RATE 30
+
+// bytes of the frame arena each frame, for transient cpu data and uploads,
+// when SpiritContextCreateInfo.frameArenaSize or uploadArenaSize is 0
+#define SPIRIT_CONTEXT_DEFAULT_FRAME_ARENA_SIZE (1 << 20)
+#define SPIRIT_CONTEXT_DEFAULT_UPLOAD_ARENA_SIZE (4 << 20)
+
+// damaged rectangles kept for a frame, see spContextAddDamage. More than this
+// redraws the whole image.
+#define SPIRIT_CONTEXT_MAX_DAMAGE_RECTS 16
+
 typedef struct t_SpiritContextCreateInfo
 {
 
     // window
-    SpiritResolution windowSize;
+    SpiritResolution windowSize; // the render resolution in px when headless
     const char *windowName;
     bool windowFullscreen;
+    bool headless; // render to offscreen images, without a window or surface
 
     // device
     bool enableValidation; // should vulkan validation be initialized
-    bool powerSaving;      // should integrated GPU's be chosen
+    bool powerSaving;      // prefer integrated GPUs, and limit the frame rate
+
+    // the device of another context to share, with its pipeline cache and
+    // meshes. NULL to create a new device, and the settings above are then
+    // used. See spCreateContext.
+    SpiritDevice sharedDevice;
+
+    // presentation
+    SpiritPresentMode presentMode; // ignored in power saving mode
+    bool limitFrameLatency; // wait for the last frame before polling input
+    f32 maxFrameRate;       // frames per second, 0 for no limit
+    bool renderOnDemand;    // only submit frames when something changed
+
+    // rendering
+    u32 maxObjectCount; // meshes drawn per frame, 0 for the default
+    u32 framesInFlight; // frames recorded ahead of the gpu, 0 for the default
+    u32 recordThreadCount; // threads recording command buffers, 0 for one
+    size_t frameArenaSize;        // see spirit_frame_arena.h, 0 for the default
+    VkDeviceSize uploadArenaSize; // 0 for the default
+
+    // render below the screen resolution to hold a frame time, see
+    // spirit_dynamic_resolution.h
+    bool dynamicResolution;
+    f32 targetFrameTime; // milliseconds of gpu time, 0 for 60 fps
+    f32 minRenderScale;  // smallest fraction of the resolution, 0 for half
 
 } SpiritContextCreateInfo;
 
@@ -28,15 +78,45 @@ struct t_ContextMaterialListNode
     LIST_ENTRY(t_ContextMaterialListNode) data;
 };
 
+// storage buffer holding the per object data for one frame. There is one for
+// each frame in flight, so a buffer is never written while the gpu reads it.
+struct t_SpiritObjectBuffer
+{
+    SpiritBuffer buffer; // of SpiritObjectData, persistently mapped
+    VkDescriptorSet descriptorSet;
+    u32 objectCount; // objects reserved this frame
+};
+
+// everything used to record and submit one frame. The context cycles through
+// framesInFlight of these, independent of the swapchain image count, and a
+// frame is only reused once the gpu has finished with it.
+struct t_SpiritFrame
+{
+    // taken from the context command pool when the frame begins, its sync
+    // point marks the frame complete
+    SpiritCommandBuffer commandBuffer;
+    VkSemaphore imageAvailable; // signaled by image acquisition
+    struct t_SpiritObjectBuffer objectBuffer;
+    bool imageWritten; // a render pass drew to the image this frame
+    u64 transferWait;  // uploads the frame may use, on the transfer timeline
+};
+
 struct t_SpiritContext
 {
 
     /**
-     * @brief The window the context renders to
+     * @brief The window the context renders to, NULL when headless
      *
      */
     SpiritWindow window;
 
+    /**
+     * @brief If the context renders to offscreen images instead of a window.
+     * The window state is always SPIRIT_WINDOW_NORMAL.
+     *
+     */
+    bool headless;
+
     /**
      * @brief the state of the window
      *
@@ -44,11 +124,19 @@ struct t_SpiritContext
     SpiritWindowState windowState;
 
     /**
-     * @brief The device selected by the context
+     * @brief The device selected by the context, may be shared with other
+     * contexts
      *
      */
     SpiritDevice device;
 
+    /**
+     * @brief The surface of the window, owned by the context. NULL when
+     * headless.
+     *
+     */
+    VkSurfaceKHR surface;
+
     /**
      * @brief The swapchain created by the context
      *
@@ -62,26 +150,83 @@ struct t_SpiritContext
     LIST_HEAD(t_ContextMaterialListHead, t_ContextMaterialListNode) materials;
     u32 materialCount;
 
-    // command buffers
-    SpiritCommandBuffer *commandBuffers;
-    size_t commandBufferCount;
+    // frames in flight
+    struct t_SpiritFrame *frames;
+    u32 frameCount;
+    u32 currentFrame;
+
+    // command buffers recorded each frame, with a pool for every recording
+    // thread, see spirit_command_pool.h. Reset once the gpu finishes the frame.
+    SpiritCommandPool commandPool;
+
+    // transient allocations for the frame being recorded, reset with the
+    // command pools, see spirit_frame_arena.h
+    SpiritFrameArena frameArena;
+
+    // per object data, indexed in the vertex shader by the object base push
+    // constant plus the instance index
+    VkDescriptorSetLayout objectSetLayout;
+    VkDescriptorPool descriptorPool;
+    u32 maxObjectCount;
+
+    // requested present mode, the swapchain may use a fallback. Power saving
+    // always uses fifo.
+    SpiritPresentMode presentMode;
+    bool powerSaving;
+    bool limitFrameLatency;
+
+    // frame limiter, in nanoseconds of spPlatformGetNanoseconds
+    u64 frameInterval; // 0 without a limit
+    u64 nextFrameTime; // when the next call to spContextPollEvents returns
+
+    // render on demand. A frame is only acquired, recorded and presented if
+    // the materials draw something different, the window changed, or the app
+    // asked for it. Damage is presented as a hint with incremental present.
+    bool renderOnDemand;
+    bool redraw; // the whole image changed
+    VkRectLayerKHR damage[SPIRIT_CONTEXT_MAX_DAMAGE_RECTS];
+    u32 damageCount;
 
     SpiritResolution windowSize; // use for UI sizes, stored as screen units
     SpiritResolution screenResolution; // resolution in px, use for
 
-    // sync
-    u32 maxImagesInFlight; // the size of all sync objects
-    VkSemaphore *imageAvailableSemaphores;
-    VkSemaphore *queueCompleteSemaphores;
+    // signaled when rendering to a swapchain image completes, and waited on
+    // by present. There is one per swapchain image rather than per frame, as
+    // the presentation engine holds it until the image is acquired again.
+    // Headless contexts do not present, so they have none.
+    VkSemaphore *renderFinishedSemaphores;
+    u32 renderFinishedSemaphoreCount;
 
-    // u32 currentFence; // the fence currently rendering
-    u32 currentFrame;
+    // resources replaced while frames in flight may still use them, like the
+    // old swapchain after a resize
+    SpiritDeletionQueue deletionQueue;
+
+    // scales the render resolution with the frame time, NULL unless enabled
+    SpiritDynamicResolution dynamicResolution;
+
+    // copies finished frames back to the cpu, NULL unless enabled
+    SpiritReadback readback;
+
+    // executed after the materials each frame, not owned by the context
+    SpiritRenderGraph renderGraph;
+    SpiritRenderGraphResource renderGraphBackbuffer;
 };
 
 /**
  * @brief Create a new context. The context included the swapchain, the device,
  * and the sync objects. Materials can be added once it is created.
  *
+ * If createInfo->headless is set no window or surface is created, and the
+ * device is created without VK_KHR_swapchain. Frames are rendered into a ring
+ * of offscreen images owned by the context, so it can run on servers and
+ * software implementations like lavapipe.
+ *
+ * If createInfo->sharedDevice is set, the context renders with the device of
+ * another context instead of creating its own, so a second window shares its
+ * pipeline cache, mesh managers and upload queue. Each context keeps its own
+ * surface, swapchain and frames. Contexts sharing a device must be used from
+ * the same thread, and the device is destroyed with the last of them.
+ *
  * @param createInfo information about the creation of the context, and the
  * objects it contains
  * @return SpiritContext a reference to the created context. This must be
@@ -94,11 +239,132 @@ SpiritContext spCreateContext(SpiritContextCreateInfo *createInfo);
  * swapchain. Should no longer be called by the app, it is handled by
  * spContextPollEvents.
  *
+ * This does not wait for the device. The old swapchain is handed to the new
+ * one, and its images and framebuffers are destroyed once the frames using
+ * them are finished.
+ *
  * @param context
  * @return SpiritResult
  */
 SpiritResult spContextHandleWindowResized(SpiritContext context);
 
+/**
+ * @brief Change the present mode, recreating the swapchain. If the mode is not
+ * supported the closest supported mode is used. In power saving mode the
+ * mode is stored, but fifo is still used.
+ *
+ * @param context
+ * @param presentMode
+ * @return SpiritResult
+ */
+SpiritResult
+spContextSetPresentMode(SpiritContext context, SpiritPresentMode presentMode);
+
+/**
+ * @brief Get the present mode the swapchain is actually using, which may be a
+ * fallback from the requested mode.
+ *
+ * @param context
+ * @return SpiritPresentMode
+ */
+SpiritPresentMode spContextGetPresentMode(const SpiritContext context);
+
+/**
+ * @brief Enable or disable the frame latency limiter. When enabled,
+ * spContextPollEvents waits for the gpu to finish the previous frame before
+ * polling input, so input is sampled as close to presentation as possible.
+ * This lowers input latency at the cost of some throughput.
+ *
+ * @param context
+ * @param enable
+ */
+void spContextSetFrameLatencyLimit(SpiritContext context, bool enable);
+
+/**
+ * @brief Limit how often spContextPollEvents returns. The limiter sleeps for
+ * most of the frame interval and spins only for the last millisecond, so the
+ * frame pacing stays precise without keeping a core busy.
+ *
+ * @param context
+ * @param frameRate frames per second, 0 to remove the limit
+ */
+void spContextSetMaxFrameRate(SpiritContext context, f32 frameRate);
+
+/**
+ * @brief Get the fraction of the screen resolution being rendered
+ *
+ * @param context
+ * @return f32 1 unless dynamic resolution is enabled
+ */
+f32 spContextGetRenderScale(const SpiritContext context);
+
+/**
+ * @brief Start copying every rendered frame back to the cpu. The copies go
+ * through a ring of host visible buffers, and each frame is available a few
+ * frames later, once the gpu has finished it. Rendering never waits for the
+ * copies, if no buffer is free the frame is dropped.
+ *
+ * Frames are passed to createInfo->callback during spContextSubmitFrame, or
+ * if there is no callback they are collected with spContextAcquireReadback.
+ * Recreating the swapchain discards frames that have not been collected.
+ *
+ * @param context
+ * @param createInfo
+ * @return SpiritResult SPIRIT_FAILURE if the swapchain images can not be
+ * copied
+ */
+SpiritResult spContextEnableReadback(
+    SpiritContext context, const SpiritReadbackCreateInfo *createInfo)
+    SPIRIT_NONULL(2);
+
+/**
+ * @brief Stop copying frames back to the cpu. Frames that have not been
+ * collected are discarded.
+ *
+ * @param context
+ */
+void spContextDisableReadback(SpiritContext context);
+
+/**
+ * @brief Collect the oldest frame that has been copied back. Does not wait
+ * for the gpu. The frame must be given back using spContextReleaseReadback.
+ *
+ * @param context
+ * @param frame set to the copied frame
+ * @return SpiritResult SPIRIT_FAILURE if no frame is ready
+ */
+SpiritResult
+spContextAcquireReadback(SpiritContext context, SpiritReadbackFrame *frame)
+    SPIRIT_NONULL(2);
+
+/**
+ * @brief Release a frame from spContextAcquireReadback so its buffer can be
+ * reused. Holding frames for too long will cause new frames to be dropped.
+ *
+ * @param context
+ * @param frame
+ */
+void spContextReleaseReadback(
+    SpiritContext context, const SpiritReadbackFrame *frame) SPIRIT_NONULL(2);
+
+/**
+ * @brief Execute a render graph every frame, after the materials are
+ * recorded. The graph is not owned by the context, and must be compiled.
+ *
+ * @param context
+ * @param graph the graph, or NULL to remove the current graph
+ * @param backbuffer an image imported into the graph, which is set to the
+ * swapchain image being rendered each frame, or the render target with
+ * dynamic resolution. Its layouts must be the final layout of the material
+ * render passes, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, or
+ * VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL when headless or with dynamic
+ * resolution. Can be SPIRIT_RENDER_GRAPH_NONE.
+ */
+void spContextSetRenderGraph(
+    SpiritContext context,
+    SpiritRenderGraph graph,
+    const SpiritRenderGraphResource backbuffer);
+
 /**
  * @brief Get the state of the of the windows. This is only updated when
  * spContextPollEvents is called.
@@ -108,10 +374,74 @@ SpiritResult spContextHandleWindowResized(SpiritContext context);
  */
 SpiritWindowState spContextGetWindowState(const SpiritContext context);
 
+/**
+ * @brief Record and present a frame with the meshes added to the materials.
+ *
+ * In render on demand mode the frame is skipped, without acquiring an image,
+ * unless the queued meshes differ from the last frame, the window was
+ * resized, restored or exposed, or the app called spContextRequestRedraw or
+ * spContextAddDamage. The queued meshes are dropped when it is skipped.
+ *
+ * @param context
+ * @return SpiritResult
+ */
 SpiritResult spContextSubmitFrame(SpiritContext context);
 
+/**
+ * @brief Draw the next frame in render on demand mode, for changes the
+ * context can not see, like new mesh contents or a render graph.
+ *
+ * @param context
+ */
+void spContextRequestRedraw(SpiritContext context);
+
+/**
+ * @brief Draw the next frame in render on demand mode, and mark part of it as
+ * changed. If nothing else changed only the damaged rectangles are presented,
+ * when the device supports VK_KHR_incremental_present. The whole image is
+ * still rendered.
+ *
+ * @param context
+ * @param rect the changed area, in swapchain pixels
+ */
+void spContextAddDamage(SpiritContext context, const VkRect2D *rect)
+    SPIRIT_NONULL(2);
+
+/**
+ * @brief Process window events, once per frame before recording it. Applies
+ * the frame rate limit and the frame latency limit first.
+ *
+ * While the window is minimized or hidden this blocks on window events
+ * instead of returning, so an idle app uses no cpu. It returns once the
+ * window is visible again, or closed. If other windows are open it returns
+ * SPIRIT_WINDOW_MINIMIZED instead, so they keep rendering.
+ *
+ * @param context
+ * @return SpiritWindowState
+ */
 SpiritWindowState spContextPollEvents(SpiritContext context);
 
+/**
+ * @brief Not to be used by the user. Get the frame currently being recorded.
+ *
+ * @param context
+ * @return struct t_SpiritFrame*
+ */
+struct t_SpiritFrame *spContextGetCurrentFrame(const SpiritContext context);
+
+/**
+ * @brief Not to be used by the user. Reserve space for count objects in the
+ * object buffer of the frame being recorded.
+ *
+ * @param context
+ * @param count the number of objects to reserve
+ * @param objectBase set to the index of the first reserved object
+ * @return SpiritObjectData* where to write the objects, or NULL if the buffer
+ * does not have enough space left
+ */
+SpiritObjectData *spContextReserveObjects(
+    SpiritContext context, const u32 count, u32 *objectBase) SPIRIT_NONULL(3);
+
 /**
  * @brief add a new material to the context, which will be rendered.
  * The material must be destroyed manually by the user.
@@ -0,0 +1,169 @@
+#include "spirit_deletion_queue.h"
+
+#include "spirit_device.h"
+#include "spirit_fence.h"
+#include "spirit_timeline.h"
+
+//
+// Helpers
+//
+
+// add an entry, stamped once a frame is submitted
+static void push(SpiritDeletionQueue queue, struct t_SpiritDeletion *entry);
+
+// destroy the object of an entry
+static void destroyEntry(
+    const SpiritDevice device, struct t_SpiritDeletion *entry);
+
+//
+// Public functions
+//
+
+SpiritDeletionQueue spCreateDeletionQueue(void)
+{
+    SpiritDeletionQueue out = new_var(struct t_SpiritDeletionQueue);
+
+    VECTOR_INIT(&out->entries, VECTOR_RESIZE_AMOUNT);
+
+    return out;
+}
+
+void spDeletionQueueSubmit(SpiritDeletionQueue queue, const u64 submitValue)
+{
+    // entries are pushed in order, so the unstamped ones are at the end
+    for (size_t i = VECTOR_SIZE(&queue->entries);
+         i > 0 && VECTOR_AT(&queue->entries, i - 1).submitValue == 0;
+         i--)
+    {
+        VECTOR_AT(&queue->entries, i - 1).submitValue = submitValue;
+    }
+}
+
+void spDeletionQueuePushSwapchain(
+    SpiritDeletionQueue queue, VkSwapchainKHR swapchain)
+{
+    if (swapchain == VK_NULL_HANDLE)
+        return;
+
+    struct t_SpiritDeletion entry = {
+        .type = SPIRIT_DELETION_SWAPCHAIN, .swapchain = swapchain};
+    push(queue, &entry);
+}
+
+void spDeletionQueuePushImage(
+    SpiritDeletionQueue queue, const SpiritImage *image)
+{
+    struct t_SpiritDeletion entry = {
+        .type  = image->memory ? SPIRIT_DELETION_IMAGE
+                               : SPIRIT_DELETION_IMAGE_VIEW,
+        .image = *image};
+    push(queue, &entry);
+}
+
+void spDeletionQueuePushFramebuffer(
+    SpiritDeletionQueue queue, VkFramebuffer framebuffer)
+{
+    if (framebuffer == VK_NULL_HANDLE)
+        return;
+
+    struct t_SpiritDeletion entry = {
+        .type = SPIRIT_DELETION_FRAMEBUFFER, .framebuffer = framebuffer};
+    push(queue, &entry);
+}
+
+void spDeletionQueuePushRenderPass(
+    SpiritDeletionQueue queue, VkRenderPass renderPass)
+{
+    if (renderPass == VK_NULL_HANDLE)
+        return;
+
+    struct t_SpiritDeletion entry = {
+        .type = SPIRIT_DELETION_RENDER_PASS, .renderPass = renderPass};
+    push(queue, &entry);
+}
+
+void spDeletionQueuePushSemaphore(
+    SpiritDeletionQueue queue, VkSemaphore semaphore)
+{
+    if (semaphore == VK_NULL_HANDLE)
+        return;
+
+    struct t_SpiritDeletion entry = {
+        .type = SPIRIT_DELETION_SEMAPHORE, .semaphore = semaphore};
+    push(queue, &entry);
+}
+
+void spDeletionQueueFlush(const SpiritDevice device, SpiritDeletionQueue queue)
+{
+    // entries are pushed in frame order, so the finished ones are a prefix
+    size_t finished = 0;
+    while (finished < VECTOR_SIZE(&queue->entries))
+    {
+        const SpiritSyncPoint point = {
+            .queue = SPIRIT_QUEUE_GRAPHICS,
+            .value = VECTOR_AT(&queue->entries, finished).submitValue};
+        if (point.value == 0 || !spTimelineReached(device, point))
+            break;
+
+        destroyEntry(device, &VECTOR_AT(&queue->entries, finished));
+        finished++;
+    }
+
+    if (finished == 0)
+        return;
+
+    memmove(
+        queue->entries.at,
+        queue->entries.at + finished,
+        (VECTOR_SIZE(&queue->entries) - finished) *
+            sizeof(struct t_SpiritDeletion));
+    queue->entries.size -= finished;
+}
+
+void spDestroyDeletionQueue(
+    const SpiritDevice device, SpiritDeletionQueue queue)
+{
+    for (size_t i = 0; i < VECTOR_SIZE(&queue->entries); i++)
+        destroyEntry(device, &VECTOR_AT(&queue->entries, i));
+
+    VECTOR_DELETE(&queue->entries);
+    free(queue);
+}
+
+//
+// Helpers
+//
+
+void push(SpiritDeletionQueue queue, struct t_SpiritDeletion *entry)
+{
+    // the frame being recorded may still use it, so it is stamped with that
+    // frame when it is submitted
+    entry->submitValue = 0;
+    VECTOR_PUSH_BACK(&queue->entries, *entry);
+}
+
+void destroyEntry(const SpiritDevice device, struct t_SpiritDeletion *entry)
+{
+    switch (entry->type)
+    {
+    case SPIRIT_DELETION_SWAPCHAIN:
+        vkDestroySwapchainKHR(
+            device->device, entry->swapchain, ALLOCATION_CALLBACK);
+        break;
+    case SPIRIT_DELETION_IMAGE: spDestroyImage(device, &entry->image); break;
+    case SPIRIT_DELETION_IMAGE_VIEW:
+        spDestroyImageView(device, &entry->image);
+        break;
+    case SPIRIT_DELETION_FRAMEBUFFER:
+        vkDestroyFramebuffer(
+            device->device, entry->framebuffer, ALLOCATION_CALLBACK);
+        break;
+    case SPIRIT_DELETION_RENDER_PASS:
+        vkDestroyRenderPass(
+            device->device, entry->renderPass, ALLOCATION_CALLBACK);
+        break;
+    case SPIRIT_DELETION_SEMAPHORE:
+        spSyncPoolReleaseSemaphore(device, entry->semaphore);
+        break;
+    }
+}
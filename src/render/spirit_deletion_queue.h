@@ -0,0 +1,131 @@
+#pragma once
+#include <spirit_header.h>
+#include "spirit_image.h"
+#include "utils/spirit_vector.h"
+
+// Deferred deletion. Objects the gpu may still be using, like the images of a
+// swapchain that was just replaced, are pushed here instead of being
+// destroyed. Each is stamped with the graphics timeline value of the next
+// frame submitted, and destroyed once the timeline reaches it, so nothing has
+// to wait for the device to go idle.
+
+//
+// Types
+//
+
+typedef enum e_SpiritDeletionType
+{
+    SPIRIT_DELETION_SWAPCHAIN,
+    SPIRIT_DELETION_IMAGE,      // the image, its memory and its view
+    SPIRIT_DELETION_IMAGE_VIEW, // only the view, like a swapchain image
+    SPIRIT_DELETION_FRAMEBUFFER,
+    SPIRIT_DELETION_RENDER_PASS,
+    SPIRIT_DELETION_SEMAPHORE,
+} SpiritDeletionType;
+
+struct t_SpiritDeletion
+{
+    SpiritDeletionType type;
+    u64 submitValue; // on the graphics timeline, 0 until a frame is submitted
+    union
+    {
+        VkSwapchainKHR swapchain;
+        SpiritImage image;
+        VkFramebuffer framebuffer;
+        VkRenderPass renderPass;
+        VkSemaphore semaphore;
+    };
+};
+
+struct t_SpiritDeletionQueue
+{
+    VECTOR(struct t_SpiritDeletion) entries; // oldest first
+};
+
+//
+// Functions
+//
+
+/**
+ * @brief Create an empty deletion queue
+ *
+ * @return SpiritDeletionQueue
+ */
+SpiritDeletionQueue spCreateDeletionQueue(void);
+
+/**
+ * @brief Stamp every object pushed since the last frame with the frame just
+ * submitted. They are destroyed once it is complete.
+ *
+ * @param queue
+ * @param submitValue the graphics timeline value of the frame
+ */
+void spDeletionQueueSubmit(SpiritDeletionQueue queue, const u64 submitValue)
+    SPIRIT_NONULL(1);
+
+/**
+ * @brief Destroy a swapchain once the current frame is complete. Its images
+ * must be pushed first.
+ *
+ * @param queue
+ * @param swapchain
+ */
+void spDeletionQueuePushSwapchain(
+    SpiritDeletionQueue queue, VkSwapchainKHR swapchain) SPIRIT_NONULL(1);
+
+/**
+ * @brief Destroy an image once the current frame is complete. Images without
+ * memory only have their view destroyed.
+ *
+ * @param queue
+ * @param image copied, the original can be reused straight away
+ */
+void spDeletionQueuePushImage(
+    SpiritDeletionQueue queue, const SpiritImage *image) SPIRIT_NONULL(1, 2);
+
+/**
+ * @brief Destroy a framebuffer once the current frame is complete
+ *
+ * @param queue
+ * @param framebuffer
+ */
+void spDeletionQueuePushFramebuffer(
+    SpiritDeletionQueue queue, VkFramebuffer framebuffer) SPIRIT_NONULL(1);
+
+/**
+ * @brief Destroy a render pass once the current frame is complete
+ *
+ * @param queue
+ * @param renderPass
+ */
+void spDeletionQueuePushRenderPass(
+    SpiritDeletionQueue queue, VkRenderPass renderPass) SPIRIT_NONULL(1);
+
+/**
+ * @brief Give a semaphore back to the device pool once the current frame is
+ * complete
+ *
+ * @param queue
+ * @param semaphore
+ */
+void spDeletionQueuePushSemaphore(
+    SpiritDeletionQueue queue, VkSemaphore semaphore) SPIRIT_NONULL(1);
+
+/**
+ * @brief Destroy every object whose frame the gpu has finished
+ *
+ * @param device
+ * @param queue
+ */
+void spDeletionQueueFlush(const SpiritDevice device, SpiritDeletionQueue queue)
+    SPIRIT_NONULL(1, 2);
+
+/**
+ * @brief Destroy every object in the queue, and the queue. The device must be
+ * idle.
+ *
+ * @param device
+ * @param queue
+ */
+void spDestroyDeletionQueue(
+    const SpiritDevice device, SpiritDeletionQueue queue) SPIRIT_NONULL(1, 2);
@@ -1,5 +1,10 @@
 #include "spirit_device.h"
 
+#include "spirit_buffer.h"
+#include "spirit_command_buffer.h"
+#include "spirit_fence.h"
+#include "spirit_timeline.h"
+
 // Create and manage a rendering device rendering device
 //
 //
@@ -11,10 +16,11 @@
 
 // queue info
 // I defined them this way so more queues could be added in the future
-#define QUEUE_COUNT 2
-#define QUEUE_NAMES(varname)                        \
-    {                                               \
-        varname.graphicsQueue, varname.presentQueue \
+#define QUEUE_COUNT 4
+#define QUEUE_NAMES(varname)                                         \
+    {                                                                \
+        varname.graphicsQueue, varname.presentQueue,                 \
+            varname.transferQueue, varname.computeQueue              \
     }
 
 // structure to aid in queue family selection
@@ -25,6 +31,10 @@ typedef struct t_QueueFamilyIndices
     bool foundGraphicsQueue;
     u32 presentQueue;
     bool foundPresentQueue;
+
+    // optional, the graphics family is used if there is no other family
+    u32 transferQueue;
+    u32 computeQueue;
 } QueueFamilyIndices;
 
 // structure to manage rendering device candidates
@@ -52,7 +62,23 @@ static VkPhysicalDevice selectPhysicalDevice(
 
 static VkDevice createDevice(
     const SpiritDeviceCreateInfo *createInfo,
-    const VkPhysicalDevice physicalDevice);
+    const VkPhysicalDevice physicalDevice,
+    bool *incrementalPresent,   // set if VK_KHR_incremental_present is enabled
+    bool *memoryBudget,         // set if VK_EXT_memory_budget is enabled
+    bool *bufferDeviceAddress); // set if the feature is enabled
+
+// cache the memory types and build the lookup table
+static void initMemory(SpiritDevice device);
+
+// find a memory type from the lookup table, UINT32_MAX if there is none
+static u32 findMemoryType(
+    const SpiritDevice device,
+    const u32 typeFilter,
+    VkMemoryPropertyFlags properties);
+
+// check if a gpu supports a single device extension
+static bool hasDeviceExtension(
+    VkPhysicalDevice physicalDevice, const char *extensionName);
 
 static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
     VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
@@ -67,8 +93,19 @@ static QueueFamilyIndices findDeviceQueues(
 static SpiritSwapchainSupportInfo querySwapChainSupport(
     const VkSurfaceKHR surface, VkPhysicalDevice questionedDevice);
 
-static VkCommandPool
-createCommandPool(VkDevice device, QueueFamilyIndices queueFamilies);
+static VkCommandPool createCommandPool(VkDevice device, u32 queueFamily);
+
+// free the uploads the transfer queue has finished, or all of them, waiting
+// for any still running. The acquire lock must be held.
+static void releaseUploads(const SpiritDevice device, const bool all);
+
+// pick the family for copies or compute work, preferring one without graphics
+// so it runs beside rendering. Falls back to the graphics family.
+static u32 findAsyncQueue(
+    const VkQueueFamilyProperties *families,
+    u32 familyCount,
+    VkQueueFlags required,
+    u32 graphicsFamily);
 
 //
 // Public Functions
@@ -78,7 +115,9 @@ SpiritDevice spCreateDevice(SpiritDeviceCreateInfo *createInfo)
 {
 
     // asserts
-    db_assert_msg(createInfo->window, "Must have window to create instance");
+    db_assert_msg(
+        createInfo->window || createInfo->headless,
+        "Must have window to create instance");
 
     SpiritDevice out = new_var(struct t_SpiritDevice);
 
@@ -108,8 +147,9 @@ SpiritDevice spCreateDevice(SpiritDeviceCreateInfo *createInfo)
                        "supported by the GPU");
     }
 
-    // fallback device extensions
-    if (createInfo->requiredDeviceExtensionCount == 0)
+    // fallback device extensions, a headless device does not present so it
+    // needs none
+    if (createInfo->requiredDeviceExtensionCount == 0 && !createInfo->headless)
     {
         const char *requiredDeviceExtensions[1] = {
             VK_KHR_SWAPCHAIN_EXTENSION_NAME};
@@ -118,6 +158,7 @@ SpiritDevice spCreateDevice(SpiritDeviceCreateInfo *createInfo)
     }
 
     out->validationEnabled = createInfo->enableValidation;
+    out->headless          = createInfo->headless;
 
     out->instance = createInstance(
         createInfo, &out->debugMessenger); // create vulkan instance
@@ -127,10 +168,12 @@ SpiritDevice spCreateDevice(SpiritDeviceCreateInfo *createInfo)
         return NULL;
     }
 
-    // get the window surface
-    out->windowSurface = spWindowGetSurface(
-        createInfo->window, out->instance); // create window surface
-    createInfo->windowSurface = out->windowSurface;
+    // get the window surface, owned by the caller
+    if (createInfo->headless)
+        createInfo->windowSurface = VK_NULL_HANDLE;
+    else
+        createInfo->windowSurface = spWindowGetSurface(
+            createInfo->window, out->instance); // create window surface
 
     out->physicalDevice = selectPhysicalDevice(
         createInfo, out->instance); // select physical device
@@ -140,19 +183,27 @@ SpiritDevice spCreateDevice(SpiritDeviceCreateInfo *createInfo)
         return NULL;
     }
     out->swapchainDetails = (SpiritSwapchainSupportInfo){};
-    spDeviceUpdateSwapchainSupport(out);
-    out->device = createDevice(createInfo, out->physicalDevice);
+    spDeviceUpdateSwapchainSupport(out, createInfo->windowSurface);
+    out->device = createDevice(
+        createInfo,
+        out->physicalDevice,
+        &out->incrementalPresent,
+        &out->memoryBudget,
+        &out->bufferDeviceAddress);
     if (out->device == NULL)
     {
         log_fatal("Failed to create logical device");
         return NULL;
     }
 
+    initMemory(out);
+
     QueueFamilyIndices indices =
         findDeviceQueues(createInfo, out->physicalDevice);
-    u32 queues[QUEUE_COUNT] = QUEUE_NAMES(indices);
-    out->queueIndices       = queues;
-    out->queueCount         = QUEUE_COUNT;
+    out->graphicsFamily = indices.graphicsQueue;
+    out->presentFamily  = indices.presentQueue;
+    out->transferFamily = indices.transferQueue;
+    out->computeFamily  = indices.computeQueue;
     vkGetDeviceQueue(
         out->device,
         indices.graphicsQueue,
@@ -163,9 +214,67 @@ SpiritDevice spCreateDevice(SpiritDeviceCreateInfo *createInfo)
         indices.presentQueue,
         0,
         &out->presentQueue); // create present queue
+    vkGetDeviceQueue(
+        out->device, indices.transferQueue, 0, &out->transferQueue);
+    vkGetDeviceQueue(out->device, indices.computeQueue, 0, &out->computeQueue);
+
+    if (out->transferFamily != out->graphicsFamily)
+        log_verbose("Using transfer queue family %u", out->transferFamily);
+    if (out->computeFamily != out->graphicsFamily)
+        log_verbose("Using async compute queue family %u", out->computeFamily);
+
+    // timestamps are optional per queue family
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(out->physicalDevice, &properties);
+    u32 familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(
+        out->physicalDevice, &familyCount, NULL);
+    VkQueueFamilyProperties families[familyCount];
+    vkGetPhysicalDeviceQueueFamilyProperties(
+        out->physicalDevice, &familyCount, families);
+    out->timestampPeriod =
+        families[indices.graphicsQueue].timestampValidBits
+            ? properties.limits.timestampPeriod
+            : 0.0f;
+    out->nonCoherentAtomSize = properties.limits.nonCoherentAtomSize;
+
+    // command pools, one for each family
+    out->commandPool = createCommandPool(out->device, out->graphicsFamily);
+    out->transferCommandPool =
+        out->transferFamily == out->graphicsFamily
+            ? out->commandPool
+            : createCommandPool(out->device, out->transferFamily);
+    out->computeCommandPool =
+        out->computeFamily == out->graphicsFamily
+            ? out->commandPool
+            : createCommandPool(out->device, out->computeFamily);
+
+    out->commandLock = spPlatformCreateMutex();
+    for (u32 i = 0; i < SPIRIT_QUEUE_TYPE_COUNT; i++)
+        VECTOR_INIT(&out->recycledCommandBuffers[i], 0);
+    VECTOR_INIT(&out->threadPools, 0);
+
+    out->acquireLock = spPlatformCreateMutex();
+    out->acquireWait = 0;
+    VECTOR_INIT(&out->pendingAcquires, 0);
+    VECTOR_INIT(&out->pendingUploads, 0);
+
+    if (spCreateTimelines(out) || spCreateSyncPool(out))
+    {
+        log_fatal("Failed to create synchronization objects");
+        return NULL;
+    }
+
+    VkPipelineCacheCreateInfo cacheInfo = {};
+    cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    if (vkCreatePipelineCache(
+            out->device, &cacheInfo, ALLOCATION_CALLBACK, &out->pipelineCache))
+    {
+        log_warning("Failed to create pipeline cache");
+        out->pipelineCache = VK_NULL_HANDLE;
+    }
 
-    // command pool
-    out->commandPool = createCommandPool(out->device, indices);
+    out->referenceCount = 1;
 
     return out;
 }
@@ -206,20 +315,104 @@ u32 spDeviceFindMemoryType(
     const u32 typeFilter,
     VkMemoryPropertyFlags properties)
 {
-    VkPhysicalDeviceMemoryProperties memProperties;
-    vkGetPhysicalDeviceMemoryProperties(device->physicalDevice, &memProperties);
-    for (u32 i = 0; i < memProperties.memoryTypeCount; i++)
+    const u32 out = findMemoryType(device, typeFilter, properties);
+    if (out == UINT32_MAX)
+    {
+        log_fatal("Could not find memory typpe");
+        abort();
+    }
+    return out;
+}
+
+u32 spDeviceChooseMemoryType(
+    const SpiritDevice device,
+    const u32 typeFilter,
+    VkMemoryPropertyFlags properties,
+    const VkDeviceSize size)
+{
+    const u32 type = spDeviceFindMemoryType(device, typeFilter, properties);
+    if (spDeviceMemoryFits(device, type, size) ||
+        !(properties & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT))
+        return type;
+
+    // host memory on another heap, the gpu reads it over the bus
+    const u32 heap = device->memoryProperties.memoryTypes[type].heapIndex;
+    u32 otherHeaps = 0;
+    for (u32 i = 0; i < device->memoryProperties.memoryTypeCount; i++)
+    {
+        if (device->memoryProperties.memoryTypes[i].heapIndex != heap)
+            otherHeaps |= 1u << i;
+    }
+
+    const u32 fallback = findMemoryType(
+        device,
+        typeFilter & otherHeaps,
+        (properties & ~VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) |
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+    if (fallback == UINT32_MAX || !spDeviceMemoryFits(device, fallback, size))
+        return type;
+
+    log_warning("Memory heap %u is over budget, using host memory", heap);
+    return fallback;
+}
+
+bool spDeviceMemoryFits(
+    const SpiritDevice device, const u32 memoryType, const VkDeviceSize size)
+{
+    const u32 heap = device->memoryProperties.memoryTypes[memoryType].heapIndex;
+
+    spPlatformLockMutex(device->memoryLock);
+    const bool out =
+        device->heaps[heap].usage + size <= device->heaps[heap].budget;
+    spPlatformUnlockMutex(device->memoryLock);
+
+    return out;
+}
+
+void spDeviceUpdateMemoryBudget(SpiritDevice device)
+{
+    const u32 heapCount = device->memoryProperties.memoryHeapCount;
+
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budget = {};
+    if (device->memoryBudget)
+    {
+        budget.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+        VkPhysicalDeviceMemoryProperties2 properties = {};
+        properties.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+        properties.pNext = &budget;
+        vkGetPhysicalDeviceMemoryProperties2(
+            device->physicalDevice, &properties);
+    }
+
+    spPlatformLockMutex(device->memoryLock);
+    for (u32 i = 0; i < heapCount; i++)
     {
-        if ((typeFilter & (1 << i)) &&
-            (memProperties.memoryTypes[i].propertyFlags & properties) ==
-                properties)
+        SpiritMemoryHeap *heap = &device->heaps[i];
+        if (device->memoryBudget)
         {
-            return i;
+            heap->budget = budget.heapBudget[i];
+            heap->usage  = budget.heapUsage[i];
+        }
+        else
+        {
+            heap->budget = heap->size;
+            heap->usage  = heap->allocated;
         }
     }
-    log_fatal("Could not find memory typpe");
-    abort();
-    return -1;
+    spPlatformUnlockMutex(device->memoryLock);
+}
+
+SpiritMemoryHeap spDeviceGetMemoryHeap(const SpiritDevice device, u32 heap)
+{
+    db_assert(heap < device->memoryProperties.memoryHeapCount);
+
+    spPlatformLockMutex(device->memoryLock);
+    SpiritMemoryHeap out = device->heaps[heap];
+    spPlatformUnlockMutex(device->memoryLock);
+
+    return out;
 }
 
 SpiritResult spDeviceAllocateMemory(
@@ -228,8 +421,15 @@ SpiritResult spDeviceAllocateMemory(
     const u32 memoryType,
     VkDeviceMemory *memory)
 {
+    // any buffer bound to the memory may want its address, and the flag
+    // costs nothing for the ones that do not
+    VkMemoryAllocateFlagsInfo flagsInfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO,
+        .flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT};
+
     VkMemoryAllocateInfo allocationInfo = {
         .sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .pNext           = device->bufferDeviceAddress ? &flagsInfo : NULL,
         .allocationSize  = size,
         .memoryTypeIndex = memoryType};
 
@@ -241,22 +441,181 @@ SpiritResult spDeviceAllocateMemory(
         return SPIRIT_FAILURE;
     }
 
+    struct t_SpiritAllocation allocation = {
+        .memory = *memory,
+        .size   = size,
+        .heap   = device->memoryProperties.memoryTypes[memoryType].heapIndex};
+
+    // the driver counts usage itself with the budget extension, but until the
+    // next update it is estimated here
+    spPlatformLockMutex(device->memoryLock);
+    device->heaps[allocation.heap].allocated += size;
+    device->heaps[allocation.heap].usage += size;
+    VECTOR_PUSH_BACK(&device->allocations, allocation);
+    spPlatformUnlockMutex(device->memoryLock);
+
     return SPIRIT_SUCCESS;
 }
 
-SpiritResult spDeviceUpdateSwapchainSupport(const SpiritDevice device)
+void spDeviceFreeMemory(const SpiritDevice device, VkDeviceMemory memory)
+{
+    if (memory == VK_NULL_HANDLE)
+        return;
+
+    spPlatformLockMutex(device->memoryLock);
+    for (size_t i = 0; i < VECTOR_SIZE(&device->allocations); i++)
+    {
+        struct t_SpiritAllocation *allocation =
+            &VECTOR_AT(&device->allocations, i);
+        if (allocation->memory != memory)
+            continue;
+
+        SpiritMemoryHeap *heap = &device->heaps[allocation->heap];
+        heap->allocated -= allocation->size;
+        heap->usage -= min_value(allocation->size, heap->usage);
+
+        // order does not matter, so the last allocation fills the gap
+        *allocation = VECTOR_AT(
+            &device->allocations, --device->allocations.size);
+        break;
+    }
+    spPlatformUnlockMutex(device->memoryLock);
+
+    vkFreeMemory(device->device, memory, ALLOCATION_CALLBACK);
+}
+
+SpiritResult
+spDeviceUpdateSwapchainSupport(const SpiritDevice device, VkSurfaceKHR surface)
 {
     if (device->swapchainDetails.presentModes)
         free(device->swapchainDetails.presentModes);
     if (device->swapchainDetails.formats)
         free(device->swapchainDetails.formats);
 
+    // there is nothing to present to without a surface
+    if (device->headless || !surface)
+    {
+        device->swapchainDetails = (SpiritSwapchainSupportInfo){};
+        return SPIRIT_SUCCESS;
+    }
+
     device->swapchainDetails =
-        querySwapChainSupport(device->windowSurface, device->physicalDevice);
+        querySwapChainSupport(surface, device->physicalDevice);
 
     return SPIRIT_SUCCESS;
 }
 
+bool spDeviceSupportsSurface(const SpiritDevice device, VkSurfaceKHR surface)
+{
+    if (device->headless || !surface)
+        return false;
+
+    VkBool32 supported = VK_FALSE;
+    vkGetPhysicalDeviceSurfaceSupportKHR(
+        device->physicalDevice, device->presentFamily, surface, &supported);
+
+    return supported;
+}
+
+SpiritDevice spDeviceRetain(SpiritDevice device)
+{
+    device->referenceCount++;
+    return device;
+}
+
+void spDeviceAcquireBuffer(
+    const SpiritDevice device,
+    VkBuffer buffer,
+    u32 srcFamily,
+    VkAccessFlags dstAccess,
+    const u64 transferValue)
+{
+    // the copy must finish even if the graphics family already owns it
+    spPlatformLockMutex(device->acquireLock);
+    device->acquireWait = max_value(device->acquireWait, transferValue);
+    spPlatformUnlockMutex(device->acquireLock);
+
+    if (srcFamily == device->graphicsFamily)
+        return;
+
+    // must match the release barrier, apart from the access mask
+    VkBufferMemoryBarrier barrier = {};
+    barrier.sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask       = 0;
+    barrier.dstAccessMask       = dstAccess;
+    barrier.srcQueueFamilyIndex = srcFamily;
+    barrier.dstQueueFamilyIndex = device->graphicsFamily;
+    barrier.buffer              = buffer;
+    barrier.offset              = 0;
+    barrier.size                = VK_WHOLE_SIZE;
+
+    spPlatformLockMutex(device->acquireLock);
+    VECTOR_PUSH_BACK(&device->pendingAcquires, barrier);
+    spPlatformUnlockMutex(device->acquireLock);
+}
+
+void spDeviceCancelAcquire(const SpiritDevice device, VkBuffer buffer)
+{
+    spPlatformLockMutex(device->acquireLock);
+    for (size_t i = 0; i < VECTOR_SIZE(&device->pendingAcquires);)
+    {
+        // order does not matter, so the last barrier fills the gap
+        if (VECTOR_AT(&device->pendingAcquires, i).buffer == buffer)
+            VECTOR_AT(&device->pendingAcquires, i) = VECTOR_AT(
+                &device->pendingAcquires, --device->pendingAcquires.size);
+        else
+            i++;
+    }
+    spPlatformUnlockMutex(device->acquireLock);
+}
+
+u64 spDeviceRecordAcquires(
+    const SpiritDevice device, VkCommandBuffer commandBuffer)
+{
+    spPlatformLockMutex(device->acquireLock);
+    releaseUploads(device, false);
+
+    // the frame waits for the transfer queue at vertex input, so the
+    // acquires must start there to follow the wait
+    if (VECTOR_SIZE(&device->pendingAcquires))
+    {
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+            VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+                VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            0,
+            0,
+            NULL,
+            VECTOR_SIZE(&device->pendingAcquires),
+            device->pendingAcquires.at,
+            0,
+            NULL);
+        device->pendingAcquires.size = 0;
+    }
+    // frames of other contexts may use the buffers too, so every frame
+    // waits. Finished values are skipped when submitting.
+    const u64 wait = device->acquireWait;
+    spPlatformUnlockMutex(device->acquireLock);
+
+    return wait;
+}
+
+void spDeviceRetireUpload(
+    const SpiritDevice device,
+    const u64 transferValue,
+    SpiritBuffer *staging)
+{
+    struct t_SpiritPendingUpload upload = {
+        .transferValue = transferValue, .staging = staging};
+
+    spPlatformLockMutex(device->acquireLock);
+    releaseUploads(device, false);
+    VECTOR_PUSH_BACK(&device->pendingUploads, upload);
+    spPlatformUnlockMutex(device->acquireLock);
+}
+
 SpiritResult spDeviceCreateImage(
     const SpiritDevice device,
     const VkImageCreateInfo *imageInfo,
@@ -270,14 +629,14 @@ SpiritResult spDeviceCreateImage(
     VkMemoryRequirements memoryRequirements = {};
     vkGetImageMemoryRequirements(device->device, *image, &memoryRequirements);
 
-    VkMemoryAllocateInfo allocInfo = {};
-    allocInfo.sType                = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize       = memoryRequirements.size;
-    allocInfo.memoryTypeIndex      = spDeviceFindMemoryType(
-        device, memoryRequirements.memoryTypeBits, memoryFlags);
+    const u32 memoryType = spDeviceChooseMemoryType(
+        device,
+        memoryRequirements.memoryTypeBits,
+        memoryFlags,
+        memoryRequirements.size);
 
-    if (vkAllocateMemory(device->device, &allocInfo, NULL, imageMemory) !=
-        VK_SUCCESS)
+    if (spDeviceAllocateMemory(
+            device, memoryRequirements.size, memoryType, imageMemory))
     {
         return SPIRIT_FAILURE;
     }
@@ -313,8 +672,8 @@ SpiritResult spDeviceCreateBuffer(
     VkMemoryRequirements req;
     vkGetBufferMemoryRequirements(device->device, *buffer, &req);
 
-    u32 memType =
-        spDeviceFindMemoryType(device, req.memoryTypeBits, properties);
+    u32 memType = spDeviceChooseMemoryType(
+        device, req.memoryTypeBits, properties, req.size);
 
     if (spDeviceAllocateMemory(device, req.size, memType, bufferMemory))
     {
@@ -335,12 +694,62 @@ SpiritResult spDeviceCreateBuffer(
 // destroy a spirit device and free all memory whatever
 SpiritResult spDestroyDevice(SpiritDevice device)
 {
+    // other contexts still use it
+    db_assert(device->referenceCount > 0);
+    if (--device->referenceCount > 0)
+        return SPIRIT_SUCCESS;
+
+    vkDestroyPipelineCache(
+        device->device, device->pipelineCache, ALLOCATION_CALLBACK);
+
+    releaseUploads(device, true);
 
+    // the command buffers themselves are freed with their pools
+    for (u32 i = 0; i < SPIRIT_QUEUE_TYPE_COUNT; i++)
+    {
+        for (size_t j = 0; j < VECTOR_SIZE(&device->recycledCommandBuffers[i]);
+             j++)
+        {
+            free(VECTOR_AT(&device->recycledCommandBuffers[i], j));
+        }
+        VECTOR_DELETE(&device->recycledCommandBuffers[i]);
+    }
+    for (size_t i = 0; i < VECTOR_SIZE(&device->threadPools); i++)
+    {
+        struct t_SpiritThreadQueuePool *pool =
+            VECTOR_AT(&device->threadPools, i);
+        for (size_t j = 0; j < VECTOR_SIZE(&pool->buffers); j++)
+            free(VECTOR_AT(&pool->buffers, j));
+        VECTOR_DELETE(&pool->buffers);
+        vkDestroyCommandPool(
+            device->device, pool->handle, ALLOCATION_CALLBACK);
+        free(pool);
+    }
+    VECTOR_DELETE(&device->threadPools);
+    spPlatformDestroyMutex(device->commandLock);
+
+    if (device->transferCommandPool != device->commandPool)
+        vkDestroyCommandPool(
+            device->device, device->transferCommandPool, ALLOCATION_CALLBACK);
+    if (device->computeCommandPool != device->commandPool)
+        vkDestroyCommandPool(
+            device->device, device->computeCommandPool, ALLOCATION_CALLBACK);
     vkDestroyCommandPool(
         device->device, device->commandPool, ALLOCATION_CALLBACK);
-    vkDestroyDevice(device->device, ALLOCATION_CALLBACK);
 
-    vkDestroySurfaceKHR(device->instance, device->windowSurface, NULL);
+    VECTOR_DELETE(&device->pendingAcquires);
+    VECTOR_DELETE(&device->pendingUploads);
+    spPlatformDestroyMutex(device->acquireLock);
+    spDestroyTimelines(device);
+    spDestroySyncPool(device);
+
+    if (VECTOR_SIZE(&device->allocations))
+        log_warning(
+            "Destroying device with %zu allocations",
+            VECTOR_SIZE(&device->allocations));
+    VECTOR_DELETE(&device->allocations);
+    spPlatformDestroyMutex(device->memoryLock);
+    vkDestroyDevice(device->device, ALLOCATION_CALLBACK);
 
     // debug messenger
     if (device->validationEnabled)
@@ -567,7 +976,10 @@ static VkPhysicalDevice selectPhysicalDevice(
 
 static VkDevice createDevice(
     const SpiritDeviceCreateInfo *createInfo,
-    const VkPhysicalDevice physicalDevice)
+    const VkPhysicalDevice physicalDevice,
+    bool *incrementalPresent,
+    bool *memoryBudget,
+    bool *bufferDeviceAddress)
 {
 
     QueueFamilyIndices indices = findDeviceQueues(createInfo, physicalDevice);
@@ -610,18 +1022,53 @@ static VkDevice createDevice(
 
     VkPhysicalDeviceFeatures deviceFeatures = {}; // populate later
 
+    // timeline semaphores track every submission, see spirit_timeline.h.
+    // Buffer device addresses are optional, see spBufferGetAddress.
+    VkPhysicalDeviceVulkan12Features supported12 = {};
+    supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    VkPhysicalDeviceFeatures2 supported = {};
+    supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supported.pNext = &supported12;
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &supported);
+    *bufferDeviceAddress = supported12.bufferDeviceAddress;
+
+    VkPhysicalDeviceVulkan12Features features12 = {};
+    features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    features12.timelineSemaphore   = VK_TRUE;
+    features12.bufferDeviceAddress = supported12.bufferDeviceAddress;
+
     VkDeviceCreateInfo deviceCreateInfo = {};
     deviceCreateInfo.sType              = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    deviceCreateInfo.pNext              = &features12;
     deviceCreateInfo.queueCreateInfoCount = queueCount - skippedQueueCount;
     deviceCreateInfo.pQueueCreateInfos    = queueCreateInfos;
 
     deviceCreateInfo.pEnabledFeatures = &deviceFeatures;
 
-    // enable device extensions
-    deviceCreateInfo.enabledExtensionCount =
-        createInfo->requiredDeviceExtensionCount;
-    deviceCreateInfo.ppEnabledExtensionNames =
-        createInfo->requiredDeviceExtensions;
+    // enable device extensions, and the optional ones the gpu supports.
+    // Incremental present lets the presentation engine update only the
+    // damaged parts of an image.
+    u32 extensionCount = createInfo->requiredDeviceExtensionCount;
+    const char *extensions[extensionCount + 2];
+    for (u32 i = 0; i < extensionCount; i++)
+        extensions[i] = createInfo->requiredDeviceExtensions[i];
+
+    *incrementalPresent =
+        !createInfo->headless &&
+        hasDeviceExtension(
+            physicalDevice, VK_KHR_INCREMENTAL_PRESENT_EXTENSION_NAME);
+    if (*incrementalPresent)
+        extensions[extensionCount++] =
+            VK_KHR_INCREMENTAL_PRESENT_EXTENSION_NAME;
+
+    // the memory budget extension reports how much of each heap is free
+    *memoryBudget =
+        hasDeviceExtension(physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    if (*memoryBudget)
+        extensions[extensionCount++] = VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
+
+    deviceCreateInfo.enabledExtensionCount   = extensionCount;
+    deviceCreateInfo.ppEnabledExtensionNames = extensions;
 
     // pass used enabled validation layers
     deviceCreateInfo.enabledLayerCount =
@@ -642,13 +1089,66 @@ static VkDevice createDevice(
     return device;
 }
 
-static VkCommandPool
-createCommandPool(VkDevice device, QueueFamilyIndices queueFamilies)
+static void initMemory(SpiritDevice device)
+{
+    vkGetPhysicalDeviceMemoryProperties(
+        device->physicalDevice, &device->memoryProperties);
+    const VkPhysicalDeviceMemoryProperties *properties =
+        &device->memoryProperties;
+
+    // every combination of the low property flags, so a lookup only has to
+    // mask by the type filter
+    for (u32 flags = 0; flags < array_length(device->memoryTypeTable); flags++)
+    {
+        u32 mask = 0;
+        for (u32 i = 0; i < properties->memoryTypeCount; i++)
+        {
+            if ((properties->memoryTypes[i].propertyFlags & flags) == flags)
+                mask |= 1u << i;
+        }
+        device->memoryTypeTable[flags] = mask;
+    }
+
+    device->memoryLock = spPlatformCreateMutex();
+    VECTOR_INIT(&device->allocations, VECTOR_RESIZE_AMOUNT);
+    memset(device->heaps, 0, sizeof(device->heaps));
+    for (u32 i = 0; i < properties->memoryHeapCount; i++)
+        device->heaps[i].size = properties->memoryHeaps[i].size;
+
+    spDeviceUpdateMemoryBudget(device);
+}
+
+static u32 findMemoryType(
+    const SpiritDevice device,
+    const u32 typeFilter,
+    VkMemoryPropertyFlags properties)
+{
+    u32 candidates = 0;
+    if (properties < array_length(device->memoryTypeTable))
+    {
+        candidates = device->memoryTypeTable[properties];
+    }
+    else
+    {
+        for (u32 i = 0; i < device->memoryProperties.memoryTypeCount; i++)
+        {
+            if ((device->memoryProperties.memoryTypes[i].propertyFlags &
+                 properties) == properties)
+                candidates |= 1u << i;
+        }
+    }
+
+    // the types are ordered by the driver's preference
+    candidates &= typeFilter;
+    return candidates ? (u32)__builtin_ctz(candidates) : UINT32_MAX;
+}
+
+static VkCommandPool createCommandPool(VkDevice device, u32 queueFamily)
 {
 
     VkCommandPoolCreateInfo poolInfo = {};
     poolInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-    poolInfo.queueFamilyIndex = queueFamilies.graphicsQueue;
+    poolInfo.queueFamilyIndex = queueFamily;
     poolInfo.flags            = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT |
                      VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
@@ -662,6 +1162,32 @@ createCommandPool(VkDevice device, QueueFamilyIndices queueFamilies)
     return commandPool;
 }
 
+static void releaseUploads(const SpiritDevice device, const bool all)
+{
+    // threads may push out of submission order, so the whole list is checked
+    size_t kept = 0;
+    for (size_t i = 0; i < VECTOR_SIZE(&device->pendingUploads); i++)
+    {
+        struct t_SpiritPendingUpload upload =
+            VECTOR_AT(&device->pendingUploads, i);
+        const SpiritSyncPoint point = {
+            .queue = SPIRIT_QUEUE_TRANSFER, .value = upload.transferValue};
+        if (!spTimelineReached(device, point))
+        {
+            if (!all)
+            {
+                VECTOR_AT(&device->pendingUploads, kept++) = upload;
+                continue;
+            }
+            spTimelineWait(device, point, UINT64_MAX);
+        }
+
+        spDestroyBuffer(device, upload.staging);
+        free(upload.staging);
+    }
+    device->pendingUploads.size = kept;
+}
+
 // debug callback function
 static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
     VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
@@ -758,14 +1284,36 @@ static u16 isDeviceSuitable(
         supportsQueues = true;
     }
 
-    // check if device has swapchain support
-    SpiritSwapchainSupportInfo swapchainDetails =
-        querySwapChainSupport(createInfo->windowSurface, questionedDevice);
-    supportsSwapchain = swapchainDetails.formatCount > 0 &&
-                        swapchainDetails.presentModeCount > 0;
+    // check if device has swapchain support, a headless device has no
+    // surface to query and never presents
+    if (createInfo->headless)
+    {
+        supportsSwapchain = true;
+    }
+    else
+    {
+        SpiritSwapchainSupportInfo swapchainDetails =
+            querySwapChainSupport(createInfo->windowSurface, questionedDevice);
+        supportsSwapchain = swapchainDetails.formatCount > 0 &&
+                            swapchainDetails.presentModeCount > 0;
+
+        free(swapchainDetails.formats);
+        free(swapchainDetails.presentModes);
+    }
 
-    free(swapchainDetails.formats);
-    free(swapchainDetails.presentModes);
+    // check if device has timeline semaphores, core since vulkan 1.2
+    bool supportsTimeline = false;
+    if (deviceProperties.apiVersion >= VK_API_VERSION_1_2)
+    {
+        VkPhysicalDeviceVulkan12Features features12 = {};
+        features12.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        VkPhysicalDeviceFeatures2 features2 = {};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &features12;
+        vkGetPhysicalDeviceFeatures2(questionedDevice, &features2);
+        supportsTimeline = features12.timelineSemaphore;
+    }
 
     // DEBUG
     if (!supportsQueues)
@@ -777,9 +1325,14 @@ static u16 isDeviceSuitable(
     if (!supportsSwapchain)
         log_error(
             "Device '%s' lacks swapchain support", deviceProperties.deviceName);
+    if (!supportsTimeline)
+        log_error(
+            "Device '%s' lacks timeline semaphores",
+            deviceProperties.deviceName);
 
     // check if device supports all functionality
-    if (hasExtensionSupport && supportsQueues && supportsSwapchain)
+    if (hasExtensionSupport && supportsQueues && supportsSwapchain &&
+        supportsTimeline)
     {
         score = 1;
     }
@@ -806,6 +1359,14 @@ static u16 isDeviceSuitable(
         }
         score += 2;
     }
+    else if (
+        createInfo->headless &&
+        (deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU ||
+         deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU))
+    {
+        // software implementations like lavapipe are fine for offscreen
+        // rendering, but any real GPU is preferred
+    }
     else
     {
         score = 0;
@@ -860,6 +1421,25 @@ static bool checkDeviceExtensionSupport(
     return true;
 }
 
+static bool hasDeviceExtension(
+    VkPhysicalDevice physicalDevice, const char *extensionName)
+{
+    u32 extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(
+        physicalDevice, NULL, &extensionCount, NULL);
+    VkExtensionProperties extensions[extensionCount];
+    vkEnumerateDeviceExtensionProperties(
+        physicalDevice, NULL, &extensionCount, extensions);
+
+    for (u32 i = 0; i < extensionCount; i++)
+    {
+        if (strcmp(extensionName, extensions[i].extensionName) == 0)
+            return true;
+    }
+
+    return false;
+}
+
 // helper function to access required device queues
 static QueueFamilyIndices findDeviceQueues(
     const SpiritDeviceCreateInfo *createInfo, VkPhysicalDevice questionedDevice)
@@ -890,8 +1470,17 @@ static QueueFamilyIndices findDeviceQueues(
             }
         }
 
-        // check for presentationSupport if not already found
-        if (!indices.foundPresentQueue)
+        // without a surface nothing is presented, so the graphics queue is
+        // used in place of a present queue
+        if (createInfo->headless && indices.foundGraphicsQueue)
+        {
+            indices.presentQueue      = indices.graphicsQueue;
+            indices.foundPresentQueue = true;
+        }
+
+        // check for presentationSupport if not already found. A headless
+        // device has no surface, or surface extension, to ask
+        if (!indices.foundPresentQueue && !createInfo->headless)
         {
             if (vkGetPhysicalDeviceSurfaceSupportKHR(
                     questionedDevice,
@@ -915,9 +1504,53 @@ static QueueFamilyIndices findDeviceQueues(
         }
     }
 
+    if (indices.foundGraphicsQueue)
+    {
+        indices.transferQueue = findAsyncQueue(
+            deviceQueueProperties,
+            queueFamilyCount,
+            VK_QUEUE_TRANSFER_BIT,
+            indices.graphicsQueue);
+        indices.computeQueue = findAsyncQueue(
+            deviceQueueProperties,
+            queueFamilyCount,
+            VK_QUEUE_COMPUTE_BIT,
+            indices.graphicsQueue);
+    }
+
     return indices;
 }
 
+static u32 findAsyncQueue(
+    const VkQueueFamilyProperties *families,
+    u32 familyCount,
+    VkQueueFlags required,
+    u32 graphicsFamily)
+{
+    // a transfer only family is usually a dedicated copy engine, so it is
+    // preferred over one that can also compute
+    const VkQueueFlags avoid =
+        required == VK_QUEUE_TRANSFER_BIT
+            ? VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT
+            : VK_QUEUE_GRAPHICS_BIT;
+
+    for (u32 i = 0; i < familyCount; i++)
+    {
+        if ((families[i].queueFlags & required) &&
+            !(families[i].queueFlags & avoid))
+            return i;
+    }
+
+    for (u32 i = 0; i < familyCount; i++)
+    {
+        if ((families[i].queueFlags & required) &&
+            !(families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT))
+            return i;
+    }
+
+    return graphicsFamily;
+}
+
 // function to check swapchain support
 SpiritSwapchainSupportInfo querySwapChainSupport(
     const VkSurfaceKHR surface, VkPhysicalDevice questionedDevice)
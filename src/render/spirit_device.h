@@ -3,6 +3,7 @@
 #include <vulkan/vulkan_core.h>
 
 #include "spirit_window.h"
+#include "utils/spirit_vector.h"
 
 // Create and return rendering device
 //
@@ -25,11 +26,48 @@ typedef struct t_SpiritSwapchainSupportInfo
     u32 presentModeCount;
 } SpiritSwapchainSupportInfo;
 
+// the queues work can be submitted to. Transfer and compute use their own
+// queue families when the gpu has them, so copies and compute work run beside
+// rendering, and otherwise fall back to the graphics queue.
+typedef enum e_SpiritQueueType
+{
+    SPIRIT_QUEUE_GRAPHICS = 0,
+    SPIRIT_QUEUE_TRANSFER,
+    SPIRIT_QUEUE_COMPUTE,
+} SpiritQueueType;
+
+#define SPIRIT_QUEUE_TYPE_COUNT 3
+
+// memory property flags covered by the memory type lookup table, see
+// spDeviceFindMemoryType
+#define SPIRIT_MEMORY_PROPERTY_TABLE_BITS 6
+
+// the memory use of one heap. Budget and usage come from the driver with
+// VK_EXT_memory_budget, and otherwise are the heap size and the amount
+// allocated.
+typedef struct t_SpiritMemoryHeap
+{
+    VkDeviceSize size;
+    VkDeviceSize budget;    // this process can use
+    VkDeviceSize usage;     // by this process
+    VkDeviceSize allocated; // through spDeviceAllocateMemory
+} SpiritMemoryHeap;
+
+// an allocation made by spDeviceAllocateMemory, to count its size against
+// its heap when it is freed
+struct t_SpiritAllocation
+{
+    VkDeviceMemory memory;
+    VkDeviceSize size;
+    u32 heap;
+};
+
 // information used to create logical device
 typedef struct t_SpiritDeviceCreateInfo
 {
     bool powerSaveMode;    // prefer integrated GPU, and limit framerate
     bool enableValidation; // enable vulkan validation layers
+    bool headless;         // no window or surface, nothing is presented
 
     const char *appName;
     u32 appVersion;
@@ -40,13 +78,35 @@ typedef struct t_SpiritDeviceCreateInfo
     u32 requiredValidationLayerCount;
     const char *const *requiredValidationLayers;
 
-    VkSurfaceKHR windowSurface; // will be overridden
+    // set to the surface made for window, which is used to pick a gpu that
+    // can present to it. It is owned by the caller, and must be destroyed
+    // before the device.
+    VkSurfaceKHR windowSurface;
 
     u32 requiredDeviceExtensionCount;
     const char *const *requiredDeviceExtensions;
 
 } SpiritDeviceCreateInfo;
 
+// an upload running on the transfer queue. Its staging buffer is released
+// once the transfer timeline reaches transferValue.
+struct t_SpiritPendingUpload
+{
+    u64 transferValue;
+    SpiritBuffer *staging; // allocated with malloc
+};
+
+// single use command buffers one thread records for one queue, like uploads,
+// see spCreateThreadCommandBuffer. Only the owning thread uses the pool, so
+// recording needs no lock.
+struct t_SpiritThreadQueuePool
+{
+    const void *thread; // identifies the owning thread
+    SpiritQueueType queue;
+    VkCommandPool handle;
+    VECTOR(SpiritCommandBuffer) buffers; // begun again once finished
+};
+
 struct t_SpiritDevice
 {
     VkDevice device;
@@ -54,20 +114,83 @@ struct t_SpiritDevice
     VkPhysicalDevice physicalDevice;
     VkDebugUtilsMessengerEXT debugMessenger;
 
-    VkCommandPool commandPool;
+    // one pool per queue family. Families shared with graphics use the
+    // same pool.
+    VkCommandPool commandPool; // graphics
+    VkCommandPool transferCommandPool;
+    VkCommandPool computeCommandPool;
 
-    VkSurfaceKHR windowSurface;
+    // single use command buffers that finished, kept to be handed out again,
+    // see spRecycleCommandBuffer. The lock also guards
+    // allocating from and freeing to the pools above.
+    SpiritMutex commandLock;
+    VECTOR(SpiritCommandBuffer) recycledCommandBuffers[SPIRIT_QUEUE_TYPE_COUNT];
+
+    // the pools of threads recording single use work, looked up under the
+    // command lock
+    VECTOR(struct t_SpiritThreadQueuePool *) threadPools;
+
+    // pipelines made for every context sharing the device
+    VkPipelineCache pipelineCache;
 
     VkQueue graphicsQueue;
     VkQueue presentQueue;
-    u32 queueCount;
-    const u32 *queueIndices;
+    VkQueue transferQueue; // may be the graphics queue
+    VkQueue computeQueue;  // may be the graphics queue
+
+    // queue family indices
+    u32 graphicsFamily;
+    u32 presentFamily;
+    u32 transferFamily;
+    u32 computeFamily;
+
+    // a timeline semaphore for each queue type, see spirit_timeline.h. The
+    // lock serializes submissions, presents and idle waits on every queue.
+    struct t_SpiritTimeline *timelines;
+    SpiritMutex submitLock;
+
+    // reusable fences and binary semaphores, see spirit_fence.h
+    struct t_SpiritSyncPool *syncPool;
+
+    // memory types, cached when the device is created. Each entry of the
+    // table is a mask of the types having at least those property flags.
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    u32 memoryTypeTable[1 << SPIRIT_MEMORY_PROPERTY_TABLE_BITS];
+
+    // memory use, refreshed by spDeviceUpdateMemoryBudget
+    SpiritMutex memoryLock;
+    SpiritMemoryHeap heaps[VK_MAX_MEMORY_HEAPS];
+    VECTOR(struct t_SpiritAllocation) allocations;
+
+    // buffers released by the transfer family, acquired by the graphics
+    // family at the start of the next frame. Frames wait for the transfer
+    // timeline to reach acquireWait, and uploads still running are kept
+    // until it passes them.
+    SpiritMutex acquireLock;
+    VECTOR(VkBufferMemoryBarrier) pendingAcquires;
+    u64 acquireWait;
+    VECTOR(struct t_SpiritPendingUpload) pendingUploads;
+
+    // the device is shared by contexts, and destroyed by the last one, see
+    // spDeviceRetain
+    u32 referenceCount;
 
     const char **deviceExtensions;
     u32 deviceExtensionCount;
 
     bool powerSaveMode;
     bool validationEnabled;
+    bool headless; // created without a surface, can not present
+    bool incrementalPresent; // VK_KHR_incremental_present is enabled
+    bool memoryBudget;       // VK_EXT_memory_budget is enabled
+    bool bufferDeviceAddress; // buffers can have device addresses
+
+    // nanoseconds per gpu timestamp tick, 0 if the graphics queue can not
+    // write timestamps
+    f32 timestampPeriod;
+
+    // alignment of flushes of memory that is not host coherent
+    VkDeviceSize nonCoherentAtomSize;
 
     SpiritSwapchainSupportInfo swapchainDetails;
 };
@@ -84,7 +207,8 @@ VkFormat spDeviceFindSupportedFormat(
     const VkFormatFeatureFlags features) SPIRIT_NONULL(2);
 
 /**
- * @brief Find the available memory type from a list of types
+ * @brief Find the available memory type from a list of types. Uses the lookup
+ * table cached on the device, and aborts if there is no such type.
  *
  * @param device
  * @param typeFilter
@@ -97,14 +221,85 @@ u32 spDeviceFindMemoryType(
     VkMemoryPropertyFlags properties);
 
 /**
- * @brief Update the stored swapchain support information of a device.
- * This will update the image size contraints, which will make it possible to
- * resize the window.
+ * @brief Pick a memory type for an allocation, and fall back to another heap
+ * if the preferred one would go over its budget. Device local memory falls
+ * back to host visible memory the device can still read.
  *
  * @param device
+ * @param typeFilter
+ * @param properties
+ * @param size of the allocation
+ * @return u32 the memory type, the preferred one if none fit
+ */
+u32 spDeviceChooseMemoryType(
+    const SpiritDevice device,
+    const u32 typeFilter,
+    VkMemoryPropertyFlags properties,
+    const VkDeviceSize size) SPIRIT_NONULL(1);
+
+/**
+ * @brief Check if an allocation fits in the budget of the heap of a memory
+ * type
+ *
+ * @param device
+ * @param memoryType
+ * @param size
+ * @return bool
+ */
+bool spDeviceMemoryFits(
+    const SpiritDevice device, const u32 memoryType, const VkDeviceSize size)
+    SPIRIT_NONULL(1);
+
+/**
+ * @brief Refresh the budget and usage of every heap. With VK_EXT_memory_budget
+ * this asks the driver, which accounts for other processes, so it should be
+ * called about once a frame.
+ *
+ * @param device
+ */
+void spDeviceUpdateMemoryBudget(SpiritDevice device) SPIRIT_NONULL(1);
+
+/**
+ * @brief Get the memory use of a heap
+ *
+ * @param device
+ * @param heap less than memoryProperties.memoryHeapCount
+ * @return SpiritMemoryHeap
+ */
+SpiritMemoryHeap spDeviceGetMemoryHeap(const SpiritDevice device, u32 heap)
+    SPIRIT_NONULL(1);
+
+/**
+ * @brief Update the stored swapchain support information of a device, for a
+ * surface. This will update the image size contraints, which will make it
+ * possible to resize the window.
+ *
+ * @param device
+ * @param surface the surface a swapchain is about to be made for
  * @return SpiritResult
  */
-SpiritResult spDeviceUpdateSwapchainSupport(SpiritDevice device);
+SpiritResult
+spDeviceUpdateSwapchainSupport(SpiritDevice device, VkSurfaceKHR surface);
+
+/**
+ * @brief Check if the present queue of a device can present to a surface.
+ * Surfaces made after the device, for other windows, must be checked.
+ *
+ * @param device
+ * @param surface
+ * @return bool
+ */
+bool spDeviceSupportsSurface(const SpiritDevice device, VkSurfaceKHR surface)
+    SPIRIT_NONULL(1);
+
+/**
+ * @brief Add a reference to a device, so it can be shared by several contexts.
+ * Each reference is given back with spDestroyDevice.
+ *
+ * @param device
+ * @return SpiritDevice device
+ */
+SpiritDevice spDeviceRetain(SpiritDevice device) SPIRIT_NONULL(1);
 
 /**
  * @brief Allocate gpu memory
@@ -127,11 +322,8 @@ SpiritResult spDeviceAllocateMemory(
  * @param device the device used to allocate the memory
  * @param memory a valid VkDeviceMemory object
  */
-SPIRIT_INLINE void
-spDeviceFreeMemory(const SpiritDevice device, VkDeviceMemory memory)
-{
-    vkFreeMemory(device->device, memory, ALLOCATION_CALLBACK);
-}
+void spDeviceFreeMemory(const SpiritDevice device, VkDeviceMemory memory)
+    SPIRIT_NONULL(1);
 
 /**
  * @brief Create a buffer on the associated device
@@ -171,11 +363,126 @@ SpiritResult spDeviceCreateImage(
     VkImage *image,
     VkDeviceMemory *imageMemory) SPIRIT_NONULL(2, 4, 5) SPIRIT_DEPRECATED;
 
+// waiting for the device uses every queue, so it is synchronized with
+// submits and presents
 SPIRIT_INLINE void spDeviceWaitIdle(const SpiritDevice device)
 {
+    spPlatformLockMutex(device->submitLock);
     vkDeviceWaitIdle(device->device);
+    spPlatformUnlockMutex(device->submitLock);
+}
+
+/**
+ * @brief Get the queue used for a type of work
+ *
+ * @param device
+ * @param type
+ * @return VkQueue
+ */
+SPIRIT_INLINE VkQueue
+spDeviceGetQueue(const SpiritDevice device, const SpiritQueueType type)
+{
+    switch (type)
+    {
+    case SPIRIT_QUEUE_TRANSFER: return device->transferQueue;
+    case SPIRIT_QUEUE_COMPUTE: return device->computeQueue;
+    default: return device->graphicsQueue;
+    }
+}
+
+/**
+ * @brief Get the queue family index of a type of queue
+ *
+ * @param device
+ * @param type
+ * @return u32
+ */
+SPIRIT_INLINE u32
+spDeviceGetQueueFamily(const SpiritDevice device, const SpiritQueueType type)
+{
+    switch (type)
+    {
+    case SPIRIT_QUEUE_TRANSFER: return device->transferFamily;
+    case SPIRIT_QUEUE_COMPUTE: return device->computeFamily;
+    default: return device->graphicsFamily;
+    }
+}
+
+/**
+ * @brief Get the command pool for a type of queue
+ *
+ * @param device
+ * @param type
+ * @return VkCommandPool
+ */
+SPIRIT_INLINE VkCommandPool
+spDeviceGetCommandPool(const SpiritDevice device, const SpiritQueueType type)
+{
+    switch (type)
+    {
+    case SPIRIT_QUEUE_TRANSFER: return device->transferCommandPool;
+    case SPIRIT_QUEUE_COMPUTE: return device->computeCommandPool;
+    default: return device->commandPool;
+    }
 }
 
+/**
+ * @brief Queue the acquire half of a queue family ownership transfer of a
+ * buffer to the graphics family. The acquire is recorded by the next frame
+ * of any context using the device, and frames wait for the transfer queue to
+ * finish the release first, so the caller does not have to. Safe to call
+ * from any thread.
+ *
+ * @param device
+ * @param buffer
+ * @param srcFamily the family that released the buffer
+ * @param dstAccess how the graphics queue will use the buffer
+ * @param transferValue the transfer timeline value of the release
+ */
+void spDeviceAcquireBuffer(
+    const SpiritDevice device,
+    VkBuffer buffer,
+    u32 srcFamily,
+    VkAccessFlags dstAccess,
+    const u64 transferValue) SPIRIT_NONULL(1);
+
+/**
+ * @brief Drop the pending acquire of a buffer that is being destroyed before
+ * a frame recorded it.
+ *
+ * @param device
+ * @param buffer
+ */
+void spDeviceCancelAcquire(const SpiritDevice device, VkBuffer buffer)
+    SPIRIT_NONULL(1);
+
+/**
+ * @brief Record every pending ownership acquire into a graphics command
+ * buffer, before anything using the buffers. Uploads the transfer queue has
+ * finished are released.
+ *
+ * @param device
+ * @param commandBuffer recording, on the graphics queue
+ * @return u64 the transfer timeline value the command buffer must wait for
+ * before vertex input, 0 if there is nothing to wait for
+ */
+u64 spDeviceRecordAcquires(
+    const SpiritDevice device, VkCommandBuffer commandBuffer)
+    SPIRIT_NONULL(1);
+
+/**
+ * @brief Keep the staging buffer of an upload until the transfer queue has
+ * finished it, instead of waiting for it. Safe to call from any thread.
+ *
+ * @param device
+ * @param transferValue the transfer timeline value of the upload
+ * @param staging allocated with malloc, destroyed and freed after
+ */
+void spDeviceRetireUpload(
+    const SpiritDevice device,
+    const u64 transferValue,
+    SpiritBuffer *staging) SPIRIT_NONULL(1, 3);
+
 /**
  * @brief Create an image view for an existing image
  *
@@ -192,7 +499,8 @@ VkImageView spDeviceCreateImageView(
     VkImageAspectFlags);
 
 /**
- * @brief Destroy a vulkan device
+ * @brief Release a reference to a device, destroying it once the last
+ * reference is gone.
  *
  * @param device
  * @return SpiritResult
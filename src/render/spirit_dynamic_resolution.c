@@ -0,0 +1,533 @@
+#include "spirit_dynamic_resolution.h"
+
+#include "spirit_command_buffer.h"
+#include "spirit_deletion_queue.h"
+#include "spirit_device.h"
+#include "spirit_swapchain.h"
+
+// defaults
+#define DEFAULT_FRAME_TIME (1000.0f / 60.0f)
+#define DEFAULT_MIN_SCALE  0.5f
+
+// weight of the newest frame in the smoothed frame time
+#define FRAME_TIME_SMOOTHING 0.1f
+
+// frames are only over budget past this much of the target, so jitter around
+// a vsync interval does not drop the resolution
+#define DOWNSCALE_TOLERANCE 1.05f
+
+// frames over budget before the resolution drops. Dropping is fast, so a
+// spike in load costs a few frames at most.
+#define DOWNSCALE_FRAMES 6
+
+// frames the next bucket must be predicted to fit before the resolution
+// rises. Rising is slow, so the resolution does not oscillate.
+#define UPSCALE_FRAMES 60
+
+// the next bucket must be predicted to use less than this much of the target
+#define UPSCALE_HEADROOM 0.85f
+
+//
+// Helpers
+//
+
+// the fraction of the screen resolution a bucket renders at
+static f32 bucketScale(const SpiritDynamicResolution dynamicResolution, u32 i);
+
+// make the render targets of a set
+static SpiritResult createTargets(
+    const SpiritDevice device,
+    SpiritDynamicResolution dynamicResolution,
+    struct t_SpiritRenderTargetSet *set);
+
+// destroy the targets of every set, now or through a deletion queue
+static void destroyTargets(
+    const SpiritDevice device,
+    SpiritDynamicResolution dynamicResolution,
+    SpiritDeletionQueue deletionQueue);
+
+// render into a bucket, creating its targets if needed
+static SpiritResult useBucket(
+    const SpiritDevice device,
+    SpiritDynamicResolution dynamicResolution,
+    SpiritSwapchain swapchain,
+    const u32 bucket);
+
+// get the time a finished frame took, in milliseconds. false if it was not
+// measured.
+static bool readFrameTime(
+    const SpiritDevice device,
+    SpiritDynamicResolution dynamicResolution,
+    const u32 frame,
+    f32 *frameTime);
+
+//
+// Public functions
+//
+
+SpiritDynamicResolution spCreateDynamicResolution(
+    const SpiritDevice device,
+    SpiritSwapchain swapchain,
+    const SpiritDynamicResolutionCreateInfo *createInfo,
+    const u32 frameCount)
+{
+    SpiritDynamicResolution out = new_var(struct t_SpiritDynamicResolution);
+    memset(out, 0, sizeof(struct t_SpiritDynamicResolution));
+
+    out->createInfo = *createInfo;
+    if (out->createInfo.targetFrameTime <= 0.0f)
+        out->createInfo.targetFrameTime = DEFAULT_FRAME_TIME;
+    if (out->createInfo.minScale <= 0.0f || out->createInfo.minScale > 1.0f)
+        out->createInfo.minScale = DEFAULT_MIN_SCALE;
+
+    out->screenExtent = swapchain->extent;
+    out->format       = swapchain->surfaceFormat.format;
+    out->imageCount   = swapchain->imageCount;
+    out->frameCount   = frameCount;
+    out->bucket       = SPIRIT_DYNAMIC_RESOLUTION_BUCKETS - 1;
+
+    out->queriesWritten = new_array(bool, frameCount);
+    memset(out->queriesWritten, 0, sizeof(bool) * frameCount);
+
+    if (device->timestampPeriod > 0.0f)
+    {
+        VkQueryPoolCreateInfo queryInfo = {
+            .sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+            .queryType  = VK_QUERY_TYPE_TIMESTAMP,
+            .queryCount = frameCount * 2};
+
+        if (vkCreateQueryPool(
+                device->device,
+                &queryInfo,
+                ALLOCATION_CALLBACK,
+                &out->queryPool))
+        {
+            log_warning("Failed to create timestamp queries, using cpu time");
+            out->queryPool = VK_NULL_HANDLE;
+        }
+    }
+    else
+        log_verbose("GPU timestamps unsupported, using cpu frame time");
+
+    if (useBucket(device, out, swapchain, out->bucket))
+    {
+        log_error("Failed to create render targets");
+        swapchain->renderTargets = NULL;
+        spDestroyDynamicResolution(device, out);
+        return NULL;
+    }
+
+    return out;
+}
+
+SpiritResult spDynamicResolutionResize(
+    const SpiritDevice device,
+    SpiritDynamicResolution dynamicResolution,
+    SpiritSwapchain swapchain,
+    SpiritDeletionQueue deletionQueue)
+{
+    // every bucket is a fraction of the old size, so the whole pool goes
+    destroyTargets(device, dynamicResolution, deletionQueue);
+
+    dynamicResolution->screenExtent = swapchain->extent;
+    dynamicResolution->format       = swapchain->surfaceFormat.format;
+    dynamicResolution->imageCount   = swapchain->imageCount;
+
+    return useBucket(
+        device, dynamicResolution, swapchain, dynamicResolution->bucket);
+}
+
+bool spDynamicResolutionUpdate(
+    const SpiritDevice device,
+    SpiritDynamicResolution dynamicResolution,
+    SpiritSwapchain swapchain,
+    const u32 frame)
+{
+    SpiritDynamicResolution dr = dynamicResolution;
+
+    f32 frameTime;
+    if (!readFrameTime(device, dr, frame, &frameTime))
+        return false;
+
+    // frames already in flight were recorded at the old resolution
+    if (dr->settleFrames)
+    {
+        --dr->settleFrames;
+        return false;
+    }
+
+    dr->frameTime = dr->frameTime == 0.0f
+                        ? frameTime
+                        : dr->frameTime + FRAME_TIME_SMOOTHING *
+                                              (frameTime - dr->frameTime);
+
+    const f32 target = dr->createInfo.targetFrameTime;
+    u32 bucket       = dr->bucket;
+
+    if (dr->frameTime > target * DOWNSCALE_TOLERANCE)
+    {
+        dr->underBudget = 0;
+        if (++dr->overBudget >= DOWNSCALE_FRAMES && bucket > 0)
+            --bucket;
+    }
+    else
+    {
+        dr->overBudget = 0;
+
+        // gpu time mostly scales with the number of pixels
+        const u32 next =
+            min_value(bucket + 1, SPIRIT_DYNAMIC_RESOLUTION_BUCKETS - 1);
+        const f32 currentScale = bucketScale(dr, bucket);
+        const f32 nextScale    = bucketScale(dr, next);
+        const f32 predicted    = dr->frameTime * (nextScale * nextScale) /
+                              (currentScale * currentScale);
+
+        if (next == bucket || predicted >= target * UPSCALE_HEADROOM)
+            dr->underBudget = 0;
+        else if (++dr->underBudget >= UPSCALE_FRAMES)
+            bucket = next;
+    }
+
+    if (bucket == dr->bucket)
+        return false;
+
+    const f32 oldScale = bucketScale(dr, dr->bucket);
+
+    // if the targets can not be made, stay where we are
+    if (useBucket(device, dr, swapchain, bucket))
+        return false;
+
+    // guess the time at the new scale, rather than waiting for it to settle
+    const f32 newScale = bucketScale(dr, bucket);
+    dr->frameTime *= (newScale * newScale) / (oldScale * oldScale);
+    dr->overBudget   = 0;
+    dr->underBudget  = 0;
+    dr->settleFrames = dr->frameCount;
+
+    log_verbose(
+        "Render scale %.2f, %ux%u",
+        newScale,
+        swapchain->renderExtent.width,
+        swapchain->renderExtent.height);
+
+    return true;
+}
+
+void spDynamicResolutionBeginFrame(
+    SpiritDynamicResolution dynamicResolution,
+    SpiritCommandBuffer commandBuffer,
+    const u32 frame)
+{
+    if (dynamicResolution->queryPool)
+    {
+        vkCmdResetQueryPool(
+            commandBuffer->handle, dynamicResolution->queryPool, frame * 2, 2);
+        vkCmdWriteTimestamp(
+            commandBuffer->handle,
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            dynamicResolution->queryPool,
+            frame * 2);
+    }
+}
+
+void spDynamicResolutionEndFrame(
+    SpiritDynamicResolution dynamicResolution,
+    SpiritCommandBuffer commandBuffer,
+    const SpiritSwapchain swapchain,
+    const u32 imageIndex,
+    const u32 frame,
+    const bool written)
+{
+    const SpiritImage *target = &swapchain->renderTargets[imageIndex];
+    const VkImage image       = swapchain->images[imageIndex].image;
+
+    // left where the render passes leave the swapchain images without
+    // dynamic resolution
+    const VkImageLayout finalLayout = swapchain->headless
+                                          ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+                                          : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+    const VkImageSubresourceRange range = {
+        .aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
+        .baseMipLevel   = 0,
+        .levelCount     = 1,
+        .baseArrayLayer = 0,
+        .layerCount     = 1};
+
+    // the render passes and render graph leave the target as a transfer
+    // source, the swapchain image contents are replaced
+    VkImageMemoryBarrier toTransfer[2] = {
+        {.sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+         .srcAccessMask       = 0,
+         .dstAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT,
+         .oldLayout           = VK_IMAGE_LAYOUT_UNDEFINED,
+         .newLayout           = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+         .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+         .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+         .image               = image,
+         .subresourceRange    = range},
+        {.sType         = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+         .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                          VK_ACCESS_TRANSFER_WRITE_BIT |
+                          VK_ACCESS_SHADER_WRITE_BIT,
+         .dstAccessMask       = VK_ACCESS_TRANSFER_READ_BIT,
+         .oldLayout           = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+         .newLayout           = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+         .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+         .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+         .image               = target->image,
+         .subresourceRange    = range},
+    };
+
+    // the colour attachment stage also waits for the image to be acquired
+    vkCmdPipelineBarrier(
+        commandBuffer->handle,
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+            VK_PIPELINE_STAGE_TRANSFER_BIT |
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0,
+        0,
+        NULL,
+        0,
+        NULL,
+        written ? 2 : 1,
+        toTransfer);
+
+    if (written)
+    {
+        VkImageBlit region = {
+            .srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+            .srcOffsets     = {
+                {0, 0, 0},
+                {(i32)swapchain->renderExtent.width,
+                 (i32)swapchain->renderExtent.height,
+                 1}},
+            .dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+            .dstOffsets     = {
+                {0, 0, 0},
+                {(i32)swapchain->extent.width,
+                 (i32)swapchain->extent.height,
+                 1}}
+        };
+
+        vkCmdBlitImage(
+            commandBuffer->handle,
+            target->image,
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            image,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            1,
+            &region,
+            VK_FILTER_LINEAR);
+    }
+    else
+    {
+        // nothing was drawn, present black rather than garbage
+        const VkClearColorValue black = {.float32 = {0.0f, 0.0f, 0.0f, 1.0f}};
+        vkCmdClearColorImage(
+            commandBuffer->handle,
+            image,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            &black,
+            1,
+            &range);
+    }
+
+    // later copies, like readback, wait on the colour attachment stage
+    VkImageMemoryBarrier toFinal = toTransfer[0];
+    toFinal.srcAccessMask        = VK_ACCESS_TRANSFER_WRITE_BIT;
+    toFinal.dstAccessMask =
+        VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+    toFinal.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    toFinal.newLayout = finalLayout;
+
+    vkCmdPipelineBarrier(
+        commandBuffer->handle,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0,
+        0,
+        NULL,
+        0,
+        NULL,
+        1,
+        &toFinal);
+
+    if (dynamicResolution->queryPool)
+    {
+        vkCmdWriteTimestamp(
+            commandBuffer->handle,
+            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+            dynamicResolution->queryPool,
+            frame * 2 + 1);
+        dynamicResolution->queriesWritten[frame] = true;
+    }
+}
+
+f32 spDynamicResolutionGetScale(const SpiritDynamicResolution dynamicResolution)
+{
+    return bucketScale(dynamicResolution, dynamicResolution->bucket);
+}
+
+SpiritResolution spDynamicResolutionGetResolution(
+    const SpiritDynamicResolution dynamicResolution)
+{
+    const VkExtent2D extent =
+        dynamicResolution->sets[dynamicResolution->bucket].extent;
+    return (SpiritResolution){extent.width, extent.height};
+}
+
+void spDestroyDynamicResolution(
+    const SpiritDevice device, SpiritDynamicResolution dynamicResolution)
+{
+    destroyTargets(device, dynamicResolution, NULL);
+
+    if (dynamicResolution->queryPool)
+        vkDestroyQueryPool(
+            device->device, dynamicResolution->queryPool, ALLOCATION_CALLBACK);
+
+    free(dynamicResolution->queriesWritten);
+    free(dynamicResolution);
+}
+
+//
+// Helpers
+//
+
+f32 bucketScale(const SpiritDynamicResolution dynamicResolution, u32 i)
+{
+    const f32 minScale = dynamicResolution->createInfo.minScale;
+    return minScale + (1.0f - minScale) * (f32)i /
+                          (f32)(SPIRIT_DYNAMIC_RESOLUTION_BUCKETS - 1);
+}
+
+SpiritResult createTargets(
+    const SpiritDevice device,
+    SpiritDynamicResolution dynamicResolution,
+    struct t_SpiritRenderTargetSet *set)
+{
+    set->images = new_array(SpiritImage, dynamicResolution->imageCount);
+    memset(set->images, 0, sizeof(SpiritImage) * dynamicResolution->imageCount);
+
+    for (u32 i = 0; i < dynamicResolution->imageCount; i++)
+    {
+        SpiritImageCreateInfo imageInfo = {
+            .flags  = 0,
+            .size.w = set->extent.width,
+            .size.h = set->extent.height,
+            .format = dynamicResolution->format,
+            .tiling = VK_IMAGE_TILING_OPTIMAL,
+            .usageFlags = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                          VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+            .memoryFlags   = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            .aspectFlags   = VK_IMAGE_ASPECT_COLOR_BIT,
+            .mipLevels     = 1,
+            .withImageView = true};
+
+        if (spCreateImage(device, &imageInfo, &set->images[i]))
+        {
+            for (u32 x = 0; x < i; x++)
+                spDestroyImage(device, &set->images[x]);
+            free(set->images);
+            set->images = NULL;
+            return SPIRIT_FAILURE;
+        }
+        set->images[i].size = imageInfo.size;
+    }
+
+    return SPIRIT_SUCCESS;
+}
+
+void destroyTargets(
+    const SpiritDevice device,
+    SpiritDynamicResolution dynamicResolution,
+    SpiritDeletionQueue deletionQueue)
+{
+    for (u32 b = 0; b < SPIRIT_DYNAMIC_RESOLUTION_BUCKETS; b++)
+    {
+        struct t_SpiritRenderTargetSet *set = &dynamicResolution->sets[b];
+        if (!set->images)
+            continue;
+
+        for (u32 i = 0; i < dynamicResolution->imageCount; i++)
+        {
+            if (deletionQueue)
+                spDeletionQueuePushImage(deletionQueue, &set->images[i]);
+            else
+                spDestroyImage(device, &set->images[i]);
+        }
+
+        free(set->images);
+        set->images = NULL;
+    }
+}
+
+SpiritResult useBucket(
+    const SpiritDevice device,
+    SpiritDynamicResolution dynamicResolution,
+    SpiritSwapchain swapchain,
+    const u32 bucket)
+{
+    struct t_SpiritRenderTargetSet *set = &dynamicResolution->sets[bucket];
+
+    if (!set->images)
+    {
+        const f32 scale   = bucketScale(dynamicResolution, bucket);
+        const VkExtent2D screen = dynamicResolution->screenExtent;
+
+        set->extent = (VkExtent2D){
+            max_value((u32)(screen.width * scale + 0.5f), 1),
+            max_value((u32)(screen.height * scale + 0.5f), 1)};
+
+        if (createTargets(device, dynamicResolution, set))
+            return SPIRIT_FAILURE;
+    }
+
+    dynamicResolution->bucket = bucket;
+    swapchain->renderTargets  = set->images;
+    swapchain->renderExtent   = set->extent;
+
+    return SPIRIT_SUCCESS;
+}
+
+bool readFrameTime(
+    const SpiritDevice device,
+    SpiritDynamicResolution dynamicResolution,
+    const u32 frame,
+    f32 *frameTime)
+{
+    if (!dynamicResolution->queryPool)
+    {
+        // the time between frames, which includes waiting on vsync
+        const u64 now  = spPlatformGetNanoseconds();
+        const u64 last = dynamicResolution->lastFrameStart;
+        dynamicResolution->lastFrameStart = now;
+
+        if (last == 0)
+            return false;
+        *frameTime = (f32)(now - last) / 1000000.0f;
+        return true;
+    }
+
+    if (!dynamicResolution->queriesWritten[frame])
+        return false;
+
+    // the frame is finished, so this does not wait
+    u64 timestamps[2];
+    if (vkGetQueryPoolResults(
+            device->device,
+            dynamicResolution->queryPool,
+            frame * 2,
+            2,
+            sizeof(timestamps),
+            timestamps,
+            sizeof(u64),
+            VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+        return false;
+
+    *frameTime = (f32)(timestamps[1] - timestamps[0]) *
+                 device->timestampPeriod / 1000000.0f;
+    return true;
+}
@@ -0,0 +1,172 @@
+#pragma once
+#include <spirit_header.h>
+#include "spirit_image.h"
+
+// Dynamic resolution. The scene is rendered into a target that is a fraction
+// of the swapchain resolution, and scaled up to the swapchain image at the end
+// of the frame. The fraction follows the measured gpu frame time, so the
+// target frame time is held by trading resolution.
+//
+// Scales are quantized into buckets, and each bucket keeps its render targets
+// once they are created, so moving between resolutions does not allocate.
+
+//
+// Types
+//
+
+// the number of render scales between minScale and 1
+#define SPIRIT_DYNAMIC_RESOLUTION_BUCKETS 8
+
+typedef struct t_SpiritDynamicResolutionCreateInfo
+{
+    f32 targetFrameTime; // milliseconds of gpu time per frame, 0 for 60 fps
+    f32 minScale;        // smallest fraction of the resolution, 0 for half
+} SpiritDynamicResolutionCreateInfo;
+
+// the render targets of one bucket, one for each swapchain image
+struct t_SpiritRenderTargetSet
+{
+    SpiritImage *images; // NULL until the bucket is first used
+    VkExtent2D extent;
+};
+
+struct t_SpiritDynamicResolution
+{
+    SpiritDynamicResolutionCreateInfo createInfo;
+
+    // the swapchain the targets are made for
+    VkExtent2D screenExtent;
+    VkFormat format;
+    u32 imageCount;
+
+    struct t_SpiritRenderTargetSet sets[SPIRIT_DYNAMIC_RESOLUTION_BUCKETS];
+    u32 bucket; // in use, SPIRIT_DYNAMIC_RESOLUTION_BUCKETS - 1 is full size
+
+    // controller
+    f32 frameTime;     // smoothed, milliseconds
+    u32 overBudget;    // consecutive frames over the target
+    u32 underBudget;   // consecutive frames where the next bucket would fit
+    u32 settleFrames;  // frames to ignore after a change
+
+    // timing, two gpu timestamps per frame in flight. Without timestamp
+    // support the time between frames on the cpu is used instead.
+    VkQueryPool queryPool;
+    bool *queriesWritten;
+    u32 frameCount;
+    u64 lastFrameStart; // nanoseconds
+};
+
+//
+// Functions
+//
+
+/**
+ * @brief Create the dynamic resolution state, and point the swapchain at the
+ * render targets of the largest bucket. The swapchain images must support
+ * being blitted to.
+ *
+ * @param device
+ * @param swapchain
+ * @param createInfo
+ * @param frameCount frames in flight
+ * @return SpiritDynamicResolution
+ */
+SpiritDynamicResolution spCreateDynamicResolution(
+    const SpiritDevice device,
+    SpiritSwapchain swapchain,
+    const SpiritDynamicResolutionCreateInfo *createInfo,
+    const u32 frameCount) SPIRIT_NONULL(1, 2, 3);
+
+/**
+ * @brief Remake the render targets for a new swapchain. The old targets are
+ * pushed to the deletion queue.
+ *
+ * @param device
+ * @param dynamicResolution
+ * @param swapchain the new swapchain
+ * @param deletionQueue
+ * @return SpiritResult
+ */
+SpiritResult spDynamicResolutionResize(
+    const SpiritDevice device,
+    SpiritDynamicResolution dynamicResolution,
+    SpiritSwapchain swapchain,
+    SpiritDeletionQueue deletionQueue) SPIRIT_NONULL(1, 2, 3, 4);
+
+/**
+ * @brief Read the timing of a finished frame and pick the scale for the next
+ * one. The frame must be finished by the gpu.
+ *
+ * @param device
+ * @param dynamicResolution
+ * @param swapchain pointed at the new render targets if the scale changes
+ * @param frame the index of the frame in flight about to be recorded
+ * @return true if the render resolution changed, and framebuffers must be
+ * recreated
+ */
+bool spDynamicResolutionUpdate(
+    const SpiritDevice device,
+    SpiritDynamicResolution dynamicResolution,
+    SpiritSwapchain swapchain,
+    const u32 frame) SPIRIT_NONULL(1, 2, 3);
+
+/**
+ * @brief Start timing a frame, at the start of its command buffer
+ *
+ * @param dynamicResolution
+ * @param commandBuffer recording
+ * @param frame the index of the frame in flight
+ */
+void spDynamicResolutionBeginFrame(
+    SpiritDynamicResolution dynamicResolution,
+    SpiritCommandBuffer commandBuffer,
+    const u32 frame) SPIRIT_NONULL(1, 2);
+
+/**
+ * @brief Scale the render target up to the swapchain image, and stop timing
+ * the frame.
+ *
+ * @param dynamicResolution
+ * @param commandBuffer recording
+ * @param swapchain
+ * @param imageIndex the swapchain image being rendered
+ * @param frame the index of the frame in flight
+ * @param written false if nothing was rendered to the target this frame, the
+ * swapchain image is then only transitioned
+ */
+void spDynamicResolutionEndFrame(
+    SpiritDynamicResolution dynamicResolution,
+    SpiritCommandBuffer commandBuffer,
+    const SpiritSwapchain swapchain,
+    const u32 imageIndex,
+    const u32 frame,
+    const bool written) SPIRIT_NONULL(1, 2, 3);
+
+/**
+ * @brief Get the current fraction of the swapchain resolution being rendered
+ *
+ * @param dynamicResolution
+ * @return f32
+ */
+f32 spDynamicResolutionGetScale(const SpiritDynamicResolution dynamicResolution)
+    SPIRIT_NONULL(1);
+
+/**
+ * @brief Get the resolution being rendered, in pixels
+ *
+ * @param dynamicResolution
+ * @return SpiritResolution
+ */
+SpiritResolution spDynamicResolutionGetResolution(
+    const SpiritDynamicResolution dynamicResolution) SPIRIT_NONULL(1);
+
+/**
+ * @brief Destroy the render targets and timing queries. The device must be
+ * idle, and the swapchain must no longer point at the targets.
+ *
+ * @param device
+ * @param dynamicResolution
+ */
+void spDestroyDynamicResolution(
+    const SpiritDevice device, SpiritDynamicResolution dynamicResolution)
+    SPIRIT_NONULL(1, 2);
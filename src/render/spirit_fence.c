@@ -1,19 +1,23 @@
 #include "spirit_fence.h"
 #include "spirit_device.h"
 
+// reset every released fence with one call, and make them available again.
+// The pool must be locked.
+static void resetReleasedFences(
+    const SpiritDevice device, struct t_SpiritSyncPool *pool);
+
 SpiritFence spCreateFence(const SpiritDevice device, bool startSignaled)
 {
+    VkFence handle = spSyncPoolGetFence(device);
+    if (handle == VK_NULL_HANDLE)
+        return NULL;
+
+    // pooled fences are unsignaled. A fence that starts signaled is only
+    // tracked as signaled, nothing waits on the handle until it is submitted.
     SpiritFence out = new_var(struct t_SpiritFence);
+    out->handle     = handle;
     out->isSignaled = startSignaled;
 
-    VkFenceCreateInfo fenceInfo = {
-        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-        .flags = startSignaled ? VK_FENCE_CREATE_SIGNALED_BIT : 0};
-
-    if (vkCreateFence(
-            device->device, &fenceInfo, ALLOCATION_CALLBACK, &out->handle))
-        return NULL;
-
     return out;
 }
 
@@ -61,7 +65,188 @@ void spDestroyFence(const SpiritDevice device, SpiritFence fence)
 {
 
     if (fence->handle)
-        vkDestroyFence(device->device, fence->handle, ALLOCATION_CALLBACK);
+        spSyncPoolReleaseFence(device, fence->handle);
 
     free(fence);
+}
+
+SpiritResult spCreateSyncPool(SpiritDevice device)
+{
+    struct t_SpiritSyncPool *pool = new_var(struct t_SpiritSyncPool);
+    memset(pool, 0, sizeof(*pool));
+
+    pool->lock = spPlatformCreateMutex();
+    VECTOR_INIT(&pool->fences, VECTOR_RESIZE_AMOUNT);
+    VECTOR_INIT(&pool->releasedFences, VECTOR_RESIZE_AMOUNT);
+    VECTOR_INIT(&pool->semaphores, VECTOR_RESIZE_AMOUNT);
+
+    device->syncPool = pool;
+    return pool->lock ? SPIRIT_SUCCESS : SPIRIT_FAILURE;
+}
+
+VkFence spSyncPoolGetFence(const SpiritDevice device)
+{
+    struct t_SpiritSyncPool *pool = device->syncPool;
+    VkFence out                   = VK_NULL_HANDLE;
+
+    spPlatformLockMutex(pool->lock);
+    pool->stats.fenceRequests++;
+    pool->stats.fencesInUse++;
+    if (!VECTOR_SIZE(&pool->fences) && VECTOR_SIZE(&pool->releasedFences))
+        resetReleasedFences(device, pool);
+    if (VECTOR_SIZE(&pool->fences))
+        out = VECTOR_AT(&pool->fences, --pool->fences.size);
+    spPlatformUnlockMutex(pool->lock);
+
+    if (out != VK_NULL_HANDLE)
+        return out;
+
+    VkFenceCreateInfo fenceInfo = {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
+    VkResult result =
+        vkCreateFence(device->device, &fenceInfo, ALLOCATION_CALLBACK, &out);
+
+    spPlatformLockMutex(pool->lock);
+    if (result)
+        pool->stats.fencesInUse--;
+    else
+        pool->stats.fencesCreated++;
+    spPlatformUnlockMutex(pool->lock);
+
+    if (result)
+    {
+        log_error("Failed to create fence");
+        return VK_NULL_HANDLE;
+    }
+
+    return out;
+}
+
+void spSyncPoolReleaseFence(const SpiritDevice device, VkFence fence)
+{
+    struct t_SpiritSyncPool *pool = device->syncPool;
+
+    spPlatformLockMutex(pool->lock);
+    VECTOR_PUSH_BACK(&pool->releasedFences, fence);
+    pool->stats.fencesInUse--;
+    spPlatformUnlockMutex(pool->lock);
+}
+
+VkSemaphore spSyncPoolGetSemaphore(const SpiritDevice device)
+{
+    struct t_SpiritSyncPool *pool = device->syncPool;
+    VkSemaphore out               = VK_NULL_HANDLE;
+
+    spPlatformLockMutex(pool->lock);
+    pool->stats.semaphoreRequests++;
+    pool->stats.semaphoresInUse++;
+    if (VECTOR_SIZE(&pool->semaphores))
+        out = VECTOR_AT(&pool->semaphores, --pool->semaphores.size);
+    spPlatformUnlockMutex(pool->lock);
+
+    if (out != VK_NULL_HANDLE)
+        return out;
+
+    VkSemaphoreCreateInfo semaphoreInfo = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+    VkResult result = vkCreateSemaphore(
+        device->device, &semaphoreInfo, ALLOCATION_CALLBACK, &out);
+
+    spPlatformLockMutex(pool->lock);
+    if (result)
+        pool->stats.semaphoresInUse--;
+    else
+        pool->stats.semaphoresCreated++;
+    spPlatformUnlockMutex(pool->lock);
+
+    if (result)
+    {
+        log_error("Failed to create semaphore");
+        return VK_NULL_HANDLE;
+    }
+
+    return out;
+}
+
+void spSyncPoolReleaseSemaphore(
+    const SpiritDevice device, VkSemaphore semaphore)
+{
+    struct t_SpiritSyncPool *pool = device->syncPool;
+
+    spPlatformLockMutex(pool->lock);
+    VECTOR_PUSH_BACK(&pool->semaphores, semaphore);
+    pool->stats.semaphoresInUse--;
+    spPlatformUnlockMutex(pool->lock);
+}
+
+SpiritSyncPoolStats spSyncPoolGetStats(const SpiritDevice device)
+{
+    struct t_SpiritSyncPool *pool = device->syncPool;
+
+    spPlatformLockMutex(pool->lock);
+    SpiritSyncPoolStats out = pool->stats;
+    out.fencesFree =
+        VECTOR_SIZE(&pool->fences) + VECTOR_SIZE(&pool->releasedFences);
+    out.semaphoresFree = VECTOR_SIZE(&pool->semaphores);
+    spPlatformUnlockMutex(pool->lock);
+
+    return out;
+}
+
+void spDestroySyncPool(SpiritDevice device)
+{
+    struct t_SpiritSyncPool *pool = device->syncPool;
+    if (!pool)
+        return;
+
+    if (pool->stats.fencesInUse || pool->stats.semaphoresInUse)
+        log_warning(
+            "Destroying sync pool with %u fences and %u semaphores in use",
+            pool->stats.fencesInUse,
+            pool->stats.semaphoresInUse);
+
+    for (size_t i = 0; i < VECTOR_SIZE(&pool->fences); i++)
+        vkDestroyFence(
+            device->device, VECTOR_AT(&pool->fences, i), ALLOCATION_CALLBACK);
+    for (size_t i = 0; i < VECTOR_SIZE(&pool->releasedFences); i++)
+        vkDestroyFence(
+            device->device,
+            VECTOR_AT(&pool->releasedFences, i),
+            ALLOCATION_CALLBACK);
+    for (size_t i = 0; i < VECTOR_SIZE(&pool->semaphores); i++)
+        vkDestroySemaphore(
+            device->device,
+            VECTOR_AT(&pool->semaphores, i),
+            ALLOCATION_CALLBACK);
+
+    VECTOR_DELETE(&pool->fences);
+    VECTOR_DELETE(&pool->releasedFences);
+    VECTOR_DELETE(&pool->semaphores);
+    spPlatformDestroyMutex(pool->lock);
+
+    free(pool);
+    device->syncPool = NULL;
+}
+
+//
+// Helpers
+//
+
+static void resetReleasedFences(
+    const SpiritDevice device, struct t_SpiritSyncPool *pool)
+{
+    if (vkResetFences(
+            device->device,
+            VECTOR_SIZE(&pool->releasedFences),
+            pool->releasedFences.at))
+    {
+        // leave them out of the pool, new fences are created instead
+        log_warning("Failed to reset fences");
+        return;
+    }
+    pool->stats.fenceResets++;
+
+    for (size_t i = 0; i < VECTOR_SIZE(&pool->releasedFences); i++)
+        VECTOR_PUSH_BACK(&pool->fences, VECTOR_AT(&pool->releasedFences, i));
+    pool->releasedFences.size = 0;
 }
\ No newline at end of file
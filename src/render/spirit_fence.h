@@ -14,13 +14,40 @@
 #pragma once
 
 #include <spirit_header.h>
+#include "utils/spirit_vector.h"
+
+// Fences and binary semaphores are pooled on the device. Objects given back
+// are handed out again instead of being destroyed, fences are reset together
+// with one vkResetFences call once the unsignaled ones run out.
 
 struct t_SpiritFence
 {
-    VkFence handle;
+    VkFence handle; // from the device pool
     bool isSignaled;
 };
 
+typedef struct t_SpiritSyncPoolStats
+{
+    u32 fencesCreated; // vulkan objects created over the life of the pool
+    u32 semaphoresCreated;
+    u32 fencesInUse; // handed out and not yet released
+    u32 semaphoresInUse;
+    u32 fencesFree; // waiting to be handed out, including ones to reset
+    u32 semaphoresFree;
+    u64 fenceRequests; // every object handed out, new or reused
+    u64 semaphoreRequests;
+    u32 fenceResets; // vkResetFences calls made by the pool
+} SpiritSyncPoolStats;
+
+struct t_SpiritSyncPool
+{
+    SpiritMutex lock;
+    VECTOR(VkFence) fences;         // unsignaled, ready to hand out
+    VECTOR(VkFence) releasedFences; // may be signaled, reset in bulk
+    VECTOR(VkSemaphore) semaphores;
+    SpiritSyncPoolStats stats;
+};
+
 /**
  * @brief Create a SpiritFence
  *
@@ -57,3 +84,63 @@ void spFenceReset(const SpiritDevice device, SpiritFence fence)
  */
 void spDestroyFence(const SpiritDevice device, SpiritFence fence)
     SPIRIT_NONULL(1, 2);
+
+/**
+ * @brief Create the fence and semaphore pool of a device
+ *
+ * @param device
+ * @return SpiritResult
+ */
+SpiritResult spCreateSyncPool(SpiritDevice device) SPIRIT_NONULL(1);
+
+/**
+ * @brief Get an unsignaled fence from the device pool
+ *
+ * @param device
+ * @return VkFence VK_NULL_HANDLE on failure
+ */
+VkFence spSyncPoolGetFence(const SpiritDevice device) SPIRIT_NONULL(1);
+
+/**
+ * @brief Give a fence back to the pool. No submission may still signal it.
+ *
+ * @param device
+ * @param fence signaled or not
+ */
+void spSyncPoolReleaseFence(const SpiritDevice device, VkFence fence)
+    SPIRIT_NONULL(1);
+
+/**
+ * @brief Get a binary semaphore from the device pool
+ *
+ * @param device
+ * @return VkSemaphore VK_NULL_HANDLE on failure
+ */
+VkSemaphore spSyncPoolGetSemaphore(const SpiritDevice device)
+    SPIRIT_NONULL(1);
+
+/**
+ * @brief Give a binary semaphore back to the pool. It must be unsignaled, and
+ * no submission or present may still wait on or signal it.
+ *
+ * @param device
+ * @param semaphore
+ */
+void spSyncPoolReleaseSemaphore(
+    const SpiritDevice device, VkSemaphore semaphore) SPIRIT_NONULL(1);
+
+/**
+ * @brief Get the pool statistics, like how many objects were reused
+ *
+ * @param device
+ * @return SpiritSyncPoolStats
+ */
+SpiritSyncPoolStats spSyncPoolGetStats(const SpiritDevice device)
+    SPIRIT_NONULL(1);
+
+/**
+ * @brief Destroy the pool and every object in it. The device must be idle.
+ *
+ * @param device
+ */
+void spDestroySyncPool(SpiritDevice device) SPIRIT_NONULL(1);
@@ -0,0 +1,150 @@
+#include "spirit_frame_arena.h"
+
+// round a size up to a multiple of a power of two
+#define ALIGN_UP(size, alignment) (((size) + (alignment)-1) & ~((alignment)-1))
+
+// split an offset with an index, see SPIRIT_FRAME_ARENA_INDEX_SHIFT
+#define ARENA_INDEX(used) ((u32)((used) >> SPIRIT_FRAME_ARENA_INDEX_SHIFT))
+#define ARENA_OFFSET(used)                                                     \
+    ((used) & ((1ull << SPIRIT_FRAME_ARENA_INDEX_SHIFT) - 1))
+
+//
+// Public functions
+//
+
+SpiritFrameArena spCreateFrameArena(
+    const SpiritDevice device, const SpiritFrameArenaCreateInfo *createInfo)
+{
+    db_assert(createInfo->frameCount > 0);
+    db_assert(createInfo->uploadSize == 0 || device);
+
+    SpiritFrameArena out = new_var(struct t_SpiritFrameArena);
+    out->frameCount      = createInfo->frameCount;
+    out->cpuSize = ALIGN_UP(createInfo->cpuSize, SPIRIT_FRAME_ARENA_ALIGNMENT);
+    out->cpuBlockCount = max_value(createInfo->frameCount, 2);
+    out->uploadSize    = ALIGN_UP(
+        createInfo->uploadSize, SPIRIT_FRAME_ARENA_UPLOAD_ALIGNMENT);
+    out->upload     = (SpiritBuffer){};
+    out->cpuPeak    = 0;
+    out->uploadPeak = 0;
+    atomic_init(&out->cpuUsed, 0);
+    atomic_init(&out->uploadUsed, 0);
+
+    out->cpuMemory = aligned_alloc(
+        SPIRIT_FRAME_ARENA_ALIGNMENT, out->cpuSize * out->cpuBlockCount);
+    if (out->cpuSize && !out->cpuMemory)
+    {
+        log_error("Failed to allocate frame arena");
+        free(out);
+        return NULL;
+    }
+
+    if (out->uploadSize)
+    {
+        const SpiritBufferCreateInfo bufferInfo = {
+            .size = out->uploadSize * out->frameCount,
+            .usage =
+                VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+                VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+                VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT |
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            .memoryFlags =
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                VK_MEMORY_PROPERTY_HOST_COHERENT_BIT};
+
+        if (spCreateBuffer(device, &bufferInfo, &out->upload))
+        {
+            log_error("Failed to create frame upload ring");
+            spDestroyFrameArena(device, out);
+            return NULL;
+        }
+    }
+
+    return out;
+}
+
+void spFrameArenaBeginFrame(SpiritFrameArena arena, const u32 frame)
+{
+    db_assert(frame < arena->frameCount);
+
+    // swapping the index and offset at once means an allocation racing this
+    // is wholly in the old frame or the new one
+    const u64 cpuBlock = (ARENA_INDEX(atomic_load(&arena->cpuUsed)) + 1) %
+                         arena->cpuBlockCount;
+    const u64 cpuUsed = atomic_exchange(
+        &arena->cpuUsed, cpuBlock << SPIRIT_FRAME_ARENA_INDEX_SHIFT);
+    const u64 uploadUsed = atomic_exchange(
+        &arena->uploadUsed, (u64)frame << SPIRIT_FRAME_ARENA_INDEX_SHIFT);
+
+    // the offsets keep growing past the end when a frame runs out
+    const size_t cpuPeak = min_value(ARENA_OFFSET(cpuUsed), arena->cpuSize);
+    const VkDeviceSize uploadPeak =
+        min_value(ARENA_OFFSET(uploadUsed), arena->uploadSize);
+    arena->cpuPeak    = max_value(arena->cpuPeak, cpuPeak);
+    arena->uploadPeak = max_value(arena->uploadPeak, uploadPeak);
+}
+
+void *spFrameArenaAlloc(SpiritFrameArena arena, const size_t size)
+{
+    const size_t alignedSize = ALIGN_UP(size, SPIRIT_FRAME_ARENA_ALIGNMENT);
+    const u64 used   = atomic_fetch_add(&arena->cpuUsed, alignedSize);
+    const u64 offset = ARENA_OFFSET(used);
+    if (offset + alignedSize > arena->cpuSize)
+    {
+        log_warning("Frame arena is full, increase its size");
+        return NULL;
+    }
+
+    return arena->cpuMemory + arena->cpuSize * ARENA_INDEX(used) + offset;
+}
+
+SpiritResult spFrameArenaUpload(
+    SpiritFrameArena arena,
+    const VkDeviceSize size,
+    const VkDeviceSize alignment,
+    SpiritUploadAllocation *output)
+{
+    db_assert(alignment && (alignment & (alignment - 1)) == 0);
+    db_assert(alignment <= SPIRIT_FRAME_ARENA_UPLOAD_ALIGNMENT);
+
+    // take room for the worst case padding, so the offset is one atomic add
+    // instead of a compare and swap loop
+    const VkDeviceSize reserved = size + alignment - 1;
+    const u64 used           = atomic_fetch_add(&arena->uploadUsed, reserved);
+    const VkDeviceSize start = ARENA_OFFSET(used);
+    if (start + reserved > arena->uploadSize)
+    {
+        log_warning("Frame upload ring is full, increase its size");
+        return SPIRIT_FAILURE;
+    }
+
+    // regions start on SPIRIT_FRAME_ARENA_UPLOAD_ALIGNMENT, so aligning
+    // within the region aligns in the buffer
+    const VkDeviceSize offset =
+        arena->uploadSize * ARENA_INDEX(used) + ALIGN_UP(start, alignment);
+
+    *output = (SpiritUploadAllocation){
+        .data   = SPIRIT_BUFFER_AT(&arena->upload, u8, offset),
+        .buffer = arena->upload.buffer,
+        .offset = offset,
+        .size   = size};
+
+    return SPIRIT_SUCCESS;
+}
+
+void spDestroyFrameArena(const SpiritDevice device, SpiritFrameArena arena)
+{
+    log_verbose(
+        "Frame arena peak use %zu of %zu bytes, upload %lu of %lu bytes",
+        arena->cpuPeak,
+        arena->cpuSize,
+        arena->uploadPeak,
+        arena->uploadSize);
+
+    if (arena->upload.buffer)
+        spDestroyBuffer(device, &arena->upload);
+
+    free(arena->cpuMemory);
+    free(arena);
+}
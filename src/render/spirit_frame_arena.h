@@ -0,0 +1,137 @@
+#pragma once
+#include <spirit_header.h>
+#include <stdatomic.h>
+#include "spirit_buffer.h"
+
+// Linear allocators for data that only lives for a frame. Allocating is one
+// atomic add to the frame's offset, and nothing is ever freed on its own,
+// instead a frame's memory is reset as a whole when the frame begins again.
+//
+// The cpu side holds data that is recorded into the frame, like draw packets.
+// It has at least two blocks, so data added between frames survives the reset
+// at the start of the frame it is for. The upload side is a host visible
+// buffer split into a region for each frame in flight, reset once the gpu has
+// finished the frame that last used it.
+
+//
+// Definitions
+//
+
+// every cpu allocation is aligned to this
+#define SPIRIT_FRAME_ARENA_ALIGNMENT 16
+
+// upload regions are aligned to this, the largest offset alignment a device
+// may require
+#define SPIRIT_FRAME_ARENA_UPLOAD_ALIGNMENT 256
+
+// the block or frame being filled is kept above this bit of the offset, so
+// both change in one atomic operation
+#define SPIRIT_FRAME_ARENA_INDEX_SHIFT 48
+
+//
+// Types
+//
+
+typedef struct t_SpiritFrameArenaCreateInfo
+{
+    u32 frameCount;          // frames in flight
+    size_t cpuSize;          // bytes each frame
+    VkDeviceSize uploadSize; // bytes each frame, 0 for no upload ring
+} SpiritFrameArenaCreateInfo;
+
+// a piece of the upload ring, valid until the frame comes around again
+typedef struct t_SpiritUploadAllocation
+{
+    void *data; // mapped, write only
+    VkBuffer buffer;
+    VkDeviceSize offset; // of data in buffer
+    VkDeviceSize size;
+} SpiritUploadAllocation;
+
+struct t_SpiritFrameArena
+{
+    u32 frameCount;
+
+    u8 *cpuMemory; // cpuBlockCount blocks of cpuSize
+    size_t cpuSize;
+    u32 cpuBlockCount;
+    _Atomic u64 cpuUsed; // and the block being filled, see INDEX_SHIFT
+
+    SpiritBuffer upload; // frameCount regions of uploadSize
+    VkDeviceSize uploadSize;
+    _Atomic u64 uploadUsed; // and the frame being filled, see INDEX_SHIFT
+
+    // the most used by any frame, to size the arena
+    size_t cpuPeak;
+    VkDeviceSize uploadPeak;
+};
+
+// allocate an array of a type from the cpu side of a frame arena
+#define SPIRIT_FRAME_ARENA_NEW(arena, type, count)                             \
+    ((type *)spFrameArenaAlloc(arena, sizeof(type) * (count)))
+
+//
+// Functions
+//
+
+/**
+ * @brief Create a frame arena
+ *
+ * @param device may be NULL if there is no upload ring
+ * @param createInfo
+ * @return SpiritFrameArena NULL on failure
+ */
+SpiritFrameArena spCreateFrameArena(
+    const SpiritDevice device, const SpiritFrameArenaCreateInfo *createInfo)
+    SPIRIT_NONULL(2);
+
+/**
+ * @brief Start a frame. Resets the next cpu block, and the upload region of
+ * the frame, so the gpu must have finished the last time the frame was
+ * submitted. Other threads may allocate meanwhile, and get memory from either
+ * the old frame or the new one.
+ *
+ * @param arena
+ * @param frame the index of the frame in flight
+ */
+void spFrameArenaBeginFrame(SpiritFrameArena arena, const u32 frame)
+    SPIRIT_NONULL(1);
+
+/**
+ * @brief Allocate cpu memory for the rest of the frame. Safe to call from
+ * several threads.
+ *
+ * @param arena
+ * @param size
+ * @return void* aligned to SPIRIT_FRAME_ARENA_ALIGNMENT, NULL if the frame
+ * is out of memory
+ */
+void *spFrameArenaAlloc(SpiritFrameArena arena, const size_t size)
+    SPIRIT_NONULL(1);
+
+/**
+ * @brief Allocate memory the gpu can read this frame, from the upload ring.
+ * Safe to call from several threads.
+ *
+ * @param arena
+ * @param size
+ * @param alignment of the offset, a power of two no larger than
+ * SPIRIT_FRAME_ARENA_UPLOAD_ALIGNMENT
+ * @param output
+ * @return SpiritResult SPIRIT_FAILURE if the frame is out of memory
+ */
+SpiritResult spFrameArenaUpload(
+    SpiritFrameArena arena,
+    const VkDeviceSize size,
+    const VkDeviceSize alignment,
+    SpiritUploadAllocation *output) SPIRIT_NONULL(1, 4);
+
+/**
+ * @brief Destroy a frame arena. The gpu must have finished with the upload
+ * ring.
+ *
+ * @param device the arena was created with
+ * @param arena
+ */
+void spDestroyFrameArena(const SpiritDevice device, SpiritFrameArena arena)
+    SPIRIT_NONULL(2);
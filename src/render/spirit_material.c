@@ -15,64 +15,190 @@
 // Helper functions
 //
 
-SPIRIT_INLINE void clearQueue(SpiritMaterial material)
+// take every queued node from the material, leaving the queue empty. The
+// nodes are linked through next, newest first.
+static SPIRIT_INLINE struct t_SpiritMaterialListNode *
+takeQueue(SpiritMaterial material)
 {
+    atomic_store_explicit(&material->meshCount, 0, memory_order_relaxed);
+    atomic_store_explicit(&material->drawHash, 0, memory_order_relaxed);
 
-    while (!LIST_EMPTY(&material->meshList))
-    {
-        struct t_SpiritMaterialListNode *np = LIST_FIRST(&material->meshList);
+    // acquire pairs with the release in spMaterialAddMesh, so the node
+    // contents are visible
+    return atomic_exchange_explicit(
+        &material->meshQueue, NULL, memory_order_acquire);
+}
+
+// return a node to the material once it has been drawn
+static void releaseNode(struct t_SpiritMaterialListNode *node);
 
-        db_assert_msg(np->used, "Unused node added to material queue");
-        LIST_REMOVE(np, data);
+// release a list of taken nodes without drawing them
+static SPIRIT_INLINE void releaseList(struct t_SpiritMaterialListNode *np)
+{
+    while (np != NULL)
+    {
+        struct t_SpiritMaterialListNode *next = np->next;
         spReleaseMesh(np->mesh);
-        if (np->isBuffer)
-            np->used = false;
-        else
-            free(np);
+        releaseNode(np);
+        np = next;
     }
 }
 
-struct t_SpiritMaterialListNode *findNode(const SpiritMaterial material)
+// release every queued node without drawing it
+static SPIRIT_INLINE void clearQueue(SpiritMaterial material)
+{
+    releaseList(takeQueue(material));
+}
+
+// slots of the node buffer tried before a node comes from the overflow
+#define NODE_BUFFER_PROBES 8
+
+// get an unused node, from the node buffer if there is space, the frame arena
+// or the heap otherwise. Safe to call from several threads.
+static struct t_SpiritMaterialListNode *findNode(const SpiritMaterial material)
 {
+    // nodes may be added while others are drawn, so a slot is only taken if
+    // its node was released. Acquire pairs with the release in releaseNode.
     struct t_SpiritMaterialListNode *node = NULL;
-    if (material->currentBufferSpot < array_length(material->nodeBuffer))
+    for (u32 i = 0; i < NODE_BUFFER_PROBES && node == NULL; i++)
     {
-        node = &material->nodeBuffer[material->currentBufferSpot];
+        const u32 spot = atomic_fetch_add_explicit(
+            &material->currentBufferSpot, 1, memory_order_relaxed);
+
+        node = &material->nodeBuffer[spot % array_length(material->nodeBuffer)];
         db_assert(node->isBuffer);
-        db_assert(node->used == false);
-        material->currentBufferSpot++;
-        node->used = true;
+        if (atomic_exchange_explicit(&node->used, true, memory_order_acquire))
+            node = NULL;
     }
-    else
+
+    if (node == NULL)
     {
-        node           = new_var(struct t_SpiritMaterialListNode);
+        // nodes are drawn in the frame after they are added, and the arena
+        // keeps the block they are in until then
+        node = SPIRIT_FRAME_ARENA_NEW(
+            material->frameArena, struct t_SpiritMaterialListNode, 1);
+        const bool isArena = node != NULL;
+        if (!isArena)
+        {
+            node = new_var(struct t_SpiritMaterialListNode);
+            log_warning(
+                "Overflowing material node buffer, increase buffer size");
+        }
+
         node->isBuffer = false;
-        node->used     = true;
-        log_warning("Overflowing material node buffer, increase buffer size");
+        node->isArena  = isArena;
+        atomic_init(&node->used, true);
     }
 
     return node;
 }
 
-SpiritResult
-releaseNode(SpiritMaterial material, struct t_SpiritMaterialListNode *node)
+void releaseNode(struct t_SpiritMaterialListNode *node)
 {
-    db_assert(node && node->used);
-
-    if (!node || !node->used)
-        return SPIRIT_FAILURE;
+    db_assert(node && atomic_load(&node->used));
 
     if (node->isBuffer)
+        atomic_store_explicit(&node->used, false, memory_order_release);
+    else if (!node->isArena)
+        free(node);
+}
+
+// hash a draw for change detection, FNV-1a over the mesh reference and the
+// push constant fields
+static u64 hashDraw(
+    const SpiritMeshReference *meshRef, const SpiritPushConstant *pushConstant);
+
+// load the materials shaders and create its pipeline, then publish the
+// result through material->state
+static void compilePipeline(SpiritMaterial material);
+
+// thread entry point for asynchronous material compilation
+static void *compileThreadFunction(void *arg);
+
+// find the pipeline to draw a material with, which may be the fallback
+// pipeline if the material is still compiling. NULL if there is none.
+static SpiritPipeline selectPipeline(const SpiritMaterial material);
+
+
+void compilePipeline(SpiritMaterial material)
+{
+    SpiritPipelineCreateInfo pipelineCreateInfo = {};
+    pipelineCreateInfo.vertexShader             = material->vertexShader;
+    pipelineCreateInfo.fragmentShader           = material->fragmentShader;
+    pipelineCreateInfo.resolution               = material->resolution;
+    pipelineCreateInfo.descriptorSetLayoutCount = 1;
+    pipelineCreateInfo.descriptorSetLayouts     = &material->objectSetLayout;
+
+    material->pipeline = spCreatePipeline(
+        material->device, &pipelineCreateInfo, material->renderPass, NULL);
+
+    if (material->pipeline == NULL)
     {
-        node->used = false;
-        material->currentBufferSpot--;
+        log_error(
+            "Failed to make pipeline for material '%s'", material->name);
+        atomic_store_explicit(
+            &material->state, SPIRIT_MATERIAL_STATE_FAILED,
+            memory_order_release);
+        return;
     }
-    else
+
+    // release so the pipeline handle is visible before the state changes
+    atomic_store_explicit(
+        &material->state, SPIRIT_MATERIAL_STATE_READY, memory_order_release);
+}
+
+void *compileThreadFunction(void *arg)
+{
+    SpiritMaterial material = arg;
+
+    // not timed, the function timer is not thread safe
+    compilePipeline(material);
+
+    if (spMaterialIsReady(material))
+        log_verbose("Material '%s' finished compiling", material->name);
+
+    return NULL;
+}
+
+u64 hashDraw(
+    const SpiritMeshReference *meshRef, const SpiritPushConstant *pushConstant)
+{
+    // hash the fields rather than the structs, so padding is not included
+    const struct
     {
-        free(node);
+        const void *data;
+        size_t size;
+    } fields[] = {
+        {&meshRef->node, sizeof(meshRef->node)},
+        {&meshRef->vertCount, sizeof(meshRef->vertCount)},
+        {&meshRef->meshManager, sizeof(meshRef->meshManager)},
+        {pushConstant->transform, sizeof(pushConstant->transform)},
+        {pushConstant->color, sizeof(pushConstant->color)},
+    };
+
+    u64 hash = 0xcbf29ce484222325ull;
+    for (u32 i = 0; i < array_length(fields); i++)
+    {
+        const u8 *bytes = fields[i].data;
+        for (size_t n = 0; n < fields[i].size; n++)
+        {
+            hash ^= bytes[n];
+            hash *= 0x100000001b3ull;
+        }
     }
 
-    return SPIRIT_SUCCESS;
+    return hash;
+}
+
+SpiritPipeline selectPipeline(const SpiritMaterial material)
+{
+    if (spMaterialIsReady(material))
+        return material->pipeline;
+
+    if (material->fallback && spMaterialIsReady(material->fallback))
+        return material->fallback->pipeline;
+
+    return NULL;
 }
 
 //
@@ -101,51 +227,80 @@ SpiritMaterial spCreateMaterial(
         return NULL;
     }
 
-    // create associated pipeline
-    SpiritPipelineCreateInfo pipelineCreateInfo = {};
-    pipelineCreateInfo.vertexShader             = createInfo->vertexShader;
-    pipelineCreateInfo.fragmentShader           = createInfo->fragmentShader;
-
-    pipelineCreateInfo.resolution     = context->screenResolution;
-    pipelineCreateInfo.vertexShader   = createInfo->vertexShader;
-    pipelineCreateInfo.fragmentShader = createInfo->fragmentShader;
-    pipelineCreateInfo.resolution     = context->screenResolution;
+    material->name            = createInfo->name;
+    material->vertexShader    = createInfo->vertexShader;
+    material->fragmentShader  = createInfo->fragmentShader;
+    material->device          = context->device;
+    material->resolution      = context->screenResolution;
+    material->objectSetLayout = context->objectSetLayout;
+    material->frameArena      = context->frameArena;
+    material->fallback        = createInfo->fallback;
+    material->pipeline        = NULL;
+    material->compileThread   = NULL;
+    atomic_init(&material->state, SPIRIT_MATERIAL_STATE_COMPILING);
 
-    time_function_with_return(
-        spCreatePipeline(
-            context->device, &pipelineCreateInfo, material->renderPass, NULL),
-        material->pipeline);
+    // create associated pipeline
+    if (createInfo->asyncCompile)
+    {
+        material->compileThread =
+            spPlatformCreateThread(compileThreadFunction, material);
+    }
 
-    if (material->pipeline == NULL)
+    // compile on this thread if async was not requested, or the worker could
+    // not be started
+    if (material->compileThread == NULL)
     {
-        spDestroyRenderPass(material->renderPass, context->device);
-        free(material);
-        log_error(
-            "Failed to make pipeline for material '%s'", createInfo->name);
-        log_error(
-            "Failed to make pipeline for material '%s'", createInfo->name);
-        return NULL;
+        time_function(compilePipeline(material));
+
+        if (material->pipeline == NULL)
+        {
+            spDestroyRenderPass(material->renderPass, context->device);
+            free(material);
+            return NULL;
+        }
     }
 
     // set node buffer data
-    material->currentBufferSpot = 0;
     for (u32 i = 0; i < array_length(material->nodeBuffer); i++)
     {
         material->nodeBuffer[i] = (struct t_SpiritMaterialListNode){
-            .isBuffer = true, .used = false, .data = {}, .mesh = {}};
+            .isBuffer = true,
+            .isArena  = false,
+            .used     = false,
+            .next     = NULL,
+            .mesh     = {}};
     }
 
-    LIST_INIT(&material->meshList);
+    atomic_init(&material->currentBufferSpot, 0);
+    atomic_init(&material->meshCount, 0);
+    atomic_init(&material->meshQueue, NULL);
+    atomic_init(&material->drawHash, 0);
+    material->lastDrawHash  = 0;
+    material->lastMeshCount = 0;
+    material->lastPipeline  = NULL;
 
     return material;
 }
 
+bool spMaterialIsReady(const SpiritMaterial material)
+{
+    return spMaterialGetState(material) == SPIRIT_MATERIAL_STATE_READY;
+}
+
+SpiritMaterialState spMaterialGetState(const SpiritMaterial material)
+{
+    return atomic_load_explicit(&material->state, memory_order_acquire);
+}
+
 SpiritResult
 spMaterialUpdate(const SpiritContext context, SpiritMaterial material)
 {
 
     return spRenderPassRecreateFramebuffers(
-        context->device, material->renderPass, context->swapchain);
+        context->device,
+        material->renderPass,
+        context->swapchain,
+        context->deletionQueue);
 }
 
 SpiritResult spMaterialAddMesh(
@@ -158,19 +313,58 @@ SpiritResult spMaterialAddMesh(
     newNode->mesh         = spCheckoutMesh(meshRef);
     newNode->pushConstant = pushConstant;
 
-    LIST_INSERT_HEAD(&material->meshList, newNode, data);
-    material->meshCount++;
+    // push onto the queue, retrying if another thread pushed first
+    newNode->next =
+        atomic_load_explicit(&material->meshQueue, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(
+        &material->meshQueue,
+        &newNode->next,
+        newNode,
+        memory_order_release,
+        memory_order_relaxed))
+        ;
+
+    atomic_fetch_add_explicit(&material->meshCount, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(
+        &material->drawHash,
+        hashDraw(&meshRef, &pushConstant),
+        memory_order_relaxed);
     return SPIRIT_SUCCESS;
 }
 
+bool spMaterialTakeChanges(SpiritMaterial material)
+{
+    const u64 drawHash =
+        atomic_load_explicit(&material->drawHash, memory_order_relaxed);
+    const u32 meshCount =
+        atomic_load_explicit(&material->meshCount, memory_order_relaxed);
+    const SpiritPipeline pipeline = selectPipeline(material);
+
+    const bool changed = drawHash != material->lastDrawHash ||
+                         meshCount != material->lastMeshCount ||
+                         pipeline != material->lastPipeline;
+
+    material->lastDrawHash  = drawHash;
+    material->lastMeshCount = meshCount;
+    material->lastPipeline  = pipeline;
+
+    return changed;
+}
+
+void spMaterialDiscardMeshes(SpiritMaterial material)
+{
+    clearQueue(material);
+}
+
 SpiritResult spMaterialRecordCommands(
     const SpiritContext context, SpiritMaterial material, const u32 imageIndex)
 {
 
     db_assert_msg(
-        imageIndex < context->commandBufferCount, "invalid image index");
+        imageIndex < context->swapchain->imageCount, "invalid image index");
 
-    SpiritCommandBuffer buf = context->commandBuffers[imageIndex];
+    struct t_SpiritFrame *frame = spContextGetCurrentFrame(context);
+    SpiritCommandBuffer buf     = frame->commandBuffer;
 
     if (buf->state != SPIRIT_COMMAND_BUFFER_STATE_RECORDING)
     {
@@ -178,67 +372,117 @@ SpiritResult spMaterialRecordCommands(
         return SPIRIT_FAILURE;
     }
 
-    if (spRenderPassBegin(
-            material->renderPass,
-            imageIndex,
-            context->commandBuffers[imageIndex]))
+    // the pipeline is not ready and there is no usable fallback, so skip the
+    // draws for this frame
+    SpiritPipeline pipeline = selectPipeline(material);
+    if (pipeline == NULL)
+    {
+        clearQueue(material);
+        return SPIRIT_SUCCESS;
+    }
+
+    if (spRenderPassBegin(material->renderPass, imageIndex, buf))
     {
         clearQueue(material);
         log_error("Failed to begin render pass");
         return SPIRIT_FAILURE;
     }
 
-    if (spPipelineBindCommandBuffer(material->pipeline, buf))
+    // the frame has contents worth reading back
+    frame->imageWritten = true;
+
+    if (spPipelineBindCommandBuffer(pipeline, buf))
     {
+        clearQueue(material);
+        spRenderPassEnd(buf);
         log_error("Failed to bind command buffer");
         return SPIRIT_FAILURE;
     }
 
-    // iterate through meshes and submit vertexes
-    struct t_SpiritMaterialListNode *currentMesh =
-        LIST_FIRST(&material->meshList);
+    // take the queue before counting it, meshes added after this are drawn
+    // next frame instead of past the reserved range
+    struct t_SpiritMaterialListNode *currentMesh = takeQueue(material);
+    u32 meshCount                                = 0;
+    for (struct t_SpiritMaterialListNode *np = currentMesh; np; np = np->next)
+        meshCount++;
 
-    while (currentMesh != NULL)
+    // reserve a range of the object buffer for this materials meshes, and
+    // push its start so the shader can index it with gl_InstanceIndex
+    SpiritDrawPushConstant pushConstant = {};
+    SpiritObjectData *objects           = spContextReserveObjects(
+        context, meshCount, &pushConstant.objectBase);
+
+    if (objects == NULL)
     {
+        releaseList(currentMesh);
+        clearQueue(material);
+        time_function(spRenderPassEnd(buf));
+        return SPIRIT_FAILURE;
+    }
+
+    vkCmdBindDescriptorSets(
+        buf->handle,
+        VK_PIPELINE_BIND_POINT_GRAPHICS,
+        pipeline->layout,
+        0,
+        1,
+        &frame->objectBuffer.descriptorSet,
+        0,
+        NULL);
+
+    vkCmdPushConstants(
+        buf->handle,
+        pipeline->layout,
+        VK_SHADER_STAGE_VERTEX_BIT,
+        0,
+        sizeof(SpiritDrawPushConstant),
+        &pushConstant);
+
+    u32 objectIndex = 0;
 
+    // iterate through meshes and submit vertexes
+    while (currentMesh != NULL)
+    {
 #ifndef FUNCTION_TIMER_NO_DIAGNOSTIC
         struct FunctionTimerData timer = start_timer("vertex commands");
 #endif
 
         VkBuffer vertBuffers[] = {
-            spMeshManagerAccessMesh(currentMesh->mesh)->vertexBuffer};
+            spMeshManagerAccessMesh(currentMesh->mesh)->vertexBuffer.buffer};
         VkDeviceSize offsets[] = {0};
 
         vkCmdBindVertexBuffers(buf->handle, 0, 1, vertBuffers, offsets);
 
-        // push constants
-        vkCmdPushConstants(
-            buf->handle,
-            material->pipeline->layout,
-            VK_SHADER_STAGE_VERTEX_BIT,
-            0,
-            sizeof(SpiritPushConstant),
-            &currentMesh->pushConstant);
-
-        vkCmdDraw(buf->handle, currentMesh->mesh.vertCount, 1, 0, 0);
+        // object data, read by the shader from the storage buffer
+        SpiritObjectData *object = &objects[objectIndex];
+        memcpy(
+            object->transform,
+            currentMesh->pushConstant.transform,
+            sizeof(object->transform));
+        memcpy(
+            object->color,
+            currentMesh->pushConstant.color,
+            sizeof(currentMesh->pushConstant.color));
+        object->color[3] = 1.0f;
+
+        // first instance selects the object
+        vkCmdDraw(
+            buf->handle, currentMesh->mesh.vertCount, 1, 0, objectIndex);
+        objectIndex++;
 
         // move to next list element
         struct t_SpiritMaterialListNode *oldNode = currentMesh;
-        currentMesh                              = LIST_NEXT(currentMesh, data);
+        currentMesh                              = currentMesh->next;
 
         spReleaseMesh(oldNode->mesh);
-        LIST_REMOVE(oldNode, data);
-        releaseNode(material, oldNode);
+        releaseNode(oldNode);
 
 #ifndef FUNCTION_TIMER_NO_DIAGNOSTIC
         end_timer(timer);
 #endif
     }
 
-    time_function(spRenderPassEnd(context->commandBuffers[imageIndex]));
-
-    // reset queue
-    material->currentBufferSpot = 0;
+    time_function(spRenderPassEnd(buf));
 
     return SPIRIT_SUCCESS;
 }
@@ -246,8 +490,13 @@ SpiritResult spMaterialRecordCommands(
 SpiritResult
 spDestroyMaterial(const SpiritContext context, SpiritMaterial material)
 {
+    // wait for the compile to finish before freeing anything it uses
+    if (material->compileThread)
+        spPlatformJoinThread(material->compileThread);
+
     clearQueue(material);
-    spDestroyPipeline(context->device, material->pipeline);
+    if (material->pipeline)
+        spDestroyPipeline(context->device, material->pipeline);
     spDestroyRenderPass(material->renderPass, context->device);
     free(material);
     return SPIRIT_SUCCESS;
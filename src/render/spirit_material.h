@@ -16,6 +16,20 @@
 
 #pragma once
 #include <spirit_header.h>
+#include <stdatomic.h>
+
+/**
+ * @brief Whether a materials pipeline can be used for drawing. Materials
+ * created with asyncCompile start in SPIRIT_MATERIAL_STATE_COMPILING, and move
+ * to READY or FAILED once the background compile finishes.
+ *
+ */
+typedef enum e_SpiritMaterialState
+{
+    SPIRIT_MATERIAL_STATE_COMPILING,
+    SPIRIT_MATERIAL_STATE_READY,
+    SPIRIT_MATERIAL_STATE_FAILED,
+} SpiritMaterialState;
 
 /**
  * @brief Information to create a material
@@ -27,15 +41,26 @@ typedef struct t_SpiritMaterialCreateInfo
     const char *vertexShader;
     const char *fragmentShader;
 
+    // load shaders and build the pipeline on a worker thread, so
+    // spCreateMaterial returns right away. The shader path strings must stay
+    // valid until the material is ready.
+    bool asyncCompile;
+
+    // optional, a material whose pipeline is used to draw this materials
+    // meshes until it has finished compiling. If it is NULL, or not ready
+    // either, the meshes are skipped.
+    SpiritMaterial fallback;
+
 } SpiritMaterialCreateInfo;
 
 struct t_SpiritMaterialListNode
 {
     bool isBuffer; // if the node is part of a buffer
-    bool used;     // if the node is part of a buffer, whether or not it is used
+    bool isArena;  // if the node is in the frame arena, and is never freed
+    atomic_bool used; // if the node is part of a buffer, whether it is taken
     SpiritMeshReference mesh;
     SpiritPushConstant pushConstant;
-    LIST_ENTRY(t_SpiritMaterialListNode) data;
+    struct t_SpiritMaterialListNode *next; // next node in the queue
 };
 
 /**
@@ -51,11 +76,32 @@ struct t_SpiritMaterial
     SpiritRenderPass renderPass;
     SpiritPipeline pipeline;
 
-    u32 meshCount;
+    // asynchronous compilation
+    _Atomic SpiritMaterialState state;
+    SpiritMaterial fallback;
+    SpiritThread compileThread;
+    SpiritDevice device;
+    SpiritResolution resolution;
+    VkDescriptorSetLayout objectSetLayout;
 
-    u32 currentBufferSpot; // store node buffer index to use next
+    // meshes queued for the next frame. The queue is a lock free stack, so
+    // several threads can add meshes at once. It is emptied by
+    // spMaterialRecordCommands.
+    _Atomic u32 meshCount;
+    // the node buffer is a ring, a slot is handed out again once its node
+    // has been released, never just because the queue was taken
+    _Atomic u32 currentBufferSpot; // store node buffer index to try next
     struct t_SpiritMaterialListNode nodeBuffer[1024];
-    LIST_HEAD(t_MaterialListHead, t_SpiritMaterialListNode) meshList;
+    SpiritFrameArena frameArena; // of the context, holds the overflow
+    _Atomic(struct t_SpiritMaterialListNode *) meshQueue;
+
+    // a hash of the queued draws, summed so the order threads add them in
+    // does not matter. Compared with the last frame to find materials whose
+    // output changed, see spMaterialTakeChanges.
+    _Atomic u64 drawHash;
+    u64 lastDrawHash;
+    u32 lastMeshCount;
+    SpiritPipeline lastPipeline; // the pipeline that drew the last frame
 };
 
 /**
@@ -68,6 +114,24 @@ struct t_SpiritMaterial
 SpiritMaterial spCreateMaterial(
     const SpiritContext context, const SpiritMaterialCreateInfo *createInfo);
 
+/**
+ * @brief Check if a material has finished compiling, and can be drawn with its
+ * own pipeline.
+ *
+ * @param material
+ * @return true the pipeline is ready
+ * @return false the pipeline is still compiling, or failed to compile
+ */
+bool spMaterialIsReady(const SpiritMaterial material);
+
+/**
+ * @brief Get the compile state of a material.
+ *
+ * @param material
+ * @return SpiritMaterialState
+ */
+SpiritMaterialState spMaterialGetState(const SpiritMaterial material);
+
 /**
  * @brief Update a material to have a relevant window size, and to know all the
  * information it needs about a window
@@ -85,6 +149,9 @@ spMaterialUpdate(const SpiritContext context, SpiritMaterial material);
  * it will be removed from the material. The mesh will also only be rendered
  * when.
  *
+ * It is safe to call from several threads at once without locking, but all
+ * calls for a frame must finish before spContextSubmitFrame is called.
+ *
  * @param material
  * @param meshRef
  * @return SpiritResult
@@ -106,9 +173,29 @@ SpiritResult spMaterialAddMesh(
 SpiritResult spMaterialRecordCommands(
     const SpiritContext context, SpiritMaterial material, const u32 imageIndex);
 
+/**
+ * @brief Not to be used by the user. Check if the meshes queued for this
+ * frame, or the pipeline drawing them, differ from the last time this was
+ * called. Only the mesh references and push constants are compared, changes
+ * to the contents of a mesh are not detected.
+ *
+ * @param material
+ * @return true if the material would draw something different
+ */
+bool spMaterialTakeChanges(SpiritMaterial material);
+
+/**
+ * @brief Not to be used by the user. Drop the meshes queued for this frame
+ * without drawing them, when the frame is skipped.
+ *
+ * @param material
+ */
+void spMaterialDiscardMeshes(SpiritMaterial material);
+
 /**
  * @brief Destroy a material. This will not destroy any meshes added to the
- * material. be sure to remove the material from the context you added it to,
+ * material. If the material is still compiling, this blocks until the compile
+ * finishes. be sure to remove the material from the context you added it to,
  * otherwise there will be a segmentation fault.
  *
  * @param context
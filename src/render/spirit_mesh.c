@@ -1,8 +1,17 @@
 #include "spirit_mesh.h"
 
+#include "spirit_buffer.h"
 #include "spirit_command_buffer.h"
 #include "spirit_context.h"
 #include "spirit_device.h"
+
+//
+// Helpers
+//
+
+// free the vertex buffer of a mesh, and the mesh
+static void destroyMesh(const SpiritDevice device, SpiritMesh mesh);
+
 //
 // Public Functions
 //
@@ -26,75 +35,113 @@ SpiritMesh spCreateMesh(
     }
 
     // obtain memory from device
-    VkBuffer hostBuffer;
-    VkDeviceMemory hostBufferMemory;
-    VkDeviceSize bufferSize = dataSize;
-    if (spDeviceCreateBuffer(
-            context->device,
-            bufferSize,
-            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
-                VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-            &hostBuffer,
-            &hostBufferMemory))
+    const SpiritDevice device = context->device;
+    VkDeviceSize bufferSize   = dataSize;
+
+    // kept by the device until the copy is done, see spDeviceRetireUpload
+    SpiritBuffer *hostBuffer = new_var(SpiritBuffer);
+    const SpiritBufferCreateInfo hostInfo = {
+        .size        = bufferSize,
+        .usage       = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        .memoryFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT};
+    if (spCreateBuffer(device, &hostInfo, hostBuffer))
     {
         log_error("Failed to create mesh");
+        free(hostBuffer);
+        free(mesh);
         return NULL;
     }
 
     // copy memory into data
-    Vertex *data;
-    vkMapMemory(
-        context->device->device,
-        hostBufferMemory,
-        0,
-        bufferSize,
-        0,
-        (void **)&data);
-    memcpy(data, mesh->verts, dataSize);
-    vkUnmapMemory(context->device->device, hostBufferMemory);
-
-    VkBuffer localBuffer;
-    VkDeviceMemory localBufferMemory;
-    if (spDeviceCreateBuffer(
-            context->device,
-            bufferSize,
+    spBufferWrite(device, hostBuffer, 0, mesh->verts, dataSize);
+
+    SpiritBuffer localBuffer;
+    const SpiritBufferCreateInfo localInfo = {
+        .size = bufferSize,
+        .usage =
             VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
-                VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-            &localBuffer,
-            &localBufferMemory))
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        .memoryFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT};
+    if (spCreateBuffer(device, &localInfo, &localBuffer))
     {
         log_error("Failed to create mesh");
+        spDestroyBuffer(device, hostBuffer);
+        free(hostBuffer);
+        free(mesh);
         return NULL;
     }
 
-    // use a single-use command buffer to copy the data
+    // copy on the transfer queue, so the upload does not wait behind the
+    // frames being rendered. The buffer comes from a pool of this thread, so
+    // meshes can be made on several threads at once.
     SpiritCommandBuffer buf =
-        spCreateCommandBufferAndBeginSingleUse(context->device);
+        spCreateThreadCommandBuffer(device, SPIRIT_QUEUE_TRANSFER);
+    if (!buf || spCommandBufferBeginSingleUse(buf))
+    {
+        log_error("Failed to create mesh");
+        spDestroyBuffer(device, hostBuffer);
+        spDestroyBuffer(device, &localBuffer);
+        free(hostBuffer);
+        free(mesh);
+        return NULL;
+    }
 
     VkBufferCopy copyData = {
         .dstOffset = 0, .srcOffset = 0, .size = bufferSize};
 
-    vkCmdCopyBuffer(buf->handle, hostBuffer, localBuffer, 1, &copyData);
+    vkCmdCopyBuffer(
+        buf->handle, hostBuffer->buffer, localBuffer.buffer, 1, &copyData);
+
+    // release the buffer to the graphics family, which acquires it at the
+    // start of its next frame
+    if (device->transferFamily != device->graphicsFamily)
+    {
+        VkBufferMemoryBarrier release = {};
+        release.sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        release.srcAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT;
+        release.dstAccessMask       = 0;
+        release.srcQueueFamilyIndex = device->transferFamily;
+        release.dstQueueFamilyIndex = device->graphicsFamily;
+        release.buffer              = localBuffer.buffer;
+        release.offset              = 0;
+        release.size                = VK_WHOLE_SIZE;
+
+        vkCmdPipelineBarrier(
+            buf->handle,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+            0,
+            0,
+            NULL,
+            1,
+            &release,
+            0,
+            NULL);
+    }
 
     if (spCommandBufferSubmitSingleUse(context->device, buf))
     {
-        log_fatal("Failed to create mesh");
+        log_error("Failed to create mesh");
+        spDestroyBuffer(device, hostBuffer);
+        spDestroyBuffer(device, &localBuffer);
+        free(hostBuffer);
+        free(mesh);
         return NULL;
     }
 
-    spCommandBufferWait(context->device, buf, UINT64_MAX);
-
-    spDestroyCommandBuffer(context->device, buf);
-
-    // destroy temp buffers
-    vkDestroyBuffer(context->device->device, hostBuffer, NULL);
-    vkFreeMemory(context->device->device, hostBufferMemory, NULL);
+    // frames wait for the copy on the gpu, and the staging buffer is freed
+    // once it is done, so nothing here waits for it
+    mesh->uploadValue = buf->submitValue;
+    spDeviceAcquireBuffer(
+        device,
+        localBuffer.buffer,
+        device->transferFamily,
+        VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+        mesh->uploadValue);
+    spDeviceRetireUpload(device, mesh->uploadValue, hostBuffer);
 
     // update mesh t reference vertex data
-    mesh->vertexBuffer      = localBuffer;
-    mesh->vetexBufferMemory = localBufferMemory;
+    mesh->vertexBuffer = localBuffer;
 
     return mesh;
 }
@@ -107,7 +154,14 @@ SpiritMeshManager spCreateMeshManager(
     meshManager->meshCount        = 0;
     LIST_INIT(&meshManager->meshes);
 
-    meshManager->contextReference = context;
+    meshManager->lock = spPlatformCreateMutex();
+    if (meshManager->lock == NULL)
+    {
+        free(meshManager);
+        return NULL;
+    }
+
+    meshManager->device = spDeviceRetain(context->device);
 
     return meshManager;
 }
@@ -125,9 +179,13 @@ spMeshManagerAddMesh(SpiritMeshManager manager, SpiritMesh mesh)
 
     struct t_MeshListNode *newNode = new_var(struct t_MeshListNode);
     newNode->mesh                  = mesh;
-    newNode->referenceCount        = 0;
+    atomic_init(&newNode->referenceCount, 0);
 
+    spPlatformLockMutex(manager->lock);
     LIST_INSERT_HEAD(&manager->meshes, newNode, data);
+    manager->meshCount++;
+    spPlatformUnlockMutex(manager->lock);
+
     SpiritMeshReference ref = {};
     ref.meshManager         = manager;
     ref.node                = newNode;
@@ -146,7 +204,10 @@ SpiritMesh spMeshManagerAccessMesh(const SpiritMeshReference ref)
 // checkout a new reference to a mesh
 SpiritMeshReference spCheckoutMesh(const SpiritMeshReference meshReference)
 {
-    meshReference.node->referenceCount++;
+    // relaxed, the caller already holds a reference so the mesh cannot be
+    // destroyed underneath it
+    atomic_fetch_add_explicit(
+        &meshReference.node->referenceCount, 1, memory_order_relaxed);
     return meshReference;
 }
 
@@ -159,15 +220,21 @@ SpiritResult spReleaseMesh(const SpiritMeshReference meshReference)
           meshReference.vertCount && meshReference.meshManager))
         return SPIRIT_FAILURE;
 
-    // reduce reference count, and if no more references free mesh
-    if (--meshReference.node->referenceCount <= 0)
+    // reduce reference count, and if no more references free mesh. Only the
+    // thread dropping the last reference sees 1, so only it frees the mesh.
+    if (atomic_fetch_sub_explicit(
+            &meshReference.node->referenceCount, 1, memory_order_acq_rel) ==
+        1)
     {
+        SpiritMeshManager manager = meshReference.meshManager;
+
+        spPlatformLockMutex(manager->lock);
         LIST_REMOVE(meshReference.node, data);
-        spDestroyMesh(
-            meshReference.meshManager->contextReference,
-            meshReference.node->mesh);
+        manager->meshCount--;
+        spPlatformUnlockMutex(manager->lock);
+
+        destroyMesh(manager->device, meshReference.node->mesh);
         free(meshReference.node);
-        meshReference.meshManager->meshCount--;
     }
 
     return SPIRIT_SUCCESS;
@@ -175,22 +242,19 @@ SpiritResult spReleaseMesh(const SpiritMeshReference meshReference)
 
 SpiritResult spDestroyMesh(const SpiritContext context, SpiritMesh mesh)
 {
-    vkDestroyBuffer(context->device->device, mesh->vertexBuffer, NULL);
-    vkFreeMemory(context->device->device, mesh->vetexBufferMemory, NULL);
-
-    free(mesh);
-
+    destroyMesh(context->device, mesh);
     return SPIRIT_SUCCESS;
 }
 
-SpiritResult
-spDestroyMeshManager(const SpiritContext context, SpiritMeshManager meshManager)
+SpiritResult spDestroyMeshManager(
+    const SpiritContext context __attribute_maybe_unused__,
+    SpiritMeshManager meshManager)
 {
 
     struct t_MeshListNode *cn = NULL;
     LIST_FOREACH(cn, &meshManager->meshes, data)
     {
-        spDestroyMesh(context, cn->mesh);
+        destroyMesh(meshManager->device, cn->mesh);
     }
 
     u32 deletedMeshCount = 0;
@@ -211,10 +275,29 @@ spDestroyMeshManager(const SpiritContext context, SpiritMeshManager meshManager)
     log_debug("Deleted %u meshes", deletedMeshCount);
 #endif
 
+    spPlatformDestroyMutex(meshManager->lock);
+    spDestroyDevice(meshManager->device);
     free(meshManager);
     return SPIRIT_SUCCESS;
 }
 
+//
+// Helpers
+//
+
+void destroyMesh(const SpiritDevice device, SpiritMesh mesh)
+{
+    // the upload is almost always done by now
+    const SpiritSyncPoint upload = {
+        .queue = SPIRIT_QUEUE_TRANSFER, .value = mesh->uploadValue};
+    spTimelineWait(device, upload, UINT64_MAX);
+
+    spDeviceCancelAcquire(device, mesh->vertexBuffer.buffer);
+    spDestroyBuffer(device, &mesh->vertexBuffer);
+
+    free(mesh);
+}
+
 SPIRIT_INLINE VkVertexInputAttributeDescription
 spMeshGetAttributeDescription(void)
 {
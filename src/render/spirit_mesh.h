@@ -18,6 +18,8 @@
 
 #pragma once
 #include <spirit_header.h>
+#include <stdatomic.h>
+#include "spirit_buffer.h"
 
 //
 // Structures
@@ -40,15 +42,15 @@ typedef struct t_SpiritMeshCreateInfo
 typedef struct t_SpiritMesh
 {
     size_t vertCount;
-    VkBuffer vertexBuffer;
-    VkDeviceMemory vetexBufferMemory;
+    SpiritBuffer vertexBuffer;
+    u64 uploadValue; // the copy into the buffer, on the transfer timeline
 
     Vertex verts[]; // flex member
 } * SpiritMesh;
 
 struct t_MeshListNode
 {
-    size_t referenceCount;
+    _Atomic size_t referenceCount; // may be changed from any thread
     SpiritMesh mesh;
     LIST_ENTRY(t_MeshListNode) data; // list data
 };
@@ -59,8 +61,11 @@ struct t_MeshListNode
 // and when it has 0 references is automatically released
 struct t_SpiritMeshManager
 {
-    SpiritContext contextReference;
+    // holds a reference, so the manager can be shared by every context using
+    // the device and outlive the one that made it
+    SpiritDevice device;
     size_t meshCount;
+    SpiritMutex lock; // protects meshes and meshCount
     LIST_HEAD(t_MeshList, t_MeshListNode) meshes;
 };
 
@@ -78,7 +83,8 @@ typedef struct t_SpiritMeshManagerCreateInfo
 /**
  * @brief Create a mesh that can be drawn by a material. The mesh cannot be used
  * until it is added to a mesh manager, which will allow you to reference the
- * material elsewhere in the program.
+ * material elsewhere in the program. Returns without waiting for the upload,
+ * frames using the mesh wait for it on the gpu.
  *
  * @param context the context that the mesh will be used with
  * @param createInfo information to create the mesh
@@ -104,6 +110,8 @@ extern SpiritResult spDestroyMesh(const SpiritContext context, SpiritMesh mesh);
  * counts references to each mesh it contains and when a mesh is no longer
  * referenced it is unloaded.
  *
+ * Its meshes can be drawn by any context sharing the device of context.
+ *
  * @param context
  * @param createInfo
  * @return SpiritMeshManager
@@ -128,7 +136,7 @@ spMeshManagerAddMesh(SpiritMeshManager manager, SpiritMesh mesh);
  * is going out of scope, or will no longer be used. This lets the mesh mangager
  * know that this mesh reference is no longer used, and if it was the last one
  * it can destroy the mesh. If you do not do this, it will result in memory
- * leaks.
+ * leaks. It is safe to call from any thread.
  *
  * @param meshReference
  * @return SpiritResult
@@ -141,7 +149,7 @@ extern SpiritResult spReleaseMesh(const SpiritMeshReference meshReference);
  * or are going to store the same mesh reference in two places, so that if you
  * release one of the references it does not destroy the mesh. The function
  * tells the mesh manager that there is an additional reference to the mesh in
- * question
+ * question. It is safe to call from any thread.
  *
  * @param meshReference a reference to the mesh
  * @return SpiritMeshReference a new reference to the mesh, which is safe to use
@@ -42,8 +42,10 @@ static VkPipeline createPipeline(
     const VkShaderModule vertexShader,
     const VkShaderModule fragmentShader);
 
-// creates a graphics pipeline layout
-static VkPipelineLayout createLayout(SpiritDevice device);
+// creates a graphics pipeline layout, with the descriptor set layouts from
+// createInfo and a single vertex push constant range for the object base
+static VkPipelineLayout createLayout(
+    SpiritDevice device, const SpiritPipelineCreateInfo *createInfo);
 
 // load array of shaders
 // uses path and type from shaderInfo array
@@ -101,7 +103,7 @@ SpiritPipeline spCreatePipeline(
     FixedFuncInfo fixedInfo;
     defaultPipelineConfig(createInfo, &fixedInfo);
 
-    pipeline->layout = createLayout(device);
+    pipeline->layout = createLayout(device, createInfo);
     if (pipeline->layout == NULL)
     {
         log_error("Failed to create pipeline layout");
@@ -171,25 +173,20 @@ spDestroyPipeline(const SpiritDevice device, SpiritPipeline pipeline)
 // Helper Function Implementation
 //
 
-VkPipelineLayout createLayout(SpiritDevice device)
+VkPipelineLayout createLayout(
+    SpiritDevice device, const SpiritPipelineCreateInfo *createInfo)
 {
 
     VkPushConstantRange pushRanges = {
-        .offset = 0,
-        .size   = sizeof(SpiritPushConstant),
-        .stageFlags =
-            VK_SHADER_STAGE_VERTEX_BIT, //  | VK_SHADER_STAGE_FRAGMENT_BIT,
+        .offset     = 0,
+        .size       = sizeof(SpiritDrawPushConstant),
+        .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
     };
 
     VkPipelineLayoutCreateInfo layoutInfo = {};
     layoutInfo.sType          = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    layoutInfo.setLayoutCount = 0;
-    layoutInfo.pSetLayouts    = NULL;
-    layoutInfo.pushConstantRangeCount = 0;
-    layoutInfo.pPushConstantRanges    = NULL;
-    layoutInfo.sType          = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    layoutInfo.setLayoutCount = 0;
-    layoutInfo.pSetLayouts    = NULL;
+    layoutInfo.setLayoutCount = createInfo->descriptorSetLayoutCount;
+    layoutInfo.pSetLayouts    = createInfo->descriptorSetLayouts;
     layoutInfo.pushConstantRangeCount = 1;
     layoutInfo.pPushConstantRanges    = &pushRanges;
 
@@ -269,8 +266,12 @@ VkPipeline createPipeline(
     VkPipeline pipeline = NULL;
 
     if (vkCreateGraphicsPipelines(
-            device->device, NULL, 1, &pipelineInfo, NULL, &pipeline) !=
-        VK_SUCCESS)
+            device->device,
+            device->pipelineCache,
+            1,
+            &pipelineInfo,
+            NULL,
+            &pipeline) != VK_SUCCESS)
     {
         return NULL;
     }
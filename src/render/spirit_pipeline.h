@@ -29,6 +29,10 @@ typedef struct t_SpiritPipelineCreateInfo
     const char *vertexShader;   // array of shader names
     const char *fragmentShader; // num of shaders
     SpiritResolution resolution;
+
+    // descriptor set layouts used by the pipeline, in set order
+    u32 descriptorSetLayoutCount;
+    const VkDescriptorSetLayout *descriptorSetLayouts;
 } SpiritPipelineCreateInfo;
 
 struct t_SpiritPipeline
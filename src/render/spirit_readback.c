@@ -0,0 +1,289 @@
+#include "spirit_readback.h"
+
+#include "spirit_command_buffer.h"
+#include "spirit_device.h"
+#include "spirit_image.h"
+#include "spirit_swapchain.h"
+
+//
+// Helpers
+//
+
+// the size of one pixel of the formats a swapchain can use
+u32 formatPixelSize(const VkFormat format);
+
+// fill a readback frame from a slot
+void fillFrame(
+    const SpiritReadback readback, const u32 slot, SpiritReadbackFrame *frame);
+
+// call the callback for every ready slot, oldest first
+void deliverFrames(SpiritReadback readback);
+
+//
+// Public functions
+//
+
+SpiritReadback spCreateReadback(
+    const SpiritDevice device,
+    const SpiritSwapchain swapchain,
+    const SpiritReadbackCreateInfo *createInfo,
+    const u32 frameCount)
+{
+    SpiritReadback out = new_var(struct t_SpiritReadback);
+
+    out->createInfo = *createInfo;
+    out->slotCount =
+        createInfo->slotCount ? createInfo->slotCount : frameCount + 1;
+    out->nextSlot = 0;
+    out->size     = (SpiritResolution){
+        swapchain->extent.width, swapchain->extent.height};
+    out->format = swapchain->surfaceFormat.format;
+    out->slotSize =
+        out->size.w * out->size.h * formatPixelSize(out->format);
+    out->frameNumber   = 0;
+    out->droppedFrames = 0;
+
+    out->slots = new_array(struct t_SpiritReadbackSlot, out->slotCount);
+    memset(out->slots, 0, sizeof(struct t_SpiritReadbackSlot) * out->slotCount);
+
+    for (u32 i = 0; i < out->slotCount; i++)
+    {
+        struct t_SpiritReadbackSlot *slot = &out->slots[i];
+
+        const SpiritBufferCreateInfo bufferInfo = {
+            .size  = out->slotSize,
+            .usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            .memoryFlags =
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                VK_MEMORY_PROPERTY_HOST_COHERENT_BIT};
+
+        if (spCreateBuffer(device, &bufferInfo, &slot->buffer))
+        {
+            log_error("Failed to create readback buffer");
+            spDestroyReadback(device, out);
+            return NULL;
+        }
+
+        slot->state = SPIRIT_READBACK_SLOT_FREE;
+    }
+
+    log_verbose(
+        "Created readback ring, %u slots of %lu bytes",
+        out->slotCount,
+        out->slotSize);
+
+    return out;
+}
+
+SpiritResult spReadbackRecordCopy(
+    SpiritReadback readback,
+    SpiritCommandBuffer commandBuffer,
+    const SpiritImage *image,
+    const VkImageLayout oldLayout,
+    const u32 frame)
+{
+    const u64 frameNumber = readback->frameNumber++;
+
+    // never wait for the user, drop the frame instead
+    struct t_SpiritReadbackSlot *slot = &readback->slots[readback->nextSlot];
+    if (slot->state != SPIRIT_READBACK_SLOT_FREE)
+    {
+        ++readback->droppedFrames;
+        return SPIRIT_UNDEFINED;
+    }
+
+    VkImageSubresourceRange range = {
+        .aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
+        .baseMipLevel   = 0,
+        .levelCount     = 1,
+        .baseArrayLayer = 0,
+        .layerCount     = 1};
+
+    // wait for the render pass to finish writing the image
+    VkImageMemoryBarrier toTransfer = {
+        .sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcAccessMask       = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+        .dstAccessMask       = VK_ACCESS_TRANSFER_READ_BIT,
+        .oldLayout           = oldLayout,
+        .newLayout           = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image               = image->image,
+        .subresourceRange    = range};
+
+    vkCmdPipelineBarrier(
+        commandBuffer->handle,
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0,
+        0,
+        NULL,
+        0,
+        NULL,
+        1,
+        &toTransfer);
+
+    VkBufferImageCopy region = {
+        .bufferOffset      = 0,
+        .bufferRowLength   = 0, // tightly packed
+        .bufferImageHeight = 0,
+        .imageSubresource  = {
+             .aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT,
+             .mipLevel       = 0,
+             .baseArrayLayer = 0,
+             .layerCount     = 1},
+        .imageOffset = {0, 0, 0},
+        .imageExtent = {readback->size.w, readback->size.h, 1}
+    };
+
+    vkCmdCopyImageToBuffer(
+        commandBuffer->handle,
+        image->image,
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        slot->buffer.buffer,
+        1,
+        &region);
+
+    // make the copy visible to the host once the frame fence signals
+    VkBufferMemoryBarrier toHost = {
+        .sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .srcAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask       = VK_ACCESS_HOST_READ_BIT,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer              = slot->buffer.buffer,
+        .offset              = 0,
+        .size                = VK_WHOLE_SIZE};
+
+    // and give the image back in the layout it came in, for presentation
+    VkImageMemoryBarrier fromTransfer = toTransfer;
+    fromTransfer.srcAccessMask        = VK_ACCESS_TRANSFER_READ_BIT;
+    fromTransfer.dstAccessMask        = 0;
+    fromTransfer.oldLayout            = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    fromTransfer.newLayout            = oldLayout;
+
+    vkCmdPipelineBarrier(
+        commandBuffer->handle,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+        0,
+        0,
+        NULL,
+        1,
+        &toHost,
+        oldLayout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL ? 0 : 1,
+        &fromTransfer);
+
+    slot->state        = SPIRIT_READBACK_SLOT_PENDING;
+    slot->frame        = frame;
+    slot->frameNumber  = frameNumber;
+    readback->nextSlot = (readback->nextSlot + 1) % readback->slotCount;
+
+    return SPIRIT_SUCCESS;
+}
+
+void spReadbackRetireFrame(SpiritReadback readback, const u32 frame)
+{
+    for (u32 i = 0; i < readback->slotCount; i++)
+    {
+        struct t_SpiritReadbackSlot *slot = &readback->slots[i];
+        if (slot->state == SPIRIT_READBACK_SLOT_PENDING && slot->frame == frame)
+            slot->state = SPIRIT_READBACK_SLOT_READY;
+    }
+
+    if (readback->createInfo.callback)
+        deliverFrames(readback);
+}
+
+SpiritResult
+spReadbackAcquire(SpiritReadback readback, SpiritReadbackFrame *frame)
+{
+    // find the oldest ready slot
+    u32 oldest      = readback->slotCount;
+    u64 oldestFrame = UINT64_MAX;
+    for (u32 i = 0; i < readback->slotCount; i++)
+    {
+        const struct t_SpiritReadbackSlot *slot = &readback->slots[i];
+        if (slot->state == SPIRIT_READBACK_SLOT_READY &&
+            slot->frameNumber < oldestFrame)
+        {
+            oldest      = i;
+            oldestFrame = slot->frameNumber;
+        }
+    }
+
+    if (oldest == readback->slotCount)
+        return SPIRIT_FAILURE;
+
+    readback->slots[oldest].state = SPIRIT_READBACK_SLOT_HELD;
+    fillFrame(readback, oldest, frame);
+
+    return SPIRIT_SUCCESS;
+}
+
+void spReadbackRelease(
+    SpiritReadback readback, const SpiritReadbackFrame *frame)
+{
+    db_assert_msg(frame->slot < readback->slotCount, "Invalid readback frame");
+    db_assert_msg(
+        readback->slots[frame->slot].state == SPIRIT_READBACK_SLOT_HELD,
+        "Readback frame was not acquired");
+
+    readback->slots[frame->slot].state = SPIRIT_READBACK_SLOT_FREE;
+}
+
+void spDestroyReadback(const SpiritDevice device, SpiritReadback readback)
+{
+    if (readback->droppedFrames)
+        log_verbose(
+            "Readback dropped %lu of %lu frames",
+            readback->droppedFrames,
+            readback->frameNumber);
+
+    for (u32 i = 0; i < readback->slotCount; i++)
+    {
+        spDestroyBuffer(device, &readback->slots[i].buffer);
+    }
+
+    free(readback->slots);
+    free(readback);
+}
+
+//
+// Helpers
+//
+
+u32 formatPixelSize(const VkFormat format)
+{
+    switch (format)
+    {
+    case VK_FORMAT_R16G16B16A16_SFLOAT:
+    case VK_FORMAT_R16G16B16A16_UNORM: return 8;
+    case VK_FORMAT_R32G32B32A32_SFLOAT: return 16;
+    case VK_FORMAT_R5G6B5_UNORM_PACK16:
+    case VK_FORMAT_B5G6R5_UNORM_PACK16: return 2;
+    default: return 4; // 8 bit rgba and 10 bit packed formats
+    }
+}
+
+void fillFrame(
+    const SpiritReadback readback, const u32 slot, SpiritReadbackFrame *frame)
+{
+    *frame = (SpiritReadbackFrame){
+        .pixels      = readback->slots[slot].buffer.mapped,
+        .pixelsSize  = readback->slotSize,
+        .size        = readback->size,
+        .format      = readback->format,
+        .frameNumber = readback->slots[slot].frameNumber,
+        .slot        = slot};
+}
+
+void deliverFrames(SpiritReadback readback)
+{
+    SpiritReadbackFrame frame;
+    while (spReadbackAcquire(readback, &frame) == SPIRIT_SUCCESS)
+    {
+        readback->createInfo.callback(&frame, readback->createInfo.userData);
+        spReadbackRelease(readback, &frame);
+    }
+}
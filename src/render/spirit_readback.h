@@ -0,0 +1,154 @@
+#pragma once
+#include <spirit_header.h>
+#include "spirit_buffer.h"
+
+// Copy rendered images back to the cpu through a ring of host visible
+// buffers. Copies are recorded at the end of a frame, and become available
+// once the gpu has finished that frame, so the render loop never waits for
+// them. If every buffer is still in use the frame is dropped instead.
+
+//
+// Types
+//
+
+// a frame that has been copied back from the gpu. The pixels are tightly
+// packed rows of the swapchain format, and stay valid until the frame is
+// released, or the swapchain is recreated.
+typedef struct t_SpiritReadbackFrame
+{
+    const void *pixels;
+    size_t pixelsSize; // bytes
+    SpiritResolution size;
+    VkFormat format;
+    u64 frameNumber; // counts every frame submitted with readback enabled
+    u32 slot;        // used to release the frame
+} SpiritReadbackFrame;
+
+// called with each frame as soon as it has been copied back. The frame is
+// released once the callback returns, so copy anything that must be kept.
+typedef void (*SpiritReadbackCallback)(
+    const SpiritReadbackFrame *frame, void *userData);
+
+typedef struct t_SpiritReadbackCreateInfo
+{
+    // number of buffers in the ring, 0 for one more than the frames in
+    // flight. More buffers allow frames to be held longer without drops.
+    u32 slotCount;
+
+    // if NULL, frames are collected with spContextAcquireReadback
+    SpiritReadbackCallback callback;
+    void *userData;
+} SpiritReadbackCreateInfo;
+
+typedef enum e_SpiritReadbackSlotState
+{
+    SPIRIT_READBACK_SLOT_FREE = 0,
+    SPIRIT_READBACK_SLOT_PENDING, // copy submitted, gpu not finished
+    SPIRIT_READBACK_SLOT_READY,   // copied, waiting for the user
+    SPIRIT_READBACK_SLOT_HELD,    // acquired by the user
+} SpiritReadbackSlotState;
+
+struct t_SpiritReadbackSlot
+{
+    SpiritBuffer buffer; // persistently mapped
+    SpiritReadbackSlotState state;
+    u32 frame; // the frame in flight the copy was recorded in
+    u64 frameNumber;
+};
+
+struct t_SpiritReadback
+{
+    struct t_SpiritReadbackSlot *slots;
+    u32 slotCount;
+    u32 nextSlot;
+
+    SpiritReadbackCreateInfo createInfo;
+
+    SpiritResolution size;
+    VkFormat format;
+    size_t slotSize;
+
+    u64 frameNumber;
+    u64 droppedFrames; // frames not copied because no slot was free
+};
+
+//
+// Functions
+//
+
+/**
+ * @brief Create a readback ring for the images of a swapchain. Used by the
+ * context, see spContextEnableReadback.
+ *
+ * @param device
+ * @param swapchain the swapchain the copied images belong to
+ * @param createInfo
+ * @param frameCount the number of frames in flight
+ * @return SpiritReadback NULL on failure
+ */
+SpiritReadback spCreateReadback(
+    const SpiritDevice device,
+    const SpiritSwapchain swapchain,
+    const SpiritReadbackCreateInfo *createInfo,
+    const u32 frameCount) SPIRIT_NONULL(1, 2, 3);
+
+/**
+ * @brief Record a copy of a rendered image into the next free slot. The image
+ * must be in oldLayout, and is left in oldLayout. If no slot is free the frame
+ * is dropped.
+ *
+ * @param readback
+ * @param commandBuffer the command buffer of the frame, must be recording
+ * @param image the image to copy, must be created with TRANSFER_SRC usage
+ * @param oldLayout the layout the render pass left the image in
+ * @param frame the index of the frame in flight being recorded
+ * @return SpiritResult SPIRIT_UNDEFINED if the frame was dropped
+ */
+SpiritResult spReadbackRecordCopy(
+    SpiritReadback readback,
+    SpiritCommandBuffer commandBuffer,
+    const SpiritImage *image,
+    const VkImageLayout oldLayout,
+    const u32 frame) SPIRIT_NONULL(1, 2, 3);
+
+/**
+ * @brief Mark the copies recorded in a frame as done. Must only be called
+ * once the gpu has finished that frame. Ready frames are passed to the
+ * callback, if there is one.
+ *
+ * @param readback
+ * @param frame the index of the frame in flight that finished
+ */
+void spReadbackRetireFrame(SpiritReadback readback, const u32 frame)
+    SPIRIT_NONULL(1);
+
+/**
+ * @brief Take the oldest ready frame. It must be released with
+ * spReadbackRelease.
+ *
+ * @param readback
+ * @param frame set to the ready frame
+ * @return SpiritResult SPIRIT_FAILURE if no frame is ready
+ */
+SpiritResult
+spReadbackAcquire(SpiritReadback readback, SpiritReadbackFrame *frame)
+    SPIRIT_NONULL(1, 2);
+
+/**
+ * @brief Give a frame back to the ring so its slot can be reused
+ *
+ * @param readback
+ * @param frame a frame from spReadbackAcquire
+ */
+void spReadbackRelease(
+    SpiritReadback readback, const SpiritReadbackFrame *frame)
+    SPIRIT_NONULL(1, 2);
+
+/**
+ * @brief Destroy a readback ring. The device must be idle.
+ *
+ * @param device
+ * @param readback
+ */
+void spDestroyReadback(const SpiritDevice device, SpiritReadback readback)
+    SPIRIT_NONULL(1, 2);
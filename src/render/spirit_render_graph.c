@@ -0,0 +1,952 @@
+#include "spirit_render_graph.h"
+
+#include "spirit_command_buffer.h"
+#include "spirit_device.h"
+
+// Render graph implementation
+//
+// Compiling runs in four steps. Passes are culled walking backwards from the
+// outputs, the lifetime of each resource is found from the live passes,
+// transient images are packed into shared memory blocks, and then the passes
+// are walked forwards tracking the last access of each resource to find the
+// barriers each pass needs.
+
+//
+// Types
+//
+
+// the pipeline stage, memory access and layout implied by an access
+struct t_AccessInfo
+{
+    VkPipelineStageFlags stage;
+    VkAccessFlags read;
+    VkAccessFlags write;
+    VkImageLayout layout;
+    VkImageUsageFlags usage;
+};
+
+static const struct t_AccessInfo accessInfo[SPIRIT_RENDER_GRAPH_ACCESS_MAX] = {
+    [SPIRIT_RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT] = {
+        .stage  = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        .read   = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT,
+        .write  = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+        .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+        .usage  = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT},
+    [SPIRIT_RENDER_GRAPH_ACCESS_DEPTH_ATTACHMENT] = {
+        .stage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                 VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+        .read   = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+        .write  = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+        .layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+        .usage  = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT},
+    [SPIRIT_RENDER_GRAPH_ACCESS_SAMPLED] = {
+        .stage = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+                 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        .read   = VK_ACCESS_SHADER_READ_BIT,
+        .write  = 0,
+        .layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        .usage  = VK_IMAGE_USAGE_SAMPLED_BIT},
+    [SPIRIT_RENDER_GRAPH_ACCESS_STORAGE] = {
+        .stage  = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        .read   = VK_ACCESS_SHADER_READ_BIT,
+        .write  = VK_ACCESS_SHADER_WRITE_BIT,
+        .layout = VK_IMAGE_LAYOUT_GENERAL,
+        .usage  = VK_IMAGE_USAGE_STORAGE_BIT},
+    [SPIRIT_RENDER_GRAPH_ACCESS_TRANSFER_SRC] = {
+        .stage  = VK_PIPELINE_STAGE_TRANSFER_BIT,
+        .read   = VK_ACCESS_TRANSFER_READ_BIT,
+        .write  = 0,
+        .layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        .usage  = VK_IMAGE_USAGE_TRANSFER_SRC_BIT},
+    [SPIRIT_RENDER_GRAPH_ACCESS_TRANSFER_DST] = {
+        .stage  = VK_PIPELINE_STAGE_TRANSFER_BIT,
+        .read   = 0,
+        .write  = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .layout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        .usage  = VK_IMAGE_USAGE_TRANSFER_DST_BIT},
+    [SPIRIT_RENDER_GRAPH_ACCESS_VERTEX_BUFFER] = {
+        .stage  = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+        .read   = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+        .write  = 0,
+        .layout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .usage  = 0},
+    [SPIRIT_RENDER_GRAPH_ACCESS_UNIFORM_BUFFER] = {
+        .stage = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+                 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        .read   = VK_ACCESS_UNIFORM_READ_BIT,
+        .write  = 0,
+        .layout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .usage  = 0},
+};
+
+// the last use of a resource while barriers are generated
+struct t_ResourceState
+{
+    VkImageLayout layout;
+    VkPipelineStageFlags writeStage; // stages of the last write
+    VkAccessFlags writeAccess;
+    VkPipelineStageFlags readStage; // stages that read since the last write
+    VkAccessFlags readAccess;
+    bool used; // a barrier was already placed for the resource
+};
+
+//
+// Helpers
+//
+
+// add a resource, and return its handle
+SpiritRenderGraphResource
+addResource(SpiritRenderGraph graph, struct t_SpiritRenderGraphResource *res);
+
+// add an access to a pass
+SpiritResult addAccess(
+    SpiritRenderGraph graph,
+    const SpiritRenderGraphPass pass,
+    const SpiritRenderGraphResource resource,
+    const SpiritRenderGraphAccess access,
+    const bool write);
+
+// destroy everything created by compile
+void releaseCompiled(SpiritRenderGraph graph);
+
+// mark passes that contribute to an output as live
+void cullPasses(SpiritRenderGraph graph);
+
+// find the first and last live pass using each resource
+void computeLifetimes(SpiritRenderGraph graph);
+
+// create transient images, sharing memory where lifetimes do not overlap
+SpiritResult createTransientImages(SpiritRenderGraph graph);
+
+// find the barriers needed before each live pass
+void generateBarriers(SpiritRenderGraph graph);
+
+// record barriers starting at firstBarrier
+void recordBarriers(
+    SpiritRenderGraph graph,
+    SpiritCommandBuffer commandBuffer,
+    const u32 firstBarrier,
+    const u32 barrierCount,
+    VkPipelineStageFlags srcStage,
+    VkPipelineStageFlags dstStage);
+
+// add a barrier to the graph
+void pushBarrier(
+    SpiritRenderGraph graph,
+    const SpiritRenderGraphResource resource,
+    const VkAccessFlags srcAccess,
+    const VkAccessFlags dstAccess,
+    const VkImageLayout oldLayout,
+    const VkImageLayout newLayout,
+    const bool first);
+
+//
+// Public functions
+//
+
+SpiritRenderGraph spCreateRenderGraph(const SpiritDevice device)
+{
+    SpiritRenderGraph graph = new_var(struct t_SpiritRenderGraph);
+
+    graph->device            = device;
+    graph->compiled          = false;
+    graph->finalFirstBarrier = 0;
+    graph->finalBarrierCount = 0;
+    graph->finalSrcStage     = 0;
+
+    VECTOR_INIT(&graph->resources, VECTOR_RESIZE_AMOUNT);
+    VECTOR_INIT(&graph->passes, VECTOR_RESIZE_AMOUNT);
+    VECTOR_INIT(&graph->barriers, VECTOR_RESIZE_AMOUNT);
+    VECTOR_INIT(&graph->memoryBlocks, VECTOR_RESIZE_AMOUNT);
+
+    return graph;
+}
+
+SpiritRenderGraphResource spRenderGraphImportImage(
+    SpiritRenderGraph graph,
+    const char *name,
+    SpiritImage *image,
+    const VkImageLayout initialLayout,
+    const VkImageLayout finalLayout)
+{
+    struct t_SpiritRenderGraphResource res = {
+        .name          = name,
+        .type          = SPIRIT_RENDER_GRAPH_RESOURCE_IMAGE,
+        .imported      = true,
+        .image         = image,
+        .initialLayout = initialLayout,
+        .finalLayout   = finalLayout};
+
+    return addResource(graph, &res);
+}
+
+SpiritRenderGraphResource spRenderGraphCreateImage(
+    SpiritRenderGraph graph,
+    const char *name,
+    const SpiritRenderGraphImageInfo *imageInfo)
+{
+    struct t_SpiritRenderGraphResource res = {
+        .name          = name,
+        .type          = SPIRIT_RENDER_GRAPH_RESOURCE_IMAGE,
+        .imported      = false,
+        .imageInfo     = *imageInfo,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .finalLayout   = VK_IMAGE_LAYOUT_UNDEFINED};
+
+    return addResource(graph, &res);
+}
+
+SpiritRenderGraphResource spRenderGraphImportBuffer(
+    SpiritRenderGraph graph, const char *name, VkBuffer buffer)
+{
+    struct t_SpiritRenderGraphResource res = {
+        .name     = name,
+        .type     = SPIRIT_RENDER_GRAPH_RESOURCE_BUFFER,
+        .imported = true,
+        .buffer   = buffer};
+
+    return addResource(graph, &res);
+}
+
+void spRenderGraphMarkOutput(
+    SpiritRenderGraph graph, const SpiritRenderGraphResource resource)
+{
+    db_assert_msg(
+        resource < VECTOR_SIZE(&graph->resources), "Invalid graph resource");
+
+    VECTOR_AT(&graph->resources, resource).output = true;
+    graph->compiled                               = false;
+}
+
+SpiritRenderGraphPass spRenderGraphAddPass(
+    SpiritRenderGraph graph,
+    const char *name,
+    SpiritRenderGraphPassFunction execute,
+    void *userData)
+{
+    struct t_SpiritRenderGraphPass pass = {
+        .name        = name,
+        .execute     = execute,
+        .userData    = userData,
+        .accessCount = 0,
+        .live        = false};
+
+    VECTOR_PUSH_BACK(&graph->passes, pass);
+    graph->compiled = false;
+
+    return VECTOR_SIZE(&graph->passes) - 1;
+}
+
+SpiritResult spRenderGraphPassRead(
+    SpiritRenderGraph graph,
+    const SpiritRenderGraphPass pass,
+    const SpiritRenderGraphResource resource,
+    const SpiritRenderGraphAccess access)
+{
+    return addAccess(graph, pass, resource, access, false);
+}
+
+SpiritResult spRenderGraphPassWrite(
+    SpiritRenderGraph graph,
+    const SpiritRenderGraphPass pass,
+    const SpiritRenderGraphResource resource,
+    const SpiritRenderGraphAccess access)
+{
+    if (accessInfo[access].write == 0)
+    {
+        log_error("Render graph access %d can not write", access);
+        return SPIRIT_FAILURE;
+    }
+
+    return addAccess(graph, pass, resource, access, true);
+}
+
+SpiritResult spRenderGraphCompile(SpiritRenderGraph graph)
+{
+    releaseCompiled(graph);
+
+    cullPasses(graph);
+    computeLifetimes(graph);
+
+    if (createTransientImages(graph))
+    {
+        log_error("Failed to create render graph images");
+        releaseCompiled(graph);
+        return SPIRIT_FAILURE;
+    }
+
+    generateBarriers(graph);
+
+    graph->compiled = true;
+
+    return SPIRIT_SUCCESS;
+}
+
+SpiritResult spRenderGraphExecute(
+    SpiritRenderGraph graph, SpiritCommandBuffer commandBuffer)
+{
+    if (!graph->compiled)
+    {
+        log_error("Render graph must be compiled before it is executed");
+        return SPIRIT_FAILURE;
+    }
+
+    for (u32 i = 0; i < VECTOR_SIZE(&graph->passes); i++)
+    {
+        struct t_SpiritRenderGraphPass *pass = &VECTOR_AT(&graph->passes, i);
+        if (!pass->live)
+            continue;
+
+        recordBarriers(
+            graph,
+            commandBuffer,
+            pass->firstBarrier,
+            pass->barrierCount,
+            pass->srcStage,
+            pass->dstStage);
+
+        pass->execute(graph, i, commandBuffer, pass->userData);
+    }
+
+    recordBarriers(
+        graph,
+        commandBuffer,
+        graph->finalFirstBarrier,
+        graph->finalBarrierCount,
+        graph->finalSrcStage,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+
+    return SPIRIT_SUCCESS;
+}
+
+void spRenderGraphSetImage(
+    SpiritRenderGraph graph,
+    const SpiritRenderGraphResource resource,
+    SpiritImage *image)
+{
+    db_assert_msg(
+        resource < VECTOR_SIZE(&graph->resources), "Invalid graph resource");
+    db_assert_msg(
+        VECTOR_AT(&graph->resources, resource).imported,
+        "Only imported images can be changed");
+
+    VECTOR_AT(&graph->resources, resource).image = image;
+}
+
+void spRenderGraphDiscardImage(
+    SpiritRenderGraph graph,
+    const SpiritRenderGraphResource resource,
+    const bool discard)
+{
+    db_assert_msg(
+        resource < VECTOR_SIZE(&graph->resources), "Invalid graph resource");
+    db_assert_msg(
+        VECTOR_AT(&graph->resources, resource).imported,
+        "Only imported images can be discarded");
+
+    VECTOR_AT(&graph->resources, resource).discard = discard;
+}
+
+SpiritImage *spRenderGraphGetImage(
+    SpiritRenderGraph graph, const SpiritRenderGraphResource resource)
+{
+    db_assert_msg(
+        resource < VECTOR_SIZE(&graph->resources), "Invalid graph resource");
+
+    struct t_SpiritRenderGraphResource *res =
+        &VECTOR_AT(&graph->resources, resource);
+
+    if (res->type != SPIRIT_RENDER_GRAPH_RESOURCE_IMAGE)
+        return NULL;
+
+    return res->imported ? res->image : &res->transientImage;
+}
+
+bool spRenderGraphPassIsLive(
+    const SpiritRenderGraph graph, const SpiritRenderGraphPass pass)
+{
+    return pass < VECTOR_SIZE(&graph->passes) &&
+           VECTOR_AT(&graph->passes, pass).live;
+}
+
+void spDestroyRenderGraph(SpiritRenderGraph graph)
+{
+    releaseCompiled(graph);
+
+    VECTOR_DELETE(&graph->resources);
+    VECTOR_DELETE(&graph->passes);
+    VECTOR_DELETE(&graph->barriers);
+    VECTOR_DELETE(&graph->memoryBlocks);
+
+    free(graph);
+}
+
+//
+// Helpers
+//
+
+SpiritRenderGraphResource
+addResource(SpiritRenderGraph graph, struct t_SpiritRenderGraphResource *res)
+{
+    res->transientImage = (SpiritImage){};
+    res->needed         = false;
+    res->firstPass      = SPIRIT_RENDER_GRAPH_NONE;
+    res->lastPass       = 0;
+    res->memoryBlock    = SPIRIT_RENDER_GRAPH_NONE;
+    res->aliasOf        = SPIRIT_RENDER_GRAPH_NONE;
+
+    VECTOR_PUSH_BACK(&graph->resources, *res);
+    graph->compiled = false;
+
+    return VECTOR_SIZE(&graph->resources) - 1;
+}
+
+SpiritResult addAccess(
+    SpiritRenderGraph graph,
+    const SpiritRenderGraphPass pass,
+    const SpiritRenderGraphResource resource,
+    const SpiritRenderGraphAccess access,
+    const bool write)
+{
+    db_assert_msg(pass < VECTOR_SIZE(&graph->passes), "Invalid graph pass");
+    db_assert_msg(
+        resource < VECTOR_SIZE(&graph->resources), "Invalid graph resource");
+    db_assert_msg(access < SPIRIT_RENDER_GRAPH_ACCESS_MAX, "Invalid access");
+
+    struct t_SpiritRenderGraphPass *p = &VECTOR_AT(&graph->passes, pass);
+    if (p->accessCount == SPIRIT_RENDER_GRAPH_MAX_PASS_ACCESSES)
+    {
+        log_error("Render graph pass '%s' uses too many resources", p->name);
+        return SPIRIT_FAILURE;
+    }
+
+    p->accesses[p->accessCount++] = (struct t_SpiritRenderGraphAccessEntry){
+        .resource = resource, .access = access, .write = write};
+    graph->compiled = false;
+
+    return SPIRIT_SUCCESS;
+}
+
+void releaseCompiled(SpiritRenderGraph graph)
+{
+    for (u32 i = 0; i < VECTOR_SIZE(&graph->resources); i++)
+    {
+        struct t_SpiritRenderGraphResource *res =
+            &VECTOR_AT(&graph->resources, i);
+
+        // the memory belongs to the block, so only the image and view go
+        if (!res->imported && res->transientImage.image)
+            spDestroyImage(graph->device, &res->transientImage);
+    }
+
+    for (u32 i = 0; i < VECTOR_SIZE(&graph->memoryBlocks); i++)
+    {
+        spDeviceFreeMemory(
+            graph->device, VECTOR_AT(&graph->memoryBlocks, i).memory);
+    }
+
+    graph->memoryBlocks.size = 0;
+    graph->barriers.size     = 0;
+    graph->compiled          = false;
+}
+
+void cullPasses(SpiritRenderGraph graph)
+{
+    for (u32 i = 0; i < VECTOR_SIZE(&graph->resources); i++)
+    {
+        struct t_SpiritRenderGraphResource *res =
+            &VECTOR_AT(&graph->resources, i);
+        res->needed = res->imported || res->output;
+    }
+
+    // walk backwards, so a pass is only kept if something after it needs
+    // what it writes
+    for (u32 i = VECTOR_SIZE(&graph->passes); i-- > 0;)
+    {
+        struct t_SpiritRenderGraphPass *pass = &VECTOR_AT(&graph->passes, i);
+
+        bool hasWrites = false;
+        pass->live     = false;
+        for (u32 a = 0; a < pass->accessCount; a++)
+        {
+            if (!pass->accesses[a].write)
+                continue;
+            hasWrites = true;
+            if (VECTOR_AT(&graph->resources, pass->accesses[a].resource).needed)
+                pass->live = true;
+        }
+
+        // passes that write nothing the graph knows of have side effects
+        if (!hasWrites)
+            pass->live = true;
+
+        if (!pass->live)
+        {
+            log_verbose("Culled render graph pass '%s'", pass->name);
+            continue;
+        }
+
+        // the load op of a write is not known, so anything the pass touches
+        // must be produced by the passes before it
+        for (u32 a = 0; a < pass->accessCount; a++)
+            VECTOR_AT(&graph->resources, pass->accesses[a].resource).needed =
+                true;
+    }
+}
+
+void computeLifetimes(SpiritRenderGraph graph)
+{
+    for (u32 i = 0; i < VECTOR_SIZE(&graph->resources); i++)
+    {
+        struct t_SpiritRenderGraphResource *res =
+            &VECTOR_AT(&graph->resources, i);
+        res->firstPass   = SPIRIT_RENDER_GRAPH_NONE;
+        res->lastPass    = 0;
+        res->memoryBlock = SPIRIT_RENDER_GRAPH_NONE;
+        res->aliasOf     = SPIRIT_RENDER_GRAPH_NONE;
+        res->stages      = 0;
+        res->writeAccess = 0;
+    }
+
+    for (u32 i = 0; i < VECTOR_SIZE(&graph->passes); i++)
+    {
+        const struct t_SpiritRenderGraphPass *pass =
+            &VECTOR_AT(&graph->passes, i);
+        if (!pass->live)
+            continue;
+
+        for (u32 a = 0; a < pass->accessCount; a++)
+        {
+            struct t_SpiritRenderGraphResource *res =
+                &VECTOR_AT(&graph->resources, pass->accesses[a].resource);
+
+            if (res->firstPass == SPIRIT_RENDER_GRAPH_NONE)
+                res->firstPass = i;
+            res->lastPass = i;
+
+            const struct t_AccessInfo *info =
+                &accessInfo[pass->accesses[a].access];
+            res->imageInfo.usageFlags |= info->usage;
+            res->stages |= info->stage;
+            if (pass->accesses[a].write)
+                res->writeAccess |= info->write;
+        }
+    }
+}
+
+SpiritResult createTransientImages(SpiritRenderGraph graph)
+{
+    const u32 resourceCount = VECTOR_SIZE(&graph->resources);
+    VkMemoryRequirements requirements[resourceCount];
+    u32 order[resourceCount];
+    u32 imageCount = 0;
+
+    // create the images, without memory
+    for (u32 i = 0; i < resourceCount; i++)
+    {
+        struct t_SpiritRenderGraphResource *res =
+            &VECTOR_AT(&graph->resources, i);
+        if (res->imported || res->type != SPIRIT_RENDER_GRAPH_RESOURCE_IMAGE ||
+            res->firstPass == SPIRIT_RENDER_GRAPH_NONE)
+            continue;
+
+        VkImageCreateInfo imageInfo = {
+            .sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+            .flags         = 0,
+            .imageType     = VK_IMAGE_TYPE_2D,
+            .format        = res->imageInfo.format,
+            .extent        = {res->imageInfo.size.w, res->imageInfo.size.h, 1},
+            .mipLevels     = 1,
+            .arrayLayers   = 1,
+            .samples       = VK_SAMPLE_COUNT_1_BIT,
+            .tiling        = VK_IMAGE_TILING_OPTIMAL,
+            .usage         = res->imageInfo.usageFlags,
+            .sharingMode   = VK_SHARING_MODE_EXCLUSIVE,
+            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED};
+
+        if (vkCreateImage(
+                graph->device->device,
+                &imageInfo,
+                ALLOCATION_CALLBACK,
+                &res->transientImage.image))
+        {
+            log_error("Failed to create render graph image '%s'", res->name);
+            return SPIRIT_FAILURE;
+        }
+
+        res->transientImage.imageFormat = res->imageInfo.format;
+        res->transientImage.aspectFlags = res->imageInfo.aspectFlags;
+        res->transientImage.size        = res->imageInfo.size;
+        res->transientImage.memory      = VK_NULL_HANDLE;
+        res->transientImage.view        = VK_NULL_HANDLE;
+
+        vkGetImageMemoryRequirements(
+            graph->device->device, res->transientImage.image, &requirements[i]);
+
+        // insert sorted by size, largest first, so small images fill the gaps
+        // in the blocks of large ones
+        u32 n = imageCount++;
+        while (n > 0 && requirements[order[n - 1]].size < requirements[i].size)
+        {
+            order[n] = order[n - 1];
+            --n;
+        }
+        order[n] = i;
+    }
+
+    // place each image in the first block it fits, where no image already in
+    // the block is used at the same time
+    for (u32 o = 0; o < imageCount; o++)
+    {
+        const u32 i = order[o];
+        struct t_SpiritRenderGraphResource *res =
+            &VECTOR_AT(&graph->resources, i);
+
+        for (u32 b = 0; b < VECTOR_SIZE(&graph->memoryBlocks); b++)
+        {
+            struct t_SpiritRenderGraphMemoryBlock *block =
+                &VECTOR_AT(&graph->memoryBlocks, b);
+            if (!(block->memoryTypeBits & requirements[i].memoryTypeBits))
+                continue;
+
+            bool overlaps = false;
+            for (u32 x = 0; x < o && !overlaps; x++)
+            {
+                const struct t_SpiritRenderGraphResource *other =
+                    &VECTOR_AT(&graph->resources, order[x]);
+                overlaps = other->memoryBlock == b &&
+                           other->firstPass <= res->lastPass &&
+                           res->firstPass <= other->lastPass;
+            }
+            if (overlaps)
+                continue;
+
+            res->memoryBlock = b;
+            block->memoryTypeBits &= requirements[i].memoryTypeBits;
+            break;
+        }
+
+        if (res->memoryBlock == SPIRIT_RENDER_GRAPH_NONE)
+        {
+            struct t_SpiritRenderGraphMemoryBlock block = {
+                .memory         = VK_NULL_HANDLE,
+                .size           = requirements[i].size,
+                .memoryTypeBits = requirements[i].memoryTypeBits};
+            VECTOR_PUSH_BACK(&graph->memoryBlocks, block);
+            res->memoryBlock = VECTOR_SIZE(&graph->memoryBlocks) - 1;
+        }
+        else
+        {
+            // sizes are sorted, but the memory type chosen may still change
+            // what later images need
+            struct t_SpiritRenderGraphMemoryBlock *block =
+                &VECTOR_AT(&graph->memoryBlocks, res->memoryBlock);
+            block->size = max_value(block->size, requirements[i].size);
+        }
+    }
+
+    // find the image that used each block before each image. The first image
+    // in a block follows the last one, from the frame before.
+    for (u32 o = 0; o < imageCount; o++)
+    {
+        struct t_SpiritRenderGraphResource *res =
+            &VECTOR_AT(&graph->resources, order[o]);
+
+        u32 before = SPIRIT_RENDER_GRAPH_NONE, last = order[o];
+        for (u32 x = 0; x < imageCount; x++)
+        {
+            const struct t_SpiritRenderGraphResource *other =
+                &VECTOR_AT(&graph->resources, order[x]);
+            if (other->memoryBlock != res->memoryBlock)
+                continue;
+
+            if (other->lastPass < res->firstPass &&
+                (before == SPIRIT_RENDER_GRAPH_NONE ||
+                 other->lastPass >
+                     VECTOR_AT(&graph->resources, before).lastPass))
+                before = order[x];
+            if (other->lastPass > VECTOR_AT(&graph->resources, last).lastPass)
+                last = order[x];
+        }
+
+        res->aliasOf = before != SPIRIT_RENDER_GRAPH_NONE ? before : last;
+    }
+
+    // allocate the blocks, and bind every image to the start of its block
+    for (u32 b = 0; b < VECTOR_SIZE(&graph->memoryBlocks); b++)
+    {
+        struct t_SpiritRenderGraphMemoryBlock *block =
+            &VECTOR_AT(&graph->memoryBlocks, b);
+
+        const u32 memoryType = spDeviceFindMemoryType(
+            graph->device,
+            block->memoryTypeBits,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        if (spDeviceAllocateMemory(
+                graph->device, block->size, memoryType, &block->memory))
+            return SPIRIT_FAILURE;
+    }
+
+    for (u32 o = 0; o < imageCount; o++)
+    {
+        struct t_SpiritRenderGraphResource *res =
+            &VECTOR_AT(&graph->resources, order[o]);
+
+        if (vkBindImageMemory(
+                graph->device->device,
+                res->transientImage.image,
+                VECTOR_AT(&graph->memoryBlocks, res->memoryBlock).memory,
+                0))
+            return SPIRIT_FAILURE;
+
+        if (spCreateImageView(graph->device, &res->transientImage))
+            return SPIRIT_FAILURE;
+    }
+
+    log_verbose(
+        "Render graph placed %u images in %lu memory blocks",
+        imageCount,
+        VECTOR_SIZE(&graph->memoryBlocks));
+
+    return SPIRIT_SUCCESS;
+}
+
+void generateBarriers(SpiritRenderGraph graph)
+{
+    const u32 resourceCount = VECTOR_SIZE(&graph->resources);
+    struct t_ResourceState states[resourceCount];
+
+    // work done before the graph on imported resources is not known, so it
+    // is waited on in full. Transient images wait for the image that used
+    // their memory before, their contents are discarded.
+    for (u32 i = 0; i < resourceCount; i++)
+    {
+        const struct t_SpiritRenderGraphResource *res =
+            &VECTOR_AT(&graph->resources, i);
+
+        states[i] = (struct t_ResourceState){
+            .layout      = res->initialLayout,
+            .writeStage  = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+            .writeAccess = VK_ACCESS_MEMORY_WRITE_BIT,
+            .readStage   = 0,
+            .readAccess  = 0,
+            .used        = false};
+
+        if (!res->imported && res->aliasOf != SPIRIT_RENDER_GRAPH_NONE)
+        {
+            const struct t_SpiritRenderGraphResource *alias =
+                &VECTOR_AT(&graph->resources, res->aliasOf);
+            states[i].writeStage  = alias->stages;
+            states[i].writeAccess = alias->writeAccess;
+        }
+    }
+
+    for (u32 p = 0; p < VECTOR_SIZE(&graph->passes); p++)
+    {
+        struct t_SpiritRenderGraphPass *pass = &VECTOR_AT(&graph->passes, p);
+        pass->firstBarrier                   = VECTOR_SIZE(&graph->barriers);
+        pass->barrierCount                   = 0;
+        pass->srcStage                       = 0;
+        pass->dstStage                       = 0;
+        if (!pass->live)
+            continue;
+
+        for (u32 a = 0; a < pass->accessCount; a++)
+        {
+            const SpiritRenderGraphResource r = pass->accesses[a].resource;
+            const struct t_SpiritRenderGraphResource *res =
+                &VECTOR_AT(&graph->resources, r);
+            const struct t_AccessInfo *info =
+                &accessInfo[pass->accesses[a].access];
+            struct t_ResourceState *state = &states[r];
+
+            const bool isImage =
+                res->type == SPIRIT_RENDER_GRAPH_RESOURCE_IMAGE;
+            const VkImageLayout layout =
+                isImage ? info->layout : VK_IMAGE_LAYOUT_UNDEFINED;
+            const bool changesLayout = isImage && state->layout != layout;
+
+            if (pass->accesses[a].write)
+            {
+                // wait for earlier writes, and for earlier reads to finish
+                // before they are overwritten
+                const VkPipelineStageFlags src =
+                    state->writeStage | state->readStage;
+                if (changesLayout || src)
+                {
+                    pushBarrier(
+                        graph,
+                        r,
+                        state->writeAccess,
+                        info->read | info->write,
+                        state->layout,
+                        layout,
+                        !state->used);
+                    pass->srcStage |= src;
+                    pass->dstStage |= info->stage;
+                }
+
+                *state = (struct t_ResourceState){
+                    .layout      = layout,
+                    .writeStage  = info->stage,
+                    .writeAccess = info->write,
+                    .readStage   = 0,
+                    .readAccess  = 0,
+                    .used        = true};
+                continue;
+            }
+
+            // reads only wait for a write once per stage
+            const bool visible =
+                (state->readStage & info->stage) == info->stage &&
+                (state->readAccess & info->read) == info->read;
+            if (changesLayout || (state->writeStage && !visible))
+            {
+                pushBarrier(
+                    graph,
+                    r,
+                    state->writeAccess,
+                    info->read,
+                    state->layout,
+                    layout,
+                    !state->used);
+                pass->srcStage |= state->writeStage;
+                pass->dstStage |= info->stage;
+
+                // a layout transition is a write, so later reads in other
+                // stages must wait for it, and earlier reads must finish
+                if (changesLayout)
+                {
+                    pass->srcStage |= state->readStage;
+                    state->writeStage  = info->stage;
+                    state->writeAccess = 0;
+                    state->readStage   = 0;
+                    state->readAccess  = 0;
+                }
+            }
+
+            state->layout = layout;
+            state->used   = true;
+            state->readStage |= info->stage;
+            state->readAccess |= info->read;
+        }
+
+        pass->barrierCount = VECTOR_SIZE(&graph->barriers) - pass->firstBarrier;
+    }
+
+    // return imported images to the layout expected after the graph
+    graph->finalFirstBarrier = VECTOR_SIZE(&graph->barriers);
+    graph->finalSrcStage     = 0;
+    for (u32 i = 0; i < resourceCount; i++)
+    {
+        const struct t_SpiritRenderGraphResource *res =
+            &VECTOR_AT(&graph->resources, i);
+        if (!res->imported || res->type != SPIRIT_RENDER_GRAPH_RESOURCE_IMAGE ||
+            res->firstPass == SPIRIT_RENDER_GRAPH_NONE)
+            continue;
+
+        pushBarrier(
+            graph,
+            i,
+            states[i].writeAccess,
+            VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT,
+            states[i].layout,
+            res->finalLayout,
+            false);
+        graph->finalSrcStage |= states[i].writeStage | states[i].readStage;
+    }
+    graph->finalBarrierCount =
+        VECTOR_SIZE(&graph->barriers) - graph->finalFirstBarrier;
+}
+
+void pushBarrier(
+    SpiritRenderGraph graph,
+    const SpiritRenderGraphResource resource,
+    const VkAccessFlags srcAccess,
+    const VkAccessFlags dstAccess,
+    const VkImageLayout oldLayout,
+    const VkImageLayout newLayout,
+    const bool first)
+{
+    struct t_SpiritRenderGraphBarrier barrier = {
+        .resource  = resource,
+        .srcAccess = srcAccess,
+        .dstAccess = dstAccess,
+        .oldLayout = oldLayout,
+        .newLayout = newLayout,
+        .first     = first};
+
+    VECTOR_PUSH_BACK(&graph->barriers, barrier);
+}
+
+void recordBarriers(
+    SpiritRenderGraph graph,
+    SpiritCommandBuffer commandBuffer,
+    const u32 firstBarrier,
+    const u32 barrierCount,
+    VkPipelineStageFlags srcStage,
+    VkPipelineStageFlags dstStage)
+{
+    if (barrierCount == 0)
+        return;
+
+    VkImageMemoryBarrier imageBarriers[barrierCount];
+    VkBufferMemoryBarrier bufferBarriers[barrierCount];
+    u32 imageBarrierCount  = 0;
+    u32 bufferBarrierCount = 0;
+
+    for (u32 i = firstBarrier; i < firstBarrier + barrierCount; i++)
+    {
+        const struct t_SpiritRenderGraphBarrier *barrier =
+            &VECTOR_AT(&graph->barriers, i);
+        const struct t_SpiritRenderGraphResource *res =
+            &VECTOR_AT(&graph->resources, barrier->resource);
+
+        if (res->type == SPIRIT_RENDER_GRAPH_RESOURCE_BUFFER)
+        {
+            bufferBarriers[bufferBarrierCount++] = (VkBufferMemoryBarrier){
+                .sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+                .srcAccessMask       = barrier->srcAccess,
+                .dstAccessMask       = barrier->dstAccess,
+                .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .buffer              = res->buffer,
+                .offset              = 0,
+                .size                = VK_WHOLE_SIZE};
+            continue;
+        }
+
+        const SpiritImage *image =
+            res->imported ? res->image : &res->transientImage;
+        imageBarriers[imageBarrierCount++] = (VkImageMemoryBarrier){
+            .sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .srcAccessMask       = barrier->srcAccess,
+            .dstAccessMask       = barrier->dstAccess,
+            .oldLayout           = barrier->first && res->discard
+                                       ? VK_IMAGE_LAYOUT_UNDEFINED
+                                       : barrier->oldLayout,
+            .newLayout           = barrier->newLayout,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image               = image->image,
+            .subresourceRange    = {
+                   .aspectMask     = image->aspectFlags,
+                   .baseMipLevel   = 0,
+                   .levelCount     = 1,
+                   .baseArrayLayer = 0,
+                   .layerCount     = 1}
+        };
+    }
+
+    vkCmdPipelineBarrier(
+        commandBuffer->handle,
+        srcStage ? srcStage : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+        dstStage,
+        0,
+        0,
+        NULL,
+        bufferBarrierCount,
+        bufferBarriers,
+        imageBarrierCount,
+        imageBarriers);
+}
@@ -0,0 +1,347 @@
+#pragma once
+#include <spirit_header.h>
+#include "spirit_image.h"
+#include "utils/spirit_vector.h"
+
+// Render graph. Passes declare the images and buffers they read and write,
+// and the graph works out the order dependent work must wait in. Compiling the
+// graph culls passes whose results are never used, generates the barriers and
+// layout transitions between passes, and lets transient images whose
+// lifetimes do not overlap share memory.
+//
+// Passes record their own commands through a callback, the graph only handles
+// resources and synchronisation.
+
+//
+// Types
+//
+
+// handle to a resource in a render graph
+typedef u32 SpiritRenderGraphResource;
+
+// handle to a pass in a render graph
+typedef u32 SpiritRenderGraphPass;
+
+#define SPIRIT_RENDER_GRAPH_NONE ((u32)-1)
+
+// the most resources a single pass can use
+#define SPIRIT_RENDER_GRAPH_MAX_PASS_ACCESSES 16
+
+// how a pass uses a resource. Each access implies the pipeline stage, memory
+// access and image layout, see accessInfo in spirit_render_graph.c
+typedef enum e_SpiritRenderGraphAccess
+{
+    SPIRIT_RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT = 0,
+    SPIRIT_RENDER_GRAPH_ACCESS_DEPTH_ATTACHMENT,
+    SPIRIT_RENDER_GRAPH_ACCESS_SAMPLED, // read in a vertex or fragment shader
+    SPIRIT_RENDER_GRAPH_ACCESS_STORAGE, // read or written in a compute shader
+    SPIRIT_RENDER_GRAPH_ACCESS_TRANSFER_SRC,
+    SPIRIT_RENDER_GRAPH_ACCESS_TRANSFER_DST,
+    SPIRIT_RENDER_GRAPH_ACCESS_VERTEX_BUFFER,
+    SPIRIT_RENDER_GRAPH_ACCESS_UNIFORM_BUFFER,
+
+    SPIRIT_RENDER_GRAPH_ACCESS_MAX
+} SpiritRenderGraphAccess;
+
+typedef enum e_SpiritRenderGraphResourceType
+{
+    SPIRIT_RENDER_GRAPH_RESOURCE_IMAGE,
+    SPIRIT_RENDER_GRAPH_RESOURCE_BUFFER,
+} SpiritRenderGraphResourceType;
+
+// a transient image, created and owned by the graph. Its contents only live
+// between the first and last pass that use it in a frame.
+typedef struct t_SpiritRenderGraphImageInfo
+{
+    SpiritResolution size;
+    VkFormat format;
+    VkImageUsageFlags usageFlags; // usage implied by passes is added
+    VkImageAspectFlags aspectFlags;
+} SpiritRenderGraphImageInfo;
+
+// records the commands of a pass
+typedef void (*SpiritRenderGraphPassFunction)(
+    SpiritRenderGraph graph,
+    SpiritRenderGraphPass pass,
+    SpiritCommandBuffer commandBuffer,
+    void *userData);
+
+struct t_SpiritRenderGraphAccessEntry
+{
+    SpiritRenderGraphResource resource;
+    SpiritRenderGraphAccess access;
+    bool write;
+};
+
+// a barrier between passes, filled with the real handles when executed so
+// imported resources can change between frames
+struct t_SpiritRenderGraphBarrier
+{
+    SpiritRenderGraphResource resource;
+    VkAccessFlags srcAccess;
+    VkAccessFlags dstAccess;
+    VkImageLayout oldLayout;
+    VkImageLayout newLayout;
+    bool first; // first use of the resource, may start from undefined
+};
+
+struct t_SpiritRenderGraphResource
+{
+    const char *name;
+    SpiritRenderGraphResourceType type;
+    bool imported;
+    bool output; // must be produced even if no pass reads it
+
+    // images
+    SpiritImage *image; // imported images
+    SpiritImage transientImage;
+    SpiritRenderGraphImageInfo imageInfo;
+    VkImageLayout initialLayout; // layout of an imported image at the start
+    VkImageLayout finalLayout;   // layout an imported image is left in
+    bool discard; // contents of an imported image are not kept this frame
+
+    // buffers
+    VkBuffer buffer;
+
+    // set by compile
+    bool needed;
+    u32 firstPass, lastPass; // lifetime, in pass order
+    u32 memoryBlock;         // transient images sharing memory
+    VkPipelineStageFlags stages; // every stage the resource is used in
+    VkAccessFlags writeAccess;   // every way the resource is written
+
+    // the image that used the memory before this one, possibly in the
+    // previous frame, and which must be finished with it first
+    SpiritRenderGraphResource aliasOf;
+};
+
+struct t_SpiritRenderGraphPass
+{
+    const char *name;
+    SpiritRenderGraphPassFunction execute;
+    void *userData;
+
+    struct t_SpiritRenderGraphAccessEntry
+        accesses[SPIRIT_RENDER_GRAPH_MAX_PASS_ACCESSES];
+    u32 accessCount;
+
+    // set by compile
+    bool live;
+    u32 firstBarrier, barrierCount;
+    VkPipelineStageFlags srcStage, dstStage;
+};
+
+struct t_SpiritRenderGraphMemoryBlock
+{
+    VkDeviceMemory memory;
+    VkDeviceSize size;
+    u32 memoryTypeBits;
+};
+
+struct t_SpiritRenderGraph
+{
+    SpiritDevice device;
+
+    VECTOR(struct t_SpiritRenderGraphResource) resources;
+    VECTOR(struct t_SpiritRenderGraphPass) passes;
+
+    // set by compile
+    bool compiled;
+    VECTOR(struct t_SpiritRenderGraphBarrier) barriers;
+    VECTOR(struct t_SpiritRenderGraphMemoryBlock) memoryBlocks;
+
+    // barriers returning imported images to their final layout
+    u32 finalFirstBarrier, finalBarrierCount;
+    VkPipelineStageFlags finalSrcStage;
+};
+
+//
+// Functions
+//
+
+/**
+ * @brief Create an empty render graph
+ *
+ * @param device the device resources are created on
+ * @return SpiritRenderGraph
+ */
+SpiritRenderGraph spCreateRenderGraph(const SpiritDevice device)
+    SPIRIT_NONULL(1);
+
+/**
+ * @brief Add an image the graph does not own, like a swapchain image.
+ * Imported images are never culled, and are left in finalLayout.
+ *
+ * @param graph
+ * @param name used for debugging
+ * @param image the image, can be changed between frames with
+ * spRenderGraphSetImage
+ * @param initialLayout the layout of the image when the graph starts
+ * @param finalLayout the layout to leave the image in
+ * @return SpiritRenderGraphResource
+ */
+SpiritRenderGraphResource spRenderGraphImportImage(
+    SpiritRenderGraph graph,
+    const char *name,
+    SpiritImage *image,
+    const VkImageLayout initialLayout,
+    const VkImageLayout finalLayout) SPIRIT_NONULL(1);
+
+/**
+ * @brief Add a transient image. It is created when the graph is compiled, and
+ * its memory may be shared with other transient images.
+ *
+ * @param graph
+ * @param name used for debugging
+ * @param imageInfo
+ * @return SpiritRenderGraphResource
+ */
+SpiritRenderGraphResource spRenderGraphCreateImage(
+    SpiritRenderGraph graph,
+    const char *name,
+    const SpiritRenderGraphImageInfo *imageInfo) SPIRIT_NONULL(1, 3);
+
+/**
+ * @brief Add a buffer the graph does not own. Imported buffers are never
+ * culled.
+ *
+ * @param graph
+ * @param name used for debugging
+ * @param buffer
+ * @return SpiritRenderGraphResource
+ */
+SpiritRenderGraphResource spRenderGraphImportBuffer(
+    SpiritRenderGraph graph, const char *name, VkBuffer buffer)
+    SPIRIT_NONULL(1);
+
+/**
+ * @brief Keep the passes producing a resource, even if nothing reads it
+ *
+ * @param graph
+ * @param resource
+ */
+void spRenderGraphMarkOutput(
+    SpiritRenderGraph graph, const SpiritRenderGraphResource resource)
+    SPIRIT_NONULL(1);
+
+/**
+ * @brief Add a pass. Passes run in the order they are added.
+ *
+ * @param graph
+ * @param name used for debugging
+ * @param execute records the pass
+ * @param userData passed to execute
+ * @return SpiritRenderGraphPass
+ */
+SpiritRenderGraphPass spRenderGraphAddPass(
+    SpiritRenderGraph graph,
+    const char *name,
+    SpiritRenderGraphPassFunction execute,
+    void *userData) SPIRIT_NONULL(1, 3);
+
+/**
+ * @brief Declare that a pass reads a resource
+ *
+ * @param graph
+ * @param pass
+ * @param resource
+ * @param access how the resource is read
+ * @return SpiritResult
+ */
+SpiritResult spRenderGraphPassRead(
+    SpiritRenderGraph graph,
+    const SpiritRenderGraphPass pass,
+    const SpiritRenderGraphResource resource,
+    const SpiritRenderGraphAccess access) SPIRIT_NONULL(1);
+
+/**
+ * @brief Declare that a pass writes a resource
+ *
+ * @param graph
+ * @param pass
+ * @param resource
+ * @param access how the resource is written
+ * @return SpiritResult
+ */
+SpiritResult spRenderGraphPassWrite(
+    SpiritRenderGraph graph,
+    const SpiritRenderGraphPass pass,
+    const SpiritRenderGraphResource resource,
+    const SpiritRenderGraphAccess access) SPIRIT_NONULL(1);
+
+/**
+ * @brief Cull unused passes, create transient images and generate barriers.
+ * Must be called again after passes or resources are added.
+ *
+ * @param graph
+ * @return SpiritResult
+ */
+SpiritResult spRenderGraphCompile(SpiritRenderGraph graph) SPIRIT_NONULL(1);
+
+/**
+ * @brief Record the live passes and their barriers into a command buffer
+ *
+ * @param graph a compiled graph
+ * @param commandBuffer must be recording
+ * @return SpiritResult
+ */
+SpiritResult spRenderGraphExecute(
+    SpiritRenderGraph graph, SpiritCommandBuffer commandBuffer)
+    SPIRIT_NONULL(1, 2);
+
+/**
+ * @brief Change an imported image, without recompiling the graph. The new
+ * image must have the same layouts.
+ *
+ * @param graph
+ * @param resource an imported image
+ * @param image
+ */
+void spRenderGraphSetImage(
+    SpiritRenderGraph graph,
+    const SpiritRenderGraphResource resource,
+    SpiritImage *image) SPIRIT_NONULL(1);
+
+/**
+ * @brief Drop the contents of an imported image on the next executions, it
+ * then starts from an undefined layout instead of its initial layout. Used
+ * when nothing was drawn to the image before the graph.
+ *
+ * @param graph
+ * @param resource an imported image
+ * @param discard
+ */
+void spRenderGraphDiscardImage(
+    SpiritRenderGraph graph,
+    const SpiritRenderGraphResource resource,
+    const bool discard) SPIRIT_NONULL(1);
+
+/**
+ * @brief Get the image of a resource, for use while executing a pass
+ *
+ * @param graph
+ * @param resource
+ * @return SpiritImage*
+ */
+SpiritImage *spRenderGraphGetImage(
+    SpiritRenderGraph graph, const SpiritRenderGraphResource resource)
+    SPIRIT_NONULL(1);
+
+/**
+ * @brief Check if a pass survived culling
+ *
+ * @param graph a compiled graph
+ * @param pass
+ * @return true if the pass will be executed
+ */
+bool spRenderGraphPassIsLive(
+    const SpiritRenderGraph graph, const SpiritRenderGraphPass pass)
+    SPIRIT_NONULL(1);
+
+/**
+ * @brief Destroy a render graph and its transient images. The device must be
+ * idle.
+ *
+ * @param graph
+ */
+void spDestroyRenderGraph(SpiritRenderGraph graph) SPIRIT_NONULL(1);
@@ -1,6 +1,7 @@
 #include "spirit_renderpass.h"
 
 #include "spirit_command_buffer.h"
+#include "spirit_deletion_queue.h"
 #include "spirit_image.h"
 
 #include "spirit_image.h"
@@ -24,6 +25,9 @@ SpiritResult createFramebuffers(
 void destroyFrameBuffers(
     const SpiritDevice device, SpiritRenderPass renderPass);
 
+// the layout the colour attachment is left in for what follows the pass
+VkImageLayout colourFinalLayout(const SpiritSwapchain swapchain);
+
 SpiritRenderPass spCreateRenderPass(
     SpiritRenderPassCreateInfo *createInfo,
     const SpiritDevice device,
@@ -33,6 +37,7 @@ SpiritRenderPass spCreateRenderPass(
     SpiritRenderPass out = new_var(struct t_SpiritRenderPass);
 
     out->renderPass       = createRenderPass(createInfo, device, swapchain);
+    out->colourLayout     = colourFinalLayout(swapchain);
     out->framebufferCount = 0;
     out->framebuffers     = NULL;
 
@@ -44,9 +49,47 @@ SpiritRenderPass spCreateRenderPass(
 SpiritResult spRenderPassRecreateFramebuffers(
     const SpiritDevice device,
     SpiritRenderPass renderPass,
-    const SpiritSwapchain swapchain)
+    const SpiritSwapchain swapchain,
+    SpiritDeletionQueue deletionQueue)
 {
+    if (deletionQueue && renderPass->framebuffers)
+    {
+        for (u32 i = 0; i < renderPass->framebufferCount; i++)
+            spDeletionQueuePushFramebuffer(
+                deletionQueue, renderPass->framebuffers[i]);
+
+        free(renderPass->framebuffers);
+        renderPass->framebuffers     = NULL;
+        renderPass->framebufferCount = 0;
+    }
+
     destroyFrameBuffers(device, renderPass);
+
+    // render targets were added or removed, so the image is needed in another
+    // layout after the pass. Pipelines stay compatible, layouts are not part
+    // of render pass compatibility.
+    const VkImageLayout colourLayout = colourFinalLayout(swapchain);
+    if (colourLayout != renderPass->colourLayout)
+    {
+        SpiritRenderPassCreateInfo createInfo = {};
+        VkRenderPass newRenderPass =
+            createRenderPass(&createInfo, device, swapchain);
+        if (!newRenderPass)
+        {
+            log_error("Failed to remake render pass");
+            return SPIRIT_FAILURE;
+        }
+
+        if (deletionQueue)
+            spDeletionQueuePushRenderPass(
+                deletionQueue, renderPass->renderPass);
+        else
+            vkDestroyRenderPass(device->device, renderPass->renderPass, NULL);
+
+        renderPass->renderPass   = newRenderPass;
+        renderPass->colourLayout = colourLayout;
+    }
+
     return createFramebuffers(device, swapchain, renderPass);
 }
 
@@ -134,7 +177,7 @@ VkRenderPass createRenderPass(
     colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     colorAttachment.stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachment.initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout    = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    colorAttachment.finalLayout    = colourFinalLayout(swapchain);
 
     VkAttachmentReference colorAttachmentRef = {};
     colorAttachmentRef.attachment            = 0;
@@ -152,10 +195,13 @@ VkRenderPass createRenderPass(
                          VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
         .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
                         VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
-        .srcSubpass    = VK_SUBPASS_EXTERNAL,
-        .srcAccessMask = 0,
+        .srcSubpass = VK_SUBPASS_EXTERNAL,
+        // depth images are kept when the swapchain is recreated, while frames
+        // of the old one may still be in flight, so earlier depth writes must
+        // finish before this frame clears it
+        .srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
         .srcStageMask  = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
-                        VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT};
+                        VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT};
 
     VkAttachmentDescription attachments[2] = {colorAttachment, depthAttachment};
 
@@ -188,16 +234,24 @@ SpiritResult createFramebuffers(
             new_array(VkFramebuffer, swapchain->imageCount);
     renderPass->framebufferCount = swapchain->imageCount;
 
+    // with dynamic resolution the scene is drawn to smaller targets. The depth
+    // images are full size, which is allowed as they are at least as large.
+    const SpiritImage *colourImages = swapchain->renderTargets
+                                          ? swapchain->renderTargets
+                                          : swapchain->images;
+    const VkExtent2D extent =
+        swapchain->renderTargets ? swapchain->renderExtent : swapchain->extent;
+
     renderPass->framebufferSize = (SpiritResolution){
-        swapchain->extent.width,
-        swapchain->extent.height,
+        extent.width,
+        extent.height,
     };
 
     for (size_t i = 0; i < swapchain->imageCount; i++)
     {
 
         VkImageView attachments[2] = {
-            spImageGetVkView(&swapchain->images[i]),
+            spImageGetVkView(&colourImages[i]),
             spImageGetVkView(&swapchain->depthImages[i])};
 
         db_assert_msg(renderPass && renderPass->renderPass, "No renderpass");
@@ -207,8 +261,8 @@ SpiritResult createFramebuffers(
         framebufferInfo.renderPass = renderPass->renderPass;
         framebufferInfo.attachmentCount = 2;
         framebufferInfo.pAttachments    = attachments;
-        framebufferInfo.width           = swapchain->extent.width;
-        framebufferInfo.height          = swapchain->extent.height;
+        framebufferInfo.width           = extent.width;
+        framebufferInfo.height          = extent.height;
         framebufferInfo.layers          = 1;
 
         if (vkCreateFramebuffer(
@@ -251,3 +305,12 @@ void destroyFrameBuffers(const SpiritDevice device, SpiritRenderPass renderPass)
         renderPass->framebufferCount = 0;
     }
 }
+
+VkImageLayout colourFinalLayout(const SpiritSwapchain swapchain)
+{
+    // offscreen images are left ready to be copied out, and render targets
+    // ready to be scaled to the swapchain image
+    return swapchain->headless || swapchain->renderTargets
+               ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+               : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+}
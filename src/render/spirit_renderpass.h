@@ -49,6 +49,7 @@ typedef struct t_SpiritRenderPassCreateInfo
 struct t_SpiritRenderPass
 {
     VkRenderPass renderPass;
+    VkImageLayout colourLayout; // final layout of the colour attachment
     VkFramebuffer *framebuffers;
     SpiritResolution framebufferSize;
     u32 framebufferCount;
@@ -67,15 +68,22 @@ SpiritRenderPass spCreateRenderPass(
 /**
  * @brief Used to recreate the framebuffers for a renderpass.
  * It should be done if the window is resized, or the resolution is changed.
+ * The render pass itself is remade if the colour image must be left in a
+ * different layout, like when render targets are removed.
  *
- * @param renderPass
  * @param device
+ * @param renderPass
+ * @param swapchain
+ * @param deletionQueue may be NULL. The old framebuffers are pushed to it, so
+ * frames still using them can finish. If it is NULL they are destroyed
+ * straight away, and must not be in use.
  * @return SpiritResult
  */
 SpiritResult spRenderPassRecreateFramebuffers(
     const SpiritDevice device,
     SpiritRenderPass renderPass,
-    const SpiritSwapchain swapchain);
+    const SpiritSwapchain swapchain,
+    SpiritDeletionQueue deletionQueue);
 
 /**
  * @brief Destroy a render pass
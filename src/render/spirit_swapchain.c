@@ -11,20 +11,38 @@ VkSurfaceFormatKHR chooseSwapSurfaceFormat(
     const VkSurfaceFormatKHR *availableFormats,
     VkSurfaceFormatKHR preferedFormat);
 
-// choose best or desired surface format
+// choose the desired present mode, or the closest available one
 VkPresentModeKHR chooseSwapPresentMode(
     uint32_t presentModeCount,
     const VkPresentModeKHR *availablePresentModes,
     VkPresentModeKHR preferredPresentMode);
 
 SpiritResult createImages(const SpiritDevice device, SpiritSwapchain swapchain);
-SpiritResult
-createDepthObjects(const SpiritDevice device, SpiritSwapchain swapchain);
+
+// create a swapchain without a VkSwapchainKHR, for headless devices
+SpiritSwapchain createHeadlessSwapchain(
+    SpiritSwapchainCreateInfo *createInfo,
+    SpiritDevice device,
+    SpiritSwapchain optionalSwapchain);
+
+// create the ring of images a headless swapchain renders to
+SpiritResult createOffscreenImages(
+    const SpiritDevice device, SpiritSwapchain swapchain, const u32 imageCount);
+// create the depth images, or take them from the old swapchain if they are
+// large enough
+SpiritResult createDepthObjects(
+    const SpiritDevice device,
+    SpiritSwapchain swapchain,
+    SpiritSwapchain oldSwapchain);
 
 void destroyDepthObjects(const SpiritDevice device, SpiritSwapchain swapchain);
 void destroyImages(const SpiritDevice device, SpiritSwapchain swapchain);
 
 VkFormat findDepthFormat(const SpiritDevice device);
+
+// the least number of images in a headless swapchain's ring
+#define HEADLESS_IMAGE_COUNT 3
+
 //
 // Public functions
 //
@@ -38,6 +56,10 @@ SpiritSwapchain spCreateSwapchain(
 
     db_assert_msg(device, "Device cannot be NULL when creating swapchain");
 
+    // there is no surface to take the limits from
+    if (device->headless || !createInfo->surface)
+        return createHeadlessSwapchain(createInfo, device, optionalSwapchain);
+
     // set present and format to fallback values
     if (!createInfo->selectedFormat)
     {
@@ -45,18 +67,14 @@ SpiritSwapchain spCreateSwapchain(
         createInfo->preferedFormat.colorSpace =
             VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
     }
-    if (device->powerSaveMode)
-    {
-        createInfo->preferredPresentMode = VK_PRESENT_MODE_FIFO_KHR;
-    }
-    else if (!createInfo->selectedPresentMode)
+    // a caller that selects a present mode also handles power saving, see
+    // fillSwapchainCreateInfo
+    if (!createInfo->selectedPresentMode)
     {
         createInfo->preferredPresentMode = VK_PRESENT_MODE_FIFO_KHR;
     }
 
-    spDeviceUpdateSwapchainSupport(device);
-
-    spDeviceUpdateSwapchainSupport(device);
+    spDeviceUpdateSwapchainSupport(device, createInfo->surface);
 
     // clamp window resolution to capabilties
     createInfo->windowRes.w = clamp_value(
@@ -76,16 +94,12 @@ SpiritSwapchain spCreateSwapchain(
             createInfo->windowRes.h);
     }
 
-    // use old swapchain memory to save memory
-    SpiritSwapchain out;
-    if (optionalSwapchain)
-    {
-        destroyDepthObjects(device, optionalSwapchain);
-        destroyImages(device, optionalSwapchain);
-        out = optionalSwapchain;
-    }
-    else
-        out = new_var(struct t_SpiritSwapchain);
+    // the old swapchain is left alone, its images may still be in use
+    SpiritSwapchain out = new_var(struct t_SpiritSwapchain);
+    memset(out, 0, sizeof(struct t_SpiritSwapchain));
+
+    out->headless  = false;
+    out->nextImage = 0;
 
     VkSwapchainCreateInfoKHR swapInfo = {};
     swapInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
@@ -122,13 +136,22 @@ SpiritSwapchain spCreateSwapchain(
     swapInfo.imageArrayLayers = 1;
     swapInfo.imageUsage       = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 
-    swapInfo.surface = device->windowSurface;
+    // allow the images to be copied out, and scaled into, when the surface
+    // supports it
+    swapInfo.imageUsage |=
+        device->swapchainDetails.capabilties.supportedUsageFlags &
+        (VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+    out->imageUsage = swapInfo.imageUsage;
+
+    swapInfo.surface = createInfo->surface;
 
-    if (device->graphicsQueue != device->presentQueue)
+    const u32 sharingFamilies[] = {
+        device->graphicsFamily, device->presentFamily};
+    if (device->graphicsFamily != device->presentFamily)
     {
         swapInfo.imageSharingMode      = VK_SHARING_MODE_CONCURRENT;
-        swapInfo.queueFamilyIndexCount = device->queueCount;
-        swapInfo.pQueueFamilyIndices   = device->queueIndices;
+        swapInfo.queueFamilyIndexCount = array_length(sharingFamilies);
+        swapInfo.pQueueFamilyIndices   = sharingFamilies;
     }
     else
     {
@@ -142,19 +165,18 @@ SpiritSwapchain spCreateSwapchain(
     swapInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
     swapInfo.clipped        = VK_TRUE;
 
-    // old swapchain
+    // lets the presentation engine hand over to the new swapchain without
+    // draining the old one. The old swapchain is retired by the caller.
     if (optionalSwapchain)
         swapInfo.oldSwapchain = optionalSwapchain->swapchain;
 
     if (vkCreateSwapchainKHR(device->device, &swapInfo, NULL, &out->swapchain))
     {
         log_error("Failed to create swapchain");
-        free(optionalSwapchain);
+        free(out);
         return NULL;
     }
 
-    vkDestroySwapchainKHR(device->device, swapInfo.oldSwapchain, NULL);
-
     out->imageCount = 0;
 
     // images
@@ -165,7 +187,7 @@ SpiritSwapchain spCreateSwapchain(
     }
 
     db_assert_msg(out->imageCount != 0, "Swapchain must have images");
-    if (createDepthObjects(device, out))
+    if (createDepthObjects(device, out, optionalSwapchain))
     {
         log_error("Failed to create depth objects");
         return NULL;
@@ -187,8 +209,14 @@ SpiritResult spSwapchainPresent(
     const SpiritDevice device,
     const SpiritSwapchain swapchain,
     const VkSemaphore waitSemaphore,
-    const u32 imageIndex)
+    const u32 imageIndex,
+    const VkRectLayerKHR *damage,
+    const u32 damageCount)
 {
+    // offscreen images stay where they are
+    if (swapchain->headless)
+        return SPIRIT_SUCCESS;
+
     VkPresentInfoKHR presentInfo = {};
     presentInfo.sType            = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 
@@ -201,7 +229,25 @@ SpiritResult spSwapchainPresent(
 
     presentInfo.pImageIndices = &imageIndex;
 
+    // only a hint, the whole image must still be valid
+    VkPresentRegionKHR region   = {};
+    VkPresentRegionsKHR regions = {};
+    if (device->incrementalPresent && damage && damageCount)
+    {
+        region.rectangleCount = damageCount;
+        region.pRectangles    = damage;
+
+        regions.sType          = VK_STRUCTURE_TYPE_PRESENT_REGIONS_KHR;
+        regions.swapchainCount = 1;
+        regions.pRegions       = &region;
+        presentInfo.pNext      = &regions;
+    }
+
+    // the present queue is usually the graphics queue, which other threads
+    // may submit to
+    spPlatformLockMutex(device->submitLock);
     VkResult r = vkQueuePresentKHR(device->presentQueue, &presentInfo);
+    spPlatformUnlockMutex(device->submitLock);
     if (r != VK_SUCCESS && r != VK_SUBOPTIMAL_KHR)
     {
         log_warning("Error attemting to present image");
@@ -219,6 +265,16 @@ SpiritResult spSwapchainAquireNextImage(
     u32 *imageIndex)
 {
 
+    // the gpu finishing with an image is tracked by the frames, so the
+    // ring is simply walked in order
+    if (swapchain->headless)
+    {
+        *imageIndex = swapchain->nextImage;
+        swapchain->nextImage =
+            (swapchain->nextImage + 1) % swapchain->imageCount;
+        return SPIRIT_SUCCESS;
+    }
+
     VkResult r = vkAcquireNextImageKHR(
         device->device,
         swapchain->swapchain,
@@ -235,6 +291,23 @@ SpiritResult spSwapchainAquireNextImage(
     return SPIRIT_SUCCESS;
 }
 
+void spRetireSwapchain(
+    const SpiritDevice device,
+    SpiritSwapchain swapchain,
+    SpiritDeletionQueue deletionQueue)
+{
+    // views before the swapchain that owns their images
+    for (u32 i = 0; i < swapchain->imageCount; i++)
+        spDeletionQueuePushImage(deletionQueue, &swapchain->images[i]);
+    for (u32 i = 0; i < swapchain->depthImageCount; i++)
+        spDeletionQueuePushImage(deletionQueue, &swapchain->depthImages[i]);
+    spDeletionQueuePushSwapchain(deletionQueue, swapchain->swapchain);
+
+    free(swapchain->images);
+    free(swapchain->depthImages);
+    free(swapchain);
+}
+
 // destroy swapchain instance
 SpiritResult
 spDestroySwapchain(SpiritSwapchain swapchain, const SpiritDevice device)
@@ -248,7 +321,8 @@ spDestroySwapchain(SpiritSwapchain swapchain, const SpiritDevice device)
     destroyDepthObjects(device, swapchain);
     destroyImages(device, swapchain);
 
-    vkDestroySwapchainKHR(device->device, swapchain->swapchain, NULL);
+    if (swapchain->swapchain)
+        vkDestroySwapchainKHR(device->device, swapchain->swapchain, NULL);
 
     free(swapchain);
 
@@ -292,23 +366,150 @@ SpiritResult createImages(const SpiritDevice device, SpiritSwapchain swapchain)
     return SPIRIT_SUCCESS;
 }
 
+SpiritSwapchain createHeadlessSwapchain(
+    SpiritSwapchainCreateInfo *createInfo,
+    SpiritDevice device,
+    SpiritSwapchain optionalSwapchain)
+{
+    SpiritSwapchain out = new_var(struct t_SpiritSwapchain);
+    memset(out, 0, sizeof(struct t_SpiritSwapchain));
+
+    // pick a format that can be rendered to, prefering the requested one
+    const VkFormat formats[] = {
+        createInfo->selectedFormat ? createInfo->preferedFormat.format
+                                   : VK_FORMAT_R8G8B8A8_UNORM,
+        VK_FORMAT_R8G8B8A8_UNORM,
+        VK_FORMAT_B8G8R8A8_UNORM};
+
+    out->swapchain     = VK_NULL_HANDLE;
+    out->supportInfo   = device->swapchainDetails;
+    out->headless      = true;
+    out->nextImage     = 0;
+    out->presentMode   = VK_PRESENT_MODE_FIFO_KHR;
+    out->surfaceFormat = (VkSurfaceFormatKHR){
+        .format = spDeviceFindSupportedFormat(
+            device,
+            formats,
+            array_length(formats),
+            VK_IMAGE_TILING_OPTIMAL,
+            VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT),
+        .colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR};
+    out->extent = (VkExtent2D){
+        createInfo->windowRes.w ? createInfo->windowRes.w : 1,
+        createInfo->windowRes.h ? createInfo->windowRes.h : 1};
+    out->imageCount = 0;
+
+    if (out->surfaceFormat.format == VK_FORMAT_UNDEFINED ||
+        createOffscreenImages(
+            device,
+            out,
+            max_value(HEADLESS_IMAGE_COUNT, createInfo->frameCount)))
+    {
+        log_error("Failed to create offscreen images");
+        free(out);
+        return NULL;
+    }
+
+    if (createDepthObjects(device, out, optionalSwapchain))
+    {
+        log_error("Failed to create depth objects");
+        return NULL;
+    }
+
+    out->createInfo = *createInfo;
+
+    if (!optionalSwapchain)
+    {
+        log_verbose(
+            "Created headless swapchain, image count %u", out->imageCount);
+    }
+
+    return out;
+}
+
+SpiritResult createOffscreenImages(
+    const SpiritDevice device, SpiritSwapchain swapchain, const u32 imageCount)
+{
+    swapchain->images = new_array(SpiritImage, imageCount);
+    memset(swapchain->images, 0, sizeof(SpiritImage) * imageCount);
+
+    for (u32 i = 0; i < imageCount; i++)
+    {
+        // transfer source so finished frames can be copied out, and
+        // destination so they can be scaled into
+        SpiritImageCreateInfo imageInfo = {
+            .flags  = 0,
+            .size.w = swapchain->extent.width,
+            .size.h = swapchain->extent.height,
+            .format = swapchain->surfaceFormat.format,
+            .tiling = VK_IMAGE_TILING_OPTIMAL,
+            .usageFlags = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                          VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+                          VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+            .memoryFlags   = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            .aspectFlags   = VK_IMAGE_ASPECT_COLOR_BIT,
+            .mipLevels     = 1,
+            .withImageView = true};
+
+        swapchain->imageUsage = imageInfo.usageFlags;
+        if (spCreateImage(device, &imageInfo, &swapchain->images[i]))
+        {
+            for (u32 x = 0; x < i; x++)
+                spDestroyImage(device, &swapchain->images[x]);
+            free(swapchain->images);
+            swapchain->images = NULL;
+            return SPIRIT_FAILURE;
+        }
+        swapchain->images[i].size = imageInfo.size;
+    }
+
+    swapchain->imageCount = imageCount;
+
+    return SPIRIT_SUCCESS;
+}
+
 void destroyImages(const SpiritDevice device, SpiritSwapchain swapchain)
 {
     for (u32 i = 0; i < swapchain->imageCount; i++)
     {
-        spDestroyImageView(device, &swapchain->images[i]);
+        // only offscreen images own their memory, the rest belong to the
+        // VkSwapchainKHR
+        if (swapchain->images[i].memory)
+            spDestroyImage(device, &swapchain->images[i]);
+        else
+            spDestroyImageView(device, &swapchain->images[i]);
     }
 
     free(swapchain->images);
 }
 
-SpiritResult
-createDepthObjects(const SpiritDevice device, SpiritSwapchain swapchain)
+SpiritResult createDepthObjects(
+    const SpiritDevice device,
+    SpiritSwapchain swapchain,
+    SpiritSwapchain oldSwapchain)
 {
     VkFormat depthFormat       = findDepthFormat(device);
     VkExtent2D swapChainExtent = swapchain->extent;
 
-    swapchain->depthImages = new_array(SpiritImage, swapchain->imageCount);
+    // framebuffers may use attachments larger than themselves, so the old
+    // depth images are kept as long as the window has not grown
+    if (oldSwapchain && oldSwapchain->depthImages &&
+        oldSwapchain->depthImageCount >= swapchain->imageCount &&
+        oldSwapchain->depthExtent.width >= swapChainExtent.width &&
+        oldSwapchain->depthExtent.height >= swapChainExtent.height)
+    {
+        swapchain->depthImages     = oldSwapchain->depthImages;
+        swapchain->depthImageCount = oldSwapchain->depthImageCount;
+        swapchain->depthExtent     = oldSwapchain->depthExtent;
+
+        oldSwapchain->depthImages     = NULL;
+        oldSwapchain->depthImageCount = 0;
+        return SPIRIT_SUCCESS;
+    }
+
+    swapchain->depthImages     = new_array(SpiritImage, swapchain->imageCount);
+    swapchain->depthImageCount = swapchain->imageCount;
+    swapchain->depthExtent     = swapChainExtent;
 
     for (u32 i = 0; i < swapchain->imageCount; i++)
     {
@@ -333,7 +534,7 @@ createDepthObjects(const SpiritDevice device, SpiritSwapchain swapchain)
 
 void destroyDepthObjects(const SpiritDevice device, SpiritSwapchain swapchain)
 {
-    for (u32 i = 0; i < swapchain->imageCount; i++)
+    for (u32 i = 0; i < swapchain->depthImageCount; i++)
     {
         spDestroyImage(device, &swapchain->depthImages[i]);
     }
@@ -366,22 +567,53 @@ VkPresentModeKHR chooseSwapPresentMode(
     VkPresentModeKHR preferredPresentMode)
 {
 
-    bool foundFallback = false;
-
-    // check if prefered render mode is available
-    for (uint32_t i = 0; i < presentModeCount; i++)
+    // modes to try for each preference, closest first. Mailbox does not fall
+    // back to immediate so that it never tears, and fifo is always available.
+    static const VkPresentModeKHR immediateFallbacks[] = {
+        VK_PRESENT_MODE_IMMEDIATE_KHR,
+        VK_PRESENT_MODE_MAILBOX_KHR,
+        VK_PRESENT_MODE_FIFO_RELAXED_KHR,
+        VK_PRESENT_MODE_FIFO_KHR};
+    static const VkPresentModeKHR mailboxFallbacks[] = {
+        VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_KHR};
+    const VkPresentModeKHR otherFallbacks[] = {
+        preferredPresentMode, VK_PRESENT_MODE_FIFO_KHR};
+
+    const VkPresentModeKHR *fallbacks;
+    u32 fallbackCount;
+    switch (preferredPresentMode)
     {
-        if (availablePresentModes[i] == preferredPresentMode)
-            return availablePresentModes[i];
+    case VK_PRESENT_MODE_IMMEDIATE_KHR:
+        fallbacks     = immediateFallbacks;
+        fallbackCount = array_length(immediateFallbacks);
+        break;
+    case VK_PRESENT_MODE_MAILBOX_KHR:
+        fallbacks     = mailboxFallbacks;
+        fallbackCount = array_length(mailboxFallbacks);
+        break;
+    default:
+        fallbacks     = otherFallbacks;
+        fallbackCount = array_length(otherFallbacks);
+        break;
+    }
 
-        if (availablePresentModes[i] == VK_PRESENT_MODE_FIFO_KHR)
-            foundFallback = true;
+    for (u32 f = 0; f < fallbackCount; f++)
+    {
+        for (uint32_t i = 0; i < presentModeCount; i++)
+        {
+            if (availablePresentModes[i] != fallbacks[f])
+                continue;
+
+            if (f != 0)
+                log_warning(
+                    "Present mode %d unavailable, using %d",
+                    preferredPresentMode,
+                    fallbacks[f]);
+            return fallbacks[f];
+        }
     }
 
-    if (foundFallback)
-        return VK_PRESENT_MODE_FIFO_KHR;
-    else
-        return availablePresentModes[0];
+    return availablePresentModes[0];
 }
 
 VkFormat findDepthFormat(const SpiritDevice device)
@@ -2,6 +2,7 @@
 #include <spirit_header.h>
 #include "spirit_renderpass.h"
 #include "spirit_device.h"
+#include "spirit_deletion_queue.h"
 
 /**
  * Manage and wrap a vulkan swapchain.
@@ -19,17 +20,25 @@
 typedef struct t_SpiritSwapchainCreateInfo
 {
 
-    // TODO vsync option
-
-    // optional options, if used set the associated boolean to true
+    // optional options, if used set the associated boolean to true. If the
+    // present mode is unsupported the closest supported mode is used, see
+    // chooseSwapPresentMode.
     bool selectedPresentMode;
     VkPresentModeKHR preferredPresentMode;
     bool selectedFormat;
     VkSurfaceFormatKHR preferedFormat;
 
-    // dimensions of the window in pixels
+    // dimensions of the window in pixels, or of the offscreen images when the
+    // device is headless
     SpiritResolution windowRes;
 
+    // the window surface to present to, ignored when the device is headless
+    VkSurfaceKHR surface;
+
+    // frames in flight. A headless swapchain has at least one image for each,
+    // so no image is rendered to while an earlier frame still reads it.
+    u32 frameCount;
+
 } SpiritSwapchainCreateInfo;
 
 /**
@@ -42,6 +51,10 @@ typedef struct t_SpiritSwapchainCreateInfo
  *
  * all sync objects use maxFramesInFlight to store their sizes.
  *
+ * When the device is headless there is no VkSwapchainKHR. The swapchain owns a
+ * ring of offscreen images instead, which are handed out in order by
+ * spSwapchainAquireNextImage, and presenting them does nothing.
+ *
  * @author Kael Johnston
  */
 struct t_SpiritSwapchain
@@ -60,7 +73,23 @@ struct t_SpiritSwapchain
     // images
     u32 imageCount;
     SpiritImage *images;
+
+    // may be more, and larger, than the colour images when they were kept
+    // from a previous swapchain
     SpiritImage *depthImages;
+    u32 depthImageCount;
+    VkExtent2D depthExtent;
+    VkImageUsageFlags imageUsage; // how the colour images can be used
+
+    // when set, render passes draw to these smaller images instead, and the
+    // context scales them up to the swapchain images. Owned by the context's
+    // SpiritDynamicResolution.
+    SpiritImage *renderTargets;
+    VkExtent2D renderExtent;
+
+    // headless only, the next image of the ring to render to
+    u32 nextImage;
+    bool headless;
 
     // useful for recreating the swapchain
     SpiritSwapchainCreateInfo createInfo;
@@ -76,8 +105,10 @@ struct t_SpiritSwapchain
  * used to configure the swapchain.
  * @param device a valid SpiritDevice, created using spCreateDevice or
  * automatically using a context.
- * @param optionalSwapchain is an old swapchain which will be recreated, so that
- * resources to not need to be destroyed and created. Currently unimplemented.
+ * @param optionalSwapchain may be NULL, or a swapchain being replaced. It is
+ * passed to vulkan as the old swapchain, and its depth images are moved to the
+ * new swapchain if they are large enough. It must be retired with
+ * spRetireSwapchain afterwards, even if creation fails.
  *
  * @return a SpiritSwapchain object which can be used in the program. If there
  * is a failure, it will return NULL. Always check if the result it NULL.
@@ -96,13 +127,19 @@ SpiritSwapchain spCreateSwapchain(
  * @param swapchain the swapchain
  * @param waitSemaphore
  * @param imageIndex the image index to submit
+ * @param damage the parts of the image that changed since the last present,
+ * passed on with VK_KHR_incremental_present if the device enabled it. NULL if
+ * the whole image changed.
+ * @param damageCount
  * @return SpiritResult
  */
 SpiritResult spSwapchainPresent(
     const SpiritDevice device,
     const SpiritSwapchain swapchain,
     const VkSemaphore waitSemaphore,
-    const u32 imageIndex);
+    const u32 imageIndex,
+    const VkRectLayerKHR *damage,
+    const u32 damageCount);
 
 /**
  * Aquire the next image to render to. This function should be used with
@@ -131,6 +168,21 @@ SpiritResult spSwapchainAquireNextImage(
     VkSemaphore waitSemaphore,
     u32 *imageIndex) SPIRIT_NONULL(1, 2, 3, 4);
 
+/**
+ * @brief Hand a replaced swapchain's resources to a deletion queue, and free
+ * it. Unlike spDestroySwapchain this does not wait for the device, frames that
+ * still use the old images can finish first.
+ *
+ * @param device
+ * @param swapchain the swapchain passed to spCreateSwapchain as
+ * optionalSwapchain
+ * @param deletionQueue
+ */
+void spRetireSwapchain(
+    const SpiritDevice device,
+    SpiritSwapchain swapchain,
+    SpiritDeletionQueue deletionQueue) SPIRIT_NONULL(1, 2, 3);
+
 /**
  * Destroy a swapchain object. This will cause errors if
  * every object that depends on the swapchain is not already destroyed, and may
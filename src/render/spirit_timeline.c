@@ -0,0 +1,214 @@
+#include "spirit_timeline.h"
+
+//
+// Helpers
+//
+
+// raise the cached completed value, other threads may be raising it too
+static void updateCompleted(struct t_SpiritTimeline *timeline, u64 value);
+
+//
+// Public functions
+//
+
+SpiritResult spCreateTimelines(SpiritDevice device)
+{
+    device->timelines =
+        new_array(struct t_SpiritTimeline, SPIRIT_QUEUE_TYPE_COUNT);
+    memset(
+        device->timelines,
+        0,
+        sizeof(struct t_SpiritTimeline) * SPIRIT_QUEUE_TYPE_COUNT);
+    device->submitLock = spPlatformCreateMutex();
+
+    VkSemaphoreTypeCreateInfo typeInfo = {};
+    typeInfo.sType         = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    typeInfo.initialValue  = 0;
+
+    VkSemaphoreCreateInfo semaphoreInfo = {};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreInfo.pNext = &typeInfo;
+
+    for (u32 i = 0; i < SPIRIT_QUEUE_TYPE_COUNT; i++)
+    {
+        if (vkCreateSemaphore(
+                device->device,
+                &semaphoreInfo,
+                ALLOCATION_CALLBACK,
+                &device->timelines[i].semaphore))
+        {
+            log_error("Failed to create timeline semaphore");
+            return SPIRIT_FAILURE;
+        }
+    }
+
+    return SPIRIT_SUCCESS;
+}
+
+SpiritSyncPoint spTimelineSubmit(
+    const SpiritDevice device,
+    const SpiritQueueType queue,
+    const SpiritSubmitInfo *submitInfo)
+{
+    struct t_SpiritTimeline *timeline = &device->timelines[queue];
+
+    // binary semaphores ignore their values, but every semaphore needs one
+    const u32 maxWaits = submitInfo->waitCount + 1;
+    VkSemaphore waitSemaphores[maxWaits];
+    u64 waitValues[maxWaits];
+    VkPipelineStageFlags waitStages[maxWaits];
+    u32 waitCount = 0;
+
+    if (submitInfo->waitSemaphore)
+    {
+        waitSemaphores[waitCount] = submitInfo->waitSemaphore;
+        waitValues[waitCount]     = 0;
+        waitStages[waitCount]     = submitInfo->waitStage;
+        waitCount++;
+    }
+
+    for (u32 i = 0; i < submitInfo->waitCount; i++)
+    {
+        const SpiritSyncPoint point = submitInfo->waits[i];
+        if (spTimelineReached(device, point))
+            continue;
+
+        waitSemaphores[waitCount] = device->timelines[point.queue].semaphore;
+        waitValues[waitCount]     = point.value;
+        waitStages[waitCount]     = submitInfo->waitPointStage;
+        waitCount++;
+    }
+
+    VkSemaphore signalSemaphores[2] = {timeline->semaphore};
+    u64 signalValues[2]             = {};
+    u32 signalCount                 = 1;
+    if (submitInfo->signalSemaphore)
+        signalSemaphores[signalCount++] = submitInfo->signalSemaphore;
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount   = waitCount;
+    timelineInfo.pWaitSemaphoreValues      = waitValues;
+    timelineInfo.signalSemaphoreValueCount = signalCount;
+    timelineInfo.pSignalSemaphoreValues    = signalValues;
+
+    VkSubmitInfo vkSubmitInfo         = {};
+    vkSubmitInfo.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    vkSubmitInfo.pNext                = &timelineInfo;
+    vkSubmitInfo.waitSemaphoreCount   = waitCount;
+    vkSubmitInfo.pWaitSemaphores      = waitSemaphores;
+    vkSubmitInfo.pWaitDstStageMask    = waitStages;
+    vkSubmitInfo.commandBufferCount   = submitInfo->commandBufferCount;
+    vkSubmitInfo.pCommandBuffers      = submitInfo->commandBuffers;
+    vkSubmitInfo.signalSemaphoreCount = signalCount;
+    vkSubmitInfo.pSignalSemaphores    = signalSemaphores;
+
+    // values must be signaled in order, and queues may be shared between
+    // queue types, so every submission takes the same lock
+    SpiritSyncPoint out = {.queue = queue, .value = 0};
+    spPlatformLockMutex(device->submitLock);
+    signalValues[0] = timeline->submitted + 1;
+    if (vkQueueSubmit(
+            spDeviceGetQueue(device, queue), 1, &vkSubmitInfo, VK_NULL_HANDLE))
+    {
+        log_error("Failed to submit to queue");
+    }
+    else
+    {
+        out.value = timeline->submitted = signalValues[0];
+    }
+    spPlatformUnlockMutex(device->submitLock);
+
+    return out;
+}
+
+bool spTimelineReached(const SpiritDevice device, const SpiritSyncPoint point)
+{
+    struct t_SpiritTimeline *timeline = &device->timelines[point.queue];
+    if (point.value <= atomic_load(&timeline->completed))
+        return true;
+
+    u64 value = 0;
+    if (vkGetSemaphoreCounterValue(device->device, timeline->semaphore, &value))
+        return false;
+
+    updateCompleted(timeline, value);
+    return point.value <= value;
+}
+
+SpiritResult spTimelineWait(
+    const SpiritDevice device, const SpiritSyncPoint point, u64 timeout_ns)
+{
+    struct t_SpiritTimeline *timeline = &device->timelines[point.queue];
+    if (point.value <= atomic_load(&timeline->completed))
+        return SPIRIT_SUCCESS;
+
+    VkSemaphoreWaitInfo waitInfo = {};
+    waitInfo.sType               = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount      = 1;
+    waitInfo.pSemaphores         = &timeline->semaphore;
+    waitInfo.pValues             = &point.value;
+
+    VkResult r = vkWaitSemaphores(device->device, &waitInfo, timeout_ns);
+    switch (r)
+    {
+    case VK_SUCCESS:
+        updateCompleted(timeline, point.value);
+        return SPIRIT_SUCCESS;
+    case VK_TIMEOUT: log_warning("Timed out"); break;
+    case VK_ERROR_DEVICE_LOST: log_error("VK_ERROR_DEVICE_LOST."); break;
+    case VK_ERROR_OUT_OF_HOST_MEMORY:
+        log_error("VK_ERROR_OUT_OF_HOST_MEMORY.");
+        break;
+    case VK_ERROR_OUT_OF_DEVICE_MEMORY:
+        log_error("VK_ERROR_OUT_OF_DEVICE_MEMORY.");
+        break;
+    default: log_error("An unknown error has occurred."); break;
+    }
+
+    return SPIRIT_FAILURE;
+}
+
+SpiritSyncPoint spTimelineGetSubmitted(
+    const SpiritDevice device, const SpiritQueueType queue)
+{
+    spPlatformLockMutex(device->submitLock);
+    SpiritSyncPoint out = {
+        .queue = queue, .value = device->timelines[queue].submitted};
+    spPlatformUnlockMutex(device->submitLock);
+
+    return out;
+}
+
+void spDestroyTimelines(SpiritDevice device)
+{
+    if (!device->timelines)
+        return;
+
+    for (u32 i = 0; i < SPIRIT_QUEUE_TYPE_COUNT; i++)
+    {
+        if (device->timelines[i].semaphore)
+            vkDestroySemaphore(
+                device->device,
+                device->timelines[i].semaphore,
+                ALLOCATION_CALLBACK);
+    }
+
+    free(device->timelines);
+    device->timelines = NULL;
+    spPlatformDestroyMutex(device->submitLock);
+}
+
+//
+// Helpers
+//
+
+static void updateCompleted(struct t_SpiritTimeline *timeline, u64 value)
+{
+    u64 current = atomic_load(&timeline->completed);
+    while (current < value &&
+           !atomic_compare_exchange_weak(&timeline->completed, &current, value))
+    {
+    }
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include <spirit_header.h>
+#include <stdatomic.h>
+#include "spirit_device.h"
+
+// Timeline semaphores. Each queue has one semaphore whose value only grows,
+// and every submission to the queue signals the next value. Work is named by
+// its queue and the value it signals, a sync point, so waiting on the host,
+// waiting on another queue and checking whether a resource is still in use
+// all compare against one counter per queue instead of a fence per submit.
+
+//
+// Types
+//
+
+// a submission on a queue. Value 0 is before any submission, and is always
+// complete.
+typedef struct t_SpiritSyncPoint
+{
+    SpiritQueueType queue;
+    u64 value;
+} SpiritSyncPoint;
+
+struct t_SpiritTimeline
+{
+    VkSemaphore semaphore;
+    u64 submitted;          // signaled by the last submission, see submitLock
+    _Atomic u64 completed;  // the largest value seen finished
+};
+
+typedef struct t_SpiritSubmitInfo
+{
+    const VkCommandBuffer *commandBuffers;
+    u32 commandBufferCount;
+
+    // binary semaphores, like swapchain acquire and present. May be NULL.
+    VkSemaphore waitSemaphore;
+    VkPipelineStageFlags waitStage;
+    VkSemaphore signalSemaphore;
+
+    // submissions to wait for, on any queue. Complete ones are skipped.
+    const SpiritSyncPoint *waits;
+    u32 waitCount;
+    VkPipelineStageFlags waitPointStage;
+} SpiritSubmitInfo;
+
+//
+// Functions
+//
+
+/**
+ * @brief Create a timeline for every queue type of a device
+ *
+ * @param device
+ * @return SpiritResult
+ */
+SpiritResult spCreateTimelines(SpiritDevice device) SPIRIT_NONULL(1);
+
+/**
+ * @brief Submit work to a queue, and signal the next value of its timeline.
+ * Submissions are serialized, so any thread may submit.
+ *
+ * @param device
+ * @param queue
+ * @param submitInfo
+ * @return SpiritSyncPoint the submission, with value 0 on failure
+ */
+SpiritSyncPoint spTimelineSubmit(
+    const SpiritDevice device,
+    const SpiritQueueType queue,
+    const SpiritSubmitInfo *submitInfo) SPIRIT_NONULL(1, 3);
+
+/**
+ * @brief Check if the gpu has finished a submission, without blocking
+ *
+ * @param device
+ * @param point
+ * @return true if it is complete
+ */
+bool spTimelineReached(const SpiritDevice device, const SpiritSyncPoint point)
+    SPIRIT_NONULL(1);
+
+/**
+ * @brief Block until the gpu has finished a submission
+ *
+ * @param device
+ * @param point
+ * @param timeout_ns
+ * @return SpiritResult
+ */
+SpiritResult spTimelineWait(
+    const SpiritDevice device, const SpiritSyncPoint point, u64 timeout_ns)
+    SPIRIT_NONULL(1);
+
+/**
+ * @brief Get the sync point of the last submission to a queue
+ *
+ * @param device
+ * @param queue
+ * @return SpiritSyncPoint
+ */
+SpiritSyncPoint spTimelineGetSubmitted(
+    const SpiritDevice device, const SpiritQueueType queue) SPIRIT_NONULL(1);
+
+/**
+ * @brief Destroy the timelines of a device. The device must be idle.
+ *
+ * @param device
+ */
+void spDestroyTimelines(SpiritDevice device) SPIRIT_NONULL(1);
@@ -39,6 +39,15 @@ typedef enum e_SpiritResult
     SPIRIT_UNDEFINED = 2  // did not succeed, may not have failed
 } SpiritResult;
 
+// how rendered images are presented. If a mode is not supported the closest
+// supported mode is used, falling back to SPIRIT_PRESENT_MODE_VSYNC.
+typedef enum e_SpiritPresentMode
+{
+    SPIRIT_PRESENT_MODE_VSYNC = 0, // wait for vblank, always supported
+    SPIRIT_PRESENT_MODE_MAILBOX,   // replace queued images, no tearing
+    SPIRIT_PRESENT_MODE_IMMEDIATE, // present right away, may tear
+} SpiritPresentMode;
+
 //
 // Structures
 //
@@ -77,6 +86,12 @@ typedef struct t_SpiritCommandBuffer *SpiritCommandBuffer;
 typedef struct t_SpiritPipeline *SpiritPipeline;
 typedef struct t_SpiritMaterial *SpiritMaterial;
 typedef struct t_SpiritContext *SpiritContext;
+typedef struct t_SpiritReadback *SpiritReadback;
+typedef struct t_SpiritRenderGraph *SpiritRenderGraph;
+typedef struct t_SpiritDeletionQueue *SpiritDeletionQueue;
+typedef struct t_SpiritDynamicResolution *SpiritDynamicResolution;
+typedef struct t_SpiritCommandPool *SpiritCommandPool;
+typedef struct t_SpiritFrameArena *SpiritFrameArena;
 
 typedef struct t_SpiritMesh *SpiritMesh;
 typedef struct t_SpiritMeshManager *SpiritMeshManager;
@@ -90,6 +105,7 @@ typedef struct t_SpiritMeshReference
 } SpiritMeshReference;
 
 typedef struct t_SpiritImage SpiritImage;
+typedef struct t_SpiritBuffer SpiritBuffer;
 
 // shaders
 // store wether a shader is frag or vert shader
@@ -112,14 +128,36 @@ typedef struct t_SpiritShader
     const char *path;
     SpiritShaderCode shader;
     u64 shaderSize;
+    bool packed; // the code is in the shader pack, and is not freed
 } SpiritShader;
 
+// per mesh data passed to spMaterialAddMesh. It is copied into the contexts
+// object storage buffer when the material is recorded, not pushed directly.
 typedef struct t_SpiritPushConstant
 {
     mat4 transform;
     CGLM_ALIGN(16) vec3 color;
 } SpiritPushConstant;
 
+// per object data as stored in the object storage buffer. It matches the
+// std430 layout of the ObjectData struct in the vertex shader, so it is kept
+// as plain floats rather than cglm types, which may be over aligned.
+typedef struct t_SpiritObjectData
+{
+    f32 transform[16];
+    f32 color[4];
+} SpiritObjectData;
+
+static_assert(
+    sizeof(SpiritObjectData) == 80, "SpiritObjectData must match std430");
+
+// the only value actually pushed for each material, the index of the
+// materials first object in the object storage buffer
+typedef struct t_SpiritDrawPushConstant
+{
+    u32 objectBase;
+} SpiritDrawPushConstant;
+
 // math presets
 /* clang-format off */
 
@@ -9,9 +9,22 @@ struct t_SpiritWindow
     SpiritResolution windowSize;
     const char *title;
     bool resizing;
+
+    // set by the callbacks, each window has its own so several windows can
+    // be open at once
+    bool wasResized;
+    SpiritResolution resizedSize;
+    bool needsRefresh; // the window system lost the window contents
 };
 
+// glfw is initialized with the first window, and terminated with the last
+static u32 g_windowCount = 0;
+
 void window_size_callback(GLFWwindow *window, int width, int height);
+void window_refresh_callback(GLFWwindow *window);
+
+// check the window after events have been processed
+SpiritWindowState updateWindowState(SpiritWindow window);
 
 SpiritWindow spCreateWindow(SpiritWindowCreateInfo *createInfo)
 {
@@ -69,9 +82,16 @@ SpiritWindow spCreateWindow(SpiritWindowCreateInfo *createInfo)
         log_fatal("Failed to create window. GLFW Error: %s", glfwError);
     }
 
+    window->resizing     = false;
+    window->wasResized   = false;
+    window->resizedSize  = (SpiritResolution){};
+    window->needsRefresh = true;
+
+    glfwSetWindowUserPointer(window->window, window);
     glfwSetWindowSizeCallback(window->window, &window_size_callback);
+    glfwSetWindowRefreshCallback(window->window, &window_refresh_callback);
 
-    window->resizing = false;
+    g_windowCount++;
 
     return window;
 }
@@ -81,27 +101,56 @@ SpiritResult spDestroyWindow(SpiritWindow window)
 
     glfwDestroyWindow(window->window);
     free(window);
-    glfwTerminate();
+
+    // other windows still need glfw
+    if (--g_windowCount == 0)
+        glfwTerminate();
 
     log_verbose("Closing window");
     return SPIRIT_SUCCESS;
 }
 
-static bool g_glfwWindowWasResized   = false;
-static SpiritResolution g_windowSize = {.w = 0, .h = 0};
+u32 spWindowGetOpenCount(void)
+{
+    return g_windowCount;
+}
+
+void window_size_callback(GLFWwindow *window, int width, int height)
+{
+    SpiritWindow spiritWindow = glfwGetWindowUserPointer(window);
+    spiritWindow->wasResized  = true;
+    spiritWindow->resizedSize = (SpiritResolution){.w = width, .h = height};
+}
 
-void window_size_callback(
-    GLFWwindow *window __attribute_maybe_unused__, int width, int height)
+void window_refresh_callback(GLFWwindow *window)
 {
-    g_glfwWindowWasResized = true;
-    g_windowSize           = (SpiritResolution){.w = width, .h = height};
+    SpiritWindow spiritWindow  = glfwGetWindowUserPointer(window);
+    spiritWindow->needsRefresh = true;
+}
+
+bool spWindowTakeRefresh(SpiritWindow window)
+{
+    const bool refresh   = window->needsRefresh;
+    window->needsRefresh = false;
+    return refresh;
 }
 
 SpiritWindowState spWindowGetState(SpiritWindow window)
+{
+    glfwPollEvents();
+    return updateWindowState(window);
+}
+
+SpiritWindowState spWindowWaitState(SpiritWindow window)
+{
+    glfwWaitEvents();
+    return updateWindowState(window);
+}
+
+SpiritWindowState updateWindowState(SpiritWindow window)
 {
     const char *description = NULL;
 
-    glfwPollEvents();
     if (glfwGetError(&description))
     {
         log_error("GLFW error: %s", description);
@@ -118,13 +167,25 @@ SpiritWindowState spWindowGetState(SpiritWindow window)
         return SPIRIT_WINDOW_CLOSED;
     }
 
+    // nothing can be presented to an iconified or hidden window, and some
+    // platforms report a zero framebuffer instead. A pending resize is kept
+    // until the window comes back.
+    int width, height;
+    glfwGetFramebufferSize(window->window, &width, &height);
+    if (glfwGetWindowAttrib(window->window, GLFW_ICONIFIED) ||
+        !glfwGetWindowAttrib(window->window, GLFW_VISIBLE) || width == 0 ||
+        height == 0)
+    {
+        return SPIRIT_WINDOW_MINIMIZED;
+    }
+
     // the window is being resized
-    if (g_glfwWindowWasResized)
+    if (window->wasResized)
     {
-        g_glfwWindowWasResized = false;
-        window->windowSize     = g_windowSize;
-        window->resizing       = true;
-        g_windowSize           = (SpiritResolution){};
+        window->wasResized  = false;
+        window->windowSize  = window->resizedSize;
+        window->resizing    = true;
+        window->resizedSize = (SpiritResolution){};
         return SPIRIT_WINDOW_RESIZING;
     }
 
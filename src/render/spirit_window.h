@@ -41,6 +41,14 @@ typedef enum e_SpiritWindowState
 SpiritWindow spCreateWindow(SpiritWindowCreateInfo *createInfo)
     SPIRIT_NONULL(1);
 
+/**
+ * @brief Get the number of windows that are open. Events for every window are
+ * processed by any of them polling.
+ *
+ * @return u32
+ */
+u32 spWindowGetOpenCount(void);
+
 /**
  * @brief Close and destroy a SpiritWindow
  *
@@ -58,6 +66,26 @@ SpiritResult spDestroyWindow(SpiritWindow window) SPIRIT_NONULL(1);
  */
 SpiritWindowState spWindowGetState(SpiritWindow window) SPIRIT_NONULL(1);
 
+/**
+ * @brief Like spWindowGetState, but block until at least one event arrives
+ * instead of polling. Used while the window is minimized, so nothing runs
+ * until it changes.
+ *
+ * @param window
+ * @return SpiritWindowState
+ */
+SpiritWindowState spWindowWaitState(SpiritWindow window) SPIRIT_NONULL(1);
+
+/**
+ * @brief Check if the window system asked for the window to be redrawn since
+ * the last call, for example because it was uncovered. Updated by
+ * spWindowGetState.
+ *
+ * @param window
+ * @return true the first time it is called after a refresh is requested
+ */
+bool spWindowTakeRefresh(SpiritWindow window) SPIRIT_NONULL(1);
+
 /**
  * @brief resize the window
  *
@@ -7,6 +7,7 @@
 #include "render/spirit_context.h"
 
 #include "render/spirit_device.h"
+#include "render/spirit_frame_arena.h"
 #include "render/spirit_material.h"
 #include "render/spirit_mesh.h"
 
@@ -16,6 +17,7 @@
 #include "render/spirit_window.h"
 #include "utils/platform.h"
 #include "utils/spirit_file.h"
+#include "utils/spirit_jobs.h"
 #include "utils/spirit_vector.h"
 
 void mainlooptest(void);
@@ -30,12 +32,15 @@ int main(int argc, char **argv) {
   if (argc >= 2 && strcmp("-h", argv[1]) == 0) {
     printf("Usage:\n\t"
            "--test - run the tests\n\t"
-           "--delete-shader-cache - delete the shader cache\n");
+           "--delete-shader-cache - delete the shader cache\n\t"
+           "--pack-shaders <pack> <shaders...> - pack shaders into one file\n\t"
+           "--shader-pack <pack> - run with shaders from a pack\n");
   }
 
   // tests
   if (argc >= 2 && strcmp("--test", argv[1]) == 0) {
     Test();
+    spReleaseShaderCompiler();
     return 0;
   }
 
@@ -44,7 +49,21 @@ int main(int argc, char **argv) {
     return 0;
   }
 
+  if (argc >= 3 && strcmp("--pack-shaders", argv[1]) == 0) {
+    const SpiritResult result = spWriteShaderPack(
+        argv[2], (const char *const *)argv + 3, argc - 3);
+    spReleaseShaderCompiler();
+    return result ? 1 : 0;
+  }
+
+  if (argc >= 3 && strcmp("--shader-pack", argv[1]) == 0 &&
+      spOpenShaderPack(argv[2])) {
+    return 1;
+  }
+
   mainlooptest();
+  spReleaseShaderCompiler();
+  spCloseShaderPack();
 
   return 0;
 }
@@ -73,7 +92,13 @@ void mainlooptest(void) {
 
   SpiritMaterial material;
   time_function_with_return(spCreateMaterial(context, &materialInfo), material);
-  SpiritMaterial material2 = spCreateMaterial(context, &materialInfo);
+
+  // second material compiles in the background, drawing with the first
+  // material until it is ready
+  SpiritMaterialCreateInfo asyncMaterialInfo = materialInfo;
+  asyncMaterialInfo.asyncCompile = true;
+  asyncMaterialInfo.fallback = material;
+  SpiritMaterial material2 = spCreateMaterial(context, &asyncMaterialInfo);
 
   if (material == NULL)
     return;
@@ -399,15 +424,10 @@ bool TestGLSLLoader(const char *restrict shaderPath) {
     equal = false;
   }
 
-  // formulate test shader binary name (hacked)
-  u32 bufLen = 256;
-  char stripBuf[256];
-  spStringStrip(stripBuf, &bufLen, shaderPath, '/');
-
   char buf[256];
-  snprintf(buf, bufLen, "%s%s.spv", GLSL_LOADER_CACHE_FOLDER, stripBuf);
-
-  spPlatformDeleteFile(buf);
+  if (spShaderCachePath(buf, sizeof(buf), shaderPath,
+                        SPIRIT_SHADER_TYPE_FRAGMENT) == SPIRIT_SUCCESS)
+    spPlatformDeleteFile(buf);
 
   time_function(spDestroyShader(testShaderSource));
   time_function(spDestroyShader(testShaderBinary));
@@ -415,6 +435,120 @@ bool TestGLSLLoader(const char *restrict shaderPath) {
   return equal;
 }
 
+struct t_JobTestData {
+  atomic_uint *values;
+  atomic_uint sum;
+  bool dependencyMet;
+};
+
+static void jobTestSquare(void *arg, u32 start, u32 end) {
+  struct t_JobTestData *data = arg;
+  for (u32 i = start; i < end; i++)
+    atomic_store(&data->values[i], i * i);
+}
+
+static void jobTestSum(void *arg) {
+  struct t_JobTestData *data = arg;
+  data->dependencyMet = true;
+  // the squares must all be written before this runs
+  for (u32 i = 0; i < 1000; i++)
+    atomic_fetch_add(&data->sum, atomic_load(&data->values[i]));
+}
+
+bool TestJobSystem(u32 workerCount) {
+
+  SpiritJobSystemCreateInfo createInfo = {};
+  createInfo.workerCount = workerCount;
+
+  SpiritJobSystem jobs = spCreateJobSystem(&createInfo);
+  if (jobs == NULL)
+    return false;
+
+  struct t_JobTestData data = {};
+  data.values = calloc(1000, sizeof(atomic_uint));
+
+  SpiritJobCounter squares = {};
+  SpiritJobCounter sum = {};
+  spJobSystemParallelFor(jobs, 1000, 0, jobTestSquare, &data, &squares);
+  spJobSystemRunAfter(jobs, &squares, jobTestSum, &data, &sum);
+  spJobSystemWait(jobs, &sum);
+
+  spDestroyJobSystem(jobs);
+
+  // sum of i^2 for i in [0, 1000)
+  bool passed = data.dependencyMet && atomic_load(&data.sum) == 332833500;
+  free(data.values);
+  return passed;
+}
+
+// cpu side only, the upload ring needs a device
+bool TestFrameArena(void) {
+
+  SpiritFrameArenaCreateInfo createInfo = {};
+  createInfo.frameCount = 1;
+  createInfo.cpuSize = 64;
+
+  SpiritFrameArena arena = spCreateFrameArena(NULL, &createInfo);
+  if (arena == NULL)
+    return false;
+
+  // sizes are rounded up, so three allocations fill the block
+  u8 *first = spFrameArenaAlloc(arena, 1);
+  u8 *second = spFrameArenaAlloc(arena, 16);
+  u32 *third = SPIRIT_FRAME_ARENA_NEW(arena, u32, 8);
+  bool passed = first && second && third && second - first == 16 &&
+                (u8 *)third - second == 16 &&
+                (uintptr_t)third % SPIRIT_FRAME_ARENA_ALIGNMENT == 0 &&
+                spFrameArenaAlloc(arena, 1) == NULL;
+
+  // data added between frames survives the reset of the next frame, even
+  // with one frame in flight
+  *first = 42;
+  spFrameArenaBeginFrame(arena, 0);
+  u8 *next = spFrameArenaAlloc(arena, 64);
+  passed = passed && next && next != first && *first == 42;
+
+  // and the block after that is the first one again
+  spFrameArenaBeginFrame(arena, 0);
+  passed = passed && spFrameArenaAlloc(arena, 1) == first;
+
+  spDestroyFrameArena(NULL, arena);
+  return passed;
+}
+
+bool TestShaderPack(void) {
+  const char packPath[] = "test_pack.spk";
+  const char *shaderPaths[] = {"test_pack_a.spv", "test_pack_b.spv"};
+  const u32 code[][4] = {{0x07230203, 1, 2, 3}, {0x07230203, 4, 5, 6}};
+
+  bool passed = true;
+  for (u32 i = 0; i < array_length(shaderPaths); i++)
+    passed = passed &&
+             !spWriteFileBinary(shaderPaths[i], code[i], sizeof(code[i]));
+
+  passed = passed && !spWriteShaderPack(packPath, shaderPaths,
+                                        array_length(shaderPaths));
+  passed = passed && !spOpenShaderPack(packPath);
+
+  // the shaders come from the pack, even with their files gone
+  for (u32 i = 0; i < array_length(shaderPaths); i++)
+    spPlatformDeleteFile(shaderPaths[i]);
+
+  for (u32 i = 0; passed && i < array_length(shaderPaths); i++) {
+    SpiritShader shader =
+        spLoadCompiledShader(shaderPaths[i], SPIRIT_SHADER_TYPE_VERTEX);
+    passed = shader.packed && shader.shaderSize == sizeof(code[i]) &&
+             shader.type == SPIRIT_SHADER_TYPE_VERTEX &&
+             (uintptr_t)shader.shader % sizeof(u32) == 0 &&
+             memcmp(shader.shader, code[i], sizeof(code[i])) == 0;
+    spDestroyShader(shader);
+  }
+
+  spCloseShaderPack();
+  spPlatformDeleteFile(packPath);
+  return passed;
+}
+
 void Test(void) {
 #ifndef FUNCTION_TIMER_NO_DIAGNOSTIC
   init_timer();
@@ -431,6 +565,9 @@ void Test(void) {
         TestFileUtilities("testfile.txt", "Testing test file\nNewline test"));
     const int arr[] = {5, 6, 4, 5, 2, 192381, 1028329};
     runTest(TestVector(arr, array_length(arr)));
+    runTest(TestJobSystem(3));
+    runTest(TestFrameArena());
+    runTest(TestShaderPack());
   }
 #ifndef FUNCTION_TIMER_NO_DIAGNOSTIC
   terminate_timer();
@@ -124,6 +124,23 @@ time_t spPlatformGetTime(void);
  */
 u64 spPlatformGetRunningTime(void);
 
+/**
+ * @brief Get a monotonic time in nanoseconds, for measuring intervals. It is
+ * not related to the wall clock.
+ *
+ * @return u64
+ */
+u64 spPlatformGetNanoseconds(void);
+
+/**
+ * @brief Sleep until spPlatformGetNanoseconds reaches a deadline. The thread
+ * may wake up late by the scheduler's timer slack, so callers that need more
+ * precision should sleep until shortly before the deadline and spin the rest.
+ *
+ * @param deadline in nanoseconds, returns immediately if it has passed
+ */
+void spPlatformSleepUntil(u64 deadline);
+
 /**
  * Test if a file exists. It will automatically localize the filename,
  * like all other file utilities.
@@ -176,6 +193,27 @@ bool spPlatformIsDirectoryEmpty(char* filepath) SPIRIT_NONULL(1);
  */
 time_t spPlatformGetFileModifiedDate(const char* filepath) SPIRIT_NONULL(1);
 
+/**
+ * @brief Map a whole file into memory, read only. The filename is localized,
+ * like all other file utilities. The pages are read ahead, so the file is
+ * read in as few reads as the system allows.
+ *
+ * @param filepath the file to map
+ * @param size set to the size of the file
+ * @return const void* the mapping, NULL for failure or an empty file. Unmap
+ * it with spPlatformUnmapFile.
+ */
+const void* spPlatformMapFile(const char* filepath, size_t* size)
+    SPIRIT_NONULL(1, 2);
+
+/**
+ * @brief Unmap a file mapped with spPlatformMapFile
+ *
+ * @param data the mapping
+ * @param size the size spPlatformMapFile returned
+ */
+void spPlatformUnmapFile(const void* data, size_t size) SPIRIT_NONULL(1);
+
 /**
  * Create a new directory relative to the executable folder.
  * The file name will be automatically localized, like all other file utiltities.
@@ -214,3 +252,139 @@ SpiritResult spPlatformDeleteFile(const char* restrict filepath) SPIRIT_NONULL(1
  * @return SpiritResult
  */
 SpiritResult spPlatformDeleteFolder(const char* restrict filepath) SPIRIT_NONULL(1);
+
+/**
+ * @brief Opaque handle to an operating system thread.
+ *
+ */
+typedef struct t_SpiritThread *SpiritThread;
+
+/**
+ * @brief Function run by a thread. The return value is passed back to the
+ * caller of spPlatformJoinThread.
+ *
+ */
+typedef void *(*SpiritThreadFunction)(void *arg);
+
+/**
+ * @brief Start a new thread running function with arg. The thread must be
+ * joined using spPlatformJoinThread, which also frees the handle.
+ *
+ * @param function the function to run on the new thread
+ * @param arg passed to function
+ * @return SpiritThread the thread handle, or NULL on failure
+ */
+SpiritThread spPlatformCreateThread(
+    SpiritThreadFunction function, void *arg) SPIRIT_NONULL(1);
+
+/**
+ * @brief Wait for a thread to exit, and free its handle.
+ *
+ * @param thread the thread to join
+ * @return void* the value returned by the thread function
+ */
+void *spPlatformJoinThread(SpiritThread thread) SPIRIT_NONULL(1);
+
+/**
+ * @brief Opaque handle to a mutex.
+ *
+ */
+typedef struct t_SpiritMutex *SpiritMutex;
+
+/**
+ * @brief Create a new, unlocked mutex.
+ *
+ * @return SpiritMutex the mutex, or NULL on failure
+ */
+SpiritMutex spPlatformCreateMutex(void);
+
+/**
+ * @brief Lock a mutex, blocking until it is available.
+ *
+ * @param mutex
+ */
+void spPlatformLockMutex(SpiritMutex mutex) SPIRIT_NONULL(1);
+
+/**
+ * @brief Unlock a mutex locked by this thread.
+ *
+ * @param mutex
+ */
+void spPlatformUnlockMutex(SpiritMutex mutex) SPIRIT_NONULL(1);
+
+/**
+ * @brief Destroy a mutex. It must not be locked.
+ *
+ * @param mutex
+ */
+void spPlatformDestroyMutex(SpiritMutex mutex) SPIRIT_NONULL(1);
+
+/**
+ * @brief Opaque handle to a condition variable.
+ *
+ */
+typedef struct t_SpiritCondition *SpiritCondition;
+
+/**
+ * @brief Create a new condition variable.
+ *
+ * @return SpiritCondition the condition variable, or NULL on failure
+ */
+SpiritCondition spPlatformCreateCondition(void);
+
+/**
+ * @brief Unlock mutex and block until the condition is signalled, then lock
+ * mutex again. Wakeups may be spurious, so the caller must check its
+ * condition in a loop.
+ *
+ * @param condition
+ * @param mutex locked by this thread
+ */
+void spPlatformWaitCondition(SpiritCondition condition, SpiritMutex mutex)
+    SPIRIT_NONULL(1, 2);
+
+/**
+ * @brief Wake one thread waiting on a condition.
+ *
+ * @param condition
+ */
+void spPlatformSignalCondition(SpiritCondition condition) SPIRIT_NONULL(1);
+
+/**
+ * @brief Wake every thread waiting on a condition.
+ *
+ * @param condition
+ */
+void spPlatformBroadcastCondition(SpiritCondition condition)
+    SPIRIT_NONULL(1);
+
+/**
+ * @brief Destroy a condition variable. No thread may be waiting on it.
+ *
+ * @param condition
+ */
+void spPlatformDestroyCondition(SpiritCondition condition) SPIRIT_NONULL(1);
+
+/**
+ * @brief Get the number of logical cores available to the process.
+ *
+ * @return u32 the core count, at least 1
+ */
+u32 spPlatformGetCoreCount(void);
+
+/**
+ * @brief Restrict a thread to run on a single logical core.
+ *
+ * @param thread
+ * @param core index of the core, less than spPlatformGetCoreCount
+ * @return SpiritResult SPIRIT_UNDEFINED if the platform does not support
+ * pinning threads
+ */
+SpiritResult spPlatformSetThreadAffinity(SpiritThread thread, u32 core)
+    SPIRIT_NONULL(1);
+
+/**
+ * @brief Give up the rest of this threads time slice.
+ *
+ */
+void spPlatformYieldThread(void);
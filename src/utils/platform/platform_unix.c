@@ -1,3 +1,6 @@
+// for pthread_setaffinity_np
+#define _GNU_SOURCE
+
 #include "../platform.h"
 
 #ifdef __unix
@@ -5,11 +8,15 @@
 #include <sys/cdefs.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <time.h>
 #include <errno.h>
 #include <stdio.h>
 #include <dirent.h>
 #include <ftw.h>
+#include <pthread.h>
+#include <sched.h>
 
 /**
  * @brief Localize a file name. This macro is more convientent then writing the
@@ -188,6 +195,26 @@ u64 spPlatformGetRunningTime(void)
     return time;
 }
 
+u64 spPlatformGetNanoseconds(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (u64)time.tv_sec * 1000000000ull + (u64)time.tv_nsec;
+}
+
+void spPlatformSleepUntil(u64 deadline)
+{
+    const struct timespec time = {
+        .tv_sec  = deadline / 1000000000ull,
+        .tv_nsec = deadline % 1000000000ull,
+    };
+
+    // an absolute deadline does not drift when a signal interrupts the sleep
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &time, NULL) ==
+           EINTR)
+        ;
+}
+
 time_t spPlatformGetFileModifiedDate(const char *filepath)
 {
     localize_path(filepath, path, pathLength);
@@ -204,6 +231,46 @@ time_t spPlatformGetFileModifiedDate(const char *filepath)
 
 }
 
+const void *spPlatformMapFile(const char *filepath, size_t *size)
+{
+    localize_path(filepath, path, pathLength);
+
+    *size = 0;
+    const int file = open(path, O_RDONLY);
+    if (file == -1)
+    {
+        log_perror("Failed to open file '%s'", path);
+        return NULL;
+    }
+
+    struct stat data;
+    if (fstat(file, &data) == -1 || data.st_size == 0)
+    {
+        close(file);
+        return NULL;
+    }
+
+    // the mapping keeps the file open on its own
+    void *out = mmap(NULL, data.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (out == MAP_FAILED)
+    {
+        log_perror("Failed to map file '%s'", path);
+        return NULL;
+    }
+
+    // read the whole file in at once, rather than a page at each fault
+    madvise(out, data.st_size, MADV_WILLNEED);
+
+    *size = data.st_size;
+    return out;
+}
+
+void spPlatformUnmapFile(const void *data, size_t size)
+{
+    munmap((void *)data, size);
+}
+
 SpiritResult spPlatformCreateFolder(const char *filepath)
 {
     localize_path(filepath, path, pathLength);
@@ -324,4 +391,146 @@ SpiritResult spPlatformDeleteFile(const char *restrict filepath)
     return SPIRIT_SUCCESS;
 }
 
+struct t_SpiritThread
+{
+    pthread_t handle;
+};
+
+SpiritThread spPlatformCreateThread(SpiritThreadFunction function, void *arg)
+{
+    SpiritThread thread = new_var(struct t_SpiritThread);
+
+    int err = pthread_create(&thread->handle, NULL, function, arg);
+    if (err)
+    {
+        log_error("Failed to create thread: %s", strerror(err));
+        free(thread);
+        return NULL;
+    }
+
+    return thread;
+}
+
+void *spPlatformJoinThread(SpiritThread thread)
+{
+    void *ret = NULL;
+
+    int err = pthread_join(thread->handle, &ret);
+    if (err)
+        log_error("Failed to join thread: %s", strerror(err));
+
+    free(thread);
+    return ret;
+}
+
+struct t_SpiritMutex
+{
+    pthread_mutex_t handle;
+};
+
+SpiritMutex spPlatformCreateMutex(void)
+{
+    SpiritMutex mutex = new_var(struct t_SpiritMutex);
+
+    int err = pthread_mutex_init(&mutex->handle, NULL);
+    if (err)
+    {
+        log_error("Failed to create mutex: %s", strerror(err));
+        free(mutex);
+        return NULL;
+    }
+
+    return mutex;
+}
+
+void spPlatformLockMutex(SpiritMutex mutex)
+{
+    pthread_mutex_lock(&mutex->handle);
+}
+
+void spPlatformUnlockMutex(SpiritMutex mutex)
+{
+    pthread_mutex_unlock(&mutex->handle);
+}
+
+void spPlatformDestroyMutex(SpiritMutex mutex)
+{
+    pthread_mutex_destroy(&mutex->handle);
+    free(mutex);
+}
+
+struct t_SpiritCondition
+{
+    pthread_cond_t handle;
+};
+
+SpiritCondition spPlatformCreateCondition(void)
+{
+    SpiritCondition condition = new_var(struct t_SpiritCondition);
+
+    int err = pthread_cond_init(&condition->handle, NULL);
+    if (err)
+    {
+        log_error("Failed to create condition: %s", strerror(err));
+        free(condition);
+        return NULL;
+    }
+
+    return condition;
+}
+
+void spPlatformWaitCondition(SpiritCondition condition, SpiritMutex mutex)
+{
+    pthread_cond_wait(&condition->handle, &mutex->handle);
+}
+
+void spPlatformSignalCondition(SpiritCondition condition)
+{
+    pthread_cond_signal(&condition->handle);
+}
+
+void spPlatformBroadcastCondition(SpiritCondition condition)
+{
+    pthread_cond_broadcast(&condition->handle);
+}
+
+void spPlatformDestroyCondition(SpiritCondition condition)
+{
+    pthread_cond_destroy(&condition->handle);
+    free(condition);
+}
+
+u32 spPlatformGetCoreCount(void)
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (count < 1)
+        return 1;
+    return (u32)count;
+}
+
+SpiritResult spPlatformSetThreadAffinity(SpiritThread thread, u32 core)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+
+    int err = pthread_setaffinity_np(thread->handle, sizeof(set), &set);
+    if (err)
+    {
+        log_warning(
+            "Failed to pin thread to core %u: %s", core, strerror(err));
+        return SPIRIT_FAILURE;
+    }
+    return SPIRIT_SUCCESS;
+#else
+    return SPIRIT_UNDEFINED;
+#endif
+}
+
+void spPlatformYieldThread(void)
+{
+    sched_yield();
+}
+
 #endif
\ No newline at end of file
@@ -7,6 +7,13 @@
 #include <direct.h>
 #include <sys/stat.h>
 #include <io.h>
+#include <handleapi.h>
+#include <memoryapi.h>
+#include <process.h>
+#include <processthreadsapi.h>
+#include <profileapi.h>
+#include <synchapi.h>
+#include <sysinfoapi.h>
 
 #include <Shlwapi.h>
 
@@ -177,6 +184,34 @@ u64 spPlatformGetRunningTime(void)
     return time;
 }
 
+u64 spPlatformGetNanoseconds(void)
+{
+    LARGE_INTEGER frequency, count;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&count);
+
+    // split the conversion so the multiply does not overflow
+    const u64 ticks     = count.QuadPart;
+    const u64 perSecond = frequency.QuadPart;
+    return ticks / perSecond * 1000000000ull +
+           ticks % perSecond * 1000000000ull / perSecond;
+}
+
+void spPlatformSleepUntil(u64 deadline)
+{
+    // Sleep only has millisecond precision, so sleep whole milliseconds and
+    // yield for the rest
+    u64 now;
+    while ((now = spPlatformGetNanoseconds()) < deadline)
+    {
+        const u64 remaining = (deadline - now) / 1000000ull;
+        if (remaining)
+            Sleep((DWORD)remaining);
+        else
+            SwitchToThread();
+    }
+}
+
 time_t spPlatformGetFileModifiedDate(const char* filepath)
 {
     db_assert_msg(filepath, "Must have valid filepath");
@@ -194,6 +229,59 @@ time_t spPlatformGetFileModifiedDate(const char* filepath)
     return data.st_ctime;
 }
 
+const void* spPlatformMapFile(const char* filepath, size_t* size)
+{
+    localize_path(filepath, path, pathLength);
+
+    *size = 0;
+    HANDLE file = CreateFileA(
+        path,
+        GENERIC_READ,
+        FILE_SHARE_READ,
+        NULL,
+        OPEN_EXISTING,
+        FILE_FLAG_SEQUENTIAL_SCAN,
+        NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        log_error("Failed to open file '%s'", path);
+        return NULL;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return NULL;
+    }
+
+    // the view keeps the file and mapping open on their own
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL)
+    {
+        log_error("Failed to map file '%s'", path);
+        return NULL;
+    }
+
+    const void* out = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (out == NULL)
+    {
+        log_error("Failed to map file '%s'", path);
+        return NULL;
+    }
+
+    *size = fileSize.QuadPart;
+    return out;
+}
+
+void spPlatformUnmapFile(const void* data, size_t size)
+{
+    (void)size;
+    UnmapViewOfFile(data);
+}
+
 SpiritResult spPlatformCreateFolder(const char* filepath)
 {
     db_assert_msg(filepath, "Must pass a valid filepath");
@@ -238,4 +326,138 @@ bool spPlatformIsDirectoryEmpty(char* filepath)
 
 }
 
+struct t_SpiritThread
+{
+    HANDLE handle;
+    SpiritThreadFunction function;
+    void* arg;
+    void* ret;
+};
+
+// _beginthreadex wants a different signature than SpiritThreadFunction
+static unsigned __stdcall threadStart(void* arg)
+{
+    SpiritThread thread = arg;
+    thread->ret         = thread->function(thread->arg);
+    return 0;
+}
+
+SpiritThread spPlatformCreateThread(SpiritThreadFunction function, void* arg)
+{
+    SpiritThread thread = new_var(struct t_SpiritThread);
+    thread->function    = function;
+    thread->arg         = arg;
+    thread->ret         = NULL;
+
+    thread->handle =
+        (HANDLE)_beginthreadex(NULL, 0, threadStart, thread, 0, NULL);
+    if (thread->handle == 0)
+    {
+        log_error("Failed to create thread: %s", strerror(errno));
+        free(thread);
+        return NULL;
+    }
+
+    return thread;
+}
+
+void* spPlatformJoinThread(SpiritThread thread)
+{
+    if (WaitForSingleObject(thread->handle, INFINITE) != WAIT_OBJECT_0)
+        log_error("Failed to join thread: %lu", GetLastError());
+    CloseHandle(thread->handle);
+
+    void* ret = thread->ret;
+    free(thread);
+    return ret;
+}
+
+struct t_SpiritMutex
+{
+    SRWLOCK handle;
+};
+
+SpiritMutex spPlatformCreateMutex(void)
+{
+    SpiritMutex mutex = new_var(struct t_SpiritMutex);
+    InitializeSRWLock(&mutex->handle);
+    return mutex;
+}
+
+void spPlatformLockMutex(SpiritMutex mutex)
+{
+    AcquireSRWLockExclusive(&mutex->handle);
+}
+
+void spPlatformUnlockMutex(SpiritMutex mutex)
+{
+    ReleaseSRWLockExclusive(&mutex->handle);
+}
+
+void spPlatformDestroyMutex(SpiritMutex mutex)
+{
+    // SRW locks have nothing to release
+    free(mutex);
+}
+
+struct t_SpiritCondition
+{
+    CONDITION_VARIABLE handle;
+};
+
+SpiritCondition spPlatformCreateCondition(void)
+{
+    SpiritCondition condition = new_var(struct t_SpiritCondition);
+    InitializeConditionVariable(&condition->handle);
+    return condition;
+}
+
+void spPlatformWaitCondition(SpiritCondition condition, SpiritMutex mutex)
+{
+    SleepConditionVariableSRW(&condition->handle, &mutex->handle, INFINITE, 0);
+}
+
+void spPlatformSignalCondition(SpiritCondition condition)
+{
+    WakeConditionVariable(&condition->handle);
+}
+
+void spPlatformBroadcastCondition(SpiritCondition condition)
+{
+    WakeAllConditionVariable(&condition->handle);
+}
+
+void spPlatformDestroyCondition(SpiritCondition condition)
+{
+    free(condition);
+}
+
+u32 spPlatformGetCoreCount(void)
+{
+    const DWORD count = GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+    if (count < 1)
+        return 1;
+    return (u32)count;
+}
+
+SpiritResult spPlatformSetThreadAffinity(SpiritThread thread, u32 core)
+{
+    // an affinity mask only covers the first processor group
+    if (core >= sizeof(DWORD_PTR) * 8)
+        return SPIRIT_UNDEFINED;
+
+    if (SetThreadAffinityMask(thread->handle, (DWORD_PTR)1 << core) == 0)
+    {
+        log_warning(
+            "Failed to pin thread to core %u: %lu", core, GetLastError());
+        return SPIRIT_FAILURE;
+    }
+    return SPIRIT_SUCCESS;
+}
+
+void spPlatformYieldThread(void)
+{
+    SwitchToThread();
+}
+
 #endif
\ No newline at end of file
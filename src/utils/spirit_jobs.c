@@ -0,0 +1,529 @@
+#include "spirit_jobs.h"
+
+// how many times an idle worker looks for work before going to sleep
+#define IDLE_SPIN_COUNT 64
+
+// the worker running on this thread, if it belongs to a job system
+static _Thread_local struct t_SpiritJobWorker *currentWorker = NULL;
+
+//
+// Helpers
+//
+
+// push a job on the bottom of a deque, only called by the owner.
+// false if the deque is full.
+static bool queuePush(struct t_SpiritJobQueue *queue, struct t_SpiritJob *job);
+
+// pop a job from the bottom of a deque, only called by the owner
+static struct t_SpiritJob *queuePop(struct t_SpiritJobQueue *queue);
+
+// steal a job from the top of a deque, called by any thread
+static struct t_SpiritJob *queueSteal(struct t_SpiritJobQueue *queue);
+
+// the worker of this thread, or NULL if it is not part of the system
+static struct t_SpiritJobWorker *getWorker(const SpiritJobSystem system);
+
+// get storage for a job on this thread, from its pool if the next job there
+// has finished, or the heap
+static struct t_SpiritJob *allocateJob(
+    SpiritJobSystem system, struct t_SpiritJobWorker *worker);
+
+// queue a filled in job, and wake a worker for it
+static void submitJob(
+    SpiritJobSystem system,
+    struct t_SpiritJobWorker *worker,
+    struct t_SpiritJob *job);
+
+// add or take a job from the shared queue
+static void sharedPush(SpiritJobSystem system, struct t_SpiritJob *job);
+static struct t_SpiritJob *sharedPop(SpiritJobSystem system);
+
+// find a job from the own deque, the shared queue, or another worker
+static struct t_SpiritJob *findJob(
+    SpiritJobSystem system, struct t_SpiritJobWorker *worker);
+
+// run one job if there is one. false if there was nothing to do.
+static bool runOneJob(SpiritJobSystem system, struct t_SpiritJobWorker *worker);
+
+// block an idle worker until jobs are queued or the system quits
+static void sleepWorker(SpiritJobSystem system);
+
+// worker thread entry point
+static void *workerFunction(void *arg);
+
+//
+// Public functions
+//
+
+SpiritJobSystem spCreateJobSystem(const SpiritJobSystemCreateInfo *createInfo)
+{
+    const u32 coreCount = spPlatformGetCoreCount();
+
+    SpiritJobSystem out = new_var(struct t_SpiritJobSystem);
+
+    out->workerCount = createInfo->workerCount
+                           ? createInfo->workerCount + 1
+                           : max_value(coreCount, 1);
+    out->workers     = new_array(struct t_SpiritJobWorker, out->workerCount);
+    memset(out->workers, 0, sizeof(*out->workers) * out->workerCount);
+
+    out->sharedHead = NULL;
+    out->sharedTail = NULL;
+    atomic_init(&out->sharedCount, 0);
+    out->sharedLock = spPlatformCreateMutex();
+    out->sleepLock  = spPlatformCreateMutex();
+    out->wake       = spPlatformCreateCondition();
+    atomic_init(&out->queuedJobs, 0);
+    atomic_init(&out->sleepingWorkers, 0);
+    atomic_init(&out->quit, false);
+
+    if (!out->sharedLock || !out->sleepLock || !out->wake)
+    {
+        log_error("Failed to create job system locks");
+        if (out->sharedLock)
+            spPlatformDestroyMutex(out->sharedLock);
+        if (out->sleepLock)
+            spPlatformDestroyMutex(out->sleepLock);
+        if (out->wake)
+            spPlatformDestroyCondition(out->wake);
+        free(out->workers);
+        free(out);
+        return NULL;
+    }
+
+    for (u32 i = 0; i < out->workerCount; i++)
+    {
+        struct t_SpiritJobWorker *worker = &out->workers[i];
+        worker->system                   = out;
+        worker->index                    = i;
+        worker->nextVictim               = i + 1;
+        atomic_init(&worker->queue.top, 0);
+        atomic_init(&worker->queue.bottom, 0);
+    }
+
+    out->previousWorker = currentWorker;
+    currentWorker       = &out->workers[0];
+
+    // start the workers after every deque is initialized, as they steal from
+    // each other straight away
+    for (u32 i = 1; i < out->workerCount; i++)
+    {
+        struct t_SpiritJobWorker *worker = &out->workers[i];
+
+        worker->thread = spPlatformCreateThread(workerFunction, worker);
+        if (worker->thread == NULL)
+        {
+            log_error("Failed to start job worker %u", i);
+            out->workerCount = i;
+            break;
+        }
+
+        if (createInfo->pinning == SPIRIT_JOB_PINNING_CORES)
+            spPlatformSetThreadAffinity(worker->thread, i % coreCount);
+    }
+
+    log_verbose("Job system running on %u threads", out->workerCount);
+
+    return out;
+}
+
+void spJobSystemRun(
+    SpiritJobSystem system,
+    SpiritJobFunction function,
+    void *arg,
+    SpiritJobCounter *counter)
+{
+    struct t_SpiritJobWorker *worker = getWorker(system);
+    struct t_SpiritJob *job          = allocateJob(system, worker);
+
+    job->function = function;
+    job->arg      = arg;
+    job->counter  = counter;
+
+    submitJob(system, worker, job);
+}
+
+void spJobSystemRunAfter(
+    SpiritJobSystem system,
+    SpiritJobCounter *dependency,
+    SpiritJobFunction function,
+    void *arg,
+    SpiritJobCounter *counter)
+{
+    struct t_SpiritJobWorker *worker = getWorker(system);
+    struct t_SpiritJob *job          = allocateJob(system, worker);
+
+    job->function   = function;
+    job->arg        = arg;
+    job->counter    = counter;
+    job->dependency = dependency;
+
+    submitJob(system, worker, job);
+}
+
+void spJobSystemParallelFor(
+    SpiritJobSystem system,
+    u32 count,
+    u32 batchSize,
+    SpiritJobParallelFunction function,
+    void *arg,
+    SpiritJobCounter *counter)
+{
+    // a few batches per worker, so stealing can even out uneven batches
+    if (batchSize == 0)
+        batchSize = max_value(count / (system->workerCount * 4), 1);
+
+    struct t_SpiritJobWorker *worker = getWorker(system);
+
+    for (u32 start = 0; start < count; start += batchSize)
+    {
+        struct t_SpiritJob *job = allocateJob(system, worker);
+
+        job->parallelFunction = function;
+        job->arg              = arg;
+        job->start            = start;
+        job->end              = start + min_value(batchSize, count - start);
+        job->counter          = counter;
+
+        submitJob(system, worker, job);
+    }
+}
+
+void spJobSystemWait(SpiritJobSystem system, SpiritJobCounter *counter)
+{
+    struct t_SpiritJobWorker *worker = getWorker(system);
+
+    while (atomic_load_explicit(&counter->value, memory_order_acquire))
+    {
+        if (!runOneJob(system, worker))
+            spPlatformYieldThread();
+    }
+}
+
+u32 spJobSystemGetWorkerCount(const SpiritJobSystem system)
+{
+    return system->workerCount;
+}
+
+void spDestroyJobSystem(SpiritJobSystem system)
+{
+    db_assert_msg(
+        getWorker(system) == &system->workers[0],
+        "Job system must be destroyed by the thread that created it");
+
+    // finish everything that is still queued
+    while (atomic_load(&system->queuedJobs))
+    {
+        if (!runOneJob(system, &system->workers[0]))
+            spPlatformYieldThread();
+    }
+
+    spPlatformLockMutex(system->sleepLock);
+    atomic_store(&system->quit, true);
+    spPlatformBroadcastCondition(system->wake);
+    spPlatformUnlockMutex(system->sleepLock);
+
+    for (u32 i = 1; i < system->workerCount; i++)
+        spPlatformJoinThread(system->workers[i].thread);
+
+    currentWorker = system->previousWorker;
+
+    spPlatformDestroyCondition(system->wake);
+    spPlatformDestroyMutex(system->sleepLock);
+    spPlatformDestroyMutex(system->sharedLock);
+    free(system->workers);
+    free(system);
+}
+
+//
+// Helpers
+//
+
+bool queuePush(struct t_SpiritJobQueue *queue, struct t_SpiritJob *job)
+{
+    long long bottom =
+        atomic_load_explicit(&queue->bottom, memory_order_relaxed);
+    long long top = atomic_load_explicit(&queue->top, memory_order_acquire);
+
+    if (bottom - top >= SPIRIT_JOB_QUEUE_SIZE)
+        return false;
+
+    atomic_store_explicit(
+        &queue->jobs[bottom % SPIRIT_JOB_QUEUE_SIZE],
+        job,
+        memory_order_relaxed);
+
+    // the job must be visible before a thief can see the new bottom
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&queue->bottom, bottom + 1, memory_order_relaxed);
+    return true;
+}
+
+struct t_SpiritJob *queuePop(struct t_SpiritJobQueue *queue)
+{
+    long long bottom =
+        atomic_load_explicit(&queue->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&queue->bottom, bottom, memory_order_relaxed);
+
+    // the store to bottom must be ordered before reading top, or a thief and
+    // the owner could both take the last job
+    atomic_thread_fence(memory_order_seq_cst);
+    long long top = atomic_load_explicit(&queue->top, memory_order_relaxed);
+
+    if (top > bottom)
+    {
+        // empty
+        atomic_store_explicit(
+            &queue->bottom, bottom + 1, memory_order_relaxed);
+        return NULL;
+    }
+
+    struct t_SpiritJob *job = atomic_load_explicit(
+        &queue->jobs[bottom % SPIRIT_JOB_QUEUE_SIZE], memory_order_relaxed);
+
+    if (top == bottom)
+    {
+        // the last job, race the thieves for it
+        if (!atomic_compare_exchange_strong_explicit(
+                &queue->top,
+                &top,
+                top + 1,
+                memory_order_seq_cst,
+                memory_order_relaxed))
+            job = NULL;
+
+        atomic_store_explicit(
+            &queue->bottom, bottom + 1, memory_order_relaxed);
+    }
+
+    return job;
+}
+
+struct t_SpiritJob *queueSteal(struct t_SpiritJobQueue *queue)
+{
+    long long top = atomic_load_explicit(&queue->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long long bottom =
+        atomic_load_explicit(&queue->bottom, memory_order_acquire);
+
+    if (top >= bottom)
+        return NULL;
+
+    struct t_SpiritJob *job = atomic_load_explicit(
+        &queue->jobs[top % SPIRIT_JOB_QUEUE_SIZE], memory_order_relaxed);
+
+    // lost to the owner or another thief
+    if (!atomic_compare_exchange_strong_explicit(
+            &queue->top,
+            &top,
+            top + 1,
+            memory_order_seq_cst,
+            memory_order_relaxed))
+        return NULL;
+
+    return job;
+}
+
+struct t_SpiritJobWorker *getWorker(const SpiritJobSystem system)
+{
+    if (currentWorker && currentWorker->system == system)
+        return currentWorker;
+    return NULL;
+}
+
+struct t_SpiritJob *allocateJob(
+    SpiritJobSystem system, struct t_SpiritJobWorker *worker)
+{
+    struct t_SpiritJob *job = NULL;
+    if (worker)
+    {
+        // more jobs than the pool holds can be in flight, as the shared queue
+        // takes them once the deque is full. Acquire pairs with the release
+        // in runOneJob, so the slot is not reused while it is read.
+        job = &worker->pool[worker->poolNext];
+        if (atomic_load_explicit(&job->running, memory_order_acquire))
+            job = NULL;
+    }
+
+    if (job)
+    {
+        worker->poolNext = (worker->poolNext + 1) % SPIRIT_JOB_QUEUE_SIZE;
+        memset(job, 0, sizeof(*job));
+        atomic_store_explicit(&job->running, true, memory_order_relaxed);
+    }
+    else
+    {
+        job = new_var(struct t_SpiritJob);
+        memset(job, 0, sizeof(*job));
+        job->allocated = true;
+    }
+
+    return job;
+}
+
+void submitJob(
+    SpiritJobSystem system,
+    struct t_SpiritJobWorker *worker,
+    struct t_SpiritJob *job)
+{
+    if (job->counter)
+        atomic_fetch_add_explicit(
+            &job->counter->value, 1, memory_order_relaxed);
+
+    // jobs waiting on a dependency go to the shared queue, so the owner does
+    // not keep popping it back off the bottom of its own deque
+    bool queued = false;
+    if (worker && !job->dependency)
+        queued = queuePush(&worker->queue, job);
+    if (!queued)
+        sharedPush(system, job);
+
+    // pairs with the sleeping worker checking queuedJobs, one of the two
+    // will see the other
+    atomic_fetch_add_explicit(&system->queuedJobs, 1, memory_order_seq_cst);
+    if (atomic_load_explicit(&system->sleepingWorkers, memory_order_seq_cst))
+    {
+        spPlatformLockMutex(system->sleepLock);
+        spPlatformSignalCondition(system->wake);
+        spPlatformUnlockMutex(system->sleepLock);
+    }
+}
+
+void sharedPush(SpiritJobSystem system, struct t_SpiritJob *job)
+{
+    job->next = NULL;
+
+    spPlatformLockMutex(system->sharedLock);
+    if (system->sharedTail)
+        system->sharedTail->next = job;
+    else
+        system->sharedHead = job;
+    system->sharedTail = job;
+    atomic_fetch_add_explicit(&system->sharedCount, 1, memory_order_relaxed);
+    spPlatformUnlockMutex(system->sharedLock);
+}
+
+struct t_SpiritJob *sharedPop(SpiritJobSystem system)
+{
+    spPlatformLockMutex(system->sharedLock);
+    struct t_SpiritJob *job = system->sharedHead;
+    if (job)
+    {
+        system->sharedHead = job->next;
+        if (system->sharedHead == NULL)
+            system->sharedTail = NULL;
+        atomic_fetch_sub_explicit(
+            &system->sharedCount, 1, memory_order_relaxed);
+    }
+    spPlatformUnlockMutex(system->sharedLock);
+
+    return job;
+}
+
+struct t_SpiritJob *findJob(
+    SpiritJobSystem system, struct t_SpiritJobWorker *worker)
+{
+    struct t_SpiritJob *job = NULL;
+
+    if (worker)
+        job = queuePop(&worker->queue);
+
+    // only take the lock if there may be something there
+    if (!job &&
+        atomic_load_explicit(&system->sharedCount, memory_order_relaxed))
+        job = sharedPop(system);
+
+    if (job)
+        return job;
+
+    // try every other worker once, starting after the last one robbed
+    u32 victim = worker ? worker->nextVictim : 0;
+    for (u32 i = 0; i < system->workerCount && !job; i++, victim++)
+    {
+        victim %= system->workerCount;
+        if (worker && victim == worker->index)
+            continue;
+        job = queueSteal(&system->workers[victim].queue);
+    }
+    if (worker)
+        worker->nextVictim = victim;
+
+    return job;
+}
+
+bool runOneJob(SpiritJobSystem system, struct t_SpiritJobWorker *worker)
+{
+    struct t_SpiritJob *job = findJob(system, worker);
+    if (job == NULL)
+        return false;
+
+    if (job->dependency &&
+        atomic_load_explicit(&job->dependency->value, memory_order_acquire))
+    {
+        // not ready yet, send it to the back of the shared queue
+        sharedPush(system, job);
+        return false;
+    }
+
+    atomic_fetch_sub_explicit(&system->queuedJobs, 1, memory_order_relaxed);
+
+    if (job->parallelFunction)
+        job->parallelFunction(job->arg, job->start, job->end);
+    else
+        job->function(job->arg);
+
+    // the job can be reused once it is released, so keep its counter
+    SpiritJobCounter *counter = job->counter;
+    if (job->allocated)
+        free(job);
+    else
+        atomic_store_explicit(&job->running, false, memory_order_release);
+
+    // release so the results of the job are visible to whoever waits
+    if (counter)
+        atomic_fetch_sub_explicit(&counter->value, 1, memory_order_release);
+
+    return true;
+}
+
+void sleepWorker(SpiritJobSystem system)
+{
+    spPlatformLockMutex(system->sleepLock);
+    atomic_fetch_add_explicit(
+        &system->sleepingWorkers, 1, memory_order_seq_cst);
+
+    while (!atomic_load(&system->quit) &&
+           !atomic_load_explicit(&system->queuedJobs, memory_order_seq_cst))
+        spPlatformWaitCondition(system->wake, system->sleepLock);
+
+    atomic_fetch_sub_explicit(
+        &system->sleepingWorkers, 1, memory_order_seq_cst);
+    spPlatformUnlockMutex(system->sleepLock);
+}
+
+void *workerFunction(void *arg)
+{
+    struct t_SpiritJobWorker *worker = arg;
+    SpiritJobSystem system           = worker->system;
+    currentWorker                    = worker;
+
+    u32 idle = 0;
+    while (!atomic_load_explicit(&system->quit, memory_order_acquire))
+    {
+        if (runOneJob(system, worker))
+        {
+            idle = 0;
+            continue;
+        }
+
+        if (++idle < IDLE_SPIN_COUNT)
+            spPlatformYieldThread();
+        else
+        {
+            sleepWorker(system);
+            idle = 0;
+        }
+    }
+
+    return NULL;
+}
@@ -0,0 +1,196 @@
+#pragma once
+#include <spirit_header.h>
+#include <stdatomic.h>
+
+// Job system. A worker thread per core runs small jobs, each worker keeping
+// its own Chase-Lev deque. Workers push and pop jobs on their own deque, and
+// steal from the other end of the others when they run out.
+//
+// The thread that creates the job system acts as an extra worker, and runs
+// jobs while it waits on a counter. Other threads may submit jobs too, they go
+// through a shared queue.
+
+//
+// Types
+//
+
+typedef struct t_SpiritJobSystem *SpiritJobSystem;
+
+// a job, run on any worker
+typedef void (*SpiritJobFunction)(void *arg);
+
+// a batch of a parallel for, covering indices [start, end)
+typedef void (*SpiritJobParallelFunction)(void *arg, u32 start, u32 end);
+
+// counts the jobs that were started with it and have not finished yet. Must
+// be zero initialized, and must outlive every job using it.
+typedef struct t_SpiritJobCounter
+{
+    atomic_uint value;
+} SpiritJobCounter;
+
+typedef enum e_SpiritJobPinning
+{
+    SPIRIT_JOB_PINNING_NONE = 0, // let the scheduler move workers
+    SPIRIT_JOB_PINNING_CORES,    // pin each worker to its own core
+} SpiritJobPinning;
+
+// the size of each deque, and of each worker's job pool. Jobs past it are
+// allocated on the heap.
+#define SPIRIT_JOB_QUEUE_SIZE 4096
+
+typedef struct t_SpiritJobSystemCreateInfo
+{
+    u32 workerCount; // worker threads, 0 for one per core minus the creator
+    SpiritJobPinning pinning;
+} SpiritJobSystemCreateInfo;
+
+struct t_SpiritJob
+{
+    SpiritJobFunction function;
+    SpiritJobParallelFunction parallelFunction;
+    void *arg;
+    u32 start, end; // parallel for batches
+
+    SpiritJobCounter *counter;    // decremented once the job is done
+    SpiritJobCounter *dependency; // must be zero before the job runs
+
+    bool allocated;          // on the heap, free after
+    atomic_bool running;     // in a pool and not finished, can not be reused
+    struct t_SpiritJob *next; // shared queue
+};
+
+// a fixed size Chase-Lev deque
+struct t_SpiritJobQueue
+{
+    atomic_llong top;
+    atomic_llong bottom;
+    _Atomic(struct t_SpiritJob *) jobs[SPIRIT_JOB_QUEUE_SIZE];
+};
+
+struct t_SpiritJobWorker
+{
+    SpiritJobSystem system;
+    u32 index;
+    SpiritThread thread; // NULL for the creating thread
+    u32 nextVictim;
+
+    struct t_SpiritJobQueue queue;
+
+    // jobs are reused once the pool wraps around and they have finished
+    struct t_SpiritJob pool[SPIRIT_JOB_QUEUE_SIZE];
+    u32 poolNext;
+};
+
+struct t_SpiritJobSystem
+{
+    struct t_SpiritJobWorker *workers; // worker 0 is the creating thread
+    u32 workerCount;
+
+    // the worker the creating thread was before, restored once destroyed
+    struct t_SpiritJobWorker *previousWorker;
+
+    // jobs submitted by other threads, or waiting on a dependency
+    SpiritMutex sharedLock;
+    struct t_SpiritJob *sharedHead, *sharedTail;
+    atomic_uint sharedCount; // checked before taking the lock
+
+    // idle workers sleep until jobs are queued
+    SpiritMutex sleepLock;
+    SpiritCondition wake;
+    atomic_uint queuedJobs;
+    atomic_uint sleepingWorkers;
+    atomic_bool quit;
+};
+
+//
+// Functions
+//
+
+/**
+ * @brief Create a job system and start its workers. The calling thread
+ * becomes worker 0. A thread that is already part of a job system leaves it
+ * until the new one is destroyed, so systems made on one thread must be
+ * destroyed in the reverse order.
+ *
+ * @param createInfo
+ * @return SpiritJobSystem
+ */
+SpiritJobSystem spCreateJobSystem(const SpiritJobSystemCreateInfo *createInfo)
+    SPIRIT_NONULL(1);
+
+/**
+ * @brief Queue a job.
+ *
+ * @param system
+ * @param function the job
+ * @param arg passed to function
+ * @param counter may be NULL. Incremented now, and decremented once the job
+ * has finished.
+ */
+void spJobSystemRun(
+    SpiritJobSystem system,
+    SpiritJobFunction function,
+    void *arg,
+    SpiritJobCounter *counter) SPIRIT_NONULL(1, 2);
+
+/**
+ * @brief Queue a job that will not start until another counter reaches zero.
+ *
+ * @param system
+ * @param dependency the jobs to wait for
+ * @param function the job
+ * @param arg passed to function
+ * @param counter may be NULL
+ */
+void spJobSystemRunAfter(
+    SpiritJobSystem system,
+    SpiritJobCounter *dependency,
+    SpiritJobFunction function,
+    void *arg,
+    SpiritJobCounter *counter) SPIRIT_NONULL(1, 2, 3);
+
+/**
+ * @brief Split [0, count) into batches and run them as jobs.
+ *
+ * @param system
+ * @param count the number of indices
+ * @param batchSize indices per job, 0 to pick one from the worker count
+ * @param function run for each batch
+ * @param arg passed to function
+ * @param counter may be NULL. Counts the batches.
+ */
+void spJobSystemParallelFor(
+    SpiritJobSystem system,
+    u32 count,
+    u32 batchSize,
+    SpiritJobParallelFunction function,
+    void *arg,
+    SpiritJobCounter *counter) SPIRIT_NONULL(1, 4);
+
+/**
+ * @brief Wait for a counter to reach zero. Workers, and the creating thread,
+ * run other jobs while they wait.
+ *
+ * @param system
+ * @param counter
+ */
+void spJobSystemWait(SpiritJobSystem system, SpiritJobCounter *counter)
+    SPIRIT_NONULL(1, 2);
+
+/**
+ * @brief Get the number of threads running jobs, including the creating
+ * thread.
+ *
+ * @param system
+ * @return u32
+ */
+u32 spJobSystemGetWorkerCount(const SpiritJobSystem system) SPIRIT_NONULL(1);
+
+/**
+ * @brief Finish all queued jobs and stop the workers. Must be called from the
+ * thread that created the job system.
+ *
+ * @param system
+ */
+void spDestroyJobSystem(SpiritJobSystem system) SPIRIT_NONULL(1);